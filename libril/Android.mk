@@ -8,6 +8,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
     ril.cpp \
     ril_event.cpp\
+    rilMonitor.cpp \
     RilSocket.cpp \
     RilSapSocket.cpp \
 
@@ -39,13 +40,109 @@ LOCAL_SANITIZE := integer
 include $(BUILD_SHARED_LIBRARY)
 
 
+# For rilmarshalbench binary
+# ==========================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    rilmarshalbench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libutils \
+    libbinder \
+    libcutils \
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+
+LOCAL_MODULE:= rilmarshalbench
+LOCAL_MODULE_TAGS := debug
+LOCAL_CLANG := true
+
+include $(BUILD_EXECUTABLE)
+
+
+# For libril_benchmark, the libril core built for the host
+# ========================================================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    ril_benchmark.cpp \
+    ril_event.cpp \
+    rilMonitor.cpp \
+    host/RilSapSocket.cpp \
+    ../librilutils/record_stream.c \
+
+# host/ stands in for libbinder, liblog, libcutils and libhardware_legacy
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/host
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+LOCAL_C_INCLUDES += $(LOCAL_PATH)
+
+LOCAL_CFLAGS := -DNDEBUG
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE:= libril_benchmark
+LOCAL_CLANG := true
+
+include $(BUILD_HOST_NATIVE_BENCHMARK)
+
+
+# For ril_fuzzer, processCommandBuffer() under libFuzzer, and
+# ril_fuzzer_standalone for AFL and throughput runs over a corpus
+# ===============================================================
+RIL_FUZZER_SRC_FILES := \
+    ril_fuzzer.cpp \
+    ril_event.cpp \
+    rilMonitor.cpp \
+    host/RilSapSocket.cpp \
+    ../librilutils/record_stream.c \
+
+RIL_FUZZER_C_INCLUDES := \
+    $(LOCAL_PATH)/host \
+    $(LOCAL_PATH)/../include \
+    $(LOCAL_PATH) \
+
+# counts libril's allocations per record
+RIL_FUZZER_LDFLAGS := \
+    -Wl,--wrap=malloc \
+    -Wl,--wrap=calloc \
+    -Wl,--wrap=realloc \
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(RIL_FUZZER_SRC_FILES)
+LOCAL_C_INCLUDES += $(RIL_FUZZER_C_INCLUDES)
+LOCAL_CFLAGS := -DNDEBUG -DRIL_FUZZ_LIBFUZZER
+LOCAL_LDFLAGS := $(RIL_FUZZER_LDFLAGS)
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE:= ril_fuzzer
+LOCAL_CLANG := true
+
+include $(BUILD_HOST_FUZZ_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(RIL_FUZZER_SRC_FILES)
+LOCAL_C_INCLUDES += $(RIL_FUZZER_C_INCLUDES)
+LOCAL_CFLAGS := -DNDEBUG
+LOCAL_LDFLAGS := $(RIL_FUZZER_LDFLAGS)
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE:= ril_fuzzer_standalone
+LOCAL_MODULE_TAGS := optional
+LOCAL_CLANG := true
+
+include $(BUILD_HOST_EXECUTABLE)
+
+
 # For RdoServD which needs a static library
 # =========================================
 ifneq ($(ANDROID_BIONIC_TRANSITION),)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
-    ril.cpp
+    ril.cpp \
+    rilMonitor.cpp
 
 LOCAL_STATIC_LIBRARIES := \
     libutils_static \
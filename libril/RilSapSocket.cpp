@@ -21,11 +21,16 @@
 #include "RilSapSocket.h"
 #include "pb_decode.h"
 #include "pb_encode.h"
+#include "sapcapture.h"
 #undef LOG_TAG
 #define LOG_TAG "RIL_UIM_SOCKET"
 #include <utils/Log.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 static RilSapSocket::RilSapSocketList *head = NULL;
 
@@ -48,6 +53,161 @@ struct RIL_Env RilSapSocket::uimRilEnv = {
         .RequestTimedCallback = RIL_requestTimedCallback
 };
 
+RilSapSocket::SapSocketRequest *RilSapSocket::requestPool = NULL;
+int RilSapSocket::requestPoolSize = 0;
+pthread_mutex_t RilSapSocket::requestPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+int RilSapSocket::traceLevel = SAP_TRACE_NONE;
+int RilSapSocket::captureFd = -1;
+pthread_mutex_t RilSapSocket::captureLock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t nowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+RilSapSocket::SapSocketRequest *RilSapSocket::obtainRequest() {
+    SapSocketRequest *request;
+
+    pthread_mutex_lock(&requestPoolLock);
+    request = requestPool;
+    if (request != NULL) {
+        requestPool = request->p_next;
+        requestPoolSize--;
+    }
+    pthread_mutex_unlock(&requestPoolLock);
+
+    if (request == NULL) {
+        // only until the pool has warmed up
+        request = (SapSocketRequest *)malloc(sizeof(SapSocketRequest));
+        if (request == NULL) {
+            return NULL;
+        }
+    }
+
+    request->token = 0;
+    request->curr = &request->hdr;
+    request->p_next = request->p_prev = request->p_indexNext = NULL;
+    request->heapPayload = false;
+    memset(&request->hdr, 0, sizeof(request->hdr));
+
+    return request;
+}
+
+void RilSapSocket::releaseRequest(SapSocketRequest *request) {
+    if (request->heapPayload) {
+        free(request->hdr.payload);
+        request->heapPayload = false;
+    }
+
+    pthread_mutex_lock(&requestPoolLock);
+    if (requestPoolSize < SAP_REQUEST_POOL_MAX) {
+        request->p_next = requestPool;
+        requestPool = request;
+        requestPoolSize++;
+        request = NULL;
+    }
+    pthread_mutex_unlock(&requestPoolLock);
+
+    free(request);
+}
+
+pb_bytes_array_t *RilSapSocket::reservePayload(SapSocketRequest *request, size_t len) {
+    pb_bytes_array_t *payload;
+
+    if (request->heapPayload) {
+        free(request->hdr.payload);
+        request->heapPayload = false;
+    }
+
+    if (len <= SAP_POOLED_PAYLOAD_MAX) {
+        payload = &request->payload;
+    } else {
+        payload = (pb_bytes_array_t *)malloc(sizeof(pb_bytes_array_t) + len);
+        if (payload == NULL) {
+            request->hdr.payload = NULL;
+            return NULL;
+        }
+        request->heapPayload = true;
+    }
+
+    payload->size = len;
+    request->hdr.payload = payload;
+    return payload;
+}
+
+/**
+ * Decodes MsgHeader field by field rather than with pb_decode(), which
+ * would malloc the FT_POINTER payload.
+ */
+bool RilSapSocket::decodeRequest(void *record, size_t recordlen, SapSocketRequest *request) {
+    pb_istream_t stream = pb_istream_from_buffer((uint8_t *)record, recordlen);
+    MsgHeader *hdr = &request->hdr;
+    uint32_t seen = 0;
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+
+    while (pb_decode_tag(&stream, &wire_type, &tag, &eof)) {
+        uint64_t value;
+        uint32_t fixed;
+
+        switch (tag) {
+            case MsgHeader_token_tag:
+                if (wire_type != PB_WT_32BIT || !pb_decode_fixed32(&stream, &fixed)) {
+                    return false;
+                }
+                hdr->token = fixed;
+                break;
+
+            case MsgHeader_type_tag:
+            case MsgHeader_id_tag:
+            case MsgHeader_error_tag:
+                if (wire_type != PB_WT_VARINT || !pb_decode_varint(&stream, &value)) {
+                    return false;
+                }
+                if (tag == MsgHeader_type_tag) {
+                    hdr->type = (MsgType)value;
+                } else if (tag == MsgHeader_id_tag) {
+                    hdr->id = (MsgId)value;
+                } else {
+                    hdr->error = (Error)value;
+                }
+                break;
+
+            case MsgHeader_payload_tag:
+                if (wire_type != PB_WT_STRING || !pb_decode_varint(&stream, &value)
+                        || value > stream.bytes_left) {
+                    return false;
+                }
+                if (reservePayload(request, (size_t)value) == NULL
+                        || !pb_read(&stream, hdr->payload->bytes, (size_t)value)) {
+                    return false;
+                }
+                break;
+
+            default:
+                if (!pb_skip_field(&stream, wire_type)) {
+                    return false;
+                }
+                continue;
+        }
+
+        seen |= 1 << tag;
+    }
+
+    if (!eof) {
+        return false;
+    }
+
+    // all of MsgHeader's fields are required
+    return seen == ((1 << MsgHeader_token_tag) | (1 << MsgHeader_type_tag)
+            | (1 << MsgHeader_id_tag) | (1 << MsgHeader_error_tag)
+            | (1 << MsgHeader_payload_tag));
+}
+
 void RilSapSocket::sOnRequestComplete (RIL_Token t,
         RIL_Errno e,
         void *response,
@@ -63,11 +223,7 @@ void RilSapSocket::sOnRequestComplete (RIL_Token t,
         sap_socket->onRequestComplete(t,e,response,responselen);
     } else {
         RLOGE("Invalid socket id");
-        if (request->curr->payload) {
-            free(request->curr->payload);
-        }
-        free(request->curr);
-        free(request);
+        releaseRequest(request);
     }
 }
 
@@ -195,28 +351,13 @@ bool RilSapSocket::SocketExists(const char *socketName) {
     return false;
 }
 
-void* RilSapSocket::processRequestsLoop(void) {
-    RLOGI("UIM_SOCKET:Request loop started");
-
-    while(true) {
-        SapSocketRequest *req = dispatchQueue.dequeue();
-
-        RLOGI("New request from the dispatch Queue");
-
-        if (req != NULL) {
-            dispatchRequest(req->curr);
-            free(req);
-        } else {
-            RLOGE("Fetched null buffer from queue!");
-        }
-    }
-    return NULL;
-}
-
 RilSapSocket::RilSapSocket(const char *socketName,
         RIL_SOCKET_ID socketId,
         RIL_RadioFunctions *inputUimFuncs):
         RilSocket(socketName, socketId) {
+    startNs = nowNs();
+    bytesRead = messagesRead = 0;
+    bytesWritten = messagesWritten = 0;
     if (inputUimFuncs) {
         uimFuncs = inputUimFuncs;
     }
@@ -265,21 +406,16 @@ void log_hex(const char *who, const uint8_t *buffer, int length) {
     } while(source < length && dest < dest_len);
 }
 
-void RilSapSocket::dispatchRequest(MsgHeader *req) {
-    // SapSocketRequest will be deallocated in onRequestComplete()
-    SapSocketRequest* currRequest=(SapSocketRequest*)malloc(sizeof(SapSocketRequest));
-    if (!currRequest) {
-        RLOGE("dispatchRequest: OOM");
-        // Free MsgHeader allocated in pushRecord()
-        free(req);
+void RilSapSocket::dispatchRequest(SapSocketRequest *currRequest) {
+    MsgHeader *req = currRequest->curr;
+
+    // SapSocketRequest will be released in onRequestComplete()
+    if (!pendingResponseQueue.enqueue(currRequest)) {
+        RLOGE("dispatchRequest: too many requests pending, failing token %d", req->token);
+        sendQueueFullResponse(currRequest);
+        releaseRequest(currRequest);
         return;
     }
-    currRequest->token = req->token;
-    currRequest->curr = req;
-    currRequest->p_next = NULL;
-    currRequest->socketId = id;
-
-    pendingResponseQueue.enqueue(currRequest);
 
     if (uimFuncs) {
         RLOGI("[%d] > SAP REQUEST type: %d. id: %d. error: %d",
@@ -301,134 +437,293 @@ void RilSapSocket::onRequestComplete(RIL_Token t, RIL_Errno e, void *response,
     SapSocketRequest* request= (SapSocketRequest*)t;
     MsgHeader *hdr = request->curr;
 
-    MsgHeader rsp;
-    rsp.token = request->curr->token;
-    rsp.type = MsgType_RESPONSE;
-    rsp.id = request->curr->id;
-    rsp.error = (Error)e;
-    rsp.payload = (pb_bytes_array_t *)calloc(1, sizeof(pb_bytes_array_t) + response_len);
-    if (!rsp.payload) {
-        RLOGE("onRequestComplete: OOM");
-    } else {
-        if (response && response_len > 0) {
-            memcpy(rsp.payload->bytes, response, response_len);
-            rsp.payload->size = response_len;
-        } else {
-            rsp.payload->size = 0;
+    // by identity: after a reconnect, a new client may reuse id and token
+    if (!pendingResponseQueue.checkAndDequeue(request)) {
+        if (pendingResponseQueue.claimAbandoned(request)) {
+            // its client has gone, so there is no one to respond to
+            RLOGD("Token:%d, MessageId:%d completed after close", hdr->token, hdr->id);
+            releaseRequest(request);
+            return;
         }
-
         RLOGE("Token:%d, MessageId:%d", hdr->token, hdr->id);
+        RLOGE ("RilSapSocket::onRequestComplete: invalid Token or Message Id");
+        return;
+    }
 
-        sendResponse(&rsp);
-        free(rsp.payload);
+    if ((uint32_t) request->token != hdr->token) {
+        RLOGE("onRequestComplete: token %d queued as %d", hdr->token, request->token);
     }
 
-    // Deallocate SapSocketRequest
-    if(!pendingResponseQueue.checkAndDequeue(hdr->id, hdr->token)) {
+    // the request payload is done with, so its storage takes the response
+    hdr->type = MsgType_RESPONSE;
+    hdr->error = (Error)e;
+    if (!response) {
+        response_len = 0;
+    }
+    if (!reservePayload(request, response_len)) {
+        RLOGE("onRequestComplete: OOM");
+    } else {
+        if (response_len > 0) {
+            memcpy(hdr->payload->bytes, response, response_len);
+        }
+
         RLOGE("Token:%d, MessageId:%d", hdr->token, hdr->id);
-        RLOGE ("RilSapSocket::onRequestComplete: invalid Token or Message Id");
+
+        sendResponse(request);
     }
 
-    // Deallocate MsgHeader
-    free(hdr);
+    releaseRequest(request);
 }
 
-void RilSapSocket::sendResponse(MsgHeader* hdr) {
+void RilSapSocket::sendResponse(SapSocketRequest *msg) {
+    MsgHeader *hdr = msg->curr;
     size_t encoded_size = 0;
     uint32_t written_size;
-    size_t buffer_size = 0;
+    uint8_t *buffer = msg->encodeBuffer;
+    size_t buffer_size = sizeof(msg->encodeBuffer);
+    uint8_t *heap_buffer = NULL;
     pb_ostream_t ostream;
-    bool success = false;
-
-    pthread_mutex_lock(&write_lock);
-
-    if ((success = pb_get_encoded_size(&encoded_size, MsgHeader_fields,
-        hdr)) && encoded_size <= INT32_MAX && commandFd != -1) {
+    bool success;
+
+    // encode outside write_lock, into the request's own buffer unless the
+    // payload is too big for it
+    if (hdr->payload != NULL && hdr->payload->size > SAP_POOLED_PAYLOAD_MAX) {
+        if (!pb_get_encoded_size(&encoded_size, MsgHeader_fields, hdr)
+                || encoded_size > INT32_MAX) {
+            RLOGE("Not sending response type %d: encoded_size: %zu", hdr->type, encoded_size);
+            return;
+        }
         buffer_size = encoded_size + sizeof(uint32_t);
-        uint8_t* buffer = (uint8_t*)malloc(buffer_size);
-        if (!buffer) {
+        heap_buffer = (uint8_t*)malloc(buffer_size);
+        if (!heap_buffer) {
             RLOGE("sendResponse: OOM");
-            pthread_mutex_unlock(&write_lock);
             return;
         }
+        buffer = heap_buffer;
+    }
+
+    ostream = pb_ostream_from_buffer(buffer + sizeof(written_size),
+            buffer_size - sizeof(written_size));
+    success = pb_encode(&ostream, MsgHeader_fields, hdr);
+
+    if (success) {
+        encoded_size = ostream.bytes_written;
+        buffer_size = encoded_size + sizeof(written_size);
         written_size = htonl((uint32_t) encoded_size);
-        ostream = pb_ostream_from_buffer(buffer, buffer_size);
-        pb_write(&ostream, (uint8_t *)&written_size, sizeof(written_size));
-        success = pb_encode(&ostream, MsgHeader_fields, hdr);
+        memcpy(buffer, &written_size, sizeof(written_size));
 
-        if (success) {
-            RLOGD("Size: %zu (0x%zx) Size as written: 0x%x", encoded_size,
-                    encoded_size, written_size);
+        RLOGD("Size: %zu (0x%zx) Size as written: 0x%x", encoded_size,
+                encoded_size, written_size);
+        if (traceLevel >= SAP_TRACE_PAYLOAD) {
             log_hex("onRequestComplete", &buffer[sizeof(written_size)], encoded_size);
-            RLOGI("[%d] < SAP RESPONSE type: %d. id: %d. error: %d",
-        hdr->token, hdr->type, hdr->id,hdr->error );
-
-            if ( 0 != blockingWrite_helper(commandFd, buffer, buffer_size)) {
-                RLOGE("Error %d while writing to fd", errno);
-            } else {
-                RLOGD("Write successful");
-            }
+        }
+        if (captureFd >= 0) {
+            captureWrite(SAP_CAPTURE_RESPONSE, &buffer[sizeof(written_size)], encoded_size);
+        }
+        RLOGI("[%d] < SAP RESPONSE type: %d. id: %d. error: %d",
+    hdr->token, hdr->type, hdr->id,hdr->error );
+
+        pthread_mutex_lock(&write_lock);
+        if (commandFd == -1) {
+            RLOGE("Not sending response type %d: commandFd: %d", hdr->type, commandFd);
+        } else if ( 0 != blockingWrite_helper(commandFd, buffer, buffer_size)) {
+            RLOGE("Error %d while writing to fd", errno);
         } else {
-            RLOGE("Error while encoding response of type %d id %d buffer_size: %zu: %s.",
-                    hdr->type, hdr->id, buffer_size, PB_GET_ERROR(&ostream));
+            RLOGD("Write successful");
+            bytesWritten += buffer_size;
+            messagesWritten++;
         }
-        free(buffer);
+        pthread_mutex_unlock(&write_lock);
     } else {
-        RLOGE("Not sending response type %d: encoded_size: %zu. commandFd: %d. encoded size result:\
-                %d", hdr->type, encoded_size, commandFd, success);
+        RLOGE("Error while encoding response of type %d id %d buffer_size: %zu: %s.",
+                hdr->type, hdr->id, buffer_size, PB_GET_ERROR(&ostream));
     }
 
-    pthread_mutex_unlock(&write_lock);
+    free(heap_buffer);
 }
 
 void RilSapSocket::onUnsolicitedResponse(int unsolResponse, void *data, size_t datalen) {
     if (data && datalen > 0) {
-        pb_bytes_array_t *payload = (pb_bytes_array_t *)calloc(1,
-                sizeof(pb_bytes_array_t) + datalen);
-        if (!payload) {
+        SapSocketRequest *msg = obtainRequest();
+        if (!msg || !reservePayload(msg, datalen)) {
             RLOGE("onUnsolicitedResponse: OOM");
+            if (msg) {
+                releaseRequest(msg);
+            }
             return;
         }
-        memcpy(payload->bytes, data, datalen);
-        payload->size = datalen;
-        MsgHeader rsp;
-        rsp.payload = payload;
-        rsp.type = MsgType_UNSOL_RESPONSE;
-        rsp.id = (MsgId)unsolResponse;
-        rsp.error = Error_RIL_E_SUCCESS;
-        sendResponse(&rsp);
-        free(payload);
+        memcpy(msg->hdr.payload->bytes, data, datalen);
+        msg->hdr.type = MsgType_UNSOL_RESPONSE;
+        msg->hdr.id = (MsgId)unsolResponse;
+        msg->hdr.error = Error_RIL_E_SUCCESS;
+        sendResponse(msg);
+        releaseRequest(msg);
     }
 }
 
 void RilSapSocket::pushRecord(void *p_record, size_t recordlen) {
-    pb_istream_t stream = pb_istream_from_buffer((uint8_t *)p_record, recordlen);
-    // MsgHeader will be deallocated in onRequestComplete()
-    MsgHeader *reqHeader = (MsgHeader *)malloc(sizeof (MsgHeader));
-    if (!reqHeader) {
+    // SapSocketRequest will be released in onRequestComplete()
+    SapSocketRequest *recv = obtainRequest();
+    if (!recv) {
         RLOGE("pushRecord: OOM");
         return;
     }
-    memset(reqHeader, 0, sizeof(MsgHeader));
 
-    log_hex("BtSapTest-Payload", (const uint8_t*)p_record, recordlen);
+    bytesRead += recordlen + sizeof(uint32_t);
+    messagesRead++;
 
-    if (!pb_decode(&stream, MsgHeader_fields, reqHeader) ) {
-        RLOGE("Error decoding protobuf buffer : %s", PB_GET_ERROR(&stream));
-        free(reqHeader);
+    if (traceLevel >= SAP_TRACE_PAYLOAD) {
+        log_hex("BtSapTest-Payload", (const uint8_t*)p_record, recordlen);
+    }
+    if (captureFd >= 0) {
+        captureWrite(SAP_CAPTURE_REQUEST, (const uint8_t*)p_record, recordlen);
+    }
+
+    if (!decodeRequest(p_record, recordlen, recv)) {
+        RLOGE("Error decoding protobuf buffer");
+        releaseRequest(recv);
     } else {
-        // SapSocketRequest will be deallocated in processRequestsLoop()
-        SapSocketRequest *recv = (SapSocketRequest*)malloc(sizeof(SapSocketRequest));
-        if (!recv) {
-            RLOGE("pushRecord: OOM");
-            free(reqHeader);
-            return;
-        }
-        recv->token = reqHeader->token;
-        recv->curr = reqHeader;
+        recv->token = recv->hdr.token;
         recv->socketId = id;
 
-        dispatchQueue.enqueue(recv);
+        dispatchRequest(recv);
+    }
+}
+
+void RilSapSocket::sendQueueFullResponse(SapSocketRequest *req) {
+    req->hdr.type = MsgType_RESPONSE;
+    req->hdr.error = (Error)RIL_E_GENERIC_FAILURE;
+    reservePayload(req, 0);
+    sendResponse(req);
+}
+
+void RilSapSocket::logQueueStats() {
+    Ril_queue_stats pendingStats;
+
+    pendingResponseQueue.getStats(&pendingStats);
+
+    RLOGI("%s pending responses: %llu requests, %llu dropped, %llu abandoned, "
+            "max depth %zu, response avg %llu us max %llu us", name,
+            (unsigned long long)pendingStats.enqueued,
+            (unsigned long long)pendingStats.dropped,
+            (unsigned long long)pendingStats.abandoned, pendingStats.maxDepth,
+            (unsigned long long)(pendingStats.removed == 0 ? 0
+                    : pendingStats.totalWaitNs / pendingStats.removed / 1000),
+            (unsigned long long)(pendingStats.maxWaitNs / 1000));
+}
+
+void RilSapSocket::logTrafficStats() {
+    uint64_t elapsedMs = (nowNs() - startNs) / 1000000;
+    uint64_t inBytes = bytesRead;
+    uint64_t inMessages = messagesRead;
+    uint64_t outBytes;
+    uint64_t outMessages;
+
+    pthread_mutex_lock(&write_lock);
+    outBytes = bytesWritten;
+    outMessages = messagesWritten;
+    pthread_mutex_unlock(&write_lock);
+
+    if (elapsedMs == 0) {
+        elapsedMs = 1;
+    }
+
+    RLOGI("%s traffic over %llu s: read %llu messages, %llu bytes (%llu msg/s, %llu B/s), "
+            "wrote %llu messages, %llu bytes (%llu msg/s, %llu B/s)", name,
+            (unsigned long long)(elapsedMs / 1000),
+            (unsigned long long)inMessages, (unsigned long long)inBytes,
+            (unsigned long long)(inMessages * 1000 / elapsedMs),
+            (unsigned long long)(inBytes * 1000 / elapsedMs),
+            (unsigned long long)outMessages, (unsigned long long)outBytes,
+            (unsigned long long)(outMessages * 1000 / elapsedMs),
+            (unsigned long long)(outBytes * 1000 / elapsedMs));
+}
+
+void RilSapSocket::setTraceLevel(int level) {
+    RLOGI("SAP trace level %d", level);
+    traceLevel = level;
+}
+
+int RilSapSocket::startCapture(const char *path) {
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd < 0) {
+        RLOGE("Unable to open SAP capture %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (write(fd, SAP_CAPTURE_MAGIC, SAP_CAPTURE_MAGIC_LEN)
+            != SAP_CAPTURE_MAGIC_LEN) {
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&captureLock);
+
+    if (captureFd >= 0) {
+        close(captureFd);
+    }
+    captureFd = fd;
+
+    pthread_mutex_unlock(&captureLock);
+
+    RLOGI("SAP capture to %s", path);
+    return 0;
+}
+
+void RilSapSocket::stopCapture() {
+    pthread_mutex_lock(&captureLock);
+
+    if (captureFd >= 0) {
+        close(captureFd);
+    }
+    captureFd = -1;
+
+    pthread_mutex_unlock(&captureLock);
+}
+
+void RilSapSocket::captureWrite(int type, const uint8_t *data, size_t len) {
+    SapCaptureRecord record;
+    struct iovec iov[2];
+    ssize_t written;
+
+    memset(&record, 0, sizeof(record));
+    record.timestampNsec = nowNs();
+    record.length = len;
+    record.type = type;
+    record.socketId = id;
+
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+
+    pthread_mutex_lock(&captureLock);
+
+    if (captureFd >= 0) {
+        do {
+            written = writev(captureFd, iov, 2);
+        } while (written < 0 && errno == EINTR);
+
+        if (written != (ssize_t)(sizeof(record) + len)) {
+            RLOGE("SAP capture write failed; capture stopped");
+            close(captureFd);
+            captureFd = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&captureLock);
+}
+
+void RilSapSocket::dumpStats() {
+    RilSapSocketList *current = head;
+
+    while (NULL != current) {
+        current->socket->logTrafficStats();
+        current->socket->logQueueStats();
+        current = current->next;
     }
 }
 
@@ -455,27 +750,21 @@ void RilSapSocket::sendDisconnect() {
         success = pb_encode(&ostream, RIL_SIM_SAP_DISCONNECT_REQ_fields, buffer);
 
         if(success) {
-            // Buffer will be deallocated in sOnRequestComplete()
-            pb_bytes_array_t *payload = (pb_bytes_array_t *)calloc(1,
-                    sizeof(pb_bytes_array_t) + written_size);
-            if (!payload) {
-                RLOGE("sendDisconnect: OOM");
-                return;
-            }
-            memcpy(payload->bytes, buffer, written_size);
-            payload->size = written_size;
-            // MsgHeader will be deallocated in sOnRequestComplete()
-            MsgHeader *hdr = (MsgHeader *)malloc(sizeof(MsgHeader));
-            if (!hdr) {
+            // SapSocketRequest will be released in sOnRequestComplete()
+            SapSocketRequest *req = obtainRequest();
+            if (!req || !reservePayload(req, written_size)) {
                 RLOGE("sendDisconnect: OOM");
-                free(payload);
+                if (req) {
+                    releaseRequest(req);
+                }
+                free(buffer);
                 return;
             }
-            hdr->payload = payload;
-            hdr->type = MsgType_REQUEST;
-            hdr->id = MsgId_RIL_SIM_SAP_DISCONNECT;
-            hdr->error = Error_RIL_E_SUCCESS;
-            dispatchDisconnect(hdr);
+            memcpy(req->hdr.payload->bytes, buffer, written_size);
+            req->hdr.type = MsgType_REQUEST;
+            req->hdr.id = MsgId_RIL_SIM_SAP_DISCONNECT;
+            req->hdr.error = Error_RIL_E_SUCCESS;
+            dispatchDisconnect(req);
         }
         else {
             RLOGE("Encode failed in send disconnect!");
@@ -484,19 +773,11 @@ void RilSapSocket::sendDisconnect() {
     }
 }
 
-void RilSapSocket::dispatchDisconnect(MsgHeader *req) {
-    // SapSocketRequest will be deallocated in sOnRequestComplete()
-    SapSocketRequest* currRequest=(SapSocketRequest*)malloc(sizeof(SapSocketRequest));
-    if (!currRequest) {
-        RLOGE("dispatchDisconnect: OOM");
-        // Free memory allocated in sendDisconnect
-        free(req->payload);
-        free(req);
-        return;
-    }
+void RilSapSocket::dispatchDisconnect(SapSocketRequest *currRequest) {
+    MsgHeader *req = currRequest->curr;
+
+    // SapSocketRequest will be released in sOnRequestComplete()
     currRequest->token = -1;
-    currRequest->curr = req;
-    currRequest->p_next = NULL;
     currRequest->socketId = (RIL_SOCKET_ID)99;
 
     RLOGD("Sending disconnect on command close!");
@@ -509,6 +790,18 @@ void RilSapSocket::dispatchDisconnect(MsgHeader *req) {
 }
 
 void RilSapSocket::onCommandsSocketClosed() {
+    size_t abandoned;
+
+    logTrafficStats();
+    logQueueStats();
+
+    // the vendor RIL still holds their tokens, so the requests are only
+    // released as it completes them; the next client gets an empty queue
+    abandoned = pendingResponseQueue.abandonAll();
+    if (abandoned > 0) {
+        RLOGI("%s: %zu requests pending on close", name, abandoned);
+    }
+
     sendDisconnect();
     RLOGE("Socket command closed");
 }
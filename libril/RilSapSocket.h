@@ -21,6 +21,29 @@
 #include "RilSocket.h"
 #include <hardware/ril/librilutils/proto/sap-api.pb.h>
 
+/**
+ * Largest SAP payload held in a pooled request; an APDU response with a
+ * full 256 bytes of data fits. Larger ones are malloc'd.
+ */
+#define SAP_POOLED_PAYLOAD_MAX 512
+
+/**
+ * Most bytes MsgHeader adds to its payload when encoded: the token, type,
+ * id and error fields and the payload tag and length.
+ */
+#define SAP_MAX_HEADER_OVERHEAD 48
+
+/**
+ * Free requests kept in the pool.
+ */
+#define SAP_REQUEST_POOL_MAX 8
+
+/**
+ * SAP trace levels, see RilSapSocket::setTraceLevel().
+ */
+#define SAP_TRACE_NONE 0
+#define SAP_TRACE_PAYLOAD 1
+
 /**
  * RilSapSocket is a derived class, derived from the RilSocket abstract
  * class, representing sockets for communication between bluetooth SAP module and
@@ -31,8 +54,10 @@
  *     <li>Initialize the socket.
  *     <li>Process the requests coming on the socket.
  *     <li>Provide handlers for Unsolicited and request responses.
- *     <li>Request and pending response queue handling.
+ *     <li>Pending response queue handling.
  * </ul>
+ * Requests are dispatched to the vendor RIL as they are read, on the
+ * ril_event loop.
  */
 class RilSapSocket : public RilSocket {
     /**
@@ -59,18 +84,118 @@ class RilSapSocket : public RilSocket {
 
     /**
      * Wrapper struct for handling the requests in the queue.
+     * <p>
+     * It carries the message and the storage to decode and encode it, and
+     * is kept in a pool, so a request and its response take no allocations
+     * unless their payload is larger than SAP_POOLED_PAYLOAD_MAX.
      */
     typedef struct SapSocketRequest {
         int token;
         MsgHeader* curr;
         struct SapSocketRequest* p_next;
+        struct SapSocketRequest* p_prev;
+        struct SapSocketRequest* p_indexNext;
+        uint64_t enqueuedNs;
         RIL_SOCKET_ID socketId;
+
+        /** what curr points to */
+        MsgHeader hdr;
+
+        /** hdr.payload did not fit payloadStorage and was malloc'd */
+        bool heapPayload;
+
+        union {
+            pb_bytes_array_t payload;
+            uint8_t payloadStorage[sizeof(pb_bytes_array_t) + SAP_POOLED_PAYLOAD_MAX];
+        };
+
+        /** length prefix and encoded hdr, for sendResponse() */
+        uint8_t encodeBuffer[sizeof(uint32_t) + SAP_MAX_HEADER_OVERHEAD
+                + SAP_POOLED_PAYLOAD_MAX];
     } SapSocketRequest;
 
     /**
-     * Queue for requests that are pending dispatch.
+     * Free requests, chained through p_next.
+     */
+    static SapSocketRequest *requestPool;
+
+    /**
+     * Number of requests in requestPool.
+     */
+    static int requestPoolSize;
+
+    /**
+     * Mutex for requestPool.
+     */
+    static pthread_mutex_t requestPoolLock;
+
+    /**
+     * Take a request from the pool, allocating one if it is empty.
+     *
+     * @return the request, with curr pointing at an empty hdr.
+     */
+    static SapSocketRequest *obtainRequest(void);
+
+    /**
+     * Return a request to the pool, freeing it if the pool is full.
+     *
+     * @param the request.
+     */
+    static void releaseRequest(SapSocketRequest *request);
+
+    /**
+     * Point the request's hdr.payload at len bytes of storage, in the
+     * request itself if they fit.
+     *
+     * @param the request.
+     * @param payload length.
+     * @return the payload, or NULL if it could not be allocated.
+     */
+    static pb_bytes_array_t *reservePayload(SapSocketRequest *request, size_t len);
+
+    /**
+     * Decode a MsgHeader into the request's own storage.
+     *
+     * @param The record data.
+     * @param The record length.
+     * @param the request.
+     * @return true on success.
      */
-    Ril_queue<SapSocketRequest> dispatchQueue;
+    static bool decodeRequest(void *record, size_t recordlen, SapSocketRequest *request);
+
+    /**
+     * Current SAP trace level, SAP_TRACE_NONE unless set from the debug port.
+     */
+    static int traceLevel;
+
+    /**
+     * File the SAP messages are captured to, or -1.
+     */
+    static int captureFd;
+
+    /**
+     * Mutex for captureFd.
+     */
+    static pthread_mutex_t captureLock;
+
+    /**
+     * Append a message to the capture, if there is one.
+     *
+     * @param SapCaptureType.
+     * @param the encoded MsgHeader.
+     * @param its length.
+     */
+    void captureWrite(int type, const uint8_t *data, size_t len);
+
+    /**
+     * Traffic counters since the socket was created. The read side is only
+     * updated by the listen thread, the write side under write_lock.
+     */
+    uint64_t startNs;
+    uint64_t bytesRead;
+    uint64_t messagesRead;
+    uint64_t bytesWritten;
+    uint64_t messagesWritten;
 
     /**
      * Queue for requests that are dispatched but are pending response
@@ -98,6 +223,34 @@ class RilSapSocket : public RilSocket {
          */
         static void printList();
 
+        /**
+         * Set the SAP trace level. At SAP_TRACE_PAYLOAD every message is
+         * hex dumped to the log, which is slow; use startCapture() to keep
+         * the payloads instead.
+         *
+         * @param the trace level.
+         */
+        static void setTraceLevel(int level);
+
+        /**
+         * Capture every SAP message, with timestamps, to the file at path
+         * (see sapcapture.h). Any previous capture is closed.
+         *
+         * @param capture file path.
+         * @return 0 on success, -1 if the file could not be opened.
+         */
+        static int startCapture(const char *path);
+
+        /**
+         * Close the capture, if there is one.
+         */
+        static void stopCapture(void);
+
+        /**
+         * Log the traffic and queue counters of every SAP socket.
+         */
+        static void dumpStats(void);
+
         /**
          * Clean up method to be called on command close.
          */
@@ -114,8 +267,7 @@ class RilSapSocket : public RilSocket {
     protected:
         /**
          * Process each record read from the socket and
-         * push a new request created from that record to
-         * the dispatch request queue.
+         * dispatch a new request created from that record.
          *
          * @param The record data.
          * @param The record length.
@@ -154,17 +306,31 @@ class RilSapSocket : public RilSocket {
         static RilSapSocket* getSocketById(RIL_SOCKET_ID socketId);
 
         /**
-         * Method to send response to SAP. It does an atomic write operation on the
+         * Method to send response to SAP. It encodes the response into the
+         * request's buffer and then does an atomic write operation on the
          * socket.
          *
-         * @param the response header with the payload.
+         * @param the request holding the response header with the payload.
+         */
+        void sendResponse(SapSocketRequest *msg);
+
+        /**
+         * Fail a request that could not be queued, so that SAP is not left
+         * waiting for a response.
+         *
+         * @param the request.
+         */
+        void sendQueueFullResponse(SapSocketRequest *req);
+
+        /**
+         * Log the depth and wait time counters of the pending response queue.
          */
-        void sendResponse(MsgHeader *hdr);
+        void logQueueStats(void);
 
         /**
-         * A loop for processing the requests in the request dispatch queue.
+         * Log the bytes and messages read and written, and their rates.
          */
-        void *processRequestsLoop(void);
+        void logTrafficStats(void);
 
         /**
          * Class method to add the sap socket to the list of sockets.
@@ -192,7 +358,7 @@ class RilSapSocket : public RilSocket {
         /**
          * Dispatch the clean up disconnect request.
          */
-        void dispatchDisconnect(MsgHeader *req);
+        void dispatchDisconnect(SapSocketRequest *req);
 
 
     private:
@@ -211,9 +377,9 @@ class RilSapSocket : public RilSocket {
          * Dispatches the request to the lower layers.
          * It calls the on request function.
          *
-         * @param The request message.
+         * @param The request, which stays pending until its response.
          */
-        void dispatchRequest(MsgHeader *request);
+        void dispatchRequest(SapSocketRequest *request);
 
         /**
          * Class method that selects the socket on which the onRequestComplete
@@ -14,9 +14,6 @@
 * limitations under the License.
 */
 
-extern "C"
-void *ril_socket_process_requests_loop(void *arg);
-
 #include "RilSocket.h"
 #include <cutils/sockets.h>
 #include <utils/Log.h>
@@ -54,20 +51,8 @@ void RilSocket::sSocketListener(int fd, short flags, void *param) {
 }
 
 void RilSocket::onNewCommandConnect() {
-    pthread_attr_t attr;
-    PthreadPtr pptr = ril_socket_process_requests_loop;
-    int result;
-
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-    //Start socket request processing loop thread
-    result = pthread_create(&socketThreadId, &attr, pptr, this);
-    if(result < 0) {
-        RLOGE("pthread_create failed with result:%d",result);
-    }
-
-    RLOGE("New socket command connected and socket request thread started");
+    // requests are dispatched from the command event, on the event loop
+    RLOGI("New socket command connected on %s", name);
 }
 
 void RilSocket::sSocketRequestsHandler(int fd, short flags, void *param) {
@@ -75,10 +60,13 @@ void RilSocket::sSocketRequestsHandler(int fd, short flags, void *param) {
     RilSocket *theSocket = sc->socketPtr;
     RecordStream *rs = sc->rs;
 
-    theSocket->socketRequestsHandler(fd, flags, rs);
+    if (!theSocket->socketRequestsHandler(fd, flags, rs)) {
+        // the record stream went with the connection
+        delete sc;
+    }
 }
 
-void RilSocket::socketRequestsHandler(int fd, short flags, RecordStream *p_rs) {
+bool RilSocket::socketRequestsHandler(int fd, short flags, RecordStream *p_rs) {
     int ret;
     assert(fd == commandFd);
     void *p_record;
@@ -118,7 +106,11 @@ void RilSocket::socketRequestsHandler(int fd, short flags, RecordStream *p_rs) {
         rilEventAddWakeup_helper(&listenEvent);
 
         onCommandsSocketClosed();
+
+        return false;
     }
+
+    return true;
 }
 
 void RilSocket::setListenFd(int fd) {
@@ -169,9 +161,3 @@ ril_event* RilSocket::getCallbackEvent(void) {
     return &callbackEvent;
 }
 
-extern "C"
-void *ril_socket_process_requests_loop(void *arg) {
-    RilSocket *socket = (RilSocket *)arg;
-    socket->processRequestsLoop();
-    return NULL;
-}
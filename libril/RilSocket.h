@@ -22,8 +22,6 @@
 
 using namespace std;
 
-extern "C" void *ril_socket_process_requests_loop(void *arg);
-
 /**
  * Abstract socket class representing sockets in rild.
  * <p>
@@ -32,6 +30,8 @@ extern "C" void *ril_socket_process_requests_loop(void *arg);
  *     <li> Start socket listen.
  *     <li> Handle socket listen and command callbacks.
  * </ul>
+ * Both run on the ril_event loop, as the rild command sockets do; a socket
+ * has no thread of its own.
  */
 class RilSocket {
     protected:
@@ -56,11 +56,6 @@ class RilSocket {
         */
         int commandFd = -1;
 
-       /**
-        * Socket request loop thread id.
-        */
-        pthread_t socketThreadId;
-
        /**
         * Listen event callack. Callback called when the other ends does accept.
         */
@@ -101,7 +96,8 @@ class RilSocket {
         static void sSocketRequestsHandler(int fd, short flags, void *param);
 
         /**
-         * Process record from the record stream and push the requests onto the queue.
+         * Process record from the record stream and dispatch the request.
+         * Called on the ril_event loop, so it must not block.
          *
          * @param record data.
          * @param record length.
@@ -113,14 +109,6 @@ class RilSocket {
          */
         pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
 
-        /**
-         * The loop to process the incoming requests.
-         */
-        virtual void *processRequestsLoop(void) = 0;
-
-    private:
-        friend void *::ril_socket_process_requests_loop(void *arg);
-
     public:
 
         /**
@@ -140,7 +128,8 @@ class RilSocket {
         virtual void onCommandsSocketClosed(void) = 0;
 
         /**
-         * Function called on new commands socket connect. Request loop thread is started here.
+         * Function called on new commands socket connect, once its command event
+         * has been added to the event loop.
          */
         void onNewCommandConnect(void);
 
@@ -245,8 +234,9 @@ class RilSocket {
          * @param Commands fd.
          * @param flags.
          * @param Record stream.
+         * @return false once the commands socket has been closed.
          */
-        void socketRequestsHandler(int fd, short flags, RecordStream *rs);
+        bool socketRequestsHandler(int fd, short flags, RecordStream *rs);
 };
 
 class socketClient {
@@ -265,8 +255,6 @@ typedef struct MySocketListenParam {
     RilSocket *socket;
 } MySocketListenParam;
 
-typedef void* (RilSocket::*RilSocketFuncPtr)(void);
 typedef void (RilSocket::*RilSocketEventPtr)(int fd,short flags, void *param);
-typedef void* (*PthreadPtr)(void*);
 
 #endif
@@ -0,0 +1,67 @@
+/* //device/libs/telephony/host/RilSapSocket.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * The SAP sockets need nanopb and are not part of the host build. ril.cpp
+ * only reaches them from RIL_register_socket(), the SAP listen path and
+ * the debug port, so these do nothing.
+ */
+
+#define RIL_SHLIB
+#include "telephony/ril.h"
+#include "RilSapSocket.h"
+
+struct RIL_Env RilSapSocket::uimRilEnv;
+
+void RilSapSocket::initSapSocket(const char *socketName, RIL_RadioFunctions *uimFuncs) {
+}
+
+void RilSapSocket::setTraceLevel(int level) {
+}
+
+int RilSapSocket::startCapture(const char *path) {
+    return -1;
+}
+
+void RilSapSocket::stopCapture(void) {
+}
+
+void RilSapSocket::dumpStats(void) {
+}
+
+void RilSocket::onNewCommandConnect() {
+}
+
+void RilSocket::setCommandFd(int fd) {
+    commandFd = fd;
+}
+
+int RilSocket::getCommandFd(void) {
+    return commandFd;
+}
+
+ril_event_cb RilSocket::getCommandCb(void) {
+    return commandCb;
+}
+
+ril_event* RilSocket::getListenEvent(void) {
+    return &listenEvent;
+}
+
+ril_event* RilSocket::getCallbackEvent(void) {
+    return &callbackEvent;
+}
@@ -0,0 +1,365 @@
+/* //device/libs/telephony/host/binder/Parcel.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for the parts of libbinder's Parcel that libril uses.
+ *
+ * Only the flat data buffer is modelled (no binder objects or fds), but
+ * the wire format and the growth policy follow frameworks/native's
+ * Parcel.cpp so that host measurements of marshalling cost, and of how
+ * often the buffer is reallocated, carry over to the device.
+ *
+ * The write and read methods are kept out of line, as calls into
+ * libbinder.so are on the device.
+ */
+
+#ifndef RIL_HOST_PARCEL_H
+#define RIL_HOST_PARCEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define RIL_HOST_PARCEL_API __attribute__((noinline))
+
+namespace android {
+
+typedef int32_t status_t;
+
+enum {
+    NO_ERROR            = 0,
+    NO_MEMORY           = -ENOMEM,
+    BAD_VALUE           = -EINVAL,
+    NOT_ENOUGH_DATA     = -ENODATA,
+};
+
+/** just enough of String16 for Parcel::readString16() round trips */
+class String16 {
+public:
+    String16() : mString(NULL), mSize(0) {}
+
+    String16(const char16_t *s, size_t len) : mString(NULL), mSize(0) {
+        setTo(s, len);
+    }
+
+    String16(const String16 &o) : mString(NULL), mSize(0) {
+        setTo(o.mString, o.mSize);
+    }
+
+    ~String16() { free(mString); }
+
+    String16 &operator=(const String16 &o) {
+        if (this != &o) {
+            setTo(o.mString, o.mSize);
+        }
+        return *this;
+    }
+
+    const char16_t *string() const { return mString; }
+    size_t size() const { return mSize; }
+
+private:
+    void setTo(const char16_t *s, size_t len) {
+        char16_t *copy = (char16_t *) malloc((len + 1) * sizeof(char16_t));
+
+        if (copy == NULL) {
+            return;
+        }
+
+        if (s != NULL) {
+            memcpy(copy, s, len * sizeof(char16_t));
+        }
+        copy[len] = 0;
+
+        free(mString);
+        mString = copy;
+        mSize = len;
+    }
+
+    char16_t *mString;
+    size_t mSize;
+};
+
+class Parcel {
+public:
+    Parcel() : mData(NULL), mDataSize(0), mDataCapacity(0), mDataPos(0) {}
+
+    ~Parcel() { free(mData); }
+
+    const uint8_t *data() const { return mData; }
+    size_t dataSize() const { return mDataSize > mDataPos ? mDataSize : mDataPos; }
+    size_t dataAvail() const { return mDataSize > mDataPos ? mDataSize - mDataPos : 0; }
+    size_t dataPosition() const { return mDataPos; }
+    size_t dataCapacity() const { return mDataCapacity; }
+
+    RIL_HOST_PARCEL_API status_t setDataSize(size_t size) {
+        status_t err = continueWrite(size);
+
+        if (err == NO_ERROR) {
+            mDataSize = size;
+        }
+        return err;
+    }
+
+    void setDataPosition(size_t pos) const { mDataPos = pos; }
+
+    RIL_HOST_PARCEL_API status_t setDataCapacity(size_t size) {
+        if (size > mDataCapacity) {
+            return continueWrite(size);
+        }
+        return NO_ERROR;
+    }
+
+    /** copies buffer, as libbinder does */
+    RIL_HOST_PARCEL_API status_t setData(const uint8_t *buffer, size_t len) {
+        status_t err = restartWrite(len);
+
+        if (err == NO_ERROR) {
+            memcpy(mData, buffer, len);
+            mDataSize = len;
+        }
+        return err;
+    }
+
+    RIL_HOST_PARCEL_API status_t appendFrom(const Parcel *parcel, size_t start,
+            size_t len) {
+        if (len > INT32_MAX || start + len < start || start + len > parcel->mDataSize) {
+            return BAD_VALUE;
+        }
+
+        if (mDataPos + len > mDataCapacity && growData(len) != NO_ERROR) {
+            return NO_MEMORY;
+        }
+
+        memcpy(mData + mDataPos, parcel->mData + start, len);
+        finishWrite(len);
+        return NO_ERROR;
+    }
+
+    RIL_HOST_PARCEL_API void *writeInplace(size_t len) {
+        size_t padded = padSize(len);
+
+        if (len > INT32_MAX || mDataPos + padded < mDataPos) {
+            return NULL;
+        }
+
+        if (mDataPos + padded > mDataCapacity && growData(padded) != NO_ERROR) {
+            return NULL;
+        }
+
+        uint8_t *data = mData + mDataPos;
+
+        // the caller fills the first len bytes; the padding must be zero
+        memset(data + len, 0, padded - len);
+        finishWrite(padded);
+        return data;
+    }
+
+    RIL_HOST_PARCEL_API status_t write(const void *data, size_t len) {
+        void *d = writeInplace(len);
+
+        if (d == NULL) {
+            return len > INT32_MAX ? BAD_VALUE : NO_MEMORY;
+        }
+
+        memcpy(d, data, len);
+        return NO_ERROR;
+    }
+
+    RIL_HOST_PARCEL_API status_t writeInt32(int32_t val) { return writeAligned(val); }
+    RIL_HOST_PARCEL_API status_t writeInt64(int64_t val) { return writeAligned(val); }
+
+    RIL_HOST_PARCEL_API status_t writeString16(const char16_t *str, size_t len) {
+        if (str == NULL) {
+            return writeInt32(-1);
+        }
+
+        status_t err = writeInt32(len);
+
+        if (err != NO_ERROR) {
+            return err;
+        }
+
+        len *= sizeof(char16_t);
+        uint8_t *data = (uint8_t *) writeInplace(len + sizeof(char16_t));
+
+        if (data == NULL) {
+            return NO_MEMORY;
+        }
+
+        memcpy(data, str, len);
+        *(char16_t *) (data + len) = 0;
+        return NO_ERROR;
+    }
+
+    status_t writeString16(const String16 &str) {
+        return writeString16(str.string(), str.size());
+    }
+
+    RIL_HOST_PARCEL_API status_t read(void *outData, size_t len) const {
+        const void *data = readInplace(len);
+
+        if (data == NULL) {
+            return NOT_ENOUGH_DATA;
+        }
+
+        memcpy(outData, data, len);
+        return NO_ERROR;
+    }
+
+    RIL_HOST_PARCEL_API const void *readInplace(size_t len) const {
+        size_t padded = padSize(len);
+
+        if (len > INT32_MAX || mDataPos + padded < mDataPos
+                || mDataPos + padded > mDataSize) {
+            return NULL;
+        }
+
+        const void *data = mData + mDataPos;
+        mDataPos += padded;
+        return data;
+    }
+
+    RIL_HOST_PARCEL_API status_t readInt32(int32_t *pArg) const { return readAligned(pArg); }
+    RIL_HOST_PARCEL_API status_t readInt64(int64_t *pArg) const { return readAligned(pArg); }
+
+    int32_t readInt32() const {
+        int32_t val = 0;
+
+        readInt32(&val);
+        return val;
+    }
+
+    RIL_HOST_PARCEL_API const char16_t *readString16Inplace(size_t *outLen) const {
+        int32_t size = readInt32();
+
+        // watch for potential int overflow from size+1
+        if (size >= 0 && size < INT32_MAX) {
+            const char16_t *str = (const char16_t *) readInplace(
+                    (size + 1) * sizeof(char16_t));
+
+            if (str != NULL) {
+                *outLen = size;
+                return str;
+            }
+        }
+
+        *outLen = 0;
+        return NULL;
+    }
+
+    String16 readString16() const {
+        size_t len;
+        const char16_t *str = readString16Inplace(&len);
+
+        return str != NULL ? String16(str, len) : String16();
+    }
+
+private:
+    Parcel(const Parcel &);
+    Parcel &operator=(const Parcel &);
+
+    static size_t padSize(size_t len) { return (len + 3) & ~(size_t) 3; }
+
+    template <typename T>
+    status_t writeAligned(T val) {
+        if (mDataPos + sizeof(val) > mDataCapacity) {
+            status_t err = growData(sizeof(val));
+
+            if (err != NO_ERROR) {
+                return err;
+            }
+        }
+
+        memcpy(mData + mDataPos, &val, sizeof(val));
+        finishWrite(sizeof(val));
+        return NO_ERROR;
+    }
+
+    template <typename T>
+    status_t readAligned(T *pArg) const {
+        if (mDataPos + sizeof(T) > mDataSize) {
+            return NOT_ENOUGH_DATA;
+        }
+
+        memcpy(pArg, mData + mDataPos, sizeof(T));
+        mDataPos += sizeof(T);
+        return NO_ERROR;
+    }
+
+    void finishWrite(size_t len) {
+        mDataPos += len;
+        if (mDataPos > mDataSize) {
+            mDataSize = mDataPos;
+        }
+    }
+
+    status_t growData(size_t len) {
+        size_t newSize = ((mDataSize + len) * 3) / 2;
+
+        return newSize <= mDataSize ? (status_t) NO_MEMORY : continueWrite(newSize);
+    }
+
+    status_t restartWrite(size_t desired) {
+        uint8_t *data = (uint8_t *) realloc(mData, desired);
+
+        if (data == NULL && desired > mDataCapacity) {
+            return NO_MEMORY;
+        }
+
+        if (data != NULL) {
+            mData = data;
+            mDataCapacity = desired;
+        }
+
+        mDataSize = mDataPos = 0;
+        return NO_ERROR;
+    }
+
+    status_t continueWrite(size_t desired) {
+        if (desired <= mDataCapacity && mData != NULL) {
+            // never shrinks, like the owned-buffer case in libbinder
+            if (mDataSize > desired) {
+                mDataSize = desired;
+            }
+            if (mDataPos > desired) {
+                mDataPos = desired;
+            }
+            return NO_ERROR;
+        }
+
+        uint8_t *data = (uint8_t *) realloc(mData, desired);
+
+        if (data == NULL) {
+            return NO_MEMORY;
+        }
+
+        mData = data;
+        mDataCapacity = desired;
+        return NO_ERROR;
+    }
+
+    uint8_t *mData;
+    size_t mDataSize;
+    size_t mDataCapacity;
+    mutable size_t mDataPos;
+};
+
+} // namespace android
+
+#endif // RIL_HOST_PARCEL_H
@@ -0,0 +1,150 @@
+/* //device/libs/telephony/host/cutils/jstring.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for libcutils' UTF-8 <-> UTF-16 helpers, with the same
+ * contracts: strcpy8to16() does not terminate its output and
+ * strncpy16to8() does. Input is assumed to be well formed, as RIL.java
+ * and the vendor RIL produce it.
+ */
+
+#ifndef RIL_HOST_JSTRING_H
+#define RIL_HOST_JSTRING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** number of UTF-16 units needed for a NUL-terminated UTF-8 string */
+static inline size_t strlen8to16(const char *utf8Str)
+{
+    const unsigned char *s = (const unsigned char *) utf8Str;
+    size_t len = 0;
+
+    for ( ; *s != '\0' ; s++) {
+        if ((*s & 0xc0) != 0x80) {
+            // four byte sequences become surrogate pairs
+            len += (*s & 0xf8) == 0xf0 ? 2 : 1;
+        }
+    }
+
+    return len;
+}
+
+static inline char16_t *strcpy8to16(char16_t *utf16Str, const char *utf8Str,
+        size_t *out_len)
+{
+    const unsigned char *s = (const unsigned char *) utf8Str;
+    char16_t *dest = utf16Str;
+
+    while (*s != '\0') {
+        uint32_t c = *s++;
+
+        if (c >= 0xf0) {
+            c = ((c & 0x07) << 18) | ((s[0] & 0x3f) << 12)
+                    | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+            s += 3;
+            c -= 0x10000;
+            *dest++ = (char16_t) (0xd800 | (c >> 10));
+            *dest++ = (char16_t) (0xdc00 | (c & 0x3ff));
+            continue;
+        } else if (c >= 0xe0) {
+            c = ((c & 0x0f) << 12) | ((s[0] & 0x3f) << 6) | (s[1] & 0x3f);
+            s += 2;
+        } else if (c >= 0xc0) {
+            c = ((c & 0x1f) << 6) | (s[0] & 0x3f);
+            s += 1;
+        }
+
+        *dest++ = (char16_t) c;
+    }
+
+    *out_len = dest - utf16Str;
+    return utf16Str;
+}
+
+static inline char16_t *strdup8to16(const char *s, size_t *out_len)
+{
+    char16_t *ret;
+
+    if (s == NULL) {
+        return NULL;
+    }
+
+    ret = (char16_t *) malloc((strlen8to16(s) + 1) * sizeof(char16_t));
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    return strcpy8to16(ret, s, out_len);
+}
+
+/** number of UTF-8 bytes, excluding the terminator, for len UTF-16 units */
+static inline size_t strnlen16to8(const char16_t *utf16Str, size_t len)
+{
+    size_t utf8Len = 0;
+    size_t i;
+
+    for (i = 0 ; i < len ; i++) {
+        uint32_t c = utf16Str[i];
+
+        if (c < 0x80) {
+            utf8Len += 1;
+        } else if (c < 0x800) {
+            utf8Len += 2;
+        } else if (c >= 0xd800 && c < 0xdc00 && i + 1 < len) {
+            utf8Len += 4;
+            i++;
+        } else {
+            utf8Len += 3;
+        }
+    }
+
+    return utf8Len;
+}
+
+static inline char *strncpy16to8(char *utf8Str, const char16_t *utf16Str,
+        size_t len)
+{
+    unsigned char *dest = (unsigned char *) utf8Str;
+    size_t i;
+
+    for (i = 0 ; i < len ; i++) {
+        uint32_t c = utf16Str[i];
+
+        if (c < 0x80) {
+            *dest++ = (unsigned char) c;
+        } else if (c < 0x800) {
+            *dest++ = (unsigned char) (0xc0 | (c >> 6));
+            *dest++ = (unsigned char) (0x80 | (c & 0x3f));
+        } else if (c >= 0xd800 && c < 0xdc00 && i + 1 < len) {
+            c = 0x10000 + (((c & 0x3ff) << 10) | (utf16Str[++i] & 0x3ff));
+            *dest++ = (unsigned char) (0xf0 | (c >> 18));
+            *dest++ = (unsigned char) (0x80 | ((c >> 12) & 0x3f));
+            *dest++ = (unsigned char) (0x80 | ((c >> 6) & 0x3f));
+            *dest++ = (unsigned char) (0x80 | (c & 0x3f));
+        } else {
+            *dest++ = (unsigned char) (0xe0 | (c >> 12));
+            *dest++ = (unsigned char) (0x80 | ((c >> 6) & 0x3f));
+            *dest++ = (unsigned char) (0x80 | (c & 0x3f));
+        }
+    }
+
+    *dest = '\0';
+    return utf8Str;
+}
+
+#endif // RIL_HOST_JSTRING_H
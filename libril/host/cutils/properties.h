@@ -0,0 +1,64 @@
+/* //device/libs/telephony/host/cutils/properties.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for the libcutils property calls. Gets always return the
+ * default and sets are dropped.
+ */
+
+#ifndef RIL_HOST_PROPERTIES_H
+#define RIL_HOST_PROPERTIES_H
+
+#include <string.h>
+#include <sys/system_properties.h>
+
+#define PROPERTY_KEY_MAX PROP_NAME_MAX
+#define PROPERTY_VALUE_MAX PROP_VALUE_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline int property_get(const char *key, char *value,
+        const char *default_value)
+{
+    size_t len = 0;
+
+    (void) key;
+    if (default_value != NULL) {
+        len = strlen(default_value);
+        if (len >= PROPERTY_VALUE_MAX) {
+            len = PROPERTY_VALUE_MAX - 1;
+        }
+        memcpy(value, default_value, len);
+    }
+    value[len] = '\0';
+    return (int) len;
+}
+
+static inline int property_set(const char *key, const char *value)
+{
+    (void) key;
+    (void) value;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RIL_HOST_PROPERTIES_H
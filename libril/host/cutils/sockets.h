@@ -0,0 +1,44 @@
+/* //device/libs/telephony/host/cutils/sockets.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for the libcutils socket helpers. There is no init on the
+ * host to hand over control sockets.
+ */
+
+#ifndef RIL_HOST_SOCKETS_H
+#define RIL_HOST_SOCKETS_H
+
+#define ANDROID_SOCKET_NAMESPACE_ABSTRACT 0
+#define ANDROID_SOCKET_NAMESPACE_RESERVED 1
+#define ANDROID_SOCKET_NAMESPACE_FILESYSTEM 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline int android_get_control_socket(const char *name)
+{
+    (void) name;
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RIL_HOST_SOCKETS_H
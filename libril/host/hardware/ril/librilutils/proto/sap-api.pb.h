@@ -0,0 +1,62 @@
+/* //device/libs/telephony/host/hardware/ril/librilutils/proto/sap-api.pb.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for the nanopb header generated from sap-api.proto, with
+ * just the types that RilSapSocket.h and rilSocketQueue.h use. The host
+ * build leaves RilSapSocket.cpp out.
+ */
+
+#ifndef RIL_HOST_SAP_API_PB_H
+#define RIL_HOST_SAP_API_PB_H
+
+#include "pb_decode.h"
+
+typedef enum _MsgType {
+    MsgType_UNKNOWN = 0,
+    MsgType_REQUEST = 1,
+    MsgType_RESPONSE = 2,
+    MsgType_UNSOL_RESPONSE = 3
+} MsgType;
+
+typedef enum _MsgId {
+    MsgId_UNKNOWN_REQ = 0,
+    MsgId_RIL_SIM_SAP_CONNECT = 1,
+    MsgId_RIL_SIM_SAP_DISCONNECT = 2,
+    MsgId_RIL_SIM_SAP_APDU = 3,
+    MsgId_RIL_SIM_SAP_TRANSFER_ATR = 4,
+    MsgId_RIL_SIM_SAP_POWER = 5,
+    MsgId_RIL_SIM_SAP_RESET_SIM = 6,
+    MsgId_RIL_SIM_SAP_STATUS = 7,
+    MsgId_RIL_SIM_SAP_TRANSFER_CARD_READER_STATUS = 8,
+    MsgId_RIL_SIM_SAP_ERROR_RESP = 9,
+    MsgId_RIL_SIM_SAP_SET_TRANSFER_PROTOCOL = 10
+} MsgId;
+
+typedef enum _Error {
+    Error_RIL_E_SUCCESS = 0
+} Error;
+
+typedef struct _MsgHeader {
+    uint32_t token;
+    MsgType type;
+    MsgId id;
+    Error error;
+    pb_bytes_array_t *payload;
+} MsgHeader;
+
+#endif // RIL_HOST_SAP_API_PB_H
@@ -0,0 +1,58 @@
+/* //device/libs/telephony/host/hardware_legacy/power.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for libhardware_legacy's wakelocks. Nothing is written to
+ * /sys/power; the number of locks held is counted instead, so that a
+ * benchmark can check that acquires and releases balance.
+ */
+
+#ifndef RIL_HOST_POWER_H
+#define RIL_HOST_POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    PARTIAL_WAKE_LOCK = 1,  // the cpu stays on, but the screen is off
+    FULL_WAKE_LOCK = 2      // the screen is also on
+};
+
+static int s_hostWakeLocksHeld;
+
+static inline int acquire_wake_lock(int lock, const char *id)
+{
+    (void) lock;
+    (void) id;
+    __atomic_add_fetch(&s_hostWakeLocksHeld, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* like the kernel, one release drops the lock however often it was taken */
+static inline int release_wake_lock(const char *id)
+{
+    (void) id;
+    __atomic_store_n(&s_hostWakeLocksHeld, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RIL_HOST_POWER_H
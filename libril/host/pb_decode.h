@@ -0,0 +1,38 @@
+/* //device/libs/telephony/host/pb_decode.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for nanopb's pb_decode.h. The SAP sockets are not part of
+ * the host build, so nothing is decoded; only the types that the SAP
+ * headers embed are here.
+ */
+
+#ifndef RIL_HOST_PB_DECODE_H
+#define RIL_HOST_PB_DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t pb_size_t;
+
+typedef struct {
+    pb_size_t size;
+    uint8_t bytes[1];
+} pb_bytes_array_t;
+
+#endif // RIL_HOST_PB_DECODE_H
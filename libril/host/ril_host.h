@@ -0,0 +1,45 @@
+/* //device/libs/telephony/host/ril_host.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * What bionic provides that the host C library may not. Included ahead
+ * of ril.cpp by the host builds.
+ */
+
+#ifndef RIL_HOST_H
+#define RIL_HOST_H
+
+#include <string.h>
+
+#if !defined(__BIONIC__) && defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+static size_t strlcat(char *dst, const char *src, size_t size)
+{
+    size_t dstlen = strnlen(dst, size);
+    size_t srclen = strlen(src);
+
+    if (dstlen < size) {
+        size_t n = srclen < size - dstlen - 1 ? srclen : size - dstlen - 1;
+
+        memcpy(dst + dstlen, src, n);
+        dst[dstlen + n] = '\0';
+    }
+
+    return dstlen + srclen;
+}
+#endif
+
+#endif // RIL_HOST_H
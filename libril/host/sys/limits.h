@@ -0,0 +1,25 @@
+/* //device/libs/telephony/host/sys/limits.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Host stand-in for bionic's <sys/limits.h>. */
+
+#ifndef RIL_HOST_SYS_LIMITS_H
+#define RIL_HOST_SYS_LIMITS_H
+
+#include <limits.h>
+
+#endif // RIL_HOST_SYS_LIMITS_H
@@ -0,0 +1,64 @@
+/* //device/libs/telephony/host/utils/Log.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host stand-in for liblog. Messages are dropped unless RIL_HOST_LOG is
+ * defined, so benchmarks time libril rather than the terminal; the
+ * arguments are still evaluated and format-checked, as on the device.
+ */
+
+#ifndef RIL_HOST_LOG_H
+#define RIL_HOST_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifndef LOG_TAG
+#define LOG_TAG NULL
+#endif
+
+static inline void __attribute__((format(printf, 3, 4)))
+ril_host_log(char prio, const char *tag, const char *fmt, ...)
+{
+#ifdef RIL_HOST_LOG
+    va_list ap;
+
+    fprintf(stderr, "%c/%s: ", prio, tag != NULL ? tag : "");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+#else
+    (void) prio;
+    (void) tag;
+    (void) fmt;
+#endif
+}
+
+#define RLOGV(...) ril_host_log('V', LOG_TAG, __VA_ARGS__)
+#define RLOGD(...) ril_host_log('D', LOG_TAG, __VA_ARGS__)
+#define RLOGI(...) ril_host_log('I', LOG_TAG, __VA_ARGS__)
+#define RLOGW(...) ril_host_log('W', LOG_TAG, __VA_ARGS__)
+#define RLOGE(...) ril_host_log('E', LOG_TAG, __VA_ARGS__)
+
+#define ALOGV RLOGV
+#define ALOGD RLOGD
+#define ALOGI RLOGI
+#define ALOGW RLOGW
+#define ALOGE RLOGE
+
+#endif // RIL_HOST_LOG_H
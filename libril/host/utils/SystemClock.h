@@ -0,0 +1,51 @@
+/* //device/libs/telephony/host/utils/SystemClock.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Host stand-in for libutils' SystemClock. */
+
+#ifndef RIL_HOST_SYSTEMCLOCK_H
+#define RIL_HOST_SYSTEMCLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+namespace android {
+
+static inline int64_t elapsedRealtimeNano()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int64_t elapsedRealtime()
+{
+    return elapsedRealtimeNano() / 1000000;
+}
+
+static inline int64_t uptimeMillis()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+} // namespace android
+
+#endif // RIL_HOST_SYSTEMCLOCK_H
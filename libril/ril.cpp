@@ -45,8 +45,11 @@
 #include <sys/un.h>
 #include <assert.h>
 #include <netinet/in.h>
+#include <signal.h>
 #include <cutils/properties.h>
 #include <RilSapSocket.h>
+#include "rilMarshal.h"
+#include "rilMonitor.h"
 
 extern "C" void
 RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responselen);
@@ -382,6 +385,142 @@ int cdmaSubscriptionSource = -1;
  */
 int simRuimStatus = -1;
 
+/*
+ * Responses and unsolicited indications are built in a Parcel kept per
+ * calling thread rather than in a new one each time, so in the steady
+ * state sending one allocates nothing. The first message of each type
+ * on a thread pre-sizes the parcel to the largest that type has needed,
+ * instead of growing it a few bytes at a time. A nested call on the same
+ * thread (processRadioState() sends indications of its own) gets a
+ * temporary parcel.
+ */
+
+#define RESPONSE_PARCEL_MAX_RETAINED (64 * 1024)
+
+typedef struct {
+    size_t highWater;       // largest parcel this type has needed
+    unsigned int sent;
+    unsigned int allocs;    // messages that had to allocate or grow a buffer
+} ParcelStats;
+
+typedef struct {
+    Parcel parcel;
+    bool busy;
+} ResponseParcel;
+
+static ParcelStats s_requestParcelStats[NUM_ELEMS(s_commands)];
+static ParcelStats s_unsolParcelStats[NUM_ELEMS(s_unsolResponses)];
+static pthread_mutex_t s_parcelStatsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t s_responseParcelKey;
+static pthread_once_t s_responseParcelOnce = PTHREAD_ONCE_INIT;
+
+static void freeResponseParcel(void *param) {
+    delete (ResponseParcel *) param;
+}
+
+static void makeResponseParcelKey() {
+    pthread_key_create(&s_responseParcelKey, freeResponseParcel);
+}
+
+/**
+ * Returns an empty parcel with room for a message of the type p_stats
+ * describes. Give it back with releaseResponseParcel().
+ */
+static Parcel *
+obtainResponseParcel(ParcelStats *p_stats, size_t *p_capacity) {
+    ResponseParcel *p_rp;
+    Parcel *p;
+    size_t highWater;
+
+    pthread_once(&s_responseParcelOnce, makeResponseParcelKey);
+
+    p_rp = (ResponseParcel *) pthread_getspecific(s_responseParcelKey);
+    if (p_rp == NULL) {
+        p_rp = new ResponseParcel();
+        p_rp->busy = false;
+        pthread_setspecific(s_responseParcelKey, p_rp);
+    }
+
+    if (p_rp->busy) {
+        p = new Parcel();
+    } else {
+        p_rp->busy = true;
+        p = &p_rp->parcel;
+        if (p->dataSize() > 0) {
+            // keeps the buffer
+            p->setDataSize(0);
+        }
+        p->setDataPosition(0);
+    }
+
+    *p_capacity = p->dataCapacity();
+
+    pthread_mutex_lock(&s_parcelStatsMutex);
+    highWater = p_stats->highWater;
+    pthread_mutex_unlock(&s_parcelStatsMutex);
+
+    if (highWater > p->dataCapacity()) {
+        p->setDataCapacity(highWater);
+    }
+
+    return p;
+}
+
+static void
+releaseResponseParcel(Parcel *p, ParcelStats *p_stats, size_t capacity) {
+    ResponseParcel *p_rp;
+
+    pthread_mutex_lock(&s_parcelStatsMutex);
+    p_stats->sent++;
+    if (p->dataCapacity() != capacity) {
+        p_stats->allocs++;
+    }
+    if (p->dataSize() > p_stats->highWater) {
+        p_stats->highWater = p->dataSize();
+    }
+    pthread_mutex_unlock(&s_parcelStatsMutex);
+
+    p_rp = (ResponseParcel *) pthread_getspecific(s_responseParcelKey);
+
+    if (p != &p_rp->parcel) {
+        delete p;
+    } else if (p->dataCapacity() > RESPONSE_PARCEL_MAX_RETAINED) {
+        // don't pin down the buffer of an occasional huge response
+        pthread_setspecific(s_responseParcelKey, NULL);
+        delete p_rp;
+    } else {
+        p_rp->busy = false;
+    }
+}
+
+static void
+dumpParcelStats() {
+    pthread_mutex_lock(&s_parcelStatsMutex);
+
+    for (size_t i = 0 ; i < NUM_ELEMS(s_requestParcelStats) ; i++) {
+        ParcelStats *p_stats = &s_requestParcelStats[i];
+
+        if (p_stats->sent > 0) {
+            RLOGI("parcels: %s: %u sent, %u allocated, high water %zu bytes",
+                    requestToString(i), p_stats->sent, p_stats->allocs,
+                    p_stats->highWater);
+        }
+    }
+
+    for (size_t i = 0 ; i < NUM_ELEMS(s_unsolParcelStats) ; i++) {
+        ParcelStats *p_stats = &s_unsolParcelStats[i];
+
+        if (p_stats->sent > 0) {
+            RLOGI("parcels: %s: %u sent, %u allocated, high water %zu bytes",
+                    requestToString(i + RIL_UNSOL_RESPONSE_BASE), p_stats->sent,
+                    p_stats->allocs, p_stats->highWater);
+        }
+    }
+
+    pthread_mutex_unlock(&s_parcelStatsMutex);
+}
+
 static char * RIL_getRilSocketName() {
     return rild;
 }
@@ -391,16 +530,6 @@ void RIL_setRilSocketName(const char * s) {
     strncpy(rild, s, MAX_SOCKET_NAME_LENGTH);
 }
 
-static char *
-strdupReadString(Parcel &p) {
-    size_t stringlen;
-    const char16_t *s16;
-
-    s16 = p.readString16Inplace(&stringlen);
-
-    return strndup16to8(s16, stringlen);
-}
-
 static status_t
 readStringFromParcelInplace(Parcel &p, char *str, size_t maxLen) {
     size_t s16Len;
@@ -430,10 +559,139 @@ static void writeStringToParcel(Parcel &p, const char *s) {
 }
 
 
+/*
+ * Strings and arrays decoded from a request parcel are carved out of a
+ * single bump arena rather than allocated and freed field by field.
+ * Requests are dispatched one at a time from the event loop, and the
+ * vendor RIL may not hold on to request data past onRequest(), so the
+ * whole arena is wiped and reset once the dispatch function returns.
+ *
+ * The arena is reserved from the record length before each dispatch.
+ * Twice the record length plus some slack for the structs is only an
+ * estimate that fits typical requests: a UTF-16 string grows by up to
+ * half when converted to UTF-8, and on 64-bit a null string's 4 bytes
+ * decode to an 8-byte pointer, so a request can need more. Anything that
+ * doesn't fit goes to a malloc'd overflow block that is freed on reset.
+ * Element counts read from the parcel are checked against the bytes left
+ * in it (every element takes at least 4) before anything is allocated
+ * for them.
+ */
+
+#define REQUEST_ARENA_SLACK 512
+#define REQUEST_ARENA_MAX_RETAINED (64 * 1024)
+#define REQUEST_ARENA_ALIGN 8
+
+typedef struct RequestArenaOverflow {
+    struct RequestArenaOverflow *p_next;
+    size_t size;
+} RequestArenaOverflow;
+
+static char *s_requestArena = NULL;
+static size_t s_requestArenaSize = 0;
+static size_t s_requestArenaUsed = 0;
+static RequestArenaOverflow *s_requestArenaOverflow = NULL;
+
+static void
+requestArenaReserve(size_t recordlen) {
+    size_t size;
+
+    if (recordlen > (SIZE_MAX - REQUEST_ARENA_SLACK) / 2) {
+        return;
+    }
+
+    size = recordlen * 2 + REQUEST_ARENA_SLACK;
+
+    if (size <= s_requestArenaSize) {
+        return;
+    }
+
+    // the arena is empty between requests, so nothing needs to be kept
+    free(s_requestArena);
+    s_requestArena = (char *)malloc(size);
+    s_requestArenaSize = (s_requestArena != NULL) ? size : 0;
+}
+
+/** returns zeroed, 8-byte aligned memory valid until requestArenaReset() */
+static void *
+arenaAlloc(size_t size) {
+    size_t aligned = (size + REQUEST_ARENA_ALIGN - 1) & ~(size_t)(REQUEST_ARENA_ALIGN - 1);
+    void *ret;
+
+    if (aligned < size) {
+        return NULL;
+    }
+
+    if (s_requestArena != NULL && aligned <= s_requestArenaSize - s_requestArenaUsed) {
+        ret = s_requestArena + s_requestArenaUsed;
+        s_requestArenaUsed += aligned;
+    } else {
+        RequestArenaOverflow *p_block;
+
+        if (aligned > SIZE_MAX - sizeof(RequestArenaOverflow)) {
+            return NULL;
+        }
+
+        p_block = (RequestArenaOverflow *)malloc(sizeof(RequestArenaOverflow) + aligned);
+        if (p_block == NULL) {
+            return NULL;
+        }
+
+        p_block->p_next = s_requestArenaOverflow;
+        p_block->size = aligned;
+        s_requestArenaOverflow = p_block;
+        ret = p_block + 1;
+    }
+
+    memset(ret, 0, aligned);
+    return ret;
+}
+
+/** reads a String16 from the parcel as UTF-8 in the arena; NULL for null */
+static char *
+arenaReadString(Parcel &p) {
+    size_t stringlen;
+    size_t len;
+    const char16_t *s16;
+    char *ret;
+
+    s16 = p.readString16Inplace(&stringlen);
+    if (s16 == NULL) {
+        return NULL;
+    }
+
+    len = strnlen16to8(s16, stringlen);
+    ret = (char *)arenaAlloc(len + 1);
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    return strncpy16to8(ret, s16, stringlen);
+}
+
 static void
-memsetString (char *s) {
-    if (s != NULL) {
-        memset (s, 0, strlen(s));
+requestArenaReset() {
+    while (s_requestArenaOverflow != NULL) {
+        RequestArenaOverflow *p_block = s_requestArenaOverflow;
+
+        s_requestArenaOverflow = p_block->p_next;
+#ifdef MEMSET_FREED
+        memset(p_block + 1, 0, p_block->size);
+#endif
+        free(p_block);
+    }
+
+#ifdef MEMSET_FREED
+    if (s_requestArena != NULL) {
+        memset(s_requestArena, 0, s_requestArenaUsed);
+    }
+#endif
+    s_requestArenaUsed = 0;
+
+    // don't pin down the memory of an occasional huge request
+    if (s_requestArenaSize > REQUEST_ARENA_MAX_RETAINED) {
+        free(s_requestArena);
+        s_requestArena = NULL;
+        s_requestArenaSize = 0;
     }
 }
 
@@ -576,7 +834,9 @@ processCommandBuffer(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id) {
 
 /*    sLastDispatchedToken = token; */
 
+    requestArenaReserve(buflen);
     pRI->pCI->dispatchFunction(p, pRI);
+    requestArenaReset();
 
     return 0;
 }
@@ -603,7 +863,7 @@ dispatchString (Parcel& p, RequestInfo *pRI) {
     size_t stringlen;
     char *string8 = NULL;
 
-    string8 = strdupReadString(p);
+    string8 = arenaReadString(p);
 
     startRequest;
     appendPrintBuf("%s%s", printBuf, string8);
@@ -613,11 +873,6 @@ dispatchString (Parcel& p, RequestInfo *pRI) {
     CALL_ONREQUEST(pRI->pCI->requestNumber, string8,
                        sizeof(char *), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString(string8);
-#endif
-
-    free(string8);
     return;
 invalid:
     invalidCommandBlock(pRI);
@@ -638,10 +893,14 @@ dispatchStrings (Parcel &p, RequestInfo *pRI) {
         goto invalid;
     }
 
+    if (countStrings > 0 && (size_t)countStrings > p.dataAvail() / sizeof(int32_t)) {
+        goto invalid;
+    }
+
     startRequest;
     if (countStrings == 0) {
         // just some non-null pointer
-        pStrings = (char **)calloc(1, sizeof(char *));
+        pStrings = (char **)arenaAlloc(sizeof(char *));
         if (pStrings == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
@@ -656,7 +915,7 @@ dispatchStrings (Parcel &p, RequestInfo *pRI) {
     } else {
         datalen = sizeof(char *) * countStrings;
 
-        pStrings = (char **)calloc(countStrings, sizeof(char *));
+        pStrings = (char **)arenaAlloc(datalen);
         if (pStrings == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
@@ -665,7 +924,7 @@ dispatchStrings (Parcel &p, RequestInfo *pRI) {
         }
 
         for (int i = 0 ; i < countStrings ; i++) {
-            pStrings[i] = strdupReadString(p);
+            pStrings[i] = arenaReadString(p);
             appendPrintBuf("%s%s,", printBuf, pStrings[i]);
         }
     }
@@ -675,20 +934,6 @@ dispatchStrings (Parcel &p, RequestInfo *pRI) {
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, pStrings, datalen, pRI, pRI->socket_id);
 
-    if (pStrings != NULL) {
-        for (int i = 0 ; i < countStrings ; i++) {
-#ifdef MEMSET_FREED
-            memsetString (pStrings[i]);
-#endif
-            free(pStrings[i]);
-        }
-
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, datalen);
-#endif
-        free(pStrings);
-    }
-
     return;
 invalid:
     invalidCommandBlock(pRI);
@@ -709,8 +954,13 @@ dispatchInts (Parcel &p, RequestInfo *pRI) {
         goto invalid;
     }
 
+    if ((size_t)count > (INT_MAX/sizeof(int))
+            || (size_t)count > p.dataAvail() / sizeof(int32_t)) {
+        goto invalid;
+    }
+
     datalen = sizeof(int) * count;
-    pInts = (int *)calloc(count, sizeof(int));
+    pInts = (int *)arenaAlloc(datalen);
     if (pInts == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(pRI->pCI->requestNumber));
         return;
@@ -725,7 +975,6 @@ dispatchInts (Parcel &p, RequestInfo *pRI) {
         appendPrintBuf("%s%d,", printBuf, t);
 
         if (status != NO_ERROR) {
-            free(pInts);
             goto invalid;
         }
    }
@@ -736,10 +985,6 @@ dispatchInts (Parcel &p, RequestInfo *pRI) {
    CALL_ONREQUEST(pRI->pCI->requestNumber, const_cast<int *>(pInts),
                        datalen, pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memset(pInts, 0, datalen);
-#endif
-    free(pInts);
     return;
 invalid:
     invalidCommandBlock(pRI);
@@ -765,13 +1010,13 @@ dispatchSmsWrite (Parcel &p, RequestInfo *pRI) {
     status = p.readInt32(&t);
     args.status = (int)t;
 
-    args.pdu = strdupReadString(p);
+    args.pdu = arenaReadString(p);
 
     if (status != NO_ERROR || args.pdu == NULL) {
         goto invalid;
     }
 
-    args.smsc = strdupReadString(p);
+    args.smsc = arenaReadString(p);
 
     startRequest;
     appendPrintBuf("%s%d,%s,smsc=%s", printBuf, args.status,
@@ -781,12 +1026,6 @@ dispatchSmsWrite (Parcel &p, RequestInfo *pRI) {
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &args, sizeof(args), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString (args.pdu);
-#endif
-
-    free (args.pdu);
-
 #ifdef MEMSET_FREED
     memset(&args, 0, sizeof(args));
 #endif
@@ -815,7 +1054,7 @@ dispatchDial (Parcel &p, RequestInfo *pRI) {
     RLOGD("dispatchDial");
     memset (&dial, 0, sizeof(dial));
 
-    dial.address = strdupReadString(p);
+    dial.address = arenaReadString(p);
 
     status = p.readInt32(&t);
     dial.clir = (int)t;
@@ -878,12 +1117,6 @@ dispatchDial (Parcel &p, RequestInfo *pRI) {
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &dial, sizeOfDial, pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString (dial.address);
-#endif
-
-    free (dial.address);
-
 #ifdef MEMSET_FREED
     memset(&uusInfo, 0, sizeof(RIL_UUS_Info));
     memset(&dial, 0, sizeof(dial));
@@ -930,7 +1163,7 @@ dispatchSIM_IO (Parcel &p, RequestInfo *pRI) {
     status = p.readInt32(&t);
     simIO.v6.fileid = (int)t;
 
-    simIO.v6.path = strdupReadString(p);
+    simIO.v6.path = arenaReadString(p);
 
     status = p.readInt32(&t);
     simIO.v6.p1 = (int)t;
@@ -941,9 +1174,9 @@ dispatchSIM_IO (Parcel &p, RequestInfo *pRI) {
     status = p.readInt32(&t);
     simIO.v6.p3 = (int)t;
 
-    simIO.v6.data = strdupReadString(p);
-    simIO.v6.pin2 = strdupReadString(p);
-    simIO.v6.aidPtr = strdupReadString(p);
+    simIO.v6.data = arenaReadString(p);
+    simIO.v6.pin2 = arenaReadString(p);
+    simIO.v6.aidPtr = arenaReadString(p);
 
     startRequest;
     appendPrintBuf("%scmd=0x%X,efid=0x%X,path=%s,%d,%d,%d,%s,pin2=%s,aid=%s", printBuf,
@@ -960,18 +1193,6 @@ dispatchSIM_IO (Parcel &p, RequestInfo *pRI) {
     size = (s_callbacks.version < 6) ? sizeof(simIO.v5) : sizeof(simIO.v6);
     CALL_ONREQUEST(pRI->pCI->requestNumber, &simIO, size, pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString (simIO.v6.path);
-    memsetString (simIO.v6.data);
-    memsetString (simIO.v6.pin2);
-    memsetString (simIO.v6.aidPtr);
-#endif
-
-    free (simIO.v6.path);
-    free (simIO.v6.data);
-    free (simIO.v6.pin2);
-    free (simIO.v6.aidPtr);
-
 #ifdef MEMSET_FREED
     memset(&simIO, 0, sizeof(simIO));
 #endif
@@ -1022,7 +1243,7 @@ dispatchSIM_APDU (Parcel &p, RequestInfo *pRI) {
     status = p.readInt32(&t);
     apdu.p3 = (int)t;
 
-    apdu.data = strdupReadString(p);
+    apdu.data = arenaReadString(p);
 
     startRequest;
     appendPrintBuf("%ssessionid=%d,cla=%d,ins=%d,p1=%d,p2=%d,p3=%d,data=%s",
@@ -1037,11 +1258,6 @@ dispatchSIM_APDU (Parcel &p, RequestInfo *pRI) {
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &apdu, sizeof(RIL_SIM_APDU), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString(apdu.data);
-#endif
-    free(apdu.data);
-
 #ifdef MEMSET_FREED
     memset(&apdu, 0, sizeof(RIL_SIM_APDU));
 #endif
@@ -1086,7 +1302,7 @@ dispatchCallForward(Parcel &p, RequestInfo *pRI) {
     status = p.readInt32(&t);
     cff.toa = (int)t;
 
-    cff.number = strdupReadString(p);
+    cff.number = arenaReadString(p);
 
     status = p.readInt32(&t);
     cff.timeSeconds = (int)t;
@@ -1110,12 +1326,6 @@ dispatchCallForward(Parcel &p, RequestInfo *pRI) {
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &cff, sizeof(cff), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString(cff.number);
-#endif
-
-    free (cff.number);
-
 #ifdef MEMSET_FREED
     memset(&cff, 0, sizeof(cff));
 #endif
@@ -1309,6 +1519,10 @@ dispatchImsGsmSms(Parcel &p, RequestInfo *pRI, uint8_t retry, int32_t messageRef
         goto invalid;
     }
 
+    if (countStrings > 0 && (size_t)countStrings > p.dataAvail() / sizeof(int32_t)) {
+        goto invalid;
+    }
+
     memset(&rism, 0, sizeof(rism));
     rism.tech = RADIO_TECH_3GPP;
     rism.retry = retry;
@@ -1319,7 +1533,7 @@ dispatchImsGsmSms(Parcel &p, RequestInfo *pRI, uint8_t retry, int32_t messageRef
                     (int)rism.tech, (int)rism.retry, rism.messageRef);
     if (countStrings == 0) {
         // just some non-null pointer
-        pStrings = (char **)calloc(1, sizeof(char *));
+        pStrings = (char **)arenaAlloc(sizeof(char *));
         if (pStrings == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
@@ -1339,7 +1553,7 @@ dispatchImsGsmSms(Parcel &p, RequestInfo *pRI, uint8_t retry, int32_t messageRef
         }
         datalen = sizeof(char *) * countStrings;
 
-        pStrings = (char **)calloc(countStrings, sizeof(char *));
+        pStrings = (char **)arenaAlloc(datalen);
         if (pStrings == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
@@ -1348,7 +1562,7 @@ dispatchImsGsmSms(Parcel &p, RequestInfo *pRI, uint8_t retry, int32_t messageRef
         }
 
         for (int i = 0 ; i < countStrings ; i++) {
-            pStrings[i] = strdupReadString(p);
+            pStrings[i] = arenaReadString(p);
             appendPrintBuf("%s%s,", printBuf, pStrings[i]);
         }
     }
@@ -1361,20 +1575,6 @@ dispatchImsGsmSms(Parcel &p, RequestInfo *pRI, uint8_t retry, int32_t messageRef
             sizeof(RIL_RadioTechnologyFamily)+sizeof(uint8_t)+sizeof(int32_t)
             +datalen, pRI, pRI->socket_id);
 
-    if (pStrings != NULL) {
-        for (int i = 0 ; i < countStrings ; i++) {
-#ifdef MEMSET_FREED
-            memsetString (pStrings[i]);
-#endif
-            free(pStrings[i]);
-        }
-
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, datalen);
-#endif
-        free(pStrings);
-    }
-
 #ifdef MEMSET_FREED
     memset(&rism, 0, sizeof(rism));
 #endif
@@ -1777,14 +1977,14 @@ static void dispatchSetInitialAttachApn(Parcel &p, RequestInfo *pRI)
 
     memset(&pf, 0, sizeof(pf));
 
-    pf.apn = strdupReadString(p);
-    pf.protocol = strdupReadString(p);
+    pf.apn = arenaReadString(p);
+    pf.protocol = arenaReadString(p);
 
     status = p.readInt32(&t);
     pf.authtype = (int) t;
 
-    pf.username = strdupReadString(p);
-    pf.password = strdupReadString(p);
+    pf.username = arenaReadString(p);
+    pf.password = arenaReadString(p);
 
     startRequest;
     appendPrintBuf("%sapn=%s, protocol=%s, authtype=%d, username=%s, password=%s",
@@ -1797,18 +1997,6 @@ static void dispatchSetInitialAttachApn(Parcel &p, RequestInfo *pRI)
     }
     CALL_ONREQUEST(pRI->pCI->requestNumber, &pf, sizeof(pf), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString(pf.apn);
-    memsetString(pf.protocol);
-    memsetString(pf.username);
-    memsetString(pf.password);
-#endif
-
-    free(pf.apn);
-    free(pf.protocol);
-    free(pf.username);
-    free(pf.password);
-
 #ifdef MEMSET_FREED
     memset(&pf, 0, sizeof(pf));
 #endif
@@ -1862,7 +2050,7 @@ static void dispatchNVWriteItem(Parcel &p, RequestInfo *pRI) {
     status = p.readInt32(&t);
     nvwi.itemID = (RIL_NV_Item) t;
 
-    nvwi.value = strdupReadString(p);
+    nvwi.value = arenaReadString(p);
 
     if (status != NO_ERROR || nvwi.value == NULL) {
         goto invalid;
@@ -1877,12 +2065,6 @@ static void dispatchNVWriteItem(Parcel &p, RequestInfo *pRI) {
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &nvwi, sizeof(nvwi), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString(nvwi.value);
-#endif
-
-    free(nvwi.value);
-
 #ifdef MEMSET_FREED
     memset(&nvwi, 0, sizeof(nvwi));
 #endif
@@ -1955,8 +2137,8 @@ static void dispatchSimAuthentication(Parcel &p, RequestInfo *pRI)
 
     status = p.readInt32(&t);
     pf.authContext = (int) t;
-    pf.authData = strdupReadString(p);
-    pf.aid = strdupReadString(p);
+    pf.authData = arenaReadString(p);
+    pf.aid = arenaReadString(p);
 
     startRequest;
     appendPrintBuf("authContext=%s, authData=%s, aid=%s", pf.authContext, pf.authData, pf.aid);
@@ -1968,14 +2150,6 @@ static void dispatchSimAuthentication(Parcel &p, RequestInfo *pRI)
     }
     CALL_ONREQUEST(pRI->pCI->requestNumber, &pf, sizeof(pf), pRI, pRI->socket_id);
 
-#ifdef MEMSET_FREED
-    memsetString(pf.authData);
-    memsetString(pf.aid);
-#endif
-
-    free(pf.authData);
-    free(pf.aid);
-
 #ifdef MEMSET_FREED
     memset(&pf, 0, sizeof(pf));
 #endif
@@ -1997,19 +2171,21 @@ static void dispatchDataProfile(Parcel &p, RequestInfo *pRI) {
     }
 
     {
+        if ((size_t)num > (INT_MAX/sizeof(RIL_DataProfileInfo))) {
+            goto invalid;
+        }
         RIL_DataProfileInfo *dataProfiles =
-                (RIL_DataProfileInfo *)calloc(num, sizeof(RIL_DataProfileInfo));
+                (RIL_DataProfileInfo *)arenaAlloc(num * sizeof(RIL_DataProfileInfo));
         if (dataProfiles == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
             return;
         }
         RIL_DataProfileInfo **dataProfilePtrs =
-                (RIL_DataProfileInfo **)calloc(num, sizeof(RIL_DataProfileInfo *));
+                (RIL_DataProfileInfo **)arenaAlloc(num * sizeof(RIL_DataProfileInfo *));
         if (dataProfilePtrs == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
-            free(dataProfiles);
             return;
         }
 
@@ -2020,13 +2196,13 @@ static void dispatchDataProfile(Parcel &p, RequestInfo *pRI) {
             status = p.readInt32(&t);
             dataProfiles[i].profileId = (int) t;
 
-            dataProfiles[i].apn = strdupReadString(p);
-            dataProfiles[i].protocol = strdupReadString(p);
+            dataProfiles[i].apn = arenaReadString(p);
+            dataProfiles[i].protocol = arenaReadString(p);
             status = p.readInt32(&t);
             dataProfiles[i].authType = (int) t;
 
-            dataProfiles[i].user = strdupReadString(p);
-            dataProfiles[i].password = strdupReadString(p);
+            dataProfiles[i].user = arenaReadString(p);
+            dataProfiles[i].password = arenaReadString(p);
 
             status = p.readInt32(&t);
             dataProfiles[i].type = (int) t;
@@ -2053,21 +2229,12 @@ static void dispatchDataProfile(Parcel &p, RequestInfo *pRI) {
         printRequest(pRI->token, pRI->pCI->requestNumber);
 
         if (status != NO_ERROR) {
-            free(dataProfiles);
-            free(dataProfilePtrs);
             goto invalid;
         }
         CALL_ONREQUEST(pRI->pCI->requestNumber,
                               dataProfilePtrs,
                               num * sizeof(RIL_DataProfileInfo *),
                               pRI, pRI->socket_id);
-
-#ifdef MEMSET_FREED
-        memset(dataProfiles, 0, num * sizeof(RIL_DataProfileInfo));
-        memset(dataProfilePtrs, 0, num * sizeof(RIL_DataProfileInfo *));
-#endif
-        free(dataProfiles);
-        free(dataProfilePtrs);
     }
 
     return;
@@ -2161,7 +2328,10 @@ static void dispatchCarrierRestrictions(Parcel &p, RequestInfo *pRI) {
     if (status != NO_ERROR) {
         goto invalid;
     }
-    allowed_carriers = (RIL_Carrier *)calloc(t, sizeof(RIL_Carrier));
+    if (t < 0 || (size_t)t > (INT_MAX/sizeof(RIL_Carrier))) {
+        goto invalid;
+    }
+    allowed_carriers = (RIL_Carrier *)arenaAlloc(t * sizeof(RIL_Carrier));
     if (allowed_carriers == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(pRI->pCI->requestNumber));
         goto exit;
@@ -2173,7 +2343,10 @@ static void dispatchCarrierRestrictions(Parcel &p, RequestInfo *pRI) {
     if (status != NO_ERROR) {
         goto invalid;
     }
-    excluded_carriers = (RIL_Carrier *)calloc(t, sizeof(RIL_Carrier));
+    if (t < 0 || (size_t)t > (INT_MAX/sizeof(RIL_Carrier))) {
+        goto invalid;
+    }
+    excluded_carriers = (RIL_Carrier *)arenaAlloc(t * sizeof(RIL_Carrier));
     if (excluded_carriers == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(pRI->pCI->requestNumber));
         goto exit;
@@ -2188,28 +2361,28 @@ static void dispatchCarrierRestrictions(Parcel &p, RequestInfo *pRI) {
     appendPrintBuf("%s allowed_carriers:", printBuf);
     for (int32_t i = 0; i < cr.len_allowed_carriers; i++) {
         RIL_Carrier *p_cr = allowed_carriers + i;
-        p_cr->mcc = strdupReadString(p);
-        p_cr->mnc = strdupReadString(p);
+        p_cr->mcc = arenaReadString(p);
+        p_cr->mnc = arenaReadString(p);
         status = p.readInt32(&t);
         p_cr->match_type = static_cast<RIL_CarrierMatchType>(t);
         if (status != NO_ERROR) {
             goto invalid;
         }
-        p_cr->match_data = strdupReadString(p);
+        p_cr->match_data = arenaReadString(p);
         appendPrintBuf("%s [%d mcc:%s, mnc:%s, match_type:%d, match_data:%s],",
                        printBuf, i, p_cr->mcc, p_cr->mnc, p_cr->match_type, p_cr->match_data);
     }
 
     for (int32_t i = 0; i < cr.len_excluded_carriers; i++) {
         RIL_Carrier *p_cr = excluded_carriers + i;
-        p_cr->mcc = strdupReadString(p);
-        p_cr->mnc = strdupReadString(p);
+        p_cr->mcc = arenaReadString(p);
+        p_cr->mnc = arenaReadString(p);
         status = p.readInt32(&t);
         p_cr->match_type = static_cast<RIL_CarrierMatchType>(t);
         if (status != NO_ERROR) {
             goto invalid;
         }
-        p_cr->match_data = strdupReadString(p);
+        p_cr->match_data = arenaReadString(p);
         appendPrintBuf("%s [%d mcc:%s, mnc:%s, match_type:%d, match_data:%s],",
                        printBuf, i, p_cr->mcc, p_cr->mnc, p_cr->match_type, p_cr->match_data);
     }
@@ -2228,12 +2401,6 @@ invalid:
     invalidCommandBlock(pRI);
     RIL_onRequestComplete(pRI, RIL_E_INVALID_ARGUMENTS, NULL, 0);
 exit:
-    if (allowed_carriers != NULL) {
-        free(allowed_carriers);
-    }
-    if (excluded_carriers != NULL) {
-        free(excluded_carriers);
-    }
     return;
 }
 
@@ -2573,21 +2740,13 @@ static int responseDataCallListV4(Parcel &p, void *response, size_t responselen)
         return RIL_ERRNO_INVALID_RESPONSE;
     }
 
-    // Write version
-    p.writeInt32(4);
-
     int num = responselen / sizeof(RIL_Data_Call_Response_v4);
-    p.writeInt32(num);
+    marshalDataCallList(p, s_dataCallV4Schema, 4, response, sizeof(RIL_Data_Call_Response_v4), num);
 
     RIL_Data_Call_Response_v4 *p_cur = (RIL_Data_Call_Response_v4 *) response;
     startResponse;
     int i;
     for (i = 0; i < num; i++) {
-        p.writeInt32(p_cur[i].cid);
-        p.writeInt32(p_cur[i].active);
-        writeStringToParcel(p, p_cur[i].type);
-        // apn is not used, so don't send.
-        writeStringToParcel(p, p_cur[i].address);
         appendPrintBuf("%s[cid=%d,%s,%s,%s],", printBuf,
             p_cur[i].cid,
             (p_cur[i].active==0)?"down":"up",
@@ -2613,25 +2772,13 @@ static int responseDataCallListV6(Parcel &p, void *response, size_t responselen)
         return RIL_ERRNO_INVALID_RESPONSE;
     }
 
-    // Write version
-    p.writeInt32(6);
-
     int num = responselen / sizeof(RIL_Data_Call_Response_v6);
-    p.writeInt32(num);
+    marshalDataCallList(p, s_dataCallV6Schema, 6, response, sizeof(RIL_Data_Call_Response_v6), num);
 
     RIL_Data_Call_Response_v6 *p_cur = (RIL_Data_Call_Response_v6 *) response;
     startResponse;
     int i;
     for (i = 0; i < num; i++) {
-        p.writeInt32((int)p_cur[i].status);
-        p.writeInt32(p_cur[i].suggestedRetryTime);
-        p.writeInt32(p_cur[i].cid);
-        p.writeInt32(p_cur[i].active);
-        writeStringToParcel(p, p_cur[i].type);
-        writeStringToParcel(p, p_cur[i].ifname);
-        writeStringToParcel(p, p_cur[i].addresses);
-        writeStringToParcel(p, p_cur[i].dnses);
-        writeStringToParcel(p, p_cur[i].gateways);
         appendPrintBuf("%s[status=%d,retry=%d,cid=%d,%s,%s,%s,%s,%s,%s],", printBuf,
             p_cur[i].status,
             p_cur[i].suggestedRetryTime,
@@ -2662,26 +2809,13 @@ static int responseDataCallListV9(Parcel &p, void *response, size_t responselen)
         return RIL_ERRNO_INVALID_RESPONSE;
     }
 
-    // Write version
-    p.writeInt32(10);
-
     int num = responselen / sizeof(RIL_Data_Call_Response_v9);
-    p.writeInt32(num);
+    marshalDataCallList(p, s_dataCallV9Schema, 10, response, sizeof(RIL_Data_Call_Response_v9), num);
 
     RIL_Data_Call_Response_v9 *p_cur = (RIL_Data_Call_Response_v9 *) response;
     startResponse;
     int i;
     for (i = 0; i < num; i++) {
-        p.writeInt32((int)p_cur[i].status);
-        p.writeInt32(p_cur[i].suggestedRetryTime);
-        p.writeInt32(p_cur[i].cid);
-        p.writeInt32(p_cur[i].active);
-        writeStringToParcel(p, p_cur[i].type);
-        writeStringToParcel(p, p_cur[i].ifname);
-        writeStringToParcel(p, p_cur[i].addresses);
-        writeStringToParcel(p, p_cur[i].dnses);
-        writeStringToParcel(p, p_cur[i].gateways);
-        writeStringToParcel(p, p_cur[i].pcscf);
         appendPrintBuf("%s[status=%d,retry=%d,cid=%d,%s,%s,%s,%s,%s,%s,%s],", printBuf,
             p_cur[i].status,
             p_cur[i].suggestedRetryTime,
@@ -2712,27 +2846,13 @@ static int responseDataCallListV11(Parcel &p, void *response, size_t responselen
         return RIL_ERRNO_INVALID_RESPONSE;
     }
 
-    // Write version
-    p.writeInt32(11);
-
     int num = responselen / sizeof(RIL_Data_Call_Response_v11);
-    p.writeInt32(num);
+    marshalDataCallList(p, s_dataCallV11Schema, 11, response, sizeof(RIL_Data_Call_Response_v11), num);
 
     RIL_Data_Call_Response_v11 *p_cur = (RIL_Data_Call_Response_v11 *) response;
     startResponse;
     int i;
     for (i = 0; i < num; i++) {
-        p.writeInt32((int)p_cur[i].status);
-        p.writeInt32(p_cur[i].suggestedRetryTime);
-        p.writeInt32(p_cur[i].cid);
-        p.writeInt32(p_cur[i].active);
-        writeStringToParcel(p, p_cur[i].type);
-        writeStringToParcel(p, p_cur[i].ifname);
-        writeStringToParcel(p, p_cur[i].addresses);
-        writeStringToParcel(p, p_cur[i].dnses);
-        writeStringToParcel(p, p_cur[i].gateways);
-        writeStringToParcel(p, p_cur[i].pcscf);
-        p.writeInt32(p_cur[i].mtu);
         appendPrintBuf("%s[status=%d,retry=%d,cid=%d,%s,%s,%s,%s,%s,%s,%s,mtu=%d],", printBuf,
         p_cur[i].status,
         p_cur[i].suggestedRetryTime,
@@ -3115,55 +3235,6 @@ static int responseCdmaInformationRecords(Parcel &p,
     return 0;
 }
 
-static void responseRilSignalStrengthV5(Parcel &p, RIL_SignalStrength_v10 *p_cur) {
-    p.writeInt32(p_cur->GW_SignalStrength.signalStrength);
-    p.writeInt32(p_cur->GW_SignalStrength.bitErrorRate);
-    p.writeInt32(p_cur->CDMA_SignalStrength.dbm);
-    p.writeInt32(p_cur->CDMA_SignalStrength.ecio);
-    p.writeInt32(p_cur->EVDO_SignalStrength.dbm);
-    p.writeInt32(p_cur->EVDO_SignalStrength.ecio);
-    p.writeInt32(p_cur->EVDO_SignalStrength.signalNoiseRatio);
-}
-
-static void responseRilSignalStrengthV6Extra(Parcel &p, RIL_SignalStrength_v10 *p_cur) {
-    /*
-     * Fixup LTE for backwards compatibility
-     */
-    // signalStrength: -1 -> 99
-    if (p_cur->LTE_SignalStrength.signalStrength == -1) {
-        p_cur->LTE_SignalStrength.signalStrength = 99;
-    }
-    // rsrp: -1 -> INT_MAX all other negative value to positive.
-    // So remap here
-    if (p_cur->LTE_SignalStrength.rsrp == -1) {
-        p_cur->LTE_SignalStrength.rsrp = INT_MAX;
-    } else if (p_cur->LTE_SignalStrength.rsrp < -1) {
-        p_cur->LTE_SignalStrength.rsrp = -p_cur->LTE_SignalStrength.rsrp;
-    }
-    // rsrq: -1 -> INT_MAX
-    if (p_cur->LTE_SignalStrength.rsrq == -1) {
-        p_cur->LTE_SignalStrength.rsrq = INT_MAX;
-    }
-    // Not remapping rssnr is already using INT_MAX
-
-    // cqi: -1 -> INT_MAX
-    if (p_cur->LTE_SignalStrength.cqi == -1) {
-        p_cur->LTE_SignalStrength.cqi = INT_MAX;
-    }
-
-    p.writeInt32(p_cur->LTE_SignalStrength.signalStrength);
-    p.writeInt32(p_cur->LTE_SignalStrength.rsrp);
-    p.writeInt32(p_cur->LTE_SignalStrength.rsrq);
-    p.writeInt32(p_cur->LTE_SignalStrength.rssnr);
-    p.writeInt32(p_cur->LTE_SignalStrength.cqi);
-}
-
-static void responseRilSignalStrengthV10(Parcel &p, RIL_SignalStrength_v10 *p_cur) {
-    responseRilSignalStrengthV5(p, p_cur);
-    responseRilSignalStrengthV6Extra(p, p_cur);
-    p.writeInt32(p_cur->TD_SCDMA_SignalStrength.rscp);
-}
-
 static int responseRilSignalStrength(Parcel &p,
                     void *response, size_t responselen) {
     if (response == NULL && responselen != 0) {
@@ -3172,26 +3243,19 @@ static int responseRilSignalStrength(Parcel &p,
     }
 
     RIL_SignalStrength_v10 *p_cur;
+    const RilSchema *schema;
     if (s_callbacks.version <= LAST_IMPRECISE_RIL_VERSION) {
         if (responselen >= sizeof (RIL_SignalStrength_v5)) {
             p_cur = ((RIL_SignalStrength_v10 *) response);
 
-            responseRilSignalStrengthV5(p, p_cur);
-
-            if (responselen >= sizeof (RIL_SignalStrength_v6)) {
-                responseRilSignalStrengthV6Extra(p, p_cur);
-                if (responselen >= sizeof (RIL_SignalStrength_v10)) {
-                    p.writeInt32(p_cur->TD_SCDMA_SignalStrength.rscp);
-                } else {
-                    p.writeInt32(INT_MAX);
-                }
+            if (responselen >= sizeof (RIL_SignalStrength_v10)) {
+                fixupLteSignalStrength(p_cur);
+                schema = &s_signalStrengthV10Schema;
+            } else if (responselen >= sizeof (RIL_SignalStrength_v6)) {
+                fixupLteSignalStrength(p_cur);
+                schema = &s_signalStrengthV6Schema;
             } else {
-                p.writeInt32(99);
-                p.writeInt32(INT_MAX);
-                p.writeInt32(INT_MAX);
-                p.writeInt32(INT_MAX);
-                p.writeInt32(INT_MAX);
-                p.writeInt32(INT_MAX);
+                schema = &s_signalStrengthV5Schema;
             }
         } else {
             RLOGE("invalid response length");
@@ -3207,8 +3271,11 @@ static int responseRilSignalStrength(Parcel &p,
             }
         }
         p_cur = ((RIL_SignalStrength_v10 *) response);
-        responseRilSignalStrengthV10(p, p_cur);
+        fixupLteSignalStrength(p_cur);
+        schema = &s_signalStrengthV10Schema;
     }
+    marshalSignalStrength(p, *schema, p_cur);
+
     startResponse;
     appendPrintBuf("%s[signalStrength=%d,bitErrorRate=%d,\
             CDMA_SS.dbm=%d,CDMA_SSecio=%d,\
@@ -3394,81 +3461,9 @@ static int responseCellInfoListV6(Parcel &p, void *response, size_t responselen)
     }
 
     int num = responselen / sizeof(RIL_CellInfo);
-    p.writeInt32(num);
+    marshalCellInfoList(p, false, response, num);
 
-    RIL_CellInfo *p_cur = (RIL_CellInfo *) response;
     startResponse;
-    int i;
-    for (i = 0; i < num; i++) {
-        p.writeInt32((int)p_cur->cellInfoType);
-        p.writeInt32(p_cur->registered);
-        p.writeInt32(p_cur->timeStampType);
-        p.writeInt64(p_cur->timeStamp);
-        switch(p_cur->cellInfoType) {
-            case RIL_CELL_INFO_TYPE_GSM: {
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mcc);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mnc);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.lac);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.cid);
-                p.writeInt32(INT_MAX); /* skip arfcn */
-                p.writeInt32(INT_MAX); /* skip bsic */
-                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.signalStrength);
-                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.bitErrorRate);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_WCDMA: {
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mcc);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mnc);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.lac);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.cid);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.psc);
-                p.writeInt32(INT_MAX); /* skip uarfcn */
-                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.signalStrength);
-                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.bitErrorRate);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_CDMA: {
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.networkId);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.systemId);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.basestationId);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.longitude);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.latitude);
-
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.dbm);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.ecio);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.dbm);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.ecio);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_LTE: {
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mcc);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mnc);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.ci);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.pci);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.tac);
-                p.writeInt32(INT_MAX); /* skip earfcn */
-
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.signalStrength);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrp);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrq);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rssnr);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.cqi);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.timingAdvance);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_TD_SCDMA: {
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mcc);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.lac);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cid);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cpid);
-                p.writeInt32(p_cur->CellInfo.tdscdma.signalStrengthTdscdma.rscp);
-                break;
-            }
-        }
-        p_cur += 1;
-    }
     removeLastChar;
     closeResponse;
 
@@ -3488,84 +3483,12 @@ static int responseCellInfoListV12(Parcel &p, void *response, size_t responselen
     }
 
     int num = responselen / sizeof(RIL_CellInfo_v12);
-    p.writeInt32(num);
+    marshalCellInfoList(p, true, response, num);
 
-    RIL_CellInfo_v12 *p_cur = (RIL_CellInfo_v12 *) response;
     startResponse;
-    int i;
-    for (i = 0; i < num; i++) {
-        p.writeInt32((int)p_cur->cellInfoType);
-        p.writeInt32(p_cur->registered);
-        p.writeInt32(p_cur->timeStampType);
-        p.writeInt64(p_cur->timeStamp);
-        switch(p_cur->cellInfoType) {
-            case RIL_CELL_INFO_TYPE_GSM: {
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mcc);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mnc);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.lac);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.cid);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.arfcn);
-                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.bsic);
-                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.signalStrength);
-                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.bitErrorRate);
-                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.timingAdvance);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_WCDMA: {
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mcc);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mnc);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.lac);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.cid);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.psc);
-                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.uarfcn);
-                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.signalStrength);
-                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.bitErrorRate);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_CDMA: {
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.networkId);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.systemId);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.basestationId);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.longitude);
-                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.latitude);
-
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.dbm);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.ecio);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.dbm);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.ecio);
-                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_LTE: {
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mcc);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mnc);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.ci);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.pci);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.tac);
-                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.earfcn);
-
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.signalStrength);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrp);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrq);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rssnr);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.cqi);
-                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.timingAdvance);
-                break;
-            }
-            case RIL_CELL_INFO_TYPE_TD_SCDMA: {
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mcc);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.lac);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cid);
-                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cpid);
-                p.writeInt32(p_cur->CellInfo.tdscdma.signalStrengthTdscdma.rscp);
-                break;
-            }
-        }
-        p_cur += 1;
-    }
     removeLastChar;
     closeResponse;
+
     return 0;
 }
 
@@ -3773,19 +3696,9 @@ static void rilEventAddWakeup(struct ril_event *ev) {
     triggerEvLoop();
 }
 
-static void sendSimStatusAppInfo(Parcel &p, int num_apps, RIL_AppStatus appStatus[]) {
-        p.writeInt32(num_apps);
+static void printSimStatusAppInfo(int num_apps, RIL_AppStatus appStatus[]) {
         startResponse;
         for (int i = 0; i < num_apps; i++) {
-            p.writeInt32(appStatus[i].app_type);
-            p.writeInt32(appStatus[i].app_state);
-            p.writeInt32(appStatus[i].perso_substate);
-            writeStringToParcel(p, (const char*)(appStatus[i].aid_ptr));
-            writeStringToParcel(p, (const char*)
-                                          (appStatus[i].app_label_ptr));
-            p.writeInt32(appStatus[i].pin1_replaced);
-            p.writeInt32(appStatus[i].pin1);
-            p.writeInt32(appStatus[i].pin2);
             appendPrintBuf("%s[app_type=%d,app_state=%d,perso_substate=%d,\
                     aid_ptr=%s,app_label_ptr=%s,pin1_replaced=%d,pin1=%d,pin2=%d],",
                     printBuf,
@@ -3801,28 +3714,32 @@ static void sendSimStatusAppInfo(Parcel &p, int num_apps, RIL_AppStatus appStatu
         closeResponse;
 }
 
-static void responseSimStatusV5(Parcel &p, void *response) {
+static int responseSimStatusV5(Parcel &p, void *response) {
     RIL_CardStatus_v5 *p_cur = ((RIL_CardStatus_v5 *) response);
 
-    p.writeInt32(p_cur->card_state);
-    p.writeInt32(p_cur->universal_pin_state);
-    p.writeInt32(p_cur->gsm_umts_subscription_app_index);
-    p.writeInt32(p_cur->cdma_subscription_app_index);
-    p.writeInt32(-1);
+    if (p_cur->num_applications < 0 || p_cur->num_applications > RIL_CARD_MAX_APPS) {
+        RLOGE("responseSimStatus: invalid num_applications %d", p_cur->num_applications);
+        return RIL_ERRNO_INVALID_RESPONSE;
+    }
 
-    sendSimStatusAppInfo(p, p_cur->num_applications, p_cur->applications);
+    marshalCardStatus(p, s_cardStatusV5Schema, p_cur, p_cur->applications,
+            p_cur->num_applications);
+    printSimStatusAppInfo(p_cur->num_applications, p_cur->applications);
+    return 0;
 }
 
-static void responseSimStatusV6(Parcel &p, void *response) {
+static int responseSimStatusV6(Parcel &p, void *response) {
     RIL_CardStatus_v6 *p_cur = ((RIL_CardStatus_v6 *) response);
 
-    p.writeInt32(p_cur->card_state);
-    p.writeInt32(p_cur->universal_pin_state);
-    p.writeInt32(p_cur->gsm_umts_subscription_app_index);
-    p.writeInt32(p_cur->cdma_subscription_app_index);
-    p.writeInt32(p_cur->ims_subscription_app_index);
+    if (p_cur->num_applications < 0 || p_cur->num_applications > RIL_CARD_MAX_APPS) {
+        RLOGE("responseSimStatus: invalid num_applications %d", p_cur->num_applications);
+        return RIL_ERRNO_INVALID_RESPONSE;
+    }
 
-    sendSimStatusAppInfo(p, p_cur->num_applications, p_cur->applications);
+    marshalCardStatus(p, s_cardStatusV6Schema, p_cur, p_cur->applications,
+            p_cur->num_applications);
+    printSimStatusAppInfo(p_cur->num_applications, p_cur->applications);
+    return 0;
 }
 
 static int responseSimStatus(Parcel &p, void *response, size_t responselen) {
@@ -3835,9 +3752,9 @@ static int responseSimStatus(Parcel &p, void *response, size_t responselen) {
 
     if (s_callbacks.version <= LAST_IMPRECISE_RIL_VERSION) {
         if (responselen == sizeof (RIL_CardStatus_v6)) {
-            responseSimStatusV6(p, response);
+            return responseSimStatusV6(p, response);
         } else if (responselen == sizeof (RIL_CardStatus_v5)) {
-            responseSimStatusV5(p, response);
+            return responseSimStatusV5(p, response);
         } else {
             RLOGE("responseSimStatus: A RilCardStatus_v6 or _v5 expected\n");
             return RIL_ERRNO_INVALID_RESPONSE;
@@ -3851,10 +3768,8 @@ static int responseSimStatus(Parcel &p, void *response, size_t responselen) {
                 assert(0);
             }
         }
-        responseSimStatusV6(p, response);
+        return responseSimStatusV6(p, response);
     }
-
-    return 0;
 }
 
 static int responseGsmBrSmsCnf(Parcel &p, void *response, size_t responselen) {
@@ -4602,6 +4517,26 @@ static void debugCallback (int fd, short flags, void *param) {
             issueLocalRequest(RIL_REQUEST_HANGUP, &hangupData,
                               sizeof(hangupData), socket_id);
             break;
+        case 11:
+            RLOGI("Debug port: Parcel stats");
+            dumpParcelStats();
+            break;
+        case 12:
+            RLOGI("Debug port: SAP trace level %s", args[1]);
+            RilSapSocket::setTraceLevel(atoi(args[1]));
+            break;
+        case 13:
+            RLOGI("Debug port: SAP capture %s", args[1]);
+            if (strcmp(args[1], "off") == 0) {
+                RilSapSocket::stopCapture();
+            } else {
+                RilSapSocket::startCapture(args[1]);
+            }
+            break;
+        case 14:
+            RLOGI("Debug port: SAP stats");
+            RilSapSocket::dumpStats();
+            break;
         default:
             RLOGE ("Invalid request");
             break;
@@ -4908,6 +4843,15 @@ RIL_register (const RIL_RadioFunctions *callbacks) {
     rilEventAddWakeup (&s_debug_event);
 #endif
 
+    // start the read-only monitor socket for unsolicited responses
+
+    char rilmonitor[MAX_MONITOR_SOCKET_NAME_LENGTH] = SOCKET_NAME_RIL_MONITOR;
+    if (inst != NULL) {
+        strlcat(rilmonitor, inst, MAX_MONITOR_SOCKET_NAME_LENGTH);
+    }
+
+    rilMonitorStart(rilmonitor);
+
 }
 
 extern "C" void
@@ -5089,7 +5033,9 @@ RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responsel
         pRI->token, requestToString(pRI->pCI->requestNumber));
 
     if (pRI->cancelled == 0) {
-        Parcel p;
+        ParcelStats *p_stats = &s_requestParcelStats[pRI->pCI - s_commands];
+        size_t capacity;
+        Parcel &p = *obtainResponseParcel(p_stats, &capacity);
 
         if (s_callbacks.version >= 13 && pRI->wasAckSent == 1) {
             // If ack was already sent, then this call is an asynchronous response. So we need to
@@ -5124,6 +5070,7 @@ RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responsel
             RLOGD ("RIL onRequestComplete: Command channel closed");
         }
         sendResponse(p, socket_id);
+        releaseResponseParcel(&p, p_stats, capacity);
     }
 
 done:
@@ -5383,7 +5330,10 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
 
     appendPrintBuf("[UNSL]< %s", requestToString(unsolResponse));
 
-    Parcel p;
+    ParcelStats *p_stats = &s_unsolParcelStats[unsolResponseIndex];
+    size_t capacity;
+    Parcel &p = *obtainResponseParcel(p_stats, &capacity);
+
     if (s_callbacks.version >= 13
                 && s_unsolResponses[unsolResponseIndex].wakeType == WAKE_PARTIAL) {
         p.writeInt32 (RESPONSE_UNSOLICITED_ACK_EXP);
@@ -5440,6 +5390,7 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
     RLOGI("%s UNSOLICITED: %s length:%d", rilSocketIdToString(soc_id), requestToString(unsolResponse), p.dataSize());
 #endif
     ret = sendResponse(p, soc_id);
+    rilMonitorPublish(p.data(), p.dataSize(), soc_id);
     if (ret != 0 && unsolResponse == RIL_UNSOL_NITZ_TIME_RECEIVED) {
 
         // Unfortunately, NITZ time is not poll/update like everything
@@ -5462,9 +5413,11 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
     }
 
     // Normal exit
+    releaseResponseParcel(&p, p_stats, capacity);
     return;
 
 error_exit:
+    releaseResponseParcel(&p, p_stats, capacity);
     if (shouldScheduleTimeout) {
         releaseWakeLock();
     }
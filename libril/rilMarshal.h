@@ -0,0 +1,443 @@
+/* //device/libs/telephony/rilMarshal.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef RIL_MARSHAL_H
+#define RIL_MARSHAL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <telephony/ril.h>
+#include <binder/Parcel.h>
+#include <cutils/jstring.h>
+
+namespace android {
+
+/*
+ * Response structs are described by tables of fields in the order they go
+ * on the wire, one table per struct version. The fixed part of each
+ * table's wire size is worked out at compile time, so a response only
+ * needs to measure its strings to know its exact size: the parcel is
+ * grown once up front, runs of adjacent ints are copied in one write, and
+ * strings are converted to UTF-16 straight into the parcel.
+ */
+
+enum RilFieldType {
+    RIL_FIELD_INTS,         // count ints from offset, copied as a block
+    RIL_FIELD_UINT8,        // a uint8_t at offset, widened to an int
+    RIL_FIELD_INT64,        // a 64-bit int at offset
+    RIL_FIELD_STRINGS,      // count char *'s from offset, as String16s
+    RIL_FIELD_CONST,        // count copies of value, for fields the struct lacks
+};
+
+struct RilField {
+    RilFieldType type;
+    size_t offset;
+    size_t count;
+    int32_t value;
+};
+
+struct RilSchema {
+    const RilField *fields;
+    size_t numFields;
+    size_t fixedSize;       // wire size less the characters of any strings
+    size_t numStrings;
+};
+
+static constexpr size_t rilFieldFixedSize(const RilField &f) {
+    return f.count * (f.type == RIL_FIELD_INT64 ? sizeof(int64_t) : sizeof(int32_t));
+}
+
+static constexpr size_t rilFieldsFixedSize(const RilField *f, size_t n) {
+    return n == 0 ? 0 : rilFieldFixedSize(*f) + rilFieldsFixedSize(f + 1, n - 1);
+}
+
+static constexpr size_t rilFieldsStrings(const RilField *f, size_t n) {
+    return n == 0 ? 0 : (f->type == RIL_FIELD_STRINGS ? f->count : 0)
+            + rilFieldsStrings(f + 1, n - 1);
+}
+
+#define RIL_INTS(type, first, last) \
+    { RIL_FIELD_INTS, offsetof(type, first), \
+      (offsetof(type, last) - offsetof(type, first)) / sizeof(int) + 1, 0 }
+#define RIL_UINT8(type, field) \
+    { RIL_FIELD_UINT8, offsetof(type, field), 1, 0 }
+#define RIL_INT64(type, field) \
+    { RIL_FIELD_INT64, offsetof(type, field), 1, 0 }
+#define RIL_STRINGS(type, first, last) \
+    { RIL_FIELD_STRINGS, offsetof(type, first), \
+      (offsetof(type, last) - offsetof(type, first)) / sizeof(char *) + 1, 0 }
+#define RIL_CONST(value, count) \
+    { RIL_FIELD_CONST, 0, count, value }
+
+#define RIL_SCHEMA(name, ...) \
+    static constexpr RilField name##Fields[] = { __VA_ARGS__ }; \
+    static constexpr RilSchema name = { name##Fields, \
+            sizeof(name##Fields) / sizeof(name##Fields[0]), \
+            rilFieldsFixedSize(name##Fields, \
+                    sizeof(name##Fields) / sizeof(name##Fields[0])), \
+            rilFieldsStrings(name##Fields, \
+                    sizeof(name##Fields) / sizeof(name##Fields[0])) }
+
+/*** Data call lists ***/
+
+RIL_SCHEMA(s_dataCallV4Schema,
+    RIL_INTS(RIL_Data_Call_Response_v4, cid, active),
+    RIL_STRINGS(RIL_Data_Call_Response_v4, type, type),
+    // apn is not used, so don't send.
+    RIL_STRINGS(RIL_Data_Call_Response_v4, address, address));
+
+RIL_SCHEMA(s_dataCallV6Schema,
+    RIL_INTS(RIL_Data_Call_Response_v6, status, active),
+    RIL_STRINGS(RIL_Data_Call_Response_v6, type, gateways));
+
+RIL_SCHEMA(s_dataCallV9Schema,
+    RIL_INTS(RIL_Data_Call_Response_v9, status, active),
+    RIL_STRINGS(RIL_Data_Call_Response_v9, type, pcscf));
+
+RIL_SCHEMA(s_dataCallV11Schema,
+    RIL_INTS(RIL_Data_Call_Response_v11, status, active),
+    RIL_STRINGS(RIL_Data_Call_Response_v11, type, pcscf),
+    RIL_INTS(RIL_Data_Call_Response_v11, mtu, mtu));
+
+/*** Signal strength ***/
+
+// LTE and TD-SCDMA are reported as unknown for a RIL_SignalStrength_v5
+RIL_SCHEMA(s_signalStrengthV5Schema,
+    RIL_INTS(RIL_SignalStrength_v10, GW_SignalStrength.signalStrength,
+            EVDO_SignalStrength.signalNoiseRatio),
+    RIL_CONST(99, 1),
+    RIL_CONST(INT_MAX, 5));
+
+// TD-SCDMA is reported as unknown for a RIL_SignalStrength_v6 or _v8
+RIL_SCHEMA(s_signalStrengthV6Schema,
+    RIL_INTS(RIL_SignalStrength_v10, GW_SignalStrength.signalStrength,
+            LTE_SignalStrength.cqi),
+    RIL_CONST(INT_MAX, 1));
+
+RIL_SCHEMA(s_signalStrengthV10Schema,
+    RIL_INTS(RIL_SignalStrength_v10, GW_SignalStrength.signalStrength,
+            LTE_SignalStrength.cqi),
+    RIL_INTS(RIL_SignalStrength_v10, TD_SCDMA_SignalStrength.rscp,
+            TD_SCDMA_SignalStrength.rscp));
+
+/*** SIM status ***/
+
+RIL_SCHEMA(s_cardStatusV5Schema,
+    RIL_INTS(RIL_CardStatus_v5, card_state, cdma_subscription_app_index),
+    RIL_CONST(-1, 1),       // ims_subscription_app_index
+    RIL_INTS(RIL_CardStatus_v5, num_applications, num_applications));
+
+RIL_SCHEMA(s_cardStatusV6Schema,
+    RIL_INTS(RIL_CardStatus_v6, card_state, num_applications));
+
+RIL_SCHEMA(s_appStatusSchema,
+    RIL_INTS(RIL_AppStatus, app_type, perso_substate),
+    RIL_STRINGS(RIL_AppStatus, aid_ptr, app_label_ptr),
+    RIL_INTS(RIL_AppStatus, pin1_replaced, pin2));
+
+/*** Cell info lists ***/
+
+#define RIL_CELL_INFO_HEADER(type) \
+    RIL_INTS(type, cellInfoType, timeStampType), \
+    RIL_INT64(type, timeStamp)
+
+// for a cell type this version doesn't know of, as the old code did
+RIL_SCHEMA(s_cellInfoUnknownSchema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo));
+
+RIL_SCHEMA(s_cellInfoGsmV6Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo),
+    RIL_INTS(RIL_CellInfo, CellInfo.gsm.cellIdentityGsm.mcc,
+            CellInfo.gsm.cellIdentityGsm.cid),
+    RIL_CONST(INT_MAX, 2),  // arfcn, bsic
+    RIL_INTS(RIL_CellInfo, CellInfo.gsm.signalStrengthGsm.signalStrength,
+            CellInfo.gsm.signalStrengthGsm.bitErrorRate));
+
+RIL_SCHEMA(s_cellInfoWcdmaV6Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo),
+    RIL_INTS(RIL_CellInfo, CellInfo.wcdma.cellIdentityWcdma.mcc,
+            CellInfo.wcdma.cellIdentityWcdma.psc),
+    RIL_CONST(INT_MAX, 1),  // uarfcn
+    RIL_INTS(RIL_CellInfo, CellInfo.wcdma.signalStrengthWcdma.signalStrength,
+            CellInfo.wcdma.signalStrengthWcdma.bitErrorRate));
+
+RIL_SCHEMA(s_cellInfoCdmaV6Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo),
+    RIL_INTS(RIL_CellInfo, CellInfo.cdma.cellIdentityCdma.networkId,
+            CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio));
+
+RIL_SCHEMA(s_cellInfoLteV6Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo),
+    RIL_INTS(RIL_CellInfo, CellInfo.lte.cellIdentityLte.mcc,
+            CellInfo.lte.cellIdentityLte.tac),
+    RIL_CONST(INT_MAX, 1),  // earfcn
+    RIL_INTS(RIL_CellInfo, CellInfo.lte.signalStrengthLte.signalStrength,
+            CellInfo.lte.signalStrengthLte.timingAdvance));
+
+RIL_SCHEMA(s_cellInfoTdscdmaV6Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo),
+    RIL_INTS(RIL_CellInfo, CellInfo.tdscdma.cellIdentityTdscdma.mcc,
+            CellInfo.tdscdma.signalStrengthTdscdma.rscp));
+
+RIL_SCHEMA(s_cellInfoGsmV12Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo_v12),
+    RIL_INTS(RIL_CellInfo_v12, CellInfo.gsm.cellIdentityGsm.mcc,
+            CellInfo.gsm.cellIdentityGsm.arfcn),
+    RIL_UINT8(RIL_CellInfo_v12, CellInfo.gsm.cellIdentityGsm.bsic),
+    RIL_INTS(RIL_CellInfo_v12, CellInfo.gsm.signalStrengthGsm.signalStrength,
+            CellInfo.gsm.signalStrengthGsm.timingAdvance));
+
+RIL_SCHEMA(s_cellInfoWcdmaV12Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo_v12),
+    RIL_INTS(RIL_CellInfo_v12, CellInfo.wcdma.cellIdentityWcdma.mcc,
+            CellInfo.wcdma.signalStrengthWcdma.bitErrorRate));
+
+RIL_SCHEMA(s_cellInfoCdmaV12Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo_v12),
+    RIL_INTS(RIL_CellInfo_v12, CellInfo.cdma.cellIdentityCdma.networkId,
+            CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio));
+
+RIL_SCHEMA(s_cellInfoLteV12Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo_v12),
+    RIL_INTS(RIL_CellInfo_v12, CellInfo.lte.cellIdentityLte.mcc,
+            CellInfo.lte.signalStrengthLte.timingAdvance));
+
+RIL_SCHEMA(s_cellInfoTdscdmaV12Schema,
+    RIL_CELL_INFO_HEADER(RIL_CellInfo_v12),
+    RIL_INTS(RIL_CellInfo_v12, CellInfo.tdscdma.cellIdentityTdscdma.mcc,
+            CellInfo.tdscdma.signalStrengthTdscdma.rscp));
+
+static inline const RilSchema &
+cellInfoSchema(RIL_CellInfoType type, bool v12) {
+    switch (type) {
+        case RIL_CELL_INFO_TYPE_GSM:
+            return v12 ? s_cellInfoGsmV12Schema : s_cellInfoGsmV6Schema;
+        case RIL_CELL_INFO_TYPE_WCDMA:
+            return v12 ? s_cellInfoWcdmaV12Schema : s_cellInfoWcdmaV6Schema;
+        case RIL_CELL_INFO_TYPE_CDMA:
+            return v12 ? s_cellInfoCdmaV12Schema : s_cellInfoCdmaV6Schema;
+        case RIL_CELL_INFO_TYPE_LTE:
+            return v12 ? s_cellInfoLteV12Schema : s_cellInfoLteV6Schema;
+        case RIL_CELL_INFO_TYPE_TD_SCDMA:
+            return v12 ? s_cellInfoTdscdmaV12Schema : s_cellInfoTdscdmaV6Schema;
+    }
+    return s_cellInfoUnknownSchema;
+}
+
+/*** Marshalling ***/
+
+/** bytes a String16 of s takes after its length word */
+static inline size_t
+string16Size(const char *s) {
+    if (s == NULL) {
+        return 0;
+    }
+    return ((strlen8to16(s) + 1) * sizeof(char16_t) + 3) & ~(size_t)3;
+}
+
+/** same wire format as Parcel::writeString16(), without the copy */
+static inline void
+writeString16(Parcel &p, const char *s) {
+    size_t len;
+    char16_t *s16;
+
+    if (s == NULL) {
+        p.writeInt32(-1);
+        return;
+    }
+
+    len = strlen8to16(s);
+    p.writeInt32(len);
+
+    s16 = (char16_t *) p.writeInplace((len + 1) * sizeof(char16_t));
+    if (s16 != NULL) {
+        strcpy8to16(s16, s, &len);
+        s16[len] = 0;
+    }
+}
+
+static inline size_t
+schemaSize(const RilSchema &schema, const void *base) {
+    size_t size = schema.fixedSize;
+
+    if (schema.numStrings == 0) {
+        return size;
+    }
+
+    for (size_t i = 0 ; i < schema.numFields ; i++) {
+        const RilField &f = schema.fields[i];
+
+        if (f.type == RIL_FIELD_STRINGS) {
+            char * const *strings = (char * const *)((const char *) base + f.offset);
+
+            for (size_t j = 0 ; j < f.count ; j++) {
+                size += string16Size(strings[j]);
+            }
+        }
+    }
+
+    return size;
+}
+
+static inline void
+schemaWrite(Parcel &p, const RilSchema &schema, const void *base) {
+    const char *cur = (const char *) base;
+
+    for (size_t i = 0 ; i < schema.numFields ; i++) {
+        const RilField &f = schema.fields[i];
+
+        switch (f.type) {
+            case RIL_FIELD_INTS:
+                p.write(cur + f.offset, f.count * sizeof(int32_t));
+                break;
+            case RIL_FIELD_UINT8:
+                p.writeInt32(*(const uint8_t *)(cur + f.offset));
+                break;
+            case RIL_FIELD_INT64:
+                p.writeInt64(*(const int64_t *)(cur + f.offset));
+                break;
+            case RIL_FIELD_STRINGS: {
+                char * const *strings = (char * const *)(cur + f.offset);
+
+                for (size_t j = 0 ; j < f.count ; j++) {
+                    writeString16(p, strings[j]);
+                }
+                break;
+            }
+            case RIL_FIELD_CONST:
+                for (size_t j = 0 ; j < f.count ; j++) {
+                    p.writeInt32(f.value);
+                }
+                break;
+        }
+    }
+}
+
+/** grows the parcel, at most once, to take size more bytes */
+static inline void
+reserveParcel(Parcel &p, size_t size) {
+    size_t needed = p.dataPosition() + size;
+
+    if (needed > p.dataCapacity()) {
+        p.setDataCapacity(needed);
+    }
+}
+
+/**
+ * Writes the ints in prefix, then num structs stride bytes apart, each
+ * laid out by the schema schemaOf() returns for it.
+ */
+template <typename SchemaOf>
+static inline void
+marshalList(Parcel &p, const int32_t *prefix, size_t prefixLen,
+        const void *base, size_t stride, size_t num, SchemaOf schemaOf) {
+    const char *cur = (const char *) base;
+    size_t size = prefixLen * sizeof(int32_t);
+
+    for (size_t i = 0 ; i < num ; i++) {
+        size += schemaSize(schemaOf(cur + i * stride), cur + i * stride);
+    }
+
+    reserveParcel(p, size);
+    p.write(prefix, prefixLen * sizeof(int32_t));
+
+    for (size_t i = 0 ; i < num ; i++) {
+        schemaWrite(p, schemaOf(cur + i * stride), cur + i * stride);
+    }
+}
+
+/** version, count, then each RIL_Data_Call_Response_vN */
+static inline void
+marshalDataCallList(Parcel &p, const RilSchema &schema, int32_t version,
+        const void *response, size_t stride, size_t num) {
+    int32_t prefix[2] = { version, (int32_t) num };
+
+    marshalList(p, prefix, 2, response, stride, num,
+            [&schema](const void *) -> const RilSchema & { return schema; });
+}
+
+/** count, then each RIL_CellInfo or RIL_CellInfo_v12 */
+static inline void
+marshalCellInfoList(Parcel &p, bool v12, const void *response, size_t num) {
+    int32_t prefix[1] = { (int32_t) num };
+
+    // cellInfoType comes first in both versions
+    marshalList(p, prefix, 1, response,
+            v12 ? sizeof(RIL_CellInfo_v12) : sizeof(RIL_CellInfo), num,
+            [v12](const void *cell) -> const RilSchema & {
+                return cellInfoSchema(*(const RIL_CellInfoType *) cell, v12);
+            });
+}
+
+/** remaps a v6 or later response's LTE fields in place, before marshalling */
+static inline void
+fixupLteSignalStrength(RIL_SignalStrength_v10 *p_cur) {
+    /*
+     * Fixup LTE for backwards compatibility
+     */
+    // signalStrength: -1 -> 99
+    if (p_cur->LTE_SignalStrength.signalStrength == -1) {
+        p_cur->LTE_SignalStrength.signalStrength = 99;
+    }
+    // rsrp: -1 -> INT_MAX all other negative value to positive.
+    // So remap here
+    if (p_cur->LTE_SignalStrength.rsrp == -1) {
+        p_cur->LTE_SignalStrength.rsrp = INT_MAX;
+    } else if (p_cur->LTE_SignalStrength.rsrp < -1) {
+        p_cur->LTE_SignalStrength.rsrp = -p_cur->LTE_SignalStrength.rsrp;
+    }
+    // rsrq: -1 -> INT_MAX
+    if (p_cur->LTE_SignalStrength.rsrq == -1) {
+        p_cur->LTE_SignalStrength.rsrq = INT_MAX;
+    }
+    // Not remapping rssnr is already using INT_MAX
+
+    // cqi: -1 -> INT_MAX
+    if (p_cur->LTE_SignalStrength.cqi == -1) {
+        p_cur->LTE_SignalStrength.cqi = INT_MAX;
+    }
+}
+
+static inline void
+marshalSignalStrength(Parcel &p, const RilSchema &schema,
+        const RIL_SignalStrength_v10 *response) {
+    reserveParcel(p, schema.fixedSize);
+    schemaWrite(p, schema, response);
+}
+
+/** RIL_CardStatus_v5 or _v6, whose applications num_apps already checked */
+static inline void
+marshalCardStatus(Parcel &p, const RilSchema &schema, const void *response,
+        const RIL_AppStatus *apps, size_t num_apps) {
+    size_t size = schemaSize(schema, response);
+
+    for (size_t i = 0 ; i < num_apps ; i++) {
+        size += schemaSize(s_appStatusSchema, &apps[i]);
+    }
+
+    reserveParcel(p, size);
+    schemaWrite(p, schema, response);
+
+    for (size_t i = 0 ; i < num_apps ; i++) {
+        schemaWrite(p, s_appStatusSchema, &apps[i]);
+    }
+}
+
+} // namespace android
+
+#endif /*RIL_MARSHAL_H*/
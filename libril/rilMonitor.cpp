@@ -0,0 +1,358 @@
+/* //device/libs/telephony/rilMonitor.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#define LOG_TAG "RILC"
+
+#include <cutils/sockets.h>
+#include <utils/Log.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rilMonitor.h"
+
+namespace android {
+
+/*
+ * One unsolicited response, framed for the subscribers and shared by all
+ * of their queues. Only the monitor thread releases references.
+ */
+typedef struct MonitorRecord {
+    int refCount;
+    size_t size;
+    uint8_t data[];
+} MonitorRecord;
+
+typedef struct MonitorSubscriber {
+    int fd;                 // -1 if the slot is free
+    MonitorRecord *queue[RIL_MONITOR_QUEUE_MAX];
+    size_t head;
+    size_t count;
+    size_t offset;          // bytes of queue[head] already written
+    uint64_t sent;
+    uint64_t dropped;
+} MonitorSubscriber;
+
+/*
+ * s_subscribers and s_numSubscribers are protected by s_monitorMutex;
+ * only the monitor thread adds or removes subscribers and writes to them
+ */
+static pthread_mutex_t s_monitorMutex = PTHREAD_MUTEX_INITIALIZER;
+static MonitorSubscriber s_subscribers[RIL_MONITOR_MAX_SUBSCRIBERS];
+static int s_numSubscribers = 0;
+
+static int s_fdMonitorListen = -1;
+static int s_fdMonitorWakeupRead = -1;
+static int s_fdMonitorWakeupWrite = -1;
+
+static void releaseRecord(MonitorRecord *record) {
+    if (--record->refCount == 0) {
+        free(record);
+    }
+}
+
+static void closeSubscriber(MonitorSubscriber *sub) {
+    int fd;
+
+    pthread_mutex_lock(&s_monitorMutex);
+
+    while (sub->count > 0) {
+        releaseRecord(sub->queue[sub->head]);
+        sub->head = (sub->head + 1) % RIL_MONITOR_QUEUE_MAX;
+        sub->count--;
+    }
+    fd = sub->fd;
+    sub->fd = -1;
+    __atomic_store_n(&s_numSubscribers, s_numSubscribers - 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&s_monitorMutex);
+
+    RLOGI("libril: monitor disconnected, %llu sent, %llu dropped",
+            (unsigned long long)sub->sent, (unsigned long long)sub->dropped);
+    close(fd);
+}
+
+static void acceptSubscriber() {
+    MonitorSubscriber *sub = NULL;
+    int fd;
+
+    fd = accept(s_fdMonitorListen, NULL, NULL);
+    if (fd < 0) {
+        RLOGE("Error on monitor accept() errno:%d", errno);
+        return;
+    }
+
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+        RLOGE("Error setting O_NONBLOCK errno:%d", errno);
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&s_monitorMutex);
+
+    for (int i = 0 ; i < RIL_MONITOR_MAX_SUBSCRIBERS ; i++) {
+        if (s_subscribers[i].fd < 0) {
+            sub = &s_subscribers[i];
+            break;
+        }
+    }
+
+    if (sub != NULL) {
+        memset(sub, 0, sizeof(*sub));
+        sub->fd = fd;
+        __atomic_store_n(&s_numSubscribers, s_numSubscribers + 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&s_monitorMutex);
+
+    if (sub == NULL) {
+        RLOGE("libril: too many monitors, closing new connection");
+        close(fd);
+        return;
+    }
+
+    RLOGI("libril: new monitor connection");
+}
+
+/**
+ * Write queued records until the socket would block.
+ * Returns -1 if the subscriber has gone.
+ */
+static int flushSubscriber(MonitorSubscriber *sub) {
+    for (;;) {
+        MonitorRecord *record;
+        size_t offset;
+        ssize_t written;
+
+        pthread_mutex_lock(&s_monitorMutex);
+        record = sub->count > 0 ? sub->queue[sub->head] : NULL;
+        offset = sub->offset;
+        pthread_mutex_unlock(&s_monitorMutex);
+
+        if (record == NULL) {
+            return 0;
+        }
+
+        // the head record stays queued until this thread pops it
+        do {
+            written = send(sub->fd, record->data + offset, record->size - offset,
+                    MSG_NOSIGNAL);
+        } while (written < 0 && errno == EINTR);
+
+        if (written < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+
+        pthread_mutex_lock(&s_monitorMutex);
+        sub->offset += written;
+        if (sub->offset == record->size) {
+            sub->head = (sub->head + 1) % RIL_MONITOR_QUEUE_MAX;
+            sub->count--;
+            sub->offset = 0;
+            sub->sent++;
+            releaseRecord(record);
+        }
+        pthread_mutex_unlock(&s_monitorMutex);
+    }
+}
+
+/**
+ * Subscribers are read-only; reads are only to notice them hang up.
+ * Returns -1 if the subscriber has gone.
+ */
+static int drainSubscriber(MonitorSubscriber *sub) {
+    char buff[64];
+    ssize_t ret;
+
+    do {
+        ret = read(sub->fd, buff, sizeof(buff));
+    } while (ret > 0 || (ret < 0 && errno == EINTR));
+
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    return -1;
+}
+
+static void *monitorLoop(void *param) {
+    struct pollfd fds[2 + RIL_MONITOR_MAX_SUBSCRIBERS];
+    MonitorSubscriber *subs[RIL_MONITOR_MAX_SUBSCRIBERS];
+
+    for (;;) {
+        int nfds = 2;
+        int ret;
+
+        fds[0].fd = s_fdMonitorWakeupRead;
+        fds[0].events = POLLIN;
+        fds[1].fd = s_fdMonitorListen;
+        fds[1].events = POLLIN;
+
+        pthread_mutex_lock(&s_monitorMutex);
+        for (int i = 0 ; i < RIL_MONITOR_MAX_SUBSCRIBERS ; i++) {
+            MonitorSubscriber *sub = &s_subscribers[i];
+
+            if (sub->fd >= 0) {
+                fds[nfds].fd = sub->fd;
+                fds[nfds].events = POLLIN | (sub->count > 0 ? POLLOUT : 0);
+                subs[nfds - 2] = sub;
+                nfds++;
+            }
+        }
+        pthread_mutex_unlock(&s_monitorMutex);
+
+        ret = poll(fds, nfds, -1);
+        if (ret < 0) {
+            if (errno != EINTR) {
+                RLOGE("monitor poll() error errno:%d", errno);
+                sleep(1);
+            }
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char buff[16];
+
+            while (read(s_fdMonitorWakeupRead, buff, sizeof(buff)) > 0) {
+                // drain the wakeups; the queues say what to write
+            }
+        }
+
+        for (int i = 2 ; i < nfds ; i++) {
+            MonitorSubscriber *sub = subs[i - 2];
+            short revents = fds[i].revents;
+
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) && drainSubscriber(sub) < 0) {
+                closeSubscriber(sub);
+            } else if ((revents & POLLOUT) && flushSubscriber(sub) < 0) {
+                closeSubscriber(sub);
+            }
+        }
+
+        // after the closes, so that a freed slot can be taken
+        if (fds[1].revents & POLLIN) {
+            acceptSubscriber();
+        }
+    }
+
+    return NULL;
+}
+
+void rilMonitorStart(const char *socketName) {
+    pthread_attr_t attr;
+    pthread_t tid;
+    int filedes[2];
+    int ret;
+
+    for (int i = 0 ; i < RIL_MONITOR_MAX_SUBSCRIBERS ; i++) {
+        s_subscribers[i].fd = -1;
+    }
+
+    s_fdMonitorListen = android_get_control_socket(socketName);
+    if (s_fdMonitorListen < 0) {
+        // optional; init only creates it if rild.rc asks
+        RLOGI("No monitor socket %s", socketName);
+        return;
+    }
+
+    ret = listen(s_fdMonitorListen, 4);
+    if (ret < 0) {
+        RLOGE("Failed to listen on ril monitor socket '%d': %s",
+             s_fdMonitorListen, strerror(errno));
+        return;
+    }
+
+    ret = pipe(filedes);
+    if (ret < 0) {
+        RLOGE("Error in pipe() errno:%d", errno);
+        return;
+    }
+
+    s_fdMonitorWakeupRead = filedes[0];
+    s_fdMonitorWakeupWrite = filedes[1];
+
+    fcntl(s_fdMonitorWakeupRead, F_SETFL, O_NONBLOCK);
+    fcntl(s_fdMonitorWakeupWrite, F_SETFL, O_NONBLOCK);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    ret = pthread_create(&tid, &attr, monitorLoop, NULL);
+    if (ret != 0) {
+        RLOGE("Failed to create monitor thread: %s", strerror(ret));
+    }
+}
+
+void rilMonitorPublish(const void *data, size_t dataSize, RIL_SOCKET_ID socket_id) {
+    MonitorRecord *record;
+    uint32_t header[2];
+    int refs = 0;
+    int ret;
+
+    if (__atomic_load_n(&s_numSubscribers, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    record = (MonitorRecord *)malloc(sizeof(MonitorRecord) + sizeof(header) + dataSize);
+    if (record == NULL) {
+        RLOGE("Memory allocation failed in rilMonitorPublish");
+        return;
+    }
+
+    header[0] = htonl(sizeof(uint32_t) + dataSize);
+    header[1] = htonl((uint32_t)socket_id);
+    record->size = sizeof(header) + dataSize;
+    memcpy(record->data, header, sizeof(header));
+    memcpy(record->data + sizeof(header), data, dataSize);
+
+    pthread_mutex_lock(&s_monitorMutex);
+
+    for (int i = 0 ; i < RIL_MONITOR_MAX_SUBSCRIBERS ; i++) {
+        MonitorSubscriber *sub = &s_subscribers[i];
+
+        if (sub->fd < 0) {
+            continue;
+        } else if (sub->count == RIL_MONITOR_QUEUE_MAX) {
+            sub->dropped++;
+            continue;
+        }
+
+        sub->queue[(sub->head + sub->count) % RIL_MONITOR_QUEUE_MAX] = record;
+        sub->count++;
+        refs++;
+    }
+    record->refCount = refs;
+
+    pthread_mutex_unlock(&s_monitorMutex);
+
+    if (refs == 0) {
+        free(record);
+        return;
+    }
+
+    do {
+        ret = write(s_fdMonitorWakeupWrite, " ", 1);
+    } while (ret < 0 && errno == EINTR);
+}
+
+} // namespace android
@@ -0,0 +1,66 @@
+/* //device/libs/telephony/rilMonitor.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef RIL_MONITOR_H
+#define RIL_MONITOR_H 1
+
+#include <stddef.h>
+#include <telephony/ril.h>
+
+/*
+ * Read-only subscribers to the unsolicited responses sent on the rild
+ * command sockets, for diagnostic and test tools that must not take the
+ * framework's connection.
+ *
+ * A subscriber connects to the rild-monitor socket and reads records of
+ *
+ *   uint32_t length          of the rest of the record, big endian
+ *   uint32_t socket id       RIL_SOCKET_ID, big endian
+ *   uint8_t  parcel[]        as sent on that command socket
+ *
+ * Anything it writes is discarded. Each unsolicited Parcel is copied once
+ * for all subscribers and written to them by the monitor thread, so the
+ * command sockets never wait on a subscriber. A subscriber that falls
+ * RIL_MONITOR_QUEUE_MAX records behind misses records until it catches up.
+ */
+
+#define SOCKET_NAME_RIL_MONITOR "rild-monitor"
+#define MAX_MONITOR_SOCKET_NAME_LENGTH 16
+
+// Subscribers beyond this are closed as soon as they connect
+#define RIL_MONITOR_MAX_SUBSCRIBERS 4
+
+// Records queued for one subscriber
+#define RIL_MONITOR_QUEUE_MAX 64
+
+namespace android {
+
+/**
+ * Start accepting subscribers on the named control socket. Does nothing
+ * if init did not create it.
+ */
+void rilMonitorStart(const char *socketName);
+
+/**
+ * Queue an unsolicited response, as written to the command socket, for
+ * every subscriber. Cheap when there are none.
+ */
+void rilMonitorPublish(const void *data, size_t dataSize, RIL_SOCKET_ID socket_id);
+
+} // namespace android
+
+#endif // RIL_MONITOR_H
@@ -14,32 +14,67 @@
 * limitations under the License.
 */
 
+#ifndef RIL_SOCKET_QUEUE_H_INCLUDED
+#define RIL_SOCKET_QUEUE_H_INCLUDED
+
 #include "pb_decode.h"
 #include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <hardware/ril/librilutils/proto/sap-api.pb.h>
 #include <utils/Log.h>
 
 using namespace std;
 
+/**
+ * Requests a queue holds before enqueue() refuses more.
+ */
+#define RIL_QUEUE_DEFAULT_CAPACITY 64
+
+/**
+ * Buckets of the token index; a power of two.
+ */
+#define RIL_QUEUE_INDEX_BUCKETS 16
+
+/**
+ * Counters kept by a queue, read with Ril_queue::getStats().
+ */
+typedef struct {
+    size_t depth;           // elements queued now
+    size_t maxDepth;        // most elements ever queued at once
+    uint64_t enqueued;      // elements accepted
+    uint64_t dropped;       // elements refused because the queue was full
+    uint64_t removed;       // elements taken off by dequeue or checkAndDequeue
+    uint64_t abandoned;     // elements taken off by abandonAll
+    uint64_t totalWaitNs;   // time the removed elements spent queued
+    uint64_t maxWaitNs;     // longest time an element spent queued
+} Ril_queue_stats;
+
 /**
  * Template queue class to handling requests for a rild socket.
  * <p>
  * This class performs the following functions :
  * <ul>
- *     <li>Enqueue.
- *     <li>Dequeue.
- *     <li>Check and dequeue.
+ *     <li>Enqueue, at the back.
+ *     <li>Dequeue, from the front, so requests are handled in the order
+ *         they arrived.
+ *     <li>Check and dequeue, by token through an index rather than a scan.
  * </ul>
+ * <p>
+ * The queue is bounded and intrusive: T provides token, curr->id and the
+ * p_next, p_prev, p_indexNext and enqueuedNs fields. Any number of threads
+ * may enqueue; one thread is expected to wait in dequeue(), so enqueue
+ * signals rather than broadcasts, and only when it is waiting.
+ * <p>
+ * When the client goes away, abandonAll() frees the queue for the next
+ * one. Whoever still holds an abandoned element gets it back from
+ * claimAbandoned(), under the same mutex, so it is never owned twice.
  */
 
 template <typename T>
 class Ril_queue {
 
-   /**
-     * Mutex attribute used in queue mutex initialization.
-     */
-    pthread_mutexattr_t attr;
-
    /**
      * Queue mutex variable for synchronized queue access.
      */
@@ -51,25 +86,62 @@ class Ril_queue {
     pthread_cond_t cond;
 
    /**
-     * Front of the queue.
+     * Threads waiting on cond.
+     */
+    int waiters;
+
+   /**
+     * Front of the queue, the oldest element.
      */
     T *front;
 
+   /**
+     * Back of the queue, the newest element.
+     */
+    T *back;
+
+   /**
+     * Most elements the queue holds.
+     */
+    size_t capacity;
+
+   /**
+     * Elements chained through p_indexNext by token.
+     */
+    T *index[RIL_QUEUE_INDEX_BUCKETS];
+
+   /**
+     * Elements taken off by abandonAll() and not yet claimed, chained
+     * through p_next.
+     */
+    T *abandoned;
+
+    Ril_queue_stats stats;
+
+    static uint64_t nowNs(void);
+
+    T **indexBucket(int token);
+
+    void remove(T *request);
+
     public:
 
        /**
-         * Remove the first element of the queue.
+         * Remove the first element of the queue, waiting for one if the
+         * queue is empty.
          *
          * @return first element of the queue.
          */
         T* dequeue(void);
 
        /**
-         * Add a request to the front of the queue.
+         * Add a request to the back of the queue.
          *
          * @param Request to be added.
+         * @return false, leaving the request to the caller, if the queue
+         *         is full.
          */
-        void enqueue(T* request);
+        bool enqueue(T* request);
 
        /**
          * Check if the queue is empty.
@@ -81,21 +153,106 @@ class Ril_queue {
          *
          * @param Request message id.
          * @param Request token.
+         * @return the element, now the caller's, or NULL if there is none.
+         */
+        T* checkAndDequeue( MsgId id, int token);
+
+       /**
+         * Check and remove a particular element, rather than whichever
+         * one has its message id and token.
+         *
+         * @param The element.
+         * @return true, and the element is now the caller's, if it was
+         *         queued.
+         */
+        bool checkAndDequeue(T *request);
+
+       /**
+         * Take every element off the queue and set them aside until they
+         * are claimed.
+         *
+         * @return number of elements abandoned.
+         */
+        size_t abandonAll(void);
+
+       /**
+         * Remove an element set aside by abandonAll().
+         *
+         * @param The element.
+         * @return true, and the element is now the caller's, if it had
+         *         been abandoned.
+         */
+        bool claimAbandoned(T *request);
+
+       /**
+         * Copy out the queue counters.
+         *
+         * @param Where to put them.
          */
-        int checkAndDequeue( MsgId id, int token);
+        void getStats(Ril_queue_stats *outStats);
 
        /**
          * Queue constructor.
+         *
+         * @param Most elements the queue holds.
          */
-        Ril_queue(void);
+        Ril_queue(size_t capacity = RIL_QUEUE_DEFAULT_CAPACITY);
 };
 
 template <typename T>
-Ril_queue<T>::Ril_queue(void) {
-    pthread_mutexattr_init(&attr);
-    pthread_mutex_init(&mutex_instance, &attr);
-    cond = PTHREAD_COND_INITIALIZER;
-    front = NULL;
+Ril_queue<T>::Ril_queue(size_t capacity) : waiters(0), front(NULL), back(NULL),
+        capacity(capacity), abandoned(NULL) {
+    pthread_mutex_init(&mutex_instance, NULL);
+    pthread_cond_init(&cond, NULL);
+    memset(index, 0, sizeof(index));
+    memset(&stats, 0, sizeof(stats));
+}
+
+template <typename T>
+uint64_t Ril_queue<T>::nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+template <typename T>
+T **Ril_queue<T>::indexBucket(int token) {
+    return &index[(uint32_t) token & (RIL_QUEUE_INDEX_BUCKETS - 1)];
+}
+
+/** unlinks request from the queue and the index; called with the mutex held */
+template <typename T>
+void Ril_queue<T>::remove(T *request) {
+    uint64_t waitNs = nowNs() - request->enqueuedNs;
+
+    if (request->p_prev != NULL) {
+        request->p_prev->p_next = request->p_next;
+    } else {
+        this->front = request->p_next;
+    }
+    if (request->p_next != NULL) {
+        request->p_next->p_prev = request->p_prev;
+    } else {
+        this->back = request->p_prev;
+    }
+
+    for (T **ppCur = indexBucket(request->token); *ppCur != NULL;
+            ppCur = &((*ppCur)->p_indexNext)) {
+        if (*ppCur == request) {
+            *ppCur = request->p_indexNext;
+            break;
+        }
+    }
+
+    request->p_next = request->p_prev = request->p_indexNext = NULL;
+
+    stats.depth--;
+    stats.removed++;
+    stats.totalWaitNs += waitNs;
+    if (waitNs > stats.maxWaitNs) {
+        stats.maxWaitNs = waitNs;
+    }
 }
 
 template <typename T>
@@ -104,48 +261,66 @@ T* Ril_queue<T>::dequeue(void) {
 
     pthread_mutex_lock(&mutex_instance);
     while(empty()) {
+        waiters++;
         pthread_cond_wait(&cond, &mutex_instance);
+        waiters--;
     }
     temp = this->front;
-    if(NULL != this->front->p_next) {
-        this->front = this->front->p_next;
-    } else {
-        this->front = NULL;
-    }
+    remove(temp);
     pthread_mutex_unlock(&mutex_instance);
 
     return temp;
 }
 
 template <typename T>
-void Ril_queue<T>::enqueue(T* request) {
+bool Ril_queue<T>::enqueue(T* request) {
+    T **bucket;
 
     pthread_mutex_lock(&mutex_instance);
 
-    if(NULL == this->front) {
+    if (stats.depth >= capacity) {
+        stats.dropped++;
+        pthread_mutex_unlock(&mutex_instance);
+        return false;
+    }
+
+    request->enqueuedNs = nowNs();
+    request->p_next = NULL;
+    request->p_prev = this->back;
+    if (NULL == this->back) {
         this->front = request;
-        request->p_next = NULL;
     } else {
-        request->p_next = this->front;
-        this->front = request;
+        this->back->p_next = request;
+    }
+    this->back = request;
+
+    bucket = indexBucket(request->token);
+    request->p_indexNext = *bucket;
+    *bucket = request;
+
+    stats.enqueued++;
+    if (++stats.depth > stats.maxDepth) {
+        stats.maxDepth = stats.depth;
+    }
+
+    if (waiters > 0) {
+        pthread_cond_signal(&cond);
     }
-    pthread_cond_broadcast(&cond);
     pthread_mutex_unlock(&mutex_instance);
+
+    return true;
 }
 
 template <typename T>
-int Ril_queue<T>::checkAndDequeue(MsgId id, int token) {
-    int ret = 0;
-    T* temp;
+T* Ril_queue<T>::checkAndDequeue(MsgId id, int token) {
+    T* ret = NULL;
 
     pthread_mutex_lock(&mutex_instance);
 
-    for(T **ppCur = &(this->front); *ppCur != NULL; ppCur = &((*ppCur)->p_next)) {
-        if (token == (*ppCur)->token && id == (*ppCur)->curr->id) {
-            ret = 1;
-            temp = *ppCur;
-            *ppCur = (*ppCur)->p_next;
-            free(temp);
+    for (T *cur = *indexBucket(token); cur != NULL; cur = cur->p_indexNext) {
+        if (token == cur->token && id == cur->curr->id) {
+            ret = cur;
+            remove(cur);
             break;
         }
     }
@@ -155,6 +330,77 @@ int Ril_queue<T>::checkAndDequeue(MsgId id, int token) {
     return ret;
 }
 
+template <typename T>
+bool Ril_queue<T>::checkAndDequeue(T *request) {
+    bool ret = false;
+
+    pthread_mutex_lock(&mutex_instance);
+
+    for (T *cur = *indexBucket(request->token); cur != NULL; cur = cur->p_indexNext) {
+        if (cur == request) {
+            remove(cur);
+            ret = true;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_instance);
+
+    return ret;
+}
+
+template <typename T>
+size_t Ril_queue<T>::abandonAll(void) {
+    size_t count = 0;
+
+    pthread_mutex_lock(&mutex_instance);
+
+    while (this->front != NULL) {
+        T *request = this->front;
+
+        this->front = request->p_next;
+        request->p_prev = request->p_indexNext = NULL;
+        request->p_next = this->abandoned;
+        this->abandoned = request;
+        count++;
+    }
+    this->back = NULL;
+    memset(index, 0, sizeof(index));
+
+    stats.depth = 0;
+    stats.abandoned += count;
+
+    pthread_mutex_unlock(&mutex_instance);
+
+    return count;
+}
+
+template <typename T>
+bool Ril_queue<T>::claimAbandoned(T *request) {
+    bool ret = false;
+
+    pthread_mutex_lock(&mutex_instance);
+
+    for (T **ppCur = &this->abandoned; *ppCur != NULL; ppCur = &((*ppCur)->p_next)) {
+        if (*ppCur == request) {
+            *ppCur = request->p_next;
+            request->p_next = NULL;
+            ret = true;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_instance);
+
+    return ret;
+}
+
+template <typename T>
+void Ril_queue<T>::getStats(Ril_queue_stats *outStats) {
+    pthread_mutex_lock(&mutex_instance);
+    *outStats = stats;
+    pthread_mutex_unlock(&mutex_instance);
+}
 
 template <typename T>
 int Ril_queue<T>::empty(void) {
@@ -165,3 +411,5 @@ int Ril_queue<T>::empty(void) {
         return 0;
     }
 }
+
+#endif /* RIL_SOCKET_QUEUE_H_INCLUDED */
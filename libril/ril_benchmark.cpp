@@ -0,0 +1,973 @@
+/* //device/libs/telephony/ril_benchmark.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host microbenchmarks for the libril core, so that the CPU cost per
+ * message can be tracked across changes:
+ *
+ *   BM_processCommandBuffer     one request per dispatch function, decoded,
+ *                               handed to a vendor RIL that completes it at
+ *                               once, and the response written to /dev/null
+ *   BM_response                 every response* marshaller on its own
+ *   BM_RIL_onUnsolicitedResponse  unsolicited responses, with and without
+ *                               the wakelock and its timeout
+ *   BM_record_stream_get_next   framing of requests read off a pipe
+ *   BM_ril_event_loop_*         waking the event loop from another thread
+ *
+ * ril.cpp is compiled into this file so that its static functions can be
+ * called directly. The Parcel, logging, wakelock and other platform
+ * headers come from host/, so this builds without an Android tree:
+ *
+ *   g++ -O2 -DNDEBUG -Ilibril/host -Iinclude -Ilibril \
+ *       libril/ril_benchmark.cpp libril/ril_event.cpp \
+ *       libril/host/RilSapSocket.cpp libril/rilMonitor.cpp \
+ *       librilutils/record_stream.c -lbenchmark -lpthread
+ */
+
+#include <benchmark/benchmark.h>
+#include <semaphore.h>
+#include <string.h>
+
+#include "ril_host.h"
+#include "ril.cpp"
+
+using namespace android;
+
+/*** A vendor RIL that completes every request at once ***/
+
+static long s_vendorRequests;
+
+static void benchOnRequest(int request, void *data, size_t datalen, RIL_Token t)
+{
+    s_vendorRequests++;
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+}
+
+static RIL_RadioState benchOnStateRequest()
+{
+    return RADIO_STATE_ON;
+}
+
+static int benchSupports(int requestCode)
+{
+    return 1;
+}
+
+static void benchOnCancel(RIL_Token t)
+{
+}
+
+static const char *benchGetVersion()
+{
+    return "ril_benchmark";
+}
+
+static const RIL_RadioFunctions s_benchCallbacks = {
+    RIL_VERSION,
+    benchOnRequest,
+    benchOnStateRequest,
+    benchSupports,
+    benchOnCancel,
+    benchGetVersion
+};
+
+/**
+ * Stands in for RIL_register() without the sockets: responses go to
+ * /dev/null and the wakeup pipe is drained by hand until the event loop
+ * is started.
+ */
+static void initBenchRil()
+{
+    int filedes[2];
+
+    memcpy(&s_callbacks, &s_benchCallbacks, sizeof(s_callbacks));
+    s_registerCalled = 1;
+
+    s_ril_param_socket.socket_id = RIL_SOCKET_1;
+    s_ril_param_socket.fdCommand = open("/dev/null", O_WRONLY);
+
+    ril_event_init();
+
+    if (pipe(filedes) == 0) {
+        s_fdWakeupRead = filedes[0];
+        s_fdWakeupWrite = filedes[1];
+        fcntl(s_fdWakeupRead, F_SETFL, O_NONBLOCK);
+    }
+}
+
+/*** Request parcels, laid out as RIL.java writes them ***/
+
+static const char *s_smsPdu =
+        "0001000b915155550100f000002bd4f29c0e9a81c8e832685e1e83dc6f7719"
+        "442fcfe9a0f1db5d9683e86f103b6d2f8bd3e1f4";
+
+static const char *s_aid = "a0000000871002ff86ff0389ffffffff";
+
+static void writeInts(Parcel &p, int count, ...)
+{
+    va_list ap;
+
+    va_start(ap, count);
+    for (int i = 0 ; i < count ; i++) {
+        p.writeInt32(va_arg(ap, int));
+    }
+    va_end(ap);
+}
+
+/** CDMA SMS fields shared by CDMA_SEND_SMS, IMS_SEND_SMS and WRITE_SMS_TO_RUIM */
+static void writeCdmaSms(Parcel &p)
+{
+    writeInts(p, 8, 4098, 0, 0, 0, 0, 0, 0, 10);   // ... number_of_digits
+    for (int i = 0 ; i < 10 ; i++) {
+        p.writeInt32(i);                            // bytes take an int each
+    }
+    writeInts(p, 3, 0, 0, 0);                       // subaddress, no digits
+    p.writeInt32(32);
+    for (int i = 0 ; i < 32 ; i++) {
+        p.writeInt32(i);
+    }
+}
+
+static void buildVoid(Parcel &p)
+{
+}
+
+static void buildString(Parcel &p)
+{
+    writeStringToParcel(p, "5");
+}
+
+static void buildStrings(Parcel &p)
+{
+    p.writeInt32(2);
+    writeStringToParcel(p, NULL);
+    writeStringToParcel(p, s_smsPdu);
+}
+
+static void buildInts(Parcel &p)
+{
+    writeInts(p, 2, 1, 1);
+}
+
+static void buildDial(Parcel &p)
+{
+    writeStringToParcel(p, "+15555550100");
+    writeInts(p, 2, 0, 0);                          // clir, no UUS
+}
+
+static void buildSmsWrite(Parcel &p)
+{
+    p.writeInt32(1);
+    writeStringToParcel(p, s_smsPdu);
+    writeStringToParcel(p, NULL);
+}
+
+static void buildSimIo(Parcel &p)
+{
+    writeInts(p, 2, 0xb0, 0x6f40);
+    writeStringToParcel(p, "3F007FFF");
+    writeInts(p, 3, 0, 0, 255);
+    writeStringToParcel(p, NULL);
+    writeStringToParcel(p, NULL);
+    writeStringToParcel(p, s_aid);
+}
+
+static void buildSimApdu(Parcel &p)
+{
+    writeInts(p, 6, 1, 0x80, 0xca, 0x9f, 0x7f, 0);
+    writeStringToParcel(p, "00a4040010a0000000871002ff86ff0389ffffffff");
+}
+
+static void buildCallForward(Parcel &p)
+{
+    writeInts(p, 4, 3, 0, 1, 145);
+    writeStringToParcel(p, "+15555550100");
+    p.writeInt32(20);
+}
+
+static void buildRaw(Parcel &p)
+{
+    uint8_t raw[64];
+
+    memset(raw, 0x5a, sizeof(raw));
+    p.writeInt32(sizeof(raw));
+    p.write(raw, sizeof(raw));
+}
+
+static void buildCdmaSms(Parcel &p)
+{
+    writeCdmaSms(p);
+}
+
+static void buildImsSms(Parcel &p)
+{
+    p.writeInt32(RADIO_TECH_3GPP);
+    writeInts(p, 2, 0, 12);                         // retry, messageRef
+    p.writeInt32(2);
+    writeStringToParcel(p, NULL);
+    writeStringToParcel(p, s_smsPdu);
+}
+
+static void buildCdmaSmsAck(Parcel &p)
+{
+    writeInts(p, 2, 0, 0);
+}
+
+static void buildGsmBrSmsCnf(Parcel &p)
+{
+    p.writeInt32(4);
+    for (int i = 0 ; i < 4 ; i++) {
+        writeInts(p, 5, 4352 + i, 4352 + i, 0, 255, 1);
+    }
+}
+
+static void buildCdmaBrSmsCnf(Parcel &p)
+{
+    p.writeInt32(4);
+    for (int i = 0 ; i < 4 ; i++) {
+        writeInts(p, 3, i, 1, 1);
+    }
+}
+
+static void buildCdmaSmsWriteArgs(Parcel &p)
+{
+    p.writeInt32(1);
+    writeCdmaSms(p);
+}
+
+static void buildDataCall(Parcel &p)
+{
+    p.writeInt32(7);
+    writeStringToParcel(p, "14");
+    writeStringToParcel(p, "0");
+    writeStringToParcel(p, "fast.t-mobile.com");
+    writeStringToParcel(p, "");
+    writeStringToParcel(p, "");
+    writeStringToParcel(p, "0");
+    writeStringToParcel(p, "IPV4V6");
+}
+
+static void buildInitialAttachApn(Parcel &p)
+{
+    writeStringToParcel(p, "fast.t-mobile.com");
+    writeStringToParcel(p, "IPV4V6");
+    p.writeInt32(0);
+    writeStringToParcel(p, NULL);
+    writeStringToParcel(p, NULL);
+}
+
+static void buildNvReadItem(Parcel &p)
+{
+    p.writeInt32(RIL_NV_LTE_BAND_ENABLE_25);
+}
+
+static void buildNvWriteItem(Parcel &p)
+{
+    p.writeInt32(RIL_NV_LTE_BAND_ENABLE_25);
+    writeStringToParcel(p, "1");
+}
+
+static void buildUiccSubscription(Parcel &p)
+{
+    writeInts(p, 4, 0, 0, 0, 1);
+}
+
+static void buildSimAuthentication(Parcel &p)
+{
+    p.writeInt32(128);
+    writeStringToParcel(p, "EJ9vcvo4/fOMFtiLRqsmbe8gEJfR/f0BjsWqNl8ZsECQZA==");
+    writeStringToParcel(p, s_aid);
+}
+
+static void buildDataProfile(Parcel &p)
+{
+    p.writeInt32(2);
+    for (int i = 0 ; i < 2 ; i++) {
+        p.writeInt32(i);
+        writeStringToParcel(p, i == 0 ? "fast.t-mobile.com" : "ims");
+        writeStringToParcel(p, "IPV4V6");
+        p.writeInt32(0);
+        writeStringToParcel(p, "");
+        writeStringToParcel(p, "");
+        writeInts(p, 5, 1, 0, 0, 0, 1);
+    }
+}
+
+static void buildRadioCapability(Parcel &p)
+{
+    writeInts(p, 4, RIL_RADIO_CAPABILITY_VERSION, 1, RC_PHASE_CONFIGURED, RAF_LTE);
+    writeStringToParcel(p, "com.android.lm0");
+    p.writeInt32(RC_STATUS_NONE);
+}
+
+static void buildCarrierRestrictions(Parcel &p)
+{
+    writeInts(p, 2, 2, 1);
+    writeStringToParcel(p, "310");
+    writeStringToParcel(p, "260");
+    p.writeInt32(RIL_MATCH_ALL);
+    writeStringToParcel(p, NULL);
+    writeStringToParcel(p, "310");
+    writeStringToParcel(p, "410");
+    p.writeInt32(RIL_MATCH_GID1);
+    writeStringToParcel(p, "ba01");
+    writeStringToParcel(p, "311");
+    writeStringToParcel(p, "480");
+    p.writeInt32(RIL_MATCH_ALL);
+    writeStringToParcel(p, NULL);
+}
+
+typedef struct {
+    const char *name;
+    int request;
+    void (*build)(Parcel &p);
+    int version;    // RIL version the vendor RIL reports, for gated dispatchers
+} DispatchCase;
+
+static const DispatchCase s_dispatchCases[] = {
+    {"dispatchVoid", RIL_REQUEST_GET_CURRENT_CALLS, buildVoid, RIL_VERSION},
+    {"dispatchString", RIL_REQUEST_DTMF, buildString, RIL_VERSION},
+    {"dispatchStrings", RIL_REQUEST_SEND_SMS, buildStrings, RIL_VERSION},
+    {"dispatchInts", RIL_REQUEST_HANGUP, buildInts, RIL_VERSION},
+    {"dispatchDial", RIL_REQUEST_DIAL, buildDial, RIL_VERSION},
+    {"dispatchSmsWrite", RIL_REQUEST_WRITE_SMS_TO_SIM, buildSmsWrite, RIL_VERSION},
+    {"dispatchSIM_IO", RIL_REQUEST_SIM_IO, buildSimIo, RIL_VERSION},
+    {"dispatchSIM_APDU", RIL_REQUEST_SIM_TRANSMIT_APDU_BASIC, buildSimApdu, RIL_VERSION},
+    {"dispatchCallForward", RIL_REQUEST_SET_CALL_FORWARD, buildCallForward, RIL_VERSION},
+    {"dispatchRaw", RIL_REQUEST_OEM_HOOK_RAW, buildRaw, RIL_VERSION},
+    {"dispatchCdmaSms", RIL_REQUEST_CDMA_SEND_SMS, buildCdmaSms, RIL_VERSION},
+    {"dispatchImsSms", RIL_REQUEST_IMS_SEND_SMS, buildImsSms, RIL_VERSION},
+    {"dispatchCdmaSmsAck", RIL_REQUEST_CDMA_SMS_ACKNOWLEDGE, buildCdmaSmsAck, RIL_VERSION},
+    {"dispatchGsmBrSmsCnf", RIL_REQUEST_GSM_SET_BROADCAST_SMS_CONFIG, buildGsmBrSmsCnf,
+            RIL_VERSION},
+    {"dispatchCdmaBrSmsCnf", RIL_REQUEST_CDMA_SET_BROADCAST_SMS_CONFIG, buildCdmaBrSmsCnf,
+            RIL_VERSION},
+    {"dispatchRilCdmaSmsWriteArgs", RIL_REQUEST_CDMA_WRITE_SMS_TO_RUIM, buildCdmaSmsWriteArgs,
+            RIL_VERSION},
+    {"dispatchDataCall", RIL_REQUEST_SETUP_DATA_CALL, buildDataCall, RIL_VERSION},
+    {"dispatchVoiceRadioTech", RIL_REQUEST_VOICE_RADIO_TECH, buildVoid, RIL_VERSION},
+    {"dispatchSetInitialAttachApn", RIL_REQUEST_SET_INITIAL_ATTACH_APN, buildInitialAttachApn,
+            RIL_VERSION},
+    {"dispatchCdmaSubscriptionSource", RIL_REQUEST_CDMA_GET_SUBSCRIPTION_SOURCE, buildVoid,
+            RIL_VERSION},
+    {"dispatchNVReadItem", RIL_REQUEST_NV_READ_ITEM, buildNvReadItem, RIL_VERSION},
+    {"dispatchNVWriteItem", RIL_REQUEST_NV_WRITE_ITEM, buildNvWriteItem, RIL_VERSION},
+    {"dispatchUiccSubscripton", RIL_REQUEST_SET_UICC_SUBSCRIPTION, buildUiccSubscription,
+            RIL_VERSION},
+    {"dispatchSimAuthentication", RIL_REQUEST_SIM_AUTHENTICATION, buildSimAuthentication,
+            RIL_VERSION},
+    {"dispatchDataProfile", RIL_REQUEST_SET_DATA_PROFILE, buildDataProfile, RIL_VERSION},
+    {"dispatchRadioCapability", RIL_REQUEST_SET_RADIO_CAPABILITY, buildRadioCapability,
+            RIL_VERSION},
+    {"dispatchCarrierRestrictions", RIL_REQUEST_SET_CARRIER_RESTRICTIONS,
+            buildCarrierRestrictions, 14},
+};
+
+static void BM_processCommandBuffer(benchmark::State &state)
+{
+    const DispatchCase *pCase = &s_dispatchCases[state.range(0)];
+    Parcel p;
+    long vendorRequests = s_vendorRequests;
+    size_t iterations = 0;
+
+    p.writeInt32(pCase->request);
+    p.writeInt32(1);                                // token
+    pCase->build(p);
+
+    s_callbacks.version = pCase->version;
+
+    // the buffer record_stream hands over, reused as rild reuses its own
+    std::vector<uint8_t> buffer(p.data(), p.data() + p.dataSize());
+
+    while (state.KeepRunning()) {
+        processCommandBuffer(&buffer[0], buffer.size(), RIL_SOCKET_1);
+        iterations++;
+    }
+
+    s_callbacks.version = s_benchCallbacks.version;
+
+    if (s_pendingRequests != NULL) {
+        state.SkipWithError("request was not completed");
+    } else if (s_vendorRequests - vendorRequests != (long) iterations) {
+        state.SkipWithError("request did not reach the vendor RIL");
+    }
+
+    state.SetLabel(pCase->name);
+    state.SetItemsProcessed(iterations);
+    state.SetBytesProcessed(iterations * buffer.size());
+}
+BENCHMARK(BM_processCommandBuffer)->DenseRange(0, NUM_ELEMS(s_dispatchCases) - 1);
+
+/*** Responses, as a vendor RIL would hand them over ***/
+
+static int s_ints[] = {1, 0, 2};
+static RIL_LastCallFailCauseInfo s_failCause;
+static char *s_operator[3];
+static const char *s_imei = "490154203237518";
+static RIL_Call s_calls[2];
+static RIL_Call *s_callPtrs[2];
+static RIL_SMS_Response s_smsResponse;
+static RIL_SIM_IO_Response s_simIoResponse;
+static RIL_CallForwardInfo s_callForwards[2];
+static RIL_CallForwardInfo *s_callForwardPtrs[2];
+static RIL_Data_Call_Response_v11 s_dataCalls[2];
+static uint8_t s_raw[64];
+static RIL_SuppSvcNotification s_ssn;
+static RIL_CardStatus_v6 s_cardStatus;
+static RIL_GSM_BroadcastSmsConfigInfo s_gsmBci[4];
+static RIL_GSM_BroadcastSmsConfigInfo *s_gsmBciPtrs[4];
+static RIL_CDMA_BroadcastSmsConfigInfo s_cdmaBci[4];
+static RIL_CDMA_BroadcastSmsConfigInfo *s_cdmaBciPtrs[4];
+static RIL_CDMA_SMS_Message s_cdmaSms;
+static RIL_NeighboringCell s_neighbors[4];
+static RIL_NeighboringCell *s_neighborPtrs[4];
+static RIL_CDMA_InformationRecords s_infoRecs;
+static RIL_SignalStrength_v10 s_signalStrength;
+static RIL_CDMA_SignalInfoRecord s_signalInfo;
+static RIL_CDMA_CallWaiting_v6 s_callWaiting;
+static RIL_SimRefreshResponse_v7 s_simRefresh;
+static RIL_CellInfo_v12 s_cells[4];
+static RIL_HardwareConfig s_hardwareConfig[2];
+static RIL_DcRtInfo s_dcRtInfo;
+static RIL_RadioCapability s_radioCapability;
+static RIL_StkCcUnsolSsResponse s_ssData;
+static RIL_LceStatusInfo s_lceStatus;
+static RIL_LceDataInfo s_lceData;
+static RIL_ActivityStatsInfo s_activity;
+static RIL_Carrier s_carriers[3];
+static RIL_CarrierRestrictions s_carrierRestrictions;
+static char s_pcoContents[16];
+static RIL_PCO_Data s_pcoData;
+
+static void initResponses()
+{
+    s_failCause.cause_code = CALL_FAIL_NORMAL;
+    s_failCause.vendor_cause = (char *) "normal call clearing";
+
+    s_operator[0] = (char *) "T-Mobile";
+    s_operator[1] = (char *) "TMO";
+    s_operator[2] = (char *) "310260";
+
+    for (int i = 0 ; i < 2 ; i++) {
+        s_calls[i].state = i == 0 ? RIL_CALL_ACTIVE : RIL_CALL_WAITING;
+        s_calls[i].index = i + 1;
+        s_calls[i].toa = 145;
+        s_calls[i].isMT = i;
+        s_calls[i].isVoice = 1;
+        s_calls[i].number = (char *) "+15555550100";
+        s_calls[i].numberPresentation = 0;
+        s_calls[i].name = (char *) "Alice";
+        s_calls[i].namePresentation = 0;
+        s_callPtrs[i] = &s_calls[i];
+    }
+
+    s_smsResponse.messageRef = 12;
+    s_smsResponse.ackPDU = NULL;
+    s_smsResponse.errorCode = -1;
+
+    s_simIoResponse.sw1 = 0x90;
+    s_simIoResponse.sw2 = 0;
+    s_simIoResponse.simResponse = (char *)
+            "621e8202412183026f40a506c00140de01008a01058b036f0604800200348800";
+
+    for (int i = 0 ; i < 2 ; i++) {
+        s_callForwards[i].status = 1;
+        s_callForwards[i].reason = i;
+        s_callForwards[i].serviceClass = 1;
+        s_callForwards[i].toa = 145;
+        s_callForwards[i].number = (char *) "+15555550100";
+        s_callForwards[i].timeSeconds = 20;
+        s_callForwardPtrs[i] = &s_callForwards[i];
+    }
+
+    for (int i = 0 ; i < 2 ; i++) {
+        s_dataCalls[i].cid = i + 1;
+        s_dataCalls[i].active = 2;
+        s_dataCalls[i].type = (char *) "IPV4V6";
+        s_dataCalls[i].ifname = (char *) "rmnet0";
+        s_dataCalls[i].addresses = (char *) "10.0.2.15/24 2001:db8::15/64";
+        s_dataCalls[i].dnses = (char *) "10.0.2.3 2001:db8::3";
+        s_dataCalls[i].gateways = (char *) "10.0.2.2 2001:db8::2";
+        s_dataCalls[i].pcscf = (char *) "";
+        s_dataCalls[i].mtu = 1440;
+    }
+
+    memset(s_raw, 0x5a, sizeof(s_raw));
+
+    s_ssn.notificationType = 1;
+    s_ssn.code = 2;
+    s_ssn.type = 145;
+    s_ssn.number = (char *) "+15555550100";
+
+    s_cardStatus.card_state = RIL_CARDSTATE_PRESENT;
+    s_cardStatus.universal_pin_state = RIL_PINSTATE_UNKNOWN;
+    s_cardStatus.gsm_umts_subscription_app_index = 0;
+    s_cardStatus.cdma_subscription_app_index = -1;
+    s_cardStatus.ims_subscription_app_index = 1;
+    s_cardStatus.num_applications = 2;
+    for (int i = 0 ; i < 2 ; i++) {
+        RIL_AppStatus *app = &s_cardStatus.applications[i];
+
+        app->app_type = i == 0 ? RIL_APPTYPE_USIM : RIL_APPTYPE_ISIM;
+        app->app_state = RIL_APPSTATE_READY;
+        app->perso_substate = RIL_PERSOSUBSTATE_READY;
+        app->aid_ptr = (char *) s_aid;
+        app->app_label_ptr = (char *) (i == 0 ? "USIM" : "ISIM");
+        app->pin1 = RIL_PINSTATE_ENABLED_VERIFIED;
+        app->pin2 = RIL_PINSTATE_UNKNOWN;
+    }
+
+    for (int i = 0 ; i < 4 ; i++) {
+        s_gsmBci[i].fromServiceId = s_gsmBci[i].toServiceId = 4352 + i;
+        s_gsmBci[i].toCodeScheme = 255;
+        s_gsmBci[i].selected = 1;
+        s_gsmBciPtrs[i] = &s_gsmBci[i];
+
+        s_cdmaBci[i].service_category = i;
+        s_cdmaBci[i].language = 1;
+        s_cdmaBci[i].selected = 1;
+        s_cdmaBciPtrs[i] = &s_cdmaBci[i];
+    }
+
+    s_cdmaSms.uTeleserviceID = 4098;
+    s_cdmaSms.sAddress.number_of_digits = 10;
+    for (int i = 0 ; i < 10 ; i++) {
+        s_cdmaSms.sAddress.digits[i] = i;
+    }
+    s_cdmaSms.uBearerDataLen = 32;
+    for (int i = 0 ; i < 32 ; i++) {
+        s_cdmaSms.aBearerData[i] = i;
+    }
+
+    for (int i = 0 ; i < 4 ; i++) {
+        s_neighbors[i].cid = (char *) "0bcd1f2e";
+        s_neighbors[i].rssi = 10 + i;
+        s_neighborPtrs[i] = &s_neighbors[i];
+    }
+
+    s_infoRecs.numberOfInfoRecs = 2;
+    for (int i = 0 ; i < 2 ; i++) {
+        RIL_CDMA_DisplayInfoRecord *display = &s_infoRecs.infoRec[i].rec.display;
+
+        s_infoRecs.infoRec[i].name = RIL_CDMA_DISPLAY_INFO_REC;
+        display->alpha_len = 20;
+        memcpy(display->alpha_buf, "Incoming call: Alice", 20);
+    }
+
+    s_signalStrength.GW_SignalStrength.signalStrength = 20;
+    s_signalStrength.GW_SignalStrength.bitErrorRate = 99;
+    s_signalStrength.CDMA_SignalStrength.dbm = -1;
+    s_signalStrength.CDMA_SignalStrength.ecio = -1;
+    s_signalStrength.EVDO_SignalStrength.dbm = -1;
+    s_signalStrength.EVDO_SignalStrength.ecio = -1;
+    s_signalStrength.EVDO_SignalStrength.signalNoiseRatio = -1;
+    s_signalStrength.LTE_SignalStrength.signalStrength = 25;
+    s_signalStrength.LTE_SignalStrength.rsrp = 95;
+    s_signalStrength.LTE_SignalStrength.rsrq = 8;
+    s_signalStrength.LTE_SignalStrength.rssnr = 120;
+    s_signalStrength.LTE_SignalStrength.cqi = INT_MAX;
+    s_signalStrength.LTE_SignalStrength.timingAdvance = INT_MAX;
+    s_signalStrength.TD_SCDMA_SignalStrength.rscp = INT_MAX;
+
+    s_signalInfo.isPresent = 1;
+    s_signalInfo.signalType = 1;
+    s_signalInfo.alertPitch = 0;
+    s_signalInfo.signal = 1;
+
+    s_callWaiting.number = (char *) "+15555550100";
+    s_callWaiting.name = (char *) "Alice";
+    s_callWaiting.signalInfoRecord = s_signalInfo;
+    s_callWaiting.number_type = 1;
+    s_callWaiting.number_plan = 1;
+
+    s_simRefresh.result = SIM_FILE_UPDATE;
+    s_simRefresh.ef_id = 0x6f40;
+    s_simRefresh.aid = (char *) s_aid;
+
+    for (int i = 0 ; i < 4 ; i++) {
+        RIL_CellInfoLte_v12 *lte = &s_cells[i].CellInfo.lte;
+
+        s_cells[i].cellInfoType = RIL_CELL_INFO_TYPE_LTE;
+        s_cells[i].registered = i == 0;
+        s_cells[i].timeStampType = RIL_TIMESTAMP_TYPE_OEM_RIL;
+        s_cells[i].timeStamp = 1000000000ULL * (i + 1);
+        lte->cellIdentityLte.mcc = 310;
+        lte->cellIdentityLte.mnc = 260;
+        lte->cellIdentityLte.ci = 0x1234500 + i;
+        lte->cellIdentityLte.pci = 100 + i;
+        lte->cellIdentityLte.tac = 0x2a;
+        lte->cellIdentityLte.earfcn = 5230;
+        lte->signalStrengthLte = s_signalStrength.LTE_SignalStrength;
+    }
+
+    s_hardwareConfig[0].type = RIL_HARDWARE_CONFIG_MODEM;
+    strcpy(s_hardwareConfig[0].uuid, "com.android.modem0");
+    s_hardwareConfig[0].state = RIL_HARDWARE_CONFIG_STATE_ENABLED;
+    s_hardwareConfig[0].cfg.modem.rat = RAF_LTE;
+    s_hardwareConfig[0].cfg.modem.maxVoice = 1;
+    s_hardwareConfig[0].cfg.modem.maxData = 1;
+    s_hardwareConfig[0].cfg.modem.maxStandby = 1;
+    s_hardwareConfig[1].type = RIL_HARDWARE_CONFIG_SIM;
+    strcpy(s_hardwareConfig[1].uuid, "com.android.sim0");
+    s_hardwareConfig[1].state = RIL_HARDWARE_CONFIG_STATE_ENABLED;
+    strcpy(s_hardwareConfig[1].cfg.sim.modemUuid, "com.android.modem0");
+
+    s_dcRtInfo.time = 123456789ULL;
+    s_dcRtInfo.powerState = RIL_DC_POWER_STATE_HIGH;
+
+    s_radioCapability.version = RIL_RADIO_CAPABILITY_VERSION;
+    s_radioCapability.session = 1;
+    s_radioCapability.phase = RC_PHASE_CONFIGURED;
+    s_radioCapability.rat = RAF_LTE;
+    strcpy(s_radioCapability.logicalModemUuid, "com.android.lm0");
+    s_radioCapability.status = RC_STATUS_NONE;
+
+    s_ssData.serviceType = SS_CLIP;
+    s_ssData.requestType = SS_INTERROGATION;
+    s_ssData.teleserviceType = SS_ALL_TELE_AND_BEARER_SERVICES;
+    s_ssData.serviceClass = 1;
+    s_ssData.result = RIL_E_SUCCESS;
+    s_ssData.ssInfo[0] = 1;
+
+    s_lceStatus.lce_status = 1;
+    s_lceStatus.actual_interval_ms = 1000;
+
+    s_lceData.last_hop_capacity_kbps = 20000;
+    s_lceData.confidence_level = 90;
+
+    s_activity.sleep_mode_time_ms = 1000;
+    s_activity.idle_mode_time_ms = 2000;
+    for (int i = 0 ; i < RIL_NUM_TX_POWER_LEVELS ; i++) {
+        s_activity.tx_mode_time_ms[i] = 100 * i;
+    }
+    s_activity.rx_mode_time_ms = 500;
+
+    for (int i = 0 ; i < 3 ; i++) {
+        s_carriers[i].mcc = "310";
+        s_carriers[i].mnc = i == 0 ? "260" : "410";
+        s_carriers[i].match_type = i == 1 ? RIL_MATCH_GID1 : RIL_MATCH_ALL;
+        s_carriers[i].match_data = i == 1 ? "ba01" : NULL;
+    }
+    s_carrierRestrictions.len_allowed_carriers = 2;
+    s_carrierRestrictions.len_excluded_carriers = 1;
+    s_carrierRestrictions.allowed_carriers = &s_carriers[0];
+    s_carrierRestrictions.excluded_carriers = &s_carriers[2];
+
+    memset(s_pcoContents, 0xa5, sizeof(s_pcoContents));
+    s_pcoData.cid = 1;
+    s_pcoData.bearer_proto = (char *) "IPV4V6";
+    s_pcoData.pco_id = 0xff00;
+    s_pcoData.contents_length = sizeof(s_pcoContents);
+    s_pcoData.contents = s_pcoContents;
+}
+
+typedef struct {
+    const char *name;
+    int (*responseFunction) (Parcel &p, void *response, size_t responselen);
+    void *response;
+    size_t responselen;
+} ResponseCase;
+
+#define RESPONSE_CASE(fn, data, len) {#fn, fn, (void *) (data), len}
+
+static const ResponseCase s_responseCases[] = {
+    RESPONSE_CASE(responseInts, s_ints, sizeof(s_ints)),
+    RESPONSE_CASE(responseFailCause, &s_failCause, sizeof(s_failCause)),
+    RESPONSE_CASE(responseStrings, s_operator, sizeof(s_operator)),
+    RESPONSE_CASE(responseString, s_imei, sizeof(char *)),
+    RESPONSE_CASE(responseVoid, NULL, 0),
+    RESPONSE_CASE(responseCallList, s_callPtrs, sizeof(s_callPtrs)),
+    RESPONSE_CASE(responseSMS, &s_smsResponse, sizeof(s_smsResponse)),
+    RESPONSE_CASE(responseSIM_IO, &s_simIoResponse, sizeof(s_simIoResponse)),
+    RESPONSE_CASE(responseCallForwards, s_callForwardPtrs, sizeof(s_callForwardPtrs)),
+    RESPONSE_CASE(responseDataCallList, s_dataCalls, sizeof(s_dataCalls)),
+    RESPONSE_CASE(responseSetupDataCall, s_dataCalls, sizeof(s_dataCalls[0])),
+    RESPONSE_CASE(responseRaw, s_raw, sizeof(s_raw)),
+    RESPONSE_CASE(responseSsn, &s_ssn, sizeof(s_ssn)),
+    RESPONSE_CASE(responseSimStatus, &s_cardStatus, sizeof(s_cardStatus)),
+    RESPONSE_CASE(responseGsmBrSmsCnf, s_gsmBciPtrs, sizeof(s_gsmBciPtrs)),
+    RESPONSE_CASE(responseCdmaBrSmsCnf, s_cdmaBciPtrs, sizeof(s_cdmaBciPtrs)),
+    RESPONSE_CASE(responseCdmaSms, &s_cdmaSms, sizeof(s_cdmaSms)),
+    RESPONSE_CASE(responseCellList, s_neighborPtrs, sizeof(s_neighborPtrs)),
+    RESPONSE_CASE(responseCdmaInformationRecords, &s_infoRecs, sizeof(s_infoRecs)),
+    RESPONSE_CASE(responseRilSignalStrength, &s_signalStrength, sizeof(s_signalStrength)),
+    RESPONSE_CASE(responseCallRing, &s_signalInfo, sizeof(s_signalInfo)),
+    RESPONSE_CASE(responseCdmaSignalInfoRecord, &s_signalInfo, sizeof(s_signalInfo)),
+    RESPONSE_CASE(responseCdmaCallWaiting, &s_callWaiting, sizeof(s_callWaiting)),
+    RESPONSE_CASE(responseSimRefresh, &s_simRefresh, sizeof(s_simRefresh)),
+    RESPONSE_CASE(responseCellInfoList, s_cells, sizeof(s_cells)),
+    RESPONSE_CASE(responseHardwareConfig, s_hardwareConfig, sizeof(s_hardwareConfig)),
+    RESPONSE_CASE(responseDcRtInfo, &s_dcRtInfo, sizeof(s_dcRtInfo)),
+    RESPONSE_CASE(responseRadioCapability, &s_radioCapability, sizeof(s_radioCapability)),
+    RESPONSE_CASE(responseSSData, &s_ssData, sizeof(s_ssData)),
+    RESPONSE_CASE(responseLceStatus, &s_lceStatus, sizeof(s_lceStatus)),
+    RESPONSE_CASE(responseLceData, &s_lceData, sizeof(s_lceData)),
+    RESPONSE_CASE(responseActivityData, &s_activity, sizeof(s_activity)),
+    RESPONSE_CASE(responseCarrierRestrictions, &s_carrierRestrictions,
+            sizeof(s_carrierRestrictions)),
+    RESPONSE_CASE(responsePcoData, &s_pcoData, sizeof(s_pcoData)),
+};
+
+static void BM_response(benchmark::State &state)
+{
+    const ResponseCase *pCase = &s_responseCases[state.range(0)];
+    Parcel p;
+    int ret = 0;
+    size_t bytes = 0;
+
+    while (state.KeepRunning()) {
+        // the reused response parcel, as obtainResponseParcel() hands it out
+        p.setDataSize(0);
+        p.setDataPosition(0);
+
+        ret |= pCase->responseFunction(p, pCase->response, pCase->responselen);
+        bytes += p.dataSize();
+    }
+
+    if (ret != 0) {
+        state.SkipWithError("response was rejected");
+    }
+
+    state.SetLabel(pCase->name);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_response)->DenseRange(0, NUM_ELEMS(s_responseCases) - 1);
+
+/*** Unsolicited responses ***/
+
+static char s_nitz[] = "16/10/18,12:00:00-28,1";
+
+typedef struct {
+    const char *name;
+    int unsolResponse;
+    const void *data;
+    size_t datalen;
+} UnsolCase;
+
+static const UnsolCase s_unsolCases[] = {
+    {"SIGNAL_STRENGTH", RIL_UNSOL_SIGNAL_STRENGTH, &s_signalStrength, sizeof(s_signalStrength)},
+    {"CALL_STATE_CHANGED", RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, NULL, 0},
+    {"NEW_SMS", RIL_UNSOL_RESPONSE_NEW_SMS, s_smsPdu, sizeof(char *)},
+    {"NITZ_TIME_RECEIVED", RIL_UNSOL_NITZ_TIME_RECEIVED, s_nitz, sizeof(char *)},
+    {"DATA_CALL_LIST_CHANGED", RIL_UNSOL_DATA_CALL_LIST_CHANGED, s_dataCalls, sizeof(s_dataCalls)},
+    {"CELL_INFO_LIST", RIL_UNSOL_CELL_INFO_LIST, s_cells, sizeof(s_cells)},
+};
+
+static bool s_eventLoopStarted;
+
+/**
+ * Does what the event loop would once TIMEVAL_WAKE_TIMEOUT has passed:
+ * fires the wakelock timeout and empties the wakeup pipe, so that timers
+ * and wakelocks do not pile up across iterations.
+ */
+static void expireWakeTimeout()
+{
+    UserCallbackInfo *p_info = s_last_wake_timeout_info;
+    char buff[16];
+
+    if (p_info == NULL) {
+        return;
+    }
+
+    p_info->event.next->prev = p_info->event.prev;
+    p_info->event.prev->next = p_info->event.next;
+    userTimerCallback(-1, 0, p_info);
+
+    while (read(s_fdWakeupRead, buff, sizeof(buff)) > 0);
+}
+
+static void BM_RIL_onUnsolicitedResponse(benchmark::State &state)
+{
+    const UnsolCase *pCase = &s_unsolCases[state.range(0)];
+    bool wakes = s_unsolResponses[pCase->unsolResponse - RIL_UNSOL_RESPONSE_BASE].wakeType
+            == android::WAKE_PARTIAL;
+
+    if (wakes && s_eventLoopStarted) {
+        state.SkipWithError("the event loop owns the wakelock timers");
+        return;
+    }
+
+    while (state.KeepRunning()) {
+        RIL_onUnsolicitedResponse(pCase->unsolResponse, pCase->data, pCase->datalen);
+
+        if (wakes) {
+            expireWakeTimeout();
+        }
+    }
+
+    if (s_hostWakeLocksHeld != 0) {
+        state.SkipWithError("wakelock was not released");
+    }
+
+    state.SetLabel(pCase->name);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RIL_onUnsolicitedResponse)->DenseRange(0, NUM_ELEMS(s_unsolCases) - 1);
+
+/*** Request framing ***/
+
+static void BM_record_stream_get_next(benchmark::State &state)
+{
+    size_t recordLen = state.range(0);
+    // as many records as fit in a pipe at once
+    size_t batch = 32 * 1024 / (recordLen + sizeof(uint32_t));
+    std::vector<uint8_t> stream(batch * (recordLen + sizeof(uint32_t)), 0x5a);
+    RecordStream *p_rs;
+    int filedes[2];
+    size_t records = 0;
+
+    for (size_t i = 0 ; i < batch ; i++) {
+        uint32_t header = htonl(recordLen);
+
+        memcpy(&stream[i * (recordLen + sizeof(header))], &header, sizeof(header));
+    }
+
+    if (pipe(filedes) < 0) {
+        state.SkipWithError("pipe() failed");
+        return;
+    }
+
+    p_rs = record_stream_new(filedes[0], MAX_COMMAND_BYTES);
+
+    while (state.KeepRunning()) {
+        void *p_record;
+        size_t len;
+
+        if (write(filedes[1], &stream[0], stream.size()) != (ssize_t) stream.size()) {
+            state.SkipWithError("short write");
+            break;
+        }
+
+        for (size_t i = 0 ; i < batch ; i++) {
+            if (record_stream_get_next(p_rs, &p_record, &len) < 0 || len != recordLen) {
+                state.SkipWithError("bad record");
+                break;
+            }
+            benchmark::DoNotOptimize(p_record);
+        }
+
+        records += batch;
+    }
+
+    record_stream_free(p_rs);
+    close(filedes[0]);
+    close(filedes[1]);
+
+    state.SetItemsProcessed(records);
+    state.SetBytesProcessed(records * recordLen);
+}
+// a parameterless request, a typical SMS and the largest RIL.java sends
+BENCHMARK(BM_record_stream_get_next)->Arg(8)->Arg(256)->Arg(MAX_COMMAND_BYTES);
+
+/*** Event loop wakeups ***/
+
+static sem_t s_wakeupSem;
+static int s_benchFdRead = -1;
+static int s_benchFdWrite = -1;
+static struct ril_event s_benchFdEvent;
+
+static void startBenchEventLoop()
+{
+    if (s_eventLoopStarted) {
+        return;
+    }
+
+    sem_init(&s_wakeupSem, 0, 0);
+
+    // eventLoop() makes its own wakeup pipe after signalling it started
+    close(s_fdWakeupRead);
+    close(s_fdWakeupWrite);
+    s_fdWakeupWrite = -1;
+
+    RIL_startEventLoop();
+    while (__atomic_load_n(&s_fdWakeupWrite, __ATOMIC_ACQUIRE) < 0) {
+        usleep(1000);
+    }
+
+    s_eventLoopStarted = true;
+}
+
+static void wakeupTimerCallback(void *param)
+{
+    sem_post(&s_wakeupSem);
+}
+
+static void wakeupFdCallback(int fd, short flags, void *param)
+{
+    char c;
+
+    if (read(fd, &c, 1) == 1) {
+        sem_post(&s_wakeupSem);
+    }
+}
+
+/** a timed callback with no delay, as vendor RILs use to get onto the loop */
+static void BM_ril_event_loop_timer(benchmark::State &state)
+{
+    startBenchEventLoop();
+
+    while (state.KeepRunning()) {
+        RIL_requestTimedCallback(wakeupTimerCallback, NULL, NULL);
+        sem_wait(&s_wakeupSem);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ril_event_loop_timer)->UseRealTime();
+
+/** a readable fd, as the command socket is when RIL.java sends a request */
+static void BM_ril_event_loop_fd(benchmark::State &state)
+{
+    startBenchEventLoop();
+
+    if (s_benchFdRead < 0) {
+        int filedes[2];
+
+        if (pipe(filedes) < 0) {
+            state.SkipWithError("pipe() failed");
+            return;
+        }
+
+        s_benchFdRead = filedes[0];
+        s_benchFdWrite = filedes[1];
+        ril_event_set(&s_benchFdEvent, s_benchFdRead, true, wakeupFdCallback, NULL);
+        rilEventAddWakeup(&s_benchFdEvent);
+    }
+
+    while (state.KeepRunning()) {
+        if (write(s_benchFdWrite, "", 1) != 1) {
+            state.SkipWithError("write() failed");
+            break;
+        }
+        sem_wait(&s_wakeupSem);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ril_event_loop_fd)->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    initBenchRil();
+    initResponses();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
@@ -0,0 +1,411 @@
+/* //device/libs/telephony/ril_fuzzer.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Fuzz harness for processCommandBuffer(), the parser for the request
+ * Parcels that arrive on the rild socket. Each input is one record as
+ * record_stream hands it over: request number, token and payload. The
+ * vendor RIL completes every request at once, so the response path runs
+ * as well.
+ *
+ * Besides crashes, an input fails if it makes libril allocate far more
+ * than its own size (RIL_FUZZ_ALLOC_BUDGET), which is how counts taken
+ * from the wire show up before they show up as OOMs.
+ *
+ * When built for libFuzzer (-DRIL_FUZZ_LIBFUZZER), libFuzzer supplies main().
+ * Otherwise main() runs the files named on the command line, or stdin,
+ * once each, which is what AFL expects:
+ *
+ *   ril_fuzzer_standalone [FILE|DIR]...
+ *
+ * With -t SECONDS it instead replays them for that long and reports
+ * records per second, allocations per record and the slowest record:
+ *
+ *   ril_fuzzer_standalone -t 10 corpus/
+ *
+ * Allocations are counted by linking with
+ *   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "ril_host.h"
+#include "ril.cpp"
+
+using namespace android;
+
+/*
+ * Parcel copy, arena, pointer arrays and UTF-8 strings together stay
+ * within a small multiple of the record; anything past this is a count
+ * from the wire being trusted.
+ */
+#define RIL_FUZZ_ALLOC_BUDGET(len) (16 * (len) + 64 * 1024)
+
+/*** Allocation counting ***/
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+}
+
+static bool s_countAllocs;
+static size_t s_allocCount;
+static size_t s_allocBytes;
+static int s_abandoned;
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    if (s_countAllocs) {
+        s_allocCount++;
+        s_allocBytes += size;
+    }
+    return __real_malloc(size);
+}
+
+extern "C" void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    if (s_countAllocs) {
+        s_allocCount++;
+        s_allocBytes += nmemb * size;
+    }
+    return __real_calloc(nmemb, size);
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (s_countAllocs) {
+        s_allocCount++;
+        s_allocBytes += size;
+    }
+    return __real_realloc(ptr, size);
+}
+
+/*** A vendor RIL that completes every request at once ***/
+
+static void fuzzOnRequest(int request, void *data, size_t datalen, RIL_Token t)
+{
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+}
+
+static RIL_RadioState fuzzOnStateRequest()
+{
+    return RADIO_STATE_ON;
+}
+
+static int fuzzSupports(int requestCode)
+{
+    return 1;
+}
+
+static void fuzzOnCancel(RIL_Token t)
+{
+}
+
+static const char *fuzzGetVersion()
+{
+    return "ril_fuzzer";
+}
+
+static const RIL_RadioFunctions s_fuzzCallbacks = {
+    RIL_VERSION,
+    fuzzOnRequest,
+    fuzzOnStateRequest,
+    fuzzSupports,
+    fuzzOnCancel,
+    fuzzGetVersion
+};
+
+/** stands in for RIL_register(), with responses going to /dev/null */
+static void initFuzzRil()
+{
+    memcpy(&s_callbacks, &s_fuzzCallbacks, sizeof(s_callbacks));
+    s_registerCalled = 1;
+
+    s_ril_param_socket.socket_id = RIL_SOCKET_1;
+    s_ril_param_socket.fdCommand = open("/dev/null", O_WRONLY);
+}
+
+/**
+ * An invalid command block is logged and the request is left pending,
+ * never to be completed. Reclaim those so that memory stays bounded over
+ * millions of inputs; returns how many there were.
+ */
+static int reclaimAbandonedRequests()
+{
+    int count = 0;
+
+    pthread_mutex_lock(&s_pendingRequestsMutex);
+    while (s_pendingRequests != NULL) {
+        RequestInfo *pRI = s_pendingRequests;
+
+        s_pendingRequests = pRI->p_next;
+        free(pRI);
+        count++;
+    }
+    pthread_mutex_unlock(&s_pendingRequestsMutex);
+
+    return count;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool initialized;
+
+    if (!initialized) {
+        initFuzzRil();
+        initialized = true;
+    }
+
+    s_allocCount = 0;
+    s_allocBytes = 0;
+
+    s_countAllocs = true;
+    processCommandBuffer(const_cast<uint8_t *>(data), size, RIL_SOCKET_1);
+    s_countAllocs = false;
+
+    s_abandoned = reclaimAbandonedRequests();
+
+    if (s_allocBytes > RIL_FUZZ_ALLOC_BUDGET(size)) {
+        fprintf(stderr, "ril_fuzzer: %zu byte record allocated %zu bytes in %zu calls\n",
+                size, s_allocBytes, s_allocCount);
+        abort();
+    }
+
+    return 0;
+}
+
+#ifndef RIL_FUZZ_LIBFUZZER
+
+typedef struct {
+    char *path;
+    uint8_t *data;
+    size_t len;
+} FuzzInput;
+
+static FuzzInput *s_inputs;
+static size_t s_numInputs;
+
+static int64_t nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void addInput(const char *path, uint8_t *data, size_t len)
+{
+    FuzzInput *inputs = (FuzzInput *) realloc(s_inputs, (s_numInputs + 1) * sizeof(FuzzInput));
+
+    if (inputs == NULL) {
+        fprintf(stderr, "ril_fuzzer: out of memory\n");
+        exit(1);
+    }
+
+    s_inputs = inputs;
+    s_inputs[s_numInputs].path = strdup(path);
+    s_inputs[s_numInputs].data = data;
+    s_inputs[s_numInputs].len = len;
+    s_numInputs++;
+}
+
+static int readInput(const char *path, int fd)
+{
+    uint8_t *data = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    ssize_t n;
+
+    for (;;) {
+        if (len == capacity) {
+            uint8_t *grown;
+
+            capacity = capacity == 0 ? 4096 : capacity * 2;
+            grown = (uint8_t *) realloc(data, capacity);
+            if (grown == NULL) {
+                free(data);
+                return -1;
+            }
+            data = grown;
+        }
+
+        n = read(fd, data + len, capacity - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            free(data);
+            return -1;
+        } else if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+
+    addInput(path, data, len);
+    return 0;
+}
+
+static int readInputs(const char *path)
+{
+    struct stat st;
+    int fd;
+    int ret;
+
+    if (stat(path, &st) < 0) {
+        fprintf(stderr, "ril_fuzzer: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path);
+        struct dirent *entry;
+
+        if (dir == NULL) {
+            fprintf(stderr, "ril_fuzzer: %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+
+        ret = 0;
+        while (ret == 0 && (entry = readdir(dir)) != NULL) {
+            char child[PATH_MAX];
+
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            ret = readInputs(child);
+        }
+        closedir(dir);
+        return ret;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ril_fuzzer: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    ret = readInput(path, fd);
+    close(fd);
+    return ret;
+}
+
+/** replays the inputs for the given time and reports the cost per record */
+static void runThroughput(int seconds)
+{
+    int64_t start = nowNs();
+    int64_t deadline = start + seconds * 1000000000LL;
+    int64_t elapsed;
+    int64_t slowestNs = 0;
+    size_t slowest = 0;
+    size_t records = 0;
+    size_t bytes = 0;
+    size_t allocs = 0;
+    size_t allocBytes = 0;
+    size_t invalid = 0;
+
+    do {
+        for (size_t i = 0 ; i < s_numInputs ; i++) {
+            int64_t before = nowNs();
+            int64_t ns;
+
+            LLVMFuzzerTestOneInput(s_inputs[i].data, s_inputs[i].len);
+            ns = nowNs() - before;
+
+            invalid += s_abandoned;
+            records++;
+            bytes += s_inputs[i].len;
+            allocs += s_allocCount;
+            allocBytes += s_allocBytes;
+
+            if (ns > slowestNs) {
+                slowestNs = ns;
+                slowest = i;
+            }
+        }
+    } while (nowNs() < deadline);
+
+    elapsed = nowNs() - start;
+
+    printf("%zu records, %zu bytes in %.2f s\n", records, bytes, elapsed / 1e9);
+    printf("%.0f records/s, %.1f MB/s\n",
+            records * 1e9 / elapsed, bytes * 1e3 / elapsed);
+    printf("%.2f allocations, %.0f bytes allocated per record\n",
+            (double) allocs / records, (double) allocBytes / records);
+    printf("%zu invalid command blocks\n", invalid);
+    printf("slowest: %s, %zu bytes in %lld ns\n",
+            s_inputs[slowest].path, s_inputs[slowest].len, (long long) slowestNs);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-t seconds] [file|dir]...\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't':
+                seconds = atoi(optarg);
+                if (seconds <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind == argc) {
+        if (readInput("<stdin>", STDIN_FILENO) < 0) {
+            fprintf(stderr, "ril_fuzzer: reading stdin: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    for (int i = optind ; i < argc ; i++) {
+        if (readInputs(argv[i]) < 0) {
+            return 1;
+        }
+    }
+
+    if (s_numInputs == 0) {
+        fprintf(stderr, "ril_fuzzer: no inputs\n");
+        return 1;
+    }
+
+    if (seconds > 0) {
+        runThroughput(seconds);
+    } else {
+        for (size_t i = 0 ; i < s_numInputs ; i++) {
+            LLVMFuzzerTestOneInput(s_inputs[i].data, s_inputs[i].len);
+        }
+    }
+
+    return 0;
+}
+
+#endif // RIL_FUZZ_LIBFUZZER
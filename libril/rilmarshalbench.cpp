@@ -0,0 +1,709 @@
+/* //device/libs/telephony/rilmarshalbench.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * rilmarshalbench times the schema-driven response marshallers in
+ * rilMarshal.h against the field-by-field writers ril.cpp used before
+ * them, which are kept here as the reference. Each case first checks
+ * that both produce byte-identical parcels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rilMarshal.h"
+
+using namespace android;
+
+#define NS_PER_S 1000000000LL
+
+static long long now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+/*** The hand-written writers, as they were in ril.cpp ***/
+
+static void writeStringToParcel(Parcel &p, const char *s) {
+    char16_t *s16;
+    size_t s16_len;
+    s16 = strdup8to16(s, &s16_len);
+    p.writeString16(s16, s16_len);
+    free(s16);
+}
+
+static void legacyDataCallListV4(Parcel &p, void *response, size_t responselen) {
+    p.writeInt32(4);
+
+    int num = responselen / sizeof(RIL_Data_Call_Response_v4);
+    p.writeInt32(num);
+
+    RIL_Data_Call_Response_v4 *p_cur = (RIL_Data_Call_Response_v4 *) response;
+    for (int i = 0; i < num; i++) {
+        p.writeInt32(p_cur[i].cid);
+        p.writeInt32(p_cur[i].active);
+        writeStringToParcel(p, p_cur[i].type);
+        // apn is not used, so don't send.
+        writeStringToParcel(p, p_cur[i].address);
+    }
+}
+
+static void legacyDataCallListV6(Parcel &p, void *response, size_t responselen) {
+    p.writeInt32(6);
+
+    int num = responselen / sizeof(RIL_Data_Call_Response_v6);
+    p.writeInt32(num);
+
+    RIL_Data_Call_Response_v6 *p_cur = (RIL_Data_Call_Response_v6 *) response;
+    for (int i = 0; i < num; i++) {
+        p.writeInt32((int)p_cur[i].status);
+        p.writeInt32(p_cur[i].suggestedRetryTime);
+        p.writeInt32(p_cur[i].cid);
+        p.writeInt32(p_cur[i].active);
+        writeStringToParcel(p, p_cur[i].type);
+        writeStringToParcel(p, p_cur[i].ifname);
+        writeStringToParcel(p, p_cur[i].addresses);
+        writeStringToParcel(p, p_cur[i].dnses);
+        writeStringToParcel(p, p_cur[i].gateways);
+    }
+}
+
+static void legacyDataCallListV9(Parcel &p, void *response, size_t responselen) {
+    p.writeInt32(10);
+
+    int num = responselen / sizeof(RIL_Data_Call_Response_v9);
+    p.writeInt32(num);
+
+    RIL_Data_Call_Response_v9 *p_cur = (RIL_Data_Call_Response_v9 *) response;
+    for (int i = 0; i < num; i++) {
+        p.writeInt32((int)p_cur[i].status);
+        p.writeInt32(p_cur[i].suggestedRetryTime);
+        p.writeInt32(p_cur[i].cid);
+        p.writeInt32(p_cur[i].active);
+        writeStringToParcel(p, p_cur[i].type);
+        writeStringToParcel(p, p_cur[i].ifname);
+        writeStringToParcel(p, p_cur[i].addresses);
+        writeStringToParcel(p, p_cur[i].dnses);
+        writeStringToParcel(p, p_cur[i].gateways);
+        writeStringToParcel(p, p_cur[i].pcscf);
+    }
+}
+
+static void legacyDataCallListV11(Parcel &p, void *response, size_t responselen) {
+    p.writeInt32(11);
+
+    int num = responselen / sizeof(RIL_Data_Call_Response_v11);
+    p.writeInt32(num);
+
+    RIL_Data_Call_Response_v11 *p_cur = (RIL_Data_Call_Response_v11 *) response;
+    for (int i = 0; i < num; i++) {
+        p.writeInt32((int)p_cur[i].status);
+        p.writeInt32(p_cur[i].suggestedRetryTime);
+        p.writeInt32(p_cur[i].cid);
+        p.writeInt32(p_cur[i].active);
+        writeStringToParcel(p, p_cur[i].type);
+        writeStringToParcel(p, p_cur[i].ifname);
+        writeStringToParcel(p, p_cur[i].addresses);
+        writeStringToParcel(p, p_cur[i].dnses);
+        writeStringToParcel(p, p_cur[i].gateways);
+        writeStringToParcel(p, p_cur[i].pcscf);
+        p.writeInt32(p_cur[i].mtu);
+    }
+}
+
+static void legacyCellInfoListV6(Parcel &p, void *response, size_t responselen) {
+    int num = responselen / sizeof(RIL_CellInfo);
+    p.writeInt32(num);
+
+    RIL_CellInfo *p_cur = (RIL_CellInfo *) response;
+    for (int i = 0; i < num; i++) {
+        p.writeInt32((int)p_cur->cellInfoType);
+        p.writeInt32(p_cur->registered);
+        p.writeInt32(p_cur->timeStampType);
+        p.writeInt64(p_cur->timeStamp);
+        switch(p_cur->cellInfoType) {
+            case RIL_CELL_INFO_TYPE_GSM: {
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mcc);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mnc);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.lac);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.cid);
+                p.writeInt32(INT_MAX); /* skip arfcn */
+                p.writeInt32(INT_MAX); /* skip bsic */
+                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.signalStrength);
+                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.bitErrorRate);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_WCDMA: {
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mcc);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mnc);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.lac);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.cid);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.psc);
+                p.writeInt32(INT_MAX); /* skip uarfcn */
+                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.signalStrength);
+                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.bitErrorRate);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_CDMA: {
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.networkId);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.systemId);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.basestationId);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.longitude);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.latitude);
+
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.dbm);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.ecio);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.dbm);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.ecio);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_LTE: {
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mcc);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mnc);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.ci);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.pci);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.tac);
+                p.writeInt32(INT_MAX); /* skip earfcn */
+
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.signalStrength);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrp);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrq);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rssnr);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.cqi);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.timingAdvance);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_TD_SCDMA: {
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mcc);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.lac);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cid);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cpid);
+                p.writeInt32(p_cur->CellInfo.tdscdma.signalStrengthTdscdma.rscp);
+                break;
+            }
+        }
+        p_cur += 1;
+    }
+}
+
+static void legacyCellInfoListV12(Parcel &p, void *response, size_t responselen) {
+    int num = responselen / sizeof(RIL_CellInfo_v12);
+    p.writeInt32(num);
+
+    RIL_CellInfo_v12 *p_cur = (RIL_CellInfo_v12 *) response;
+    for (int i = 0; i < num; i++) {
+        p.writeInt32((int)p_cur->cellInfoType);
+        p.writeInt32(p_cur->registered);
+        p.writeInt32(p_cur->timeStampType);
+        p.writeInt64(p_cur->timeStamp);
+        switch(p_cur->cellInfoType) {
+            case RIL_CELL_INFO_TYPE_GSM: {
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mcc);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.mnc);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.lac);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.cid);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.arfcn);
+                p.writeInt32(p_cur->CellInfo.gsm.cellIdentityGsm.bsic);
+                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.signalStrength);
+                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.bitErrorRate);
+                p.writeInt32(p_cur->CellInfo.gsm.signalStrengthGsm.timingAdvance);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_WCDMA: {
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mcc);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.mnc);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.lac);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.cid);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.psc);
+                p.writeInt32(p_cur->CellInfo.wcdma.cellIdentityWcdma.uarfcn);
+                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.signalStrength);
+                p.writeInt32(p_cur->CellInfo.wcdma.signalStrengthWcdma.bitErrorRate);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_CDMA: {
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.networkId);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.systemId);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.basestationId);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.longitude);
+                p.writeInt32(p_cur->CellInfo.cdma.cellIdentityCdma.latitude);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.dbm);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthCdma.ecio);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.dbm);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.ecio);
+                p.writeInt32(p_cur->CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_LTE: {
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mcc);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.mnc);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.ci);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.pci);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.tac);
+                p.writeInt32(p_cur->CellInfo.lte.cellIdentityLte.earfcn);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.signalStrength);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrp);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rsrq);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.rssnr);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.cqi);
+                p.writeInt32(p_cur->CellInfo.lte.signalStrengthLte.timingAdvance);
+                break;
+            }
+            case RIL_CELL_INFO_TYPE_TD_SCDMA: {
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mcc);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.lac);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cid);
+                p.writeInt32(p_cur->CellInfo.tdscdma.cellIdentityTdscdma.cpid);
+                p.writeInt32(p_cur->CellInfo.tdscdma.signalStrengthTdscdma.rscp);
+                break;
+            }
+        }
+        p_cur += 1;
+    }
+}
+
+static void legacySignalStrengthV5Part(Parcel &p, RIL_SignalStrength_v10 *p_cur) {
+    p.writeInt32(p_cur->GW_SignalStrength.signalStrength);
+    p.writeInt32(p_cur->GW_SignalStrength.bitErrorRate);
+    p.writeInt32(p_cur->CDMA_SignalStrength.dbm);
+    p.writeInt32(p_cur->CDMA_SignalStrength.ecio);
+    p.writeInt32(p_cur->EVDO_SignalStrength.dbm);
+    p.writeInt32(p_cur->EVDO_SignalStrength.ecio);
+    p.writeInt32(p_cur->EVDO_SignalStrength.signalNoiseRatio);
+}
+
+static void legacySignalStrengthV6Extra(Parcel &p, RIL_SignalStrength_v10 *p_cur) {
+    /*
+     * Fixup LTE for backwards compatibility
+     */
+    // signalStrength: -1 -> 99
+    if (p_cur->LTE_SignalStrength.signalStrength == -1) {
+        p_cur->LTE_SignalStrength.signalStrength = 99;
+    }
+    // rsrp: -1 -> INT_MAX all other negative value to positive.
+    // So remap here
+    if (p_cur->LTE_SignalStrength.rsrp == -1) {
+        p_cur->LTE_SignalStrength.rsrp = INT_MAX;
+    } else if (p_cur->LTE_SignalStrength.rsrp < -1) {
+        p_cur->LTE_SignalStrength.rsrp = -p_cur->LTE_SignalStrength.rsrp;
+    }
+    // rsrq: -1 -> INT_MAX
+    if (p_cur->LTE_SignalStrength.rsrq == -1) {
+        p_cur->LTE_SignalStrength.rsrq = INT_MAX;
+    }
+    // Not remapping rssnr is already using INT_MAX
+
+    // cqi: -1 -> INT_MAX
+    if (p_cur->LTE_SignalStrength.cqi == -1) {
+        p_cur->LTE_SignalStrength.cqi = INT_MAX;
+    }
+
+    p.writeInt32(p_cur->LTE_SignalStrength.signalStrength);
+    p.writeInt32(p_cur->LTE_SignalStrength.rsrp);
+    p.writeInt32(p_cur->LTE_SignalStrength.rsrq);
+    p.writeInt32(p_cur->LTE_SignalStrength.rssnr);
+    p.writeInt32(p_cur->LTE_SignalStrength.cqi);
+}
+
+/*
+ * The fixups remap the vendor's struct in place, so the signal strength
+ * writers work on a copy; otherwise the first run would hide the second's
+ * remapping.
+ */
+static void copySignalStrength(RIL_SignalStrength_v10 *copy, void *response,
+        size_t responselen) {
+    memset(copy, 0, sizeof(*copy));
+    memcpy(copy, response, responselen);
+}
+
+static void legacySignalStrengthV5(Parcel &p, void *response, size_t responselen) {
+    RIL_SignalStrength_v10 cur;
+
+    copySignalStrength(&cur, response, responselen);
+    legacySignalStrengthV5Part(p, &cur);
+    p.writeInt32(99);
+    p.writeInt32(INT_MAX);
+    p.writeInt32(INT_MAX);
+    p.writeInt32(INT_MAX);
+    p.writeInt32(INT_MAX);
+    p.writeInt32(INT_MAX);
+}
+
+static void legacySignalStrengthV6(Parcel &p, void *response, size_t responselen) {
+    RIL_SignalStrength_v10 cur;
+
+    copySignalStrength(&cur, response, responselen);
+    legacySignalStrengthV5Part(p, &cur);
+    legacySignalStrengthV6Extra(p, &cur);
+    p.writeInt32(INT_MAX);
+}
+
+static void legacySignalStrengthV10(Parcel &p, void *response, size_t responselen) {
+    RIL_SignalStrength_v10 *p_cur = (RIL_SignalStrength_v10 *) response;
+
+    p.writeInt32(p_cur->GW_SignalStrength.signalStrength);
+    p.writeInt32(p_cur->GW_SignalStrength.bitErrorRate);
+    p.writeInt32(p_cur->CDMA_SignalStrength.dbm);
+    p.writeInt32(p_cur->CDMA_SignalStrength.ecio);
+    p.writeInt32(p_cur->EVDO_SignalStrength.dbm);
+    p.writeInt32(p_cur->EVDO_SignalStrength.ecio);
+    p.writeInt32(p_cur->EVDO_SignalStrength.signalNoiseRatio);
+    p.writeInt32(p_cur->LTE_SignalStrength.signalStrength);
+    p.writeInt32(p_cur->LTE_SignalStrength.rsrp);
+    p.writeInt32(p_cur->LTE_SignalStrength.rsrq);
+    p.writeInt32(p_cur->LTE_SignalStrength.rssnr);
+    p.writeInt32(p_cur->LTE_SignalStrength.cqi);
+    p.writeInt32(p_cur->TD_SCDMA_SignalStrength.rscp);
+}
+
+static void legacySimStatusV5(Parcel &p, void *response, size_t responselen) {
+    RIL_CardStatus_v5 *p_cur = ((RIL_CardStatus_v5 *) response);
+
+    p.writeInt32(p_cur->card_state);
+    p.writeInt32(p_cur->universal_pin_state);
+    p.writeInt32(p_cur->gsm_umts_subscription_app_index);
+    p.writeInt32(p_cur->cdma_subscription_app_index);
+    p.writeInt32(-1);
+
+    p.writeInt32(p_cur->num_applications);
+    for (int i = 0; i < p_cur->num_applications; i++) {
+        RIL_AppStatus *appStatus = &p_cur->applications[i];
+
+        p.writeInt32(appStatus->app_type);
+        p.writeInt32(appStatus->app_state);
+        p.writeInt32(appStatus->perso_substate);
+        writeStringToParcel(p, (const char*)(appStatus->aid_ptr));
+        writeStringToParcel(p, (const char*)(appStatus->app_label_ptr));
+        p.writeInt32(appStatus->pin1_replaced);
+        p.writeInt32(appStatus->pin1);
+        p.writeInt32(appStatus->pin2);
+    }
+}
+
+static void legacySimStatusV6(Parcel &p, void *response, size_t responselen) {
+    RIL_CardStatus_v6 *p_cur = ((RIL_CardStatus_v6 *) response);
+
+    p.writeInt32(p_cur->card_state);
+    p.writeInt32(p_cur->universal_pin_state);
+    p.writeInt32(p_cur->gsm_umts_subscription_app_index);
+    p.writeInt32(p_cur->cdma_subscription_app_index);
+    p.writeInt32(p_cur->ims_subscription_app_index);
+
+    p.writeInt32(p_cur->num_applications);
+    for (int i = 0; i < p_cur->num_applications; i++) {
+        RIL_AppStatus *appStatus = &p_cur->applications[i];
+
+        p.writeInt32(appStatus->app_type);
+        p.writeInt32(appStatus->app_state);
+        p.writeInt32(appStatus->perso_substate);
+        writeStringToParcel(p, (const char*)(appStatus->aid_ptr));
+        writeStringToParcel(p, (const char*)(appStatus->app_label_ptr));
+        p.writeInt32(appStatus->pin1_replaced);
+        p.writeInt32(appStatus->pin1);
+        p.writeInt32(appStatus->pin2);
+    }
+}
+
+/*** The schema-driven marshallers, called as ril.cpp calls them ***/
+
+static void tableDataCallListV4(Parcel &p, void *response, size_t responselen) {
+    marshalDataCallList(p, s_dataCallV4Schema, 4, response,
+            sizeof(RIL_Data_Call_Response_v4),
+            responselen / sizeof(RIL_Data_Call_Response_v4));
+}
+
+static void tableDataCallListV6(Parcel &p, void *response, size_t responselen) {
+    marshalDataCallList(p, s_dataCallV6Schema, 6, response,
+            sizeof(RIL_Data_Call_Response_v6),
+            responselen / sizeof(RIL_Data_Call_Response_v6));
+}
+
+static void tableDataCallListV9(Parcel &p, void *response, size_t responselen) {
+    marshalDataCallList(p, s_dataCallV9Schema, 10, response,
+            sizeof(RIL_Data_Call_Response_v9),
+            responselen / sizeof(RIL_Data_Call_Response_v9));
+}
+
+static void tableDataCallListV11(Parcel &p, void *response, size_t responselen) {
+    marshalDataCallList(p, s_dataCallV11Schema, 11, response,
+            sizeof(RIL_Data_Call_Response_v11),
+            responselen / sizeof(RIL_Data_Call_Response_v11));
+}
+
+static void tableCellInfoListV6(Parcel &p, void *response, size_t responselen) {
+    marshalCellInfoList(p, false, response, responselen / sizeof(RIL_CellInfo));
+}
+
+static void tableCellInfoListV12(Parcel &p, void *response, size_t responselen) {
+    marshalCellInfoList(p, true, response, responselen / sizeof(RIL_CellInfo_v12));
+}
+
+static void tableSignalStrengthV5(Parcel &p, void *response, size_t responselen) {
+    RIL_SignalStrength_v10 cur;
+
+    copySignalStrength(&cur, response, responselen);
+    marshalSignalStrength(p, s_signalStrengthV5Schema, &cur);
+}
+
+static void tableSignalStrengthV6(Parcel &p, void *response, size_t responselen) {
+    RIL_SignalStrength_v10 cur;
+
+    copySignalStrength(&cur, response, responselen);
+    fixupLteSignalStrength(&cur);
+    marshalSignalStrength(p, s_signalStrengthV6Schema, &cur);
+}
+
+static void tableSignalStrengthV10(Parcel &p, void *response, size_t responselen) {
+    marshalSignalStrength(p, s_signalStrengthV10Schema,
+            (RIL_SignalStrength_v10 *) response);
+}
+
+static void tableSimStatusV5(Parcel &p, void *response, size_t responselen) {
+    RIL_CardStatus_v5 *p_cur = ((RIL_CardStatus_v5 *) response);
+
+    marshalCardStatus(p, s_cardStatusV5Schema, p_cur, p_cur->applications,
+            p_cur->num_applications);
+}
+
+static void tableSimStatusV6(Parcel &p, void *response, size_t responselen) {
+    RIL_CardStatus_v6 *p_cur = ((RIL_CardStatus_v6 *) response);
+
+    marshalCardStatus(p, s_cardStatusV6Schema, p_cur, p_cur->applications,
+            p_cur->num_applications);
+}
+
+/*** Test data, typical of what reference-ril and vendor RILs report ***/
+
+static RIL_Data_Call_Response_v11 s_dataCalls[4];
+static RIL_Data_Call_Response_v4 s_dataCallsV4[4];
+static RIL_Data_Call_Response_v6 s_dataCallsV6[4];
+static RIL_Data_Call_Response_v9 s_dataCallsV9[4];
+static RIL_CellInfo_v12 s_cells[12];
+static RIL_CellInfo s_cellsV6[12];
+static RIL_SignalStrength_v10 s_signalStrength;
+static RIL_SignalStrength_v5 s_signalStrengthV5;
+static RIL_SignalStrength_v6 s_signalStrengthV6;
+static RIL_CardStatus_v6 s_cardStatus;
+static RIL_CardStatus_v5 s_cardStatusV5;
+
+static void initTestData()
+{
+    for (size_t i = 0 ; i < sizeof(s_dataCalls) / sizeof(s_dataCalls[0]) ; i++) {
+        RIL_Data_Call_Response_v11 *call = &s_dataCalls[i];
+
+        call->status = 0;
+        call->suggestedRetryTime = -1;
+        call->cid = i + 1;
+        call->active = 2;
+        call->type = (char *) "IPV4V6";
+        call->ifname = (char *) "rmnet_data0";
+        call->addresses = (char *) "10.0.2.15/24 2001:db8:1234::15/64";
+        call->dnses = (char *) "10.0.2.3 2001:db8:1234::3";
+        call->gateways = (char *) "10.0.2.2 fe80::1";
+        call->pcscf = (i == 0) ? (char *) "2001:db8:1234::7" : NULL;
+        call->mtu = 1500;
+
+        s_dataCallsV4[i].cid = call->cid;
+        s_dataCallsV4[i].active = call->active;
+        s_dataCallsV4[i].type = call->type;
+        s_dataCallsV4[i].apn = (char *) "internet";
+        s_dataCallsV4[i].address = (i == 0) ? (char *) "10.0.2.15" : NULL;
+
+        // v6 and v9 are each a prefix of v11
+        memcpy(&s_dataCallsV6[i], call, sizeof(s_dataCallsV6[i]));
+        memcpy(&s_dataCallsV9[i], call, sizeof(s_dataCallsV9[i]));
+    }
+
+    for (size_t i = 0 ; i < sizeof(s_cells) / sizeof(s_cells[0]) ; i++) {
+        RIL_CellInfo_v12 *cell = &s_cells[i];
+
+        memset(cell, 0, sizeof(*cell));
+        cell->cellInfoType = (RIL_CellInfoType)(i % 5 + 1);
+        cell->registered = (i == 0);
+        cell->timeStampType = RIL_TIMESTAMP_TYPE_OEM_RIL;
+        cell->timeStamp = 123456789012345ULL + i;
+        // fill the union with recognisable, distinct ints
+        int *ints = (int *) &cell->CellInfo;
+        for (size_t j = 0 ; j < sizeof(cell->CellInfo) / sizeof(int) ; j++) {
+            ints[j] = (int)(i * 100 + j);
+        }
+        if (cell->cellInfoType == RIL_CELL_INFO_TYPE_GSM) {
+            cell->CellInfo.gsm.cellIdentityGsm.bsic = 0x3f;
+        }
+    }
+
+    for (size_t i = 0 ; i < sizeof(s_cellsV6) / sizeof(s_cellsV6[0]) ; i++) {
+        RIL_CellInfo *cell = &s_cellsV6[i];
+
+        memset(cell, 0, sizeof(*cell));
+        cell->cellInfoType = (RIL_CellInfoType)(i % 5 + 1);
+        cell->registered = (i == 0);
+        cell->timeStampType = RIL_TIMESTAMP_TYPE_OEM_RIL;
+        cell->timeStamp = 123456789012345ULL + i;
+        int *ints = (int *) &cell->CellInfo;
+        for (size_t j = 0 ; j < sizeof(cell->CellInfo) / sizeof(int) ; j++) {
+            ints[j] = (int)(i * 100 + j);
+        }
+    }
+
+    int *ints = (int *) &s_signalStrength;
+    for (size_t j = 0 ; j < sizeof(s_signalStrength) / sizeof(int) ; j++) {
+        ints[j] = (int)(j * 7 - 20);
+    }
+    memcpy(&s_signalStrengthV5, &s_signalStrength, sizeof(s_signalStrengthV5));
+    memcpy(&s_signalStrengthV6, &s_signalStrength, sizeof(s_signalStrengthV6));
+    // the unknown values the LTE fixups remap
+    s_signalStrengthV6.LTE_SignalStrength.signalStrength = -1;
+    s_signalStrengthV6.LTE_SignalStrength.rsrp = -110;
+    s_signalStrengthV6.LTE_SignalStrength.rsrq = -1;
+    s_signalStrengthV6.LTE_SignalStrength.rssnr = INT_MAX;
+    s_signalStrengthV6.LTE_SignalStrength.cqi = -1;
+
+    memset(&s_cardStatus, 0, sizeof(s_cardStatus));
+    s_cardStatus.card_state = RIL_CARDSTATE_PRESENT;
+    s_cardStatus.universal_pin_state = RIL_PINSTATE_UNKNOWN;
+    s_cardStatus.gsm_umts_subscription_app_index = 0;
+    s_cardStatus.cdma_subscription_app_index = -1;
+    s_cardStatus.ims_subscription_app_index = 1;
+    s_cardStatus.num_applications = 2;
+    for (int i = 0 ; i < 2 ; i++) {
+        RIL_AppStatus *app = &s_cardStatus.applications[i];
+
+        app->app_type = (i == 0) ? RIL_APPTYPE_USIM : RIL_APPTYPE_ISIM;
+        app->app_state = RIL_APPSTATE_READY;
+        app->perso_substate = RIL_PERSOSUBSTATE_READY;
+        app->aid_ptr = (char *) "A0000000871002FF49FF0589";
+        app->app_label_ptr = (i == 0) ? (char *) "USIM" : NULL;
+        app->pin1_replaced = 0;
+        app->pin1 = RIL_PINSTATE_ENABLED_NOT_VERIFIED;
+        app->pin2 = RIL_PINSTATE_UNKNOWN;
+    }
+
+    memset(&s_cardStatusV5, 0, sizeof(s_cardStatusV5));
+    s_cardStatusV5.card_state = s_cardStatus.card_state;
+    s_cardStatusV5.universal_pin_state = s_cardStatus.universal_pin_state;
+    s_cardStatusV5.gsm_umts_subscription_app_index = 0;
+    s_cardStatusV5.cdma_subscription_app_index = 1;
+    s_cardStatusV5.num_applications = 2;
+    memcpy(s_cardStatusV5.applications, s_cardStatus.applications,
+            sizeof(s_cardStatusV5.applications));
+}
+
+/*** Benchmark ***/
+
+typedef void (*Marshaller)(Parcel &p, void *response, size_t responselen);
+
+static long long timeMarshaller(Marshaller marshal, void *response, size_t responselen,
+        int count)
+{
+    long long startNsec = now();
+
+    for (int i = 0 ; i < count ; i++) {
+        // as RIL_onRequestComplete() does: a fresh parcel after a header
+        Parcel p;
+
+        p.writeInt32(0);
+        p.writeInt32(i);
+        p.writeInt32(0);
+        marshal(p, response, responselen);
+    }
+
+    return (now() - startNsec) / count;
+}
+
+static int runCase(const char *name, Marshaller legacy, Marshaller table,
+        void *response, size_t responselen, int count)
+{
+    Parcel expected, actual;
+    long long legacyNsec, tableNsec;
+
+    legacy(expected, response, responselen);
+    table(actual, response, responselen);
+
+    if (expected.dataSize() != actual.dataSize()
+            || memcmp(expected.data(), actual.data(), expected.dataSize()) != 0) {
+        printf("%-20s MISMATCH: %zu bytes, expected %zu\n", name,
+                actual.dataSize(), expected.dataSize());
+        return 1;
+    }
+
+    legacyNsec = timeMarshaller(legacy, response, responselen, count);
+    tableNsec = timeMarshaller(table, response, responselen, count);
+
+    printf("%-20s %5zu bytes  legacy %6lld ns  table %6lld ns  %.2fx\n", name,
+            actual.dataSize(), legacyNsec, tableNsec,
+            tableNsec > 0 ? (double) legacyNsec / tableNsec : 0.0);
+    return 0;
+}
+
+static void usage(const char *s)
+{
+    fprintf(stderr, "usage: %s [-n <iterations>]\n", s);
+    exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+    int count = 100000;
+    int opt;
+    int failures = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "n:"))) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (count <= 0) {
+        usage(argv[0]);
+    }
+
+    initTestData();
+
+    failures += runCase("DataCallListV4", legacyDataCallListV4, tableDataCallListV4,
+            s_dataCallsV4, sizeof(s_dataCallsV4), count);
+    failures += runCase("DataCallListV6", legacyDataCallListV6, tableDataCallListV6,
+            s_dataCallsV6, sizeof(s_dataCallsV6), count);
+    failures += runCase("DataCallListV9", legacyDataCallListV9, tableDataCallListV9,
+            s_dataCallsV9, sizeof(s_dataCallsV9), count);
+    failures += runCase("DataCallListV11", legacyDataCallListV11, tableDataCallListV11,
+            s_dataCalls, sizeof(s_dataCalls), count);
+    failures += runCase("CellInfoListV6", legacyCellInfoListV6, tableCellInfoListV6,
+            s_cellsV6, sizeof(s_cellsV6), count);
+    failures += runCase("CellInfoListV12", legacyCellInfoListV12, tableCellInfoListV12,
+            s_cells, sizeof(s_cells), count);
+    failures += runCase("SignalStrengthV5", legacySignalStrengthV5, tableSignalStrengthV5,
+            &s_signalStrengthV5, sizeof(s_signalStrengthV5), count);
+    failures += runCase("SignalStrengthV6", legacySignalStrengthV6, tableSignalStrengthV6,
+            &s_signalStrengthV6, sizeof(s_signalStrengthV6), count);
+    failures += runCase("SignalStrengthV10", legacySignalStrengthV10, tableSignalStrengthV10,
+            &s_signalStrength, sizeof(s_signalStrength), count);
+    failures += runCase("SimStatusV5", legacySimStatusV5, tableSimStatusV5,
+            &s_cardStatusV5, sizeof(s_cardStatusV5), count);
+    failures += runCase("SimStatusV6", legacySimStatusV6, tableSimStatusV6,
+            &s_cardStatus, sizeof(s_cardStatus), count);
+
+    return failures == 0 ? 0 : 1;
+}
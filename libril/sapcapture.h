@@ -0,0 +1,49 @@
+/* //device/libs/telephony/sapcapture.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef SAPCAPTURE_H
+#define SAPCAPTURE_H 1
+
+#include <stdint.h>
+
+/*
+ * SAP message capture format, written by RilSapSocket (see
+ * RilSapSocket::startCapture()).
+ *
+ * The file starts with SAP_CAPTURE_MAGIC, followed by records. Each
+ * record is a SapCaptureRecord followed by "length" bytes of encoded
+ * MsgHeader, without the length prefix it has on the socket.
+ * All fields are in host byte order.
+ */
+
+#define SAP_CAPTURE_MAGIC "SAPCAP01"
+#define SAP_CAPTURE_MAGIC_LEN 8
+
+typedef enum {
+    SAP_CAPTURE_REQUEST = '<',  /* record read from the SAP socket */
+    SAP_CAPTURE_RESPONSE = '>', /* response or unsol written to it */
+} SapCaptureType;
+
+typedef struct {
+    uint64_t timestampNsec;     /* CLOCK_MONOTONIC */
+    uint32_t length;
+    uint8_t type;               /* SapCaptureType */
+    uint8_t socketId;           /* RIL_SOCKET_ID */
+    uint8_t reserved[2];
+} SapCaptureRecord;
+
+#endif /*SAPCAPTURE_H*/
@@ -48,4 +48,47 @@ else
   include $(BUILD_EXECUTABLE)
 endif
 
+# For atreplay host tool
+# ======================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    atreplay.c \
+    hostmodem.c
+
+LOCAL_CFLAGS := -D_GNU_SOURCE
+
+LOCAL_MODULE:= atreplay
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# For at_tok_benchmark, the AT tokenizers over a corpus of response lines
+# ========================================================================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    at_tok_benchmark.cpp \
+    at_tok.c
+
+LOCAL_MODULE:= at_tok_benchmark
+
+include $(BUILD_HOST_NATIVE_BENCHMARK)
+
+# For atsim host modem simulator
+# ==============================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    atsim.c \
+    hostmodem.c
+
+LOCAL_CFLAGS := -D_GNU_SOURCE
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE:= atsim
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
 endif # BOARD_PROVIDES_LIBREFERENCE_RIL
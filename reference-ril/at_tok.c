@@ -19,6 +19,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdarg.h>
 
 /**
  * Starts tokenizing an AT response string
@@ -188,3 +189,255 @@ int at_tok_hasmore(char **p_cur)
 }
 
 
+/**
+ * Starts tokenizing an AT response line without modifying it.
+ * *p_cur is set to the part of the line following the prefix
+ * returns -1 if this is not a valid response string, 0 on success.
+ */
+int at_span_start(const char *line, ATSpan *p_cur)
+{
+    const char *colon;
+
+    if (line == NULL) {
+        return -1;
+    }
+
+    // skip prefix
+    // consume "^[^:]:"
+
+    colon = strchr(line, ':');
+
+    if (colon == NULL) {
+        return -1;
+    }
+
+    p_cur->p = colon + 1;
+    p_cur->len = strlen(p_cur->p);
+
+    return 0;
+}
+
+/**
+ * Places the next token of *p_cur in *p_out and advances *p_cur
+ * past it and its trailing comma. Surrounding quotes are not part
+ * of the token.
+ * returns 0 on success and -1 if there are no more tokens
+ */
+int at_span_next(ATSpan *p_cur, ATSpan *p_out)
+{
+    const char *s;
+    const char *end;
+
+    if (p_cur->p == NULL) {
+        return -1;
+    }
+
+    s = p_cur->p;
+    end = s + p_cur->len;
+
+    while (s < end && isspace((unsigned char)*s)) {
+        s++;
+    }
+
+    if (s < end && *s == '"') {
+        s++;
+        p_out->p = s;
+
+        while (s < end && *s != '"') s++;
+
+        p_out->len = s - p_out->p;
+
+        /* skip to the comma after the closing quote */
+        while (s < end && *s != ',') s++;
+    } else {
+        p_out->p = s;
+
+        while (s < end && *s != ',') s++;
+
+        p_out->len = s - p_out->p;
+    }
+
+    if (s == end) {
+        /* that was the last token */
+        p_cur->p = NULL;
+        p_cur->len = 0;
+    } else {
+        s++; /* the comma */
+        p_cur->len = end - s;
+        p_cur->p = s;
+    }
+
+    return 0;
+}
+
+/** returns 1 on "has more tokens" and 0 if no */
+int at_span_hasmore(const ATSpan *p_cur)
+{
+    return ! (p_cur->p == NULL || p_cur->len == 0);
+}
+
+/**
+ * Parses the integer in token *p_tok and places it in *p_out
+ * "base" is 10 or 16; base 16 values are read as unsigned, as in
+ * at_tok_nexthexint
+ * returns 0 on success and -1 on fail
+ */
+int at_span_toint(const ATSpan *p_tok, int base, int *p_out)
+{
+    const char *s = p_tok->p;
+    const char *end = p_tok->p + p_tok->len;
+    unsigned long val = 0;
+    int negative = 0;
+    int digits = 0;
+
+    while (s < end && isspace((unsigned char)*s)) {
+        s++;
+    }
+
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = (*s == '-');
+        s++;
+    }
+
+    for ( ; s < end ; s++, digits++) {
+        int digit;
+
+        if (*s >= '0' && *s <= '9') {
+            digit = *s - '0';
+        } else if (base == 16 && *s >= 'a' && *s <= 'f') {
+            digit = *s - 'a' + 10;
+        } else if (base == 16 && *s >= 'A' && *s <= 'F') {
+            digit = *s - 'A' + 10;
+        } else {
+            break;
+        }
+
+        val = val * base + digit;
+    }
+
+    if (digits == 0) {
+        return -1;
+    }
+
+    *p_out = negative ? -(int)val : (int)val;
+
+    return 0;
+}
+
+/** returns 1 if token *p_tok is exactly the string s, 0 if it is not */
+int at_span_equals(const ATSpan *p_tok, const char *s)
+{
+    return strlen(s) == p_tok->len && 0 == memcmp(p_tok->p, s, p_tok->len);
+}
+
+/**
+ * Parses a whole AT response line in one pass, without modifying the
+ * line or allocating.
+ *
+ * "fmt" is the expected line prefix followed by comma separated
+ * conversions, eg "+CREG: %d,%d,%x,%x". Whitespace in the prefix
+ * matches any amount of whitespace. Conversions are:
+ *
+ *   %d  int *     decimal integer
+ *   %x  int *     hex integer
+ *   %b  char *    boolean, 0 or 1
+ *   %s  ATSpan *  string, without quotes
+ *   %*  (none)    token is skipped
+ *
+ * Trailing fields missing from the line are left untouched, so
+ * optional parameters go at the end of the format.
+ *
+ * returns the number of conversions performed, or -1 if the prefix
+ * does not match or a present field fails to parse
+ */
+int at_tok_scan(const char *line, const char *fmt, ...)
+{
+    va_list ap;
+    ATSpan cur;
+    ATSpan tok;
+    int count = 0;
+
+    if (line == NULL) {
+        return -1;
+    }
+
+    /* match the prefix */
+    while (*fmt != '\0' && *fmt != '%') {
+        if (isspace((unsigned char)*fmt)) {
+            while (isspace((unsigned char)*line)) line++;
+            fmt++;
+        } else if (*fmt++ != *line++) {
+            return -1;
+        }
+    }
+
+    cur.p = line;
+    cur.len = strlen(line);
+
+    va_start(ap, fmt);
+
+    while (*fmt != '\0') {
+        if (*fmt == ',' || isspace((unsigned char)*fmt)) {
+            fmt++;
+            continue;
+        }
+
+        if (*fmt != '%' || fmt[1] == '\0') {
+            goto error;
+        }
+
+        fmt++;
+
+        if (at_span_next(&cur, &tok) < 0) {
+            /* ran out of fields */
+            break;
+        }
+
+        switch (*fmt++) {
+            case 'd':
+                if (at_span_toint(&tok, 10, va_arg(ap, int *)) < 0) {
+                    goto error;
+                }
+                break;
+
+            case 'x':
+                if (at_span_toint(&tok, 16, va_arg(ap, int *)) < 0) {
+                    goto error;
+                }
+                break;
+
+            case 'b': {
+                int result;
+                char *p_out = va_arg(ap, char *);
+
+                // booleans should be 0 or 1
+                if (at_span_toint(&tok, 10, &result) < 0
+                    || !(result == 0 || result == 1)
+                ) {
+                    goto error;
+                }
+                *p_out = (char)result;
+                break;
+            }
+
+            case 's':
+                *va_arg(ap, ATSpan *) = tok;
+                break;
+
+            case '*':
+                break;
+
+            default:
+                goto error;
+        }
+
+        count++;
+    }
+
+    va_end(ap);
+    return count;
+
+error:
+    va_end(ap);
+    return -1;
+}
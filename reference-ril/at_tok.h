@@ -18,6 +18,17 @@
 #ifndef AT_TOK_H
 #define AT_TOK_H 1
 
+#include <stddef.h>
+
+/**
+ * A non-owning view of part of an AT response line.
+ * Spans are not NUL terminated; use len.
+ */
+typedef struct {
+    const char *p;
+    size_t len;
+} ATSpan;
+
 int at_tok_start(char **p_cur);
 int at_tok_nextint(char **p_cur, int *p_out);
 int at_tok_nexthexint(char **p_cur, int *p_out);
@@ -27,4 +38,17 @@ int at_tok_nextstr(char **p_cur, char **out);
 
 int at_tok_hasmore(char **p_cur);
 
+/*
+ * Non-mutating variants of the above. These never write to the line
+ * and never allocate, so they may be used directly on a const line or
+ * on an ATResponse that is still needed afterwards.
+ */
+int at_span_start(const char *line, ATSpan *p_cur);
+int at_span_next(ATSpan *p_cur, ATSpan *p_out);
+int at_span_hasmore(const ATSpan *p_cur);
+int at_span_toint(const ATSpan *p_tok, int base, int *p_out);
+int at_span_equals(const ATSpan *p_tok, const char *s);
+
+int at_tok_scan(const char *line, const char *fmt, ...);
+
 #endif /*AT_TOK_H */
@@ -0,0 +1,162 @@
+/* //device/system/reference-ril/at_tok_benchmark.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Host microbenchmarks for the AT response tokenizers, over a corpus of
+ * +CREG, +CGREG, +CSQ and +CLCC lines as modems send them:
+ *
+ *   BM_at_tok       at_tok_start() and at_tok_next*(), which write to the
+ *                   line, so each iteration first copies it as atchannel
+ *                   would have
+ *   BM_at_tok_scan  at_tok_scan() straight from the const line
+ *
+ * Both are driven by the same format, so they do the same conversions:
+ *
+ *   g++ -O2 reference-ril/at_tok_benchmark.cpp reference-ril/at_tok.c \
+ *       -lbenchmark -lpthread
+ */
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+extern "C" {
+#include "at_tok.h"
+}
+
+#define NUM_ELEMS(x) (sizeof(x) / sizeof(x[0]))
+
+#define MAX_LINE 128
+
+typedef struct {
+    const char *line;
+    const char *fmt;
+} TokCase;
+
+static const TokCase s_tokCases[] = {
+    // unsolicited, +CREG=1
+    {"+CREG: 1", "+CREG: %d"},
+    // AT+CREG? with +CREG=2
+    {"+CREG: 2,1,\"00C3\",\"0000D5E7\"", "+CREG: %d,%d,%x,%x,%d"},
+    {"+CREG: 2,5,\"1A2B\",\"01C3D5E7\",7", "+CREG: %d,%d,%x,%x,%d"},
+    {"+CGREG: 2,1,\"00C3\",\"0000D5E7\",7,\"01\"", "+CGREG: %d,%d,%x,%x,%d,%s"},
+    {"+CSQ: 17,99", "+CSQ: %d,%d"},
+    {"+CSQ: 31,0", "+CSQ: %d,%d"},
+    {"+CLCC: 1,0,0,0,0,\"+15555551234\",145", "+CLCC: %d,%b,%d,%d,%b,%s,%d"},
+    {"+CLCC: 2,1,4,0,0,\"0123456789\",129,\"\"", "+CLCC: %d,%b,%d,%d,%b,%s,%d,%s"},
+};
+
+/**
+ * Parses a copy of the line with the at_tok_next*() call for each
+ * conversion in fmt, the way the callers of at_tok_start() do.
+ * Returns the number of conversions, as at_tok_scan() does.
+ */
+static int atTokParse(char *line, const char *fmt)
+{
+    char *cur = line;
+    int count = 0;
+    int ival;
+    char bval;
+    char *sval;
+
+    if (at_tok_start(&cur) < 0) {
+        return -1;
+    }
+
+    for ( ; *fmt != '\0' && at_tok_hasmore(&cur) ; fmt++) {
+        int ret;
+
+        if (*fmt != '%') {
+            continue;
+        }
+
+        switch (*++fmt) {
+            case 'd': ret = at_tok_nextint(&cur, &ival); break;
+            case 'x': ret = at_tok_nexthexint(&cur, &ival); break;
+            case 'b': ret = at_tok_nextbool(&cur, &bval); break;
+            default:  ret = at_tok_nextstr(&cur, &sval); break;
+        }
+
+        if (ret < 0) {
+            return -1;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+/** at_tok_scan() with one int (or span) per conversion in fmt */
+static int atTokScan(const char *line, const char *fmt)
+{
+    int i[8];
+    char b[8];
+    ATSpan s[8];
+
+    // each case uses at most 8 conversions, in these positions
+    if (strstr(fmt, "+CLCC") == fmt) {
+        return at_tok_scan(line, fmt, &i[0], &b[0], &i[1], &i[2], &b[1], &s[0],
+                &i[3], &s[1]);
+    } else if (strstr(fmt, "+CGREG") == fmt) {
+        return at_tok_scan(line, fmt, &i[0], &i[1], &i[2], &i[3], &i[4], &s[0]);
+    }
+    return at_tok_scan(line, fmt, &i[0], &i[1], &i[2], &i[3], &i[4]);
+}
+
+static void BM_at_tok(benchmark::State &state)
+{
+    const TokCase *pCase = &s_tokCases[state.range(0)];
+    size_t len = strlen(pCase->line) + 1;
+    char line[MAX_LINE];
+    int count = 0;
+
+    while (state.KeepRunning()) {
+        memcpy(line, pCase->line, len);
+        count = atTokParse(line, pCase->fmt);
+        benchmark::DoNotOptimize(count);
+    }
+
+    if (count < 0 || count != atTokScan(pCase->line, pCase->fmt)) {
+        state.SkipWithError("at_tok and at_tok_scan disagree");
+    }
+
+    state.SetLabel(pCase->line);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * (len - 1));
+}
+BENCHMARK(BM_at_tok)->DenseRange(0, NUM_ELEMS(s_tokCases) - 1);
+
+static void BM_at_tok_scan(benchmark::State &state)
+{
+    const TokCase *pCase = &s_tokCases[state.range(0)];
+    int count = 0;
+
+    while (state.KeepRunning()) {
+        count = atTokScan(pCase->line, pCase->fmt);
+        benchmark::DoNotOptimize(count);
+    }
+
+    if (count < 0) {
+        state.SkipWithError("at_tok_scan failed");
+    }
+
+    state.SetLabel(pCase->line);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * strlen(pCase->line));
+}
+BENCHMARK(BM_at_tok_scan)->DenseRange(0, NUM_ELEMS(s_tokCases) - 1);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,48 @@
+/* //device/system/reference-ril/atcapture.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ATCAPTURE_H
+#define ATCAPTURE_H 1
+
+#include <stdint.h>
+
+/*
+ * AT transcript capture format, written by atchannel (see
+ * at_capture_open()) and read by atreplay.
+ *
+ * The file starts with AT_CAPTURE_MAGIC, followed by records. Each
+ * record is an ATCaptureRecord followed by "length" bytes of data.
+ * All fields are in host byte order.
+ */
+
+#define AT_CAPTURE_MAGIC "ATCAP001"
+#define AT_CAPTURE_MAGIC_LEN 8
+
+typedef enum {
+    AT_CAPTURE_COMMAND = '>',   /* command line sent, without the \r */
+    AT_CAPTURE_PDU = '*',       /* SMS PDU sent, without the ^Z */
+    AT_CAPTURE_INPUT = '<',     /* bytes as returned by one read() */
+} ATCaptureType;
+
+typedef struct {
+    uint64_t timestampNsec;     /* CLOCK_MONOTONIC */
+    uint32_t length;
+    uint8_t type;               /* ATCaptureType */
+    uint8_t reserved[3];
+} ATCaptureRecord;
+
+#endif /*ATCAPTURE_H*/
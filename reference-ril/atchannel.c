@@ -16,6 +16,7 @@
 */
 
 #include "atchannel.h"
+#include "atcapture.h"
 #include "at_tok.h"
 
 #include <stdio.h>
@@ -26,6 +27,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -41,6 +43,7 @@
 #define MAX_AT_RESPONSE (8 * 1024)
 #define HANDSHAKE_RETRY_COUNT 8
 #define HANDSHAKE_TIMEOUT_MSEC 250
+#define NS_PER_S 1000000000
 
 static pthread_t s_tid_reader;
 static int s_fd = -1;    /* fd of the AT channel */
@@ -60,6 +63,53 @@ void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
 }
 #endif
 
+/*
+ * AT transcript capture, see atcapture.h
+ * s_captureFd is only changed with s_captureMutex held
+ */
+static pthread_mutex_t s_captureMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_captureFd = -1;
+
+static void captureWrite(ATCaptureType type, const char *buff, size_t len)
+{
+    ATCaptureRecord record;
+    struct timespec ts;
+    struct iovec iov[2];
+    ssize_t written;
+
+    if (s_captureFd < 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    memset(&record, 0, sizeof(record));
+    record.timestampNsec = (uint64_t) ts.tv_sec * NS_PER_S + ts.tv_nsec;
+    record.length = len;
+    record.type = type;
+
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = (void *) buff;
+    iov[1].iov_len = len;
+
+    pthread_mutex_lock(&s_captureMutex);
+
+    if (s_captureFd >= 0) {
+        do {
+            written = writev(s_captureFd, iov, 2);
+        } while (written < 0 && errno == EINTR);
+
+        if (written != (ssize_t) (sizeof(record) + len)) {
+            RLOGE("AT capture write failed; capture stopped");
+            close(s_captureFd);
+            s_captureFd = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&s_captureMutex);
+}
+
 /*
  * for current pending command
  * these are protected by s_commandmutex
@@ -68,6 +118,12 @@ void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
 static pthread_mutex_t s_commandmutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t s_commandcond = PTHREAD_COND_INITIALIZER;
 
+/* the channel is handed to command threads in the order they asked for it;
+   see acquireChannel() */
+static pthread_cond_t s_channelcond = PTHREAD_COND_INITIALIZER;
+static unsigned int s_channelNextTicket = 0;
+static unsigned int s_channelServing = 0;
+
 static ATCommandType s_type;
 static const char *s_responsePrefix = NULL;
 static const char *s_smsPDU = NULL;
@@ -81,7 +137,6 @@ static void onReaderClosed();
 static int writeCtrlZ (const char *s);
 static int writeline (const char *s);
 
-#define NS_PER_S 1000000000
 static void setTimespecRelative(struct timespec *p_ts, long long msec)
 {
     struct timeval tv;
@@ -112,20 +167,415 @@ static void sleepMsec(long long msec)
 
 
 
+/*
+ * Command timeouts
+ *
+ * Commands sent without an explicit timeout get one from their command
+ * class, so that a single unresponsive command fails (and the channel
+ * is recovered through the on_timeout callback) instead of hanging
+ * the channel forever.
+ *
+ * The observed latency of each command (keyed by its name and operator,
+ * eg "AT+COPS=?") is kept in a log2 histogram. A command that times out
+ * is counted as slower than every bucket, since its real latency is not
+ * known. The histogram starts over with each at_open().
+ *
+ * In adaptive mode, once enough samples exist, a multiple of the observed
+ * p99 becomes a soft deadline: a command still running at that point is
+ * logged as slow, but it only fails, and the channel is only recovered,
+ * at the class timeout. There is no soft deadline while more than 1% of
+ * the samples are timeouts.
+ */
+
+#define AT_LATENCY_BUCKETS 20          /* 1ms .. 2^19ms */
+#define AT_LATENCY_KEY_MAX 16
+#define AT_LATENCY_TABLE_SIZE 32
+#define AT_ADAPTIVE_MIN_SAMPLES 20
+#define AT_ADAPTIVE_MULTIPLIER 4
+#define AT_ADAPTIVE_MIN_TIMEOUT_MSEC 5000
+
+static long long s_classTimeoutMsec[AT_TIMEOUT_NUM_CLASSES] = {
+    5000,       /* AT_TIMEOUT_SHORT */
+    30000,      /* AT_TIMEOUT_DEFAULT */
+    180000,     /* AT_TIMEOUT_LONG */
+};
+
+/* first match wins, so more specific prefixes go first */
+static const struct {
+    const char *prefix;
+    ATTimeoutClass timeoutClass;
+} s_commandClasses[] = {
+    { "AT+COPS=?", AT_TIMEOUT_LONG },   /* network scan */
+    { "AT+COPS=", AT_TIMEOUT_LONG },    /* registration */
+    { "AT+CFUN=", AT_TIMEOUT_LONG },
+    { "AT+CGACT", AT_TIMEOUT_LONG },
+    { "AT+CMGS", AT_TIMEOUT_LONG },     /* waits for the network */
+    { "AT+CUSD=", AT_TIMEOUT_LONG },
+    { "ATD", AT_TIMEOUT_LONG },
+    { "AT+CSQ", AT_TIMEOUT_SHORT },
+    { "AT+CREG?", AT_TIMEOUT_SHORT },
+    { "AT+CGREG?", AT_TIMEOUT_SHORT },
+    { "AT+COPS?", AT_TIMEOUT_SHORT },
+    { "AT+CPIN?", AT_TIMEOUT_SHORT },
+    { "AT+CFUN?", AT_TIMEOUT_SHORT },
+    { "AT+CTEC?", AT_TIMEOUT_SHORT },
+    { "AT+CLCC", AT_TIMEOUT_SHORT },
+};
+
+typedef struct {
+    char key[AT_LATENCY_KEY_MAX];
+    unsigned int count;     /* including timeouts */
+    unsigned int timeouts;
+    unsigned int buckets[AT_LATENCY_BUCKETS];
+} ATLatencyStats;
+
+/* protected by s_commandmutex */
+static int s_adaptiveTimeouts = 0;
+static ATLatencyStats s_latencyStats[AT_LATENCY_TABLE_SIZE];
+static int s_latencyStatsCount = 0;
+
+static long long nowMsec()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static ATTimeoutClass timeoutClassForCommand(const char *command)
+{
+    size_t i;
+
+    for (i = 0 ; i < NUM_ELEMS(s_commandClasses) ; i++) {
+        if (strStartsWith(command, s_commandClasses[i].prefix)) {
+            return s_commandClasses[i].timeoutClass;
+        }
+    }
+
+    return AT_TIMEOUT_DEFAULT;
+}
+
+/**
+ * Places the latency key for command in key: the command name and its
+ * operator, eg "AT+CSQ", "AT+COPS?", "AT+COPS=?", "AT+CGACT="
+ */
+static void latencyKeyForCommand(const char *command, char *key)
+{
+    size_t i;
+
+    for (i = 0 ; i < AT_LATENCY_KEY_MAX - 1 && command[i] != '\0' ; i++) {
+        key[i] = command[i];
+
+        if (command[i] == '?' || command[i] == ';') {
+            i++;
+            break;
+        } else if (command[i] == '=') {
+            if (command[i + 1] == '?' && i + 1 < AT_LATENCY_KEY_MAX - 1) {
+                key[++i] = '?';
+            }
+            i++;
+            break;
+        }
+    }
+
+    key[i] = '\0';
+}
+
+static ATLatencyStats *findLatencyStats(const char *command, int create)
+{
+    char key[AT_LATENCY_KEY_MAX];
+    int i;
+
+    latencyKeyForCommand(command, key);
+
+    for (i = 0 ; i < s_latencyStatsCount ; i++) {
+        if (0 == strcmp(s_latencyStats[i].key, key)) {
+            return &s_latencyStats[i];
+        }
+    }
+
+    if (!create || s_latencyStatsCount == AT_LATENCY_TABLE_SIZE) {
+        return NULL;
+    }
+
+    memset(&s_latencyStats[i], 0, sizeof(s_latencyStats[i]));
+    strcpy(s_latencyStats[i].key, key);
+    s_latencyStatsCount++;
+
+    return &s_latencyStats[i];
+}
+
+/** assumes s_commandmutex is held */
+static void recordLatency(const char *command, long long msec)
+{
+    ATLatencyStats *p_stats;
+    int bucket = 0;
+
+    p_stats = findLatencyStats(command, 1);
+
+    if (p_stats == NULL) {
+        return;
+    }
+
+    while (bucket < AT_LATENCY_BUCKETS - 1 && msec >= (1LL << bucket)) {
+        bucket++;
+    }
+
+    p_stats->buckets[bucket]++;
+    p_stats->count++;
+}
+
+/** assumes s_commandmutex is held */
+static void recordTimeout(const char *command)
+{
+    ATLatencyStats *p_stats;
+
+    p_stats = findLatencyStats(command, 1);
+
+    if (p_stats == NULL) {
+        return;
+    }
+
+    p_stats->timeouts++;
+    p_stats->count++;
+}
+
+/**
+ * Returns the timeout to use for a command issued without one, and
+ * places its soft deadline, or 0 for none, in *p_softMsec
+ * assumes s_commandmutex is held
+ */
+static long long timeoutForCommand(const char *command, long long *p_softMsec)
+{
+    long long timeoutMsec;
+    ATLatencyStats *p_stats;
+    unsigned int seen = 0;
+    int bucket;
+
+    *p_softMsec = 0;
+
+    timeoutMsec = s_classTimeoutMsec[timeoutClassForCommand(command)];
+
+    if (!s_adaptiveTimeouts || timeoutMsec == 0) {
+        return timeoutMsec;
+    }
+
+    p_stats = findLatencyStats(command, 0);
+
+    if (p_stats == NULL || p_stats->count < AT_ADAPTIVE_MIN_SAMPLES) {
+        return timeoutMsec;
+    }
+
+    for (bucket = 0 ; bucket < AT_LATENCY_BUCKETS ; bucket++) {
+        seen += p_stats->buckets[bucket];
+
+        if (seen * 100ULL >= p_stats->count * 99ULL) {
+            long long p99 = 1LL << bucket; /* bucket upper bound */
+            long long adaptive = p99 * AT_ADAPTIVE_MULTIPLIER;
+
+            if (adaptive < AT_ADAPTIVE_MIN_TIMEOUT_MSEC) {
+                adaptive = AT_ADAPTIVE_MIN_TIMEOUT_MSEC;
+            }
+
+            if (adaptive < timeoutMsec) {
+                *p_softMsec = adaptive;
+            }
+            break;
+        }
+    }
+
+    return timeoutMsec;
+}
+
+/*
+ * ATResponse storage
+ *
+ * Each ATResponse lives at the head of an ATResponseArena. The ATLine
+ * nodes, the intermediate line text and the final response are carved
+ * out of the arena's blocks in arrival order, so the intermediate list
+ * never needs to be reversed and at_response_free() is a single
+ * reset rather than one free() per line.
+ *
+ * Released arenas are kept on a small free list and recycled by the
+ * next command. An arena that had to chain overflow blocks is
+ * collapsed into one block of its high water mark when released, so
+ * a command that repeatedly returns long responses (eg AT+COPS=?)
+ * stops allocating after the first time.
+ */
+
+#define AT_ARENA_BLOCK_SIZE 512
+#define AT_ARENA_MAX_BLOCK_SIZE (4 * MAX_AT_RESPONSE)
+#define AT_ARENA_POOL_MAX 4
+#define AT_ARENA_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+typedef struct ATArenaBlock {
+    struct ATArenaBlock *p_next; /* previously filled block, or NULL */
+    size_t size;
+    size_t used;
+    char data[];
+} ATArenaBlock;
+
+typedef struct ATResponseArena {
+    ATResponse response;    /* must be first, see arenaFromResponse() */
+    ATLine *p_lastIntermediate;
+    ATArenaBlock *p_block;  /* block currently being filled */
+    struct ATResponseArena *p_nextFree;
+} ATResponseArena;
+
+static pthread_mutex_t s_arenaPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static ATResponseArena *s_arenaPool = NULL;
+static int s_arenaPoolCount = 0;
+
+static ATResponseArena *arenaFromResponse(ATResponse *p_response)
+{
+    return (ATResponseArena *) p_response;
+}
+
+static ATArenaBlock *arenaBlockNew(size_t size)
+{
+    ATArenaBlock *p_block;
+
+    p_block = (ATArenaBlock *) malloc(sizeof(ATArenaBlock) + size);
+
+    if (p_block == NULL) {
+        return NULL;
+    }
+
+    p_block->p_next = NULL;
+    p_block->size = size;
+    p_block->used = 0;
+
+    return p_block;
+}
+
+/** returns len bytes from the arena, or NULL on allocation failure */
+static void *arenaAlloc(ATResponseArena *p_arena, size_t len)
+{
+    ATArenaBlock *p_block = p_arena->p_block;
+    void *ret;
+
+    len = AT_ARENA_ALIGN(len);
+
+    if (p_block == NULL || p_block->size - p_block->used < len) {
+        size_t size = AT_ARENA_BLOCK_SIZE;
+        ATArenaBlock *p_new;
+
+        if (p_block != NULL) {
+            size = p_block->size * 2;
+        }
+        if (size < len) {
+            size = len;
+        }
+
+        p_new = arenaBlockNew(size);
+
+        if (p_new == NULL) {
+            return NULL;
+        }
+
+        p_new->p_next = p_block;
+        p_arena->p_block = p_block = p_new;
+    }
+
+    ret = p_block->data + p_block->used;
+    p_block->used += len;
+
+    return ret;
+}
+
+static char *arenaStrdup(ATResponseArena *p_arena, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *ret;
+
+    ret = (char *) arenaAlloc(p_arena, len);
+
+    if (ret != NULL) {
+        memcpy(ret, s, len);
+    }
+
+    return ret;
+}
+
+/**
+ * Empties the arena. If the last use overflowed the current block, the
+ * chain is replaced with one block big enough for all of it
+ */
+static void arenaReset(ATResponseArena *p_arena)
+{
+    ATArenaBlock *p_block = p_arena->p_block;
+
+    if (p_block != NULL && p_block->p_next != NULL) {
+        size_t total = 0;
+
+        while (p_block != NULL) {
+            ATArenaBlock *p_toFree = p_block;
+
+            total += p_block->used;
+            p_block = p_block->p_next;
+            free(p_toFree);
+        }
+
+        if (total > AT_ARENA_MAX_BLOCK_SIZE) {
+            total = AT_ARENA_MAX_BLOCK_SIZE;
+        }
+
+        /* a NULL block is fine; arenaAlloc() will retry */
+        p_arena->p_block = arenaBlockNew(AT_ARENA_ALIGN(total));
+    } else if (p_block != NULL) {
+        p_block->used = 0;
+    }
+
+    memset(&p_arena->response, 0, sizeof(p_arena->response));
+    p_arena->p_lastIntermediate = NULL;
+    p_arena->p_nextFree = NULL;
+}
+
+static void arenaDestroy(ATResponseArena *p_arena)
+{
+    ATArenaBlock *p_block = p_arena->p_block;
+
+    while (p_block != NULL) {
+        ATArenaBlock *p_toFree = p_block;
+
+        p_block = p_block->p_next;
+        free(p_toFree);
+    }
+
+    free(p_arena);
+}
+
 /** add an intermediate response to sp_response*/
 static void addIntermediate(const char *line)
 {
+    ATResponseArena *p_arena = arenaFromResponse(sp_response);
     ATLine *p_new;
 
-    p_new = (ATLine  *) malloc(sizeof(ATLine));
+    p_new = (ATLine *) arenaAlloc(p_arena, sizeof(ATLine));
+
+    if (p_new == NULL) {
+        RLOGE("Out of memory storing intermediate response\n");
+        return;
+    }
+
+    p_new->line = arenaStrdup(p_arena, line);
 
-    p_new->line = strdup(line);
+    if (p_new->line == NULL) {
+        RLOGE("Out of memory storing intermediate response\n");
+        return;
+    }
+
+    /* lines are appended, so the list is in the order received */
+    p_new->p_next = NULL;
+
+    if (p_arena->p_lastIntermediate == NULL) {
+        sp_response->p_intermediates = p_new;
+    } else {
+        p_arena->p_lastIntermediate->p_next = p_new;
+    }
 
-    /* note: this adds to the head of the list, so the list
-       will be in reverse order of lines received. the order is flipped
-       again before passing on to the command issuer */
-    p_new->p_next = sp_response->p_intermediates;
-    sp_response->p_intermediates = p_new;
+    p_arena->p_lastIntermediate = p_new;
 }
 
 
@@ -214,7 +664,8 @@ static int isSMSUnsolicited(const char *line)
 /** assumes s_commandmutex is held */
 static void handleFinalResponse(const char *line)
 {
-    sp_response->finalResponse = strdup(line);
+    sp_response->finalResponse = arenaStrdup(arenaFromResponse(sp_response),
+                                             line);
 
     pthread_cond_signal(&s_commandcond);
 }
@@ -373,6 +824,7 @@ static const char *readline()
 
         if (count > 0) {
             AT_DUMP( "<< ", p_read, count );
+            captureWrite(AT_CAPTURE_INPUT, p_read, count);
 
             p_read[count] = '\0';
 
@@ -396,9 +848,17 @@ static const char *readline()
     /* a full line in the buffer. Place a \0 over the \r and return */
 
     ret = s_ATBufferCur;
-    *p_eol = '\0';
-    s_ATBufferCur = p_eol + 1; /* this will always be <= p_read,    */
-                              /* and there will be a \0 at *p_read */
+
+    if (*p_eol == '\0') {
+        /* the SMS prompt ends at the end of the buffer rather than at
+           a \r; stepping past its \0 would hand stale data to the next
+           call, so leave the buffer consumed */
+        s_ATBufferCur = p_eol;
+    } else {
+        *p_eol = '\0';
+        s_ATBufferCur = p_eol + 1; /* this will always be <= p_read,    */
+                                  /* and there will be a \0 at *p_read */
+    }
 
     RLOGD("AT< %s\n", ret);
     return ret;
@@ -463,89 +923,86 @@ static void *readerLoop(void *arg __unused)
 }
 
 /**
- * Sends string s to the radio with a \r appended.
- * Returns AT_ERROR_* on error, 0 on success
+ * Writes s followed by the terminator character
  *
- * This function exists because as of writing, android libc does not
- * have buffered stdio.
+ * Both go out in a single write where possible: a command split over two
+ * writes costs a round of Nagle / delayed ACK on socket based modems
+ * (eg the emulator or a host simulator), and an extra wakeup on ttys.
  */
-static int writeline (const char *s)
+static int writeTerminated (const char *s, size_t len, char terminator)
 {
-    size_t cur = 0;
-    size_t len = strlen(s);
+    struct iovec iov[2];
+    int iovcnt = 2;
     ssize_t written;
 
-    if (s_fd < 0 || s_readerClosed > 0) {
-        return AT_ERROR_CHANNEL_CLOSED;
-    }
+    iov[0].iov_base = (void *) s;
+    iov[0].iov_len = len;
+    iov[1].iov_base = &terminator;
+    iov[1].iov_len = 1;
 
-    RLOGD("AT> %s\n", s);
-
-    AT_DUMP( ">> ", s, strlen(s) );
-
-    /* the main string */
-    while (cur < len) {
+    while (iovcnt > 0) {
         do {
-            written = write (s_fd, s + cur, len - cur);
+            written = writev (s_fd, iov + 2 - iovcnt, iovcnt);
         } while (written < 0 && errno == EINTR);
 
         if (written < 0) {
             return AT_ERROR_GENERIC;
         }
 
-        cur += written;
-    }
-
-    /* the \r  */
-
-    do {
-        written = write (s_fd, "\r" , 1);
-    } while ((written < 0 && errno == EINTR) || (written == 0));
+        /* partial write: skip what went out */
+        while (iovcnt > 0 && (size_t) written >= iov[2 - iovcnt].iov_len) {
+            written -= iov[2 - iovcnt].iov_len;
+            iovcnt--;
+        }
 
-    if (written < 0) {
-        return AT_ERROR_GENERIC;
+        if (iovcnt > 0) {
+            iov[2 - iovcnt].iov_base = (char *) iov[2 - iovcnt].iov_base + written;
+            iov[2 - iovcnt].iov_len -= written;
+        }
     }
 
     return 0;
 }
-static int writeCtrlZ (const char *s)
+
+/**
+ * Sends string s to the radio with a \r appended.
+ * Returns AT_ERROR_* on error, 0 on success
+ *
+ * This function exists because as of writing, android libc does not
+ * have buffered stdio.
+ */
+static int writeline (const char *s)
 {
-    size_t cur = 0;
     size_t len = strlen(s);
-    ssize_t written;
 
     if (s_fd < 0 || s_readerClosed > 0) {
         return AT_ERROR_CHANNEL_CLOSED;
     }
 
-    RLOGD("AT> %s^Z\n", s);
+    RLOGD("AT> %s\n", s);
 
-    AT_DUMP( ">* ", s, strlen(s) );
+    AT_DUMP( ">> ", s, strlen(s) );
+    captureWrite(AT_CAPTURE_COMMAND, s, len);
 
-    /* the main string */
-    while (cur < len) {
-        do {
-            written = write (s_fd, s + cur, len - cur);
-        } while (written < 0 && errno == EINTR);
+    /* the main string and the \r */
+    return writeTerminated(s, len, '\r');
+}
 
-        if (written < 0) {
-            return AT_ERROR_GENERIC;
-        }
+static int writeCtrlZ (const char *s)
+{
+    size_t len = strlen(s);
 
-        cur += written;
+    if (s_fd < 0 || s_readerClosed > 0) {
+        return AT_ERROR_CHANNEL_CLOSED;
     }
 
-    /* the ^Z  */
-
-    do {
-        written = write (s_fd, "\032" , 1);
-    } while ((written < 0 && errno == EINTR) || (written == 0));
+    RLOGD("AT> %s^Z\n", s);
 
-    if (written < 0) {
-        return AT_ERROR_GENERIC;
-    }
+    AT_DUMP( ">* ", s, strlen(s) );
+    captureWrite(AT_CAPTURE_PDU, s, len);
 
-    return 0;
+    /* the main string and the ^Z */
+    return writeTerminated(s, len, '\032');
 }
 
 static void clearPendingCommand()
@@ -578,6 +1035,11 @@ int at_open(int fd, ATUnsolHandler h)
     s_smsPDU = NULL;
     sp_response = NULL;
 
+    /* a new channel may well be a different modem */
+    pthread_mutex_lock(&s_commandmutex);
+    s_latencyStatsCount = 0;
+    pthread_mutex_unlock(&s_commandmutex);
+
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
@@ -613,47 +1075,55 @@ void at_close()
 
 static ATResponse * at_response_new()
 {
-    return (ATResponse *) calloc(1, sizeof(ATResponse));
-}
+    ATResponseArena *p_arena;
 
-void at_response_free(ATResponse *p_response)
-{
-    ATLine *p_line;
+    pthread_mutex_lock(&s_arenaPoolMutex);
 
-    if (p_response == NULL) return;
+    p_arena = s_arenaPool;
 
-    p_line = p_response->p_intermediates;
+    if (p_arena != NULL) {
+        s_arenaPool = p_arena->p_nextFree;
+        s_arenaPoolCount--;
+    }
 
-    while (p_line != NULL) {
-        ATLine *p_toFree;
+    pthread_mutex_unlock(&s_arenaPoolMutex);
 
-        p_toFree = p_line;
-        p_line = p_line->p_next;
+    if (p_arena == NULL) {
+        p_arena = (ATResponseArena *) calloc(1, sizeof(ATResponseArena));
 
-        free(p_toFree->line);
-        free(p_toFree);
+        if (p_arena == NULL) {
+            return NULL;
+        }
     }
 
-    free (p_response->finalResponse);
-    free (p_response);
+    p_arena->p_nextFree = NULL;
+
+    return &p_arena->response;
 }
 
-/**
- * The line reader places the intermediate responses in reverse order
- * here we flip them back
- */
-static void reverseIntermediates(ATResponse *p_response)
+void at_response_free(ATResponse *p_response)
 {
-    ATLine *pcur,*pnext;
+    ATResponseArena *p_arena;
 
-    pcur = p_response->p_intermediates;
-    p_response->p_intermediates = NULL;
+    if (p_response == NULL) return;
 
-    while (pcur != NULL) {
-        pnext = pcur->p_next;
-        pcur->p_next = p_response->p_intermediates;
-        p_response->p_intermediates = pcur;
-        pcur = pnext;
+    p_arena = arenaFromResponse(p_response);
+
+    arenaReset(p_arena);
+
+    pthread_mutex_lock(&s_arenaPoolMutex);
+
+    if (s_arenaPoolCount < AT_ARENA_POOL_MAX) {
+        p_arena->p_nextFree = s_arenaPool;
+        s_arenaPool = p_arena;
+        s_arenaPoolCount++;
+        p_arena = NULL;
+    }
+
+    pthread_mutex_unlock(&s_arenaPoolMutex);
+
+    if (p_arena != NULL) {
+        arenaDestroy(p_arena);
     }
 }
 
@@ -662,20 +1132,25 @@ static void reverseIntermediates(ATResponse *p_response)
  * Doesn't lock or call the timeout callback
  *
  * timeoutMsec == 0 means infinite timeout
+ * softTimeoutMsec, if not 0, is when to log the command as slow
  */
 
 static int at_send_command_full_nolock (const char *command, ATCommandType type,
                     const char *responsePrefix, const char *smspdu,
-                    long long timeoutMsec, ATResponse **pp_outResponse)
+                    long long timeoutMsec, long long softTimeoutMsec,
+                    ATResponse **pp_outResponse)
 {
     int err = 0;
     struct timespec ts;
+    long long startMsec;
 
     if(sp_response != NULL) {
         err = AT_ERROR_COMMAND_PENDING;
         goto error;
     }
 
+    startMsec = nowMsec();
+
     err = writeline (command);
 
     if (err < 0) {
@@ -687,7 +1162,14 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
     s_smsPDU = smspdu;
     sp_response = at_response_new();
 
-    if (timeoutMsec != 0) {
+    if (sp_response == NULL) {
+        err = AT_ERROR_GENERIC;
+        goto error;
+    }
+
+    if (softTimeoutMsec != 0) {
+        setTimespecRelative(&ts, softTimeoutMsec);
+    } else if (timeoutMsec != 0) {
         setTimespecRelative(&ts, timeoutMsec);
     }
 
@@ -698,17 +1180,28 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
             err = pthread_cond_wait(&s_commandcond, &s_commandmutex);
         }
 
-        if (err == ETIMEDOUT) {
+        if (err == ETIMEDOUT && softTimeoutMsec != 0) {
+            /* slower than usual, but the channel may well be fine */
+            RLOGW("AT command %s still running after %lld ms\n",
+                    command, softTimeoutMsec);
+            setTimespecRelative(&ts, timeoutMsec - softTimeoutMsec);
+            softTimeoutMsec = 0;
+        } else if (err == ETIMEDOUT) {
+            RLOGE("AT command %s timed out after %lld ms\n",
+                    command, timeoutMsec);
+            recordTimeout(command);
             err = AT_ERROR_TIMEOUT;
             goto error;
         }
     }
 
+    if (sp_response->finalResponse != NULL) {
+        recordLatency(command, nowMsec() - startMsec);
+    }
+
     if (pp_outResponse == NULL) {
         at_response_free(sp_response);
     } else {
-        /* line reader stores intermediate responses in reverse order */
-        reverseIntermediates(sp_response);
         *pp_outResponse = sp_response;
     }
 
@@ -726,15 +1219,37 @@ error:
     return err;
 }
 
+/**
+ * Waits until no other thread has a command outstanding on the channel.
+ * Threads get the channel first come first served, so a caller can't be
+ * starved by a busy one. Assumes s_commandmutex is held
+ */
+static void acquireChannel()
+{
+    unsigned int ticket = s_channelNextTicket++;
+
+    while (ticket != s_channelServing) {
+        pthread_cond_wait(&s_channelcond, &s_commandmutex);
+    }
+}
+
+/** assumes s_commandmutex is held */
+static void releaseChannel()
+{
+    s_channelServing++;
+    pthread_cond_broadcast(&s_channelcond);
+}
+
 /**
  * Internal send_command implementation
  *
- * timeoutMsec == 0 means infinite timeout
+ * timeoutMsec == 0 means use the timeout of the command's class
  */
 static int at_send_command_full (const char *command, ATCommandType type,
                     const char *responsePrefix, const char *smspdu,
                     long long timeoutMsec, ATResponse **pp_outResponse)
 {
+    long long softTimeoutMsec = 0;
     int err;
 
     if (0 != pthread_equal(s_tid_reader, pthread_self())) {
@@ -744,9 +1259,17 @@ static int at_send_command_full (const char *command, ATCommandType type,
 
     pthread_mutex_lock(&s_commandmutex);
 
+    if (timeoutMsec == 0) {
+        timeoutMsec = timeoutForCommand(command, &softTimeoutMsec);
+    }
+
+    acquireChannel();
+
     err = at_send_command_full_nolock(command, type,
                     responsePrefix, smspdu,
-                    timeoutMsec, pp_outResponse);
+                    timeoutMsec, softTimeoutMsec, pp_outResponse);
+
+    releaseChannel();
 
     pthread_mutex_unlock(&s_commandmutex);
 
@@ -866,6 +1389,79 @@ void at_set_on_timeout(void (*onTimeout)(void))
     s_onTimeout = onTimeout;
 }
 
+/**
+ * Starts recording every command sent and every chunk read on the
+ * channel, with timestamps, to the file at path (see atcapture.h).
+ * Any previous capture is closed.
+ * returns 0 on success, -1 on error
+ */
+int at_capture_open(const char *path)
+{
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd < 0) {
+        RLOGE("Unable to open AT capture %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (write(fd, AT_CAPTURE_MAGIC, AT_CAPTURE_MAGIC_LEN)
+            != AT_CAPTURE_MAGIC_LEN) {
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_captureMutex);
+
+    if (s_captureFd >= 0) {
+        close(s_captureFd);
+    }
+    s_captureFd = fd;
+
+    pthread_mutex_unlock(&s_captureMutex);
+
+    return 0;
+}
+
+void at_capture_close()
+{
+    pthread_mutex_lock(&s_captureMutex);
+
+    if (s_captureFd >= 0) {
+        close(s_captureFd);
+    }
+    s_captureFd = -1;
+
+    pthread_mutex_unlock(&s_captureMutex);
+}
+
+/**
+ * Sets the timeout used for commands of class timeoutClass.
+ * 0 means commands of that class never time out
+ */
+void at_set_timeout_class_msec(ATTimeoutClass timeoutClass, long long msec)
+{
+    if (timeoutClass < 0 || timeoutClass >= AT_TIMEOUT_NUM_CLASSES) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_commandmutex);
+    s_classTimeoutMsec[timeoutClass] = msec;
+    pthread_mutex_unlock(&s_commandmutex);
+}
+
+/**
+ * Enables or disables the soft deadlines derived from observed latency.
+ * Latency is always recorded; this only controls whether it is used
+ */
+void at_set_adaptive_timeouts(int enable)
+{
+    pthread_mutex_lock(&s_commandmutex);
+    s_adaptiveTimeouts = enable;
+    pthread_mutex_unlock(&s_commandmutex);
+}
+
 /**
  *  This callback is invoked on the reader thread (like ATUnsolHandler)
  *  when the input stream closes before you call at_close
@@ -896,10 +1492,12 @@ int at_handshake()
 
     pthread_mutex_lock(&s_commandmutex);
 
+    acquireChannel();
+
     for (i = 0 ; i < HANDSHAKE_RETRY_COUNT ; i++) {
         /* some stacks start with verbose off */
         err = at_send_command_full_nolock ("ATE0Q0V1", NO_RESULT,
-                    NULL, NULL, HANDSHAKE_TIMEOUT_MSEC, NULL);
+                    NULL, NULL, HANDSHAKE_TIMEOUT_MSEC, 0, NULL);
 
         if (err == 0) {
             break;
@@ -913,6 +1511,8 @@ int at_handshake()
         sleepMsec(HANDSHAKE_TIMEOUT_MSEC);
     }
 
+    releaseChannel();
+
     pthread_mutex_unlock(&s_commandmutex);
 
     return err;
@@ -925,32 +1525,16 @@ int at_handshake()
 AT_CME_Error at_get_cme_error(const ATResponse *p_response)
 {
     int ret;
-    int err;
-    char *p_cur;
 
     if (p_response->success > 0) {
         return CME_SUCCESS;
     }
 
     if (p_response->finalResponse == NULL
-        || !strStartsWith(p_response->finalResponse, "+CME ERROR:")
+        || at_tok_scan(p_response->finalResponse, "+CME ERROR: %d", &ret) != 1
     ) {
         return CME_ERROR_NON_CME;
     }
 
-    p_cur = p_response->finalResponse;
-    err = at_tok_start(&p_cur);
-
-    if (err < 0) {
-        return CME_ERROR_NON_CME;
-    }
-
-    err = at_tok_nextint(&p_cur, &ret);
-
-    if (err < 0) {
-        return CME_ERROR_NON_CME;
-    }
-
     return (AT_CME_Error) ret;
 }
-
@@ -22,7 +22,8 @@
 extern "C" {
 #endif
 
-/* define AT_DEBUG to send AT traffic to /tmp/radio-at.log" */
+/* define AT_DEBUG to send AT traffic to /tmp/radio-at.log"
+   (see also at_capture_open() for a runtime, replayable capture) */
 #define AT_DEBUG  0
 
 #if AT_DEBUG
@@ -51,13 +52,30 @@ typedef enum {
                     starting with a prefix */
 } ATCommandType;
 
+/**
+ * Commands issued through the at_send_command_* functions time out
+ * according to their class. See at_set_timeout_class_msec()
+ */
+typedef enum {
+    AT_TIMEOUT_SHORT,    /* simple queries, eg AT+CSQ, AT+CREG? */
+    AT_TIMEOUT_DEFAULT,  /* anything not otherwise classified */
+    AT_TIMEOUT_LONG,     /* network dependent, eg AT+COPS=?, AT+CMGS */
+    AT_TIMEOUT_NUM_CLASSES
+} ATTimeoutClass;
+
 /** a singly-lined list of intermediate responses */
 typedef struct ATLine  {
     struct ATLine *p_next;
     char *line;
 } ATLine;
 
-/** Free this with at_response_free() */
+/**
+ * Free this with at_response_free()
+ *
+ * The intermediate lines and finalResponse are owned by the response
+ * and are only valid until it is freed. Intermediates are listed in
+ * the order they were received.
+ */
 typedef struct {
     int success;              /* true if final response indicates
                                     success (eg "OK") */
@@ -87,6 +105,18 @@ void at_set_on_timeout(void (*onTimeout)(void));
    channel is already closed */
 void at_set_on_reader_closed(void (*onClose)(void));
 
+/* Record all channel traffic with timestamps for replay with atreplay.
+   See atcapture.h for the format */
+int at_capture_open(const char *path);
+void at_capture_close();
+
+/* 0 means commands of this class never time out */
+void at_set_timeout_class_msec(ATTimeoutClass timeoutClass, long long msec);
+
+/* Log commands that run well past their observed p99 latency. They
+   still only time out at the class timeout */
+void at_set_adaptive_timeouts(int enable);
+
 int at_send_command_singleline (const char *command,
                                 const char *responsePrefix,
                                  ATResponse **pp_outResponse);
@@ -0,0 +1,231 @@
+/* //device/system/reference-ril/atreplay.c
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * atreplay plays the modem side of an AT capture (see atcapture.h)
+ * back to reference-ril.
+ *
+ * Commands from the capture are waited for, in order, and compared with
+ * what reference-ril actually sends. Modem input is written back with the
+ * captured inter-record delays divided by the speed factor. At the end,
+ * the time reference-ril spent between receiving modem input and sending
+ * its next command is reported for both the capture and the replay, which
+ * makes handler latency regressions visible offline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "atcapture.h"
+#include "hostmodem.h"
+
+#define NS_PER_S 1000000000LL
+
+typedef struct {
+    ATCaptureRecord header;
+    char *data;
+} Record;
+
+static int s_verbose = 0;
+
+static void usage(const char *s)
+{
+    fprintf(stderr, "usage: %s [-x <speed>] [-v] (-p <tcp port> | -t) <capture>\n"
+            "  -x  speed factor; 1 is real time, 0 is as fast as possible\n"
+            "  -p  listen for reference-ril -p <port> on the loopback\n"
+            "  -t  create a pty for reference-ril -d <path>\n", s);
+    exit(-1);
+}
+
+static Record *readCapture(const char *path, int *p_count)
+{
+    FILE *fp;
+    char magic[AT_CAPTURE_MAGIC_LEN];
+    Record *records = NULL;
+    int count = 0;
+    int alloced = 0;
+
+    fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+            || memcmp(magic, AT_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not an AT capture\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    for (;;) {
+        Record r;
+
+        if (fread(&r.header, sizeof(r.header), 1, fp) != 1) {
+            break;
+        }
+
+        r.data = malloc(r.header.length + 1);
+
+        if (r.data == NULL
+                || fread(r.data, 1, r.header.length, fp) != r.header.length) {
+            fprintf(stderr, "%s: truncated record %d\n", path, count);
+            free(r.data);
+            break;
+        }
+
+        r.data[r.header.length] = '\0';
+
+        if (count == alloced) {
+            alloced = alloced ? alloced * 2 : 256;
+            records = realloc(records, alloced * sizeof(Record));
+
+            if (records == NULL) {
+                fclose(fp);
+                return NULL;
+            }
+        }
+
+        records[count++] = r;
+    }
+
+    fclose(fp);
+
+    *p_count = count;
+    return records;
+}
+
+int main(int argc, char **argv)
+{
+    Record *records;
+    int count = 0;
+    int port = -1;
+    int usePty = 0;
+    double speed = 1.0;
+    int opt;
+    int fd;
+    int i;
+    char buf[4096];
+    long long lastWallNsec, lastCaptureNsec, startNsec;
+    long long captureThinkNsec = 0, replayThinkNsec = 0;
+    long long inputDoneNsec = -1;
+    int commands = 0, mismatches = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "x:p:tv"))) {
+        switch (opt) {
+            case 'x': speed = atof(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 't': usePty = 1; break;
+            case 'v': s_verbose = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1 || (port <= 0 && !usePty) || speed < 0) {
+        usage(argv[0]);
+    }
+
+    records = readCapture(argv[optind], &count);
+
+    if (records == NULL || count == 0) {
+        return -1;
+    }
+
+    fd = usePty ? hostmodem_open_pty() : hostmodem_open_loopback(port);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    startNsec = lastWallNsec = hostmodem_now_nsec();
+    lastCaptureNsec = records[0].header.timestampNsec;
+
+    for (i = 0 ; i < count ; i++) {
+        Record *r = &records[i];
+        long long captureDelta = r->header.timestampNsec - lastCaptureNsec;
+
+        switch (r->header.type) {
+            case AT_CAPTURE_COMMAND:
+            case AT_CAPTURE_PDU:
+                if (hostmodem_read_until(fd, r->header.type == AT_CAPTURE_PDU ? '\032' : '\r',
+                        buf, sizeof(buf)) < 0) {
+                    fprintf(stderr, "reference-ril closed the channel at record %d\n", i);
+                    goto done;
+                }
+
+                lastWallNsec = hostmodem_now_nsec();
+                commands++;
+
+                if (inputDoneNsec >= 0) {
+                    captureThinkNsec += captureDelta;
+                    replayThinkNsec += lastWallNsec - inputDoneNsec;
+                    inputDoneNsec = -1;
+                }
+
+                if (strcmp(buf, r->data) != 0) {
+                    mismatches++;
+                    fprintf(stderr, "record %d: expected '%s' got '%s'\n",
+                            i, r->data, buf);
+                } else if (s_verbose) {
+                    fprintf(stderr, "> %s\n", buf);
+                }
+                break;
+
+            case AT_CAPTURE_INPUT:
+                if (speed > 0) {
+                    hostmodem_sleep_until_nsec(lastWallNsec + (long long) (captureDelta / speed));
+                }
+
+                if (hostmodem_write_all(fd, r->data, r->header.length) < 0) {
+                    fprintf(stderr, "write failed at record %d\n", i);
+                    goto done;
+                }
+
+                lastWallNsec = inputDoneNsec = hostmodem_now_nsec();
+
+                if (s_verbose) {
+                    fprintf(stderr, "< %.*s\n", (int) r->header.length, r->data);
+                }
+                break;
+
+            default:
+                fprintf(stderr, "record %d: unknown type %d\n", i, r->header.type);
+                break;
+        }
+
+        lastCaptureNsec = r->header.timestampNsec;
+    }
+
+done:
+    printf("records: %d/%d, commands: %d, mismatches: %d\n",
+            i, count, commands, mismatches);
+    printf("captured span: %lld ms, replay: %lld ms\n",
+            (long long) (records[count - 1].header.timestampNsec
+                    - records[0].header.timestampNsec) / 1000000,
+            (hostmodem_now_nsec() - startNsec) / 1000000);
+    printf("ril response-to-next-command time: captured %lld ms, replay %lld ms\n",
+            captureThinkNsec / 1000000, replayThinkNsec / 1000000);
+
+    close(fd);
+
+    return mismatches == 0 && i == count ? 0 : 1;
+}
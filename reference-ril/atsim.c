@@ -0,0 +1,611 @@
+/* //device/system/reference-ril/atsim.c
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * atsim is a host side modem simulator for reference-ril. It answers
+ * the AT commands reference-ril issues (registration, signal, calls,
+ * PDP contexts, SIM I/O, SMS...) from a small amount of modem state, so
+ * reference-ril can run end to end without a real modem or the emulator.
+ *
+ * A script (-f) adjusts behaviour per command. Each line is one of:
+ *
+ *   delay <command> <msec>                  answer after msec
+ *   error <command> <percent> [<final>]     fail percent% of the time,
+ *                                           with <final> (default ERROR)
+ *   reply <command> <line>                  answer with <line> instead
+ *                                           (repeat for several lines)
+ *   unsol <interval msec> <count> <line>    send an unsolicited line count
+ *                                           times (0 = forever); interval
+ *                                           0 sends a burst
+ *
+ * <command> is matched as a prefix of each ';' separated command with the
+ * leading "AT" removed, eg "+CSQ", "+COPS=?", "D". '#' starts a comment.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "hostmodem.h"
+
+#define NUM_ELEMS(x) (sizeof(x)/sizeof(x[0]))
+
+#define MAX_RULES 64
+#define MAX_REPLY_LINES 8
+#define MAX_UNSOLS 16
+#define MAX_CALLS 7
+#define MAX_CONTEXTS 4
+#define MAX_LINE 1024
+#define MAX_RESPONSE (16 * 1024)
+
+typedef struct {
+    char command[32];
+    int delayMsec;
+    int errorPercent;
+    char errorFinal[64];
+    int replyCount;
+    char *replies[MAX_REPLY_LINES];
+} Rule;
+
+typedef struct {
+    int intervalMsec;
+    int count;
+    char line[MAX_LINE];
+} Unsol;
+
+typedef struct {
+    int index;
+    int isMT;
+    int state;      /* +CLCC stat */
+    char number[32];
+} Call;
+
+typedef struct {
+    int cid;
+    int active;
+    char type[8];
+    char apn[64];
+} Context;
+
+/* response being built for the current command line */
+typedef struct {
+    char buf[MAX_RESPONSE];
+    size_t len;
+    const char *final;
+} Response;
+
+static Rule s_rules[MAX_RULES];
+static int s_ruleCount = 0;
+static Unsol s_unsols[MAX_UNSOLS];
+static int s_unsolCount = 0;
+static int s_defaultDelayMsec = 0;
+static int s_verbose = 0;
+
+static int s_fd = -1;
+static pthread_mutex_t s_writeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* modem state; only touched by the command thread */
+static int s_cfun = 0;
+static int s_copsFormat = 0;
+static Call s_calls[MAX_CALLS];
+static int s_callCount = 0;
+static Context s_contexts[MAX_CONTEXTS];
+static int s_contextCount = 0;
+static int s_smsRef = 0;
+
+/* statistics */
+static long s_commandCount = 0;
+static long s_errorCount = 0;
+static long s_unsolSent = 0;
+
+static void usage(const char *s)
+{
+    fprintf(stderr, "usage: %s [-f <script>] [-l <default delay msec>] [-v]"
+            " (-p <tcp port> | -t)\n", s);
+    exit(-1);
+}
+
+static char *trim(char *s)
+{
+    char *end;
+
+    while (isspace(*s)) s++;
+
+    end = s + strlen(s);
+
+    while (end > s && isspace(end[-1])) end--;
+
+    *end = '\0';
+    return s;
+}
+
+/** splits the next whitespace separated word off *p_cur */
+static char *nextWord(char **p_cur)
+{
+    char *ret;
+
+    *p_cur = trim(*p_cur);
+    ret = *p_cur;
+
+    while (**p_cur != '\0' && !isspace(**p_cur)) (*p_cur)++;
+
+    if (**p_cur != '\0') {
+        *(*p_cur)++ = '\0';
+    }
+
+    return ret;
+}
+
+static Rule *findRule(const char *command, int create)
+{
+    int i;
+
+    for (i = 0 ; i < s_ruleCount ; i++) {
+        if (create ? 0 == strcmp(s_rules[i].command, command)
+                : 0 == strncmp(command, s_rules[i].command,
+                        strlen(s_rules[i].command))) {
+            return &s_rules[i];
+        }
+    }
+
+    if (!create || s_ruleCount == MAX_RULES) {
+        return NULL;
+    }
+
+    memset(&s_rules[i], 0, sizeof(Rule));
+    snprintf(s_rules[i].command, sizeof(s_rules[i].command), "%s", command);
+    s_rules[i].delayMsec = -1;
+    s_ruleCount++;
+
+    return &s_rules[i];
+}
+
+static int loadScript(const char *path)
+{
+    FILE *fp;
+    char buf[MAX_LINE];
+    int lineNumber = 0;
+
+    fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        char *cur = buf;
+        char *directive;
+        char *hash;
+        Rule *rule;
+
+        lineNumber++;
+
+        hash = strchr(buf, '#');
+        if (hash != NULL) *hash = '\0';
+
+        directive = nextWord(&cur);
+
+        if (*directive == '\0') {
+            continue;
+        }
+
+        if (0 == strcmp(directive, "unsol")) {
+            Unsol *u;
+
+            if (s_unsolCount == MAX_UNSOLS) {
+                goto error;
+            }
+
+            u = &s_unsols[s_unsolCount++];
+            u->intervalMsec = atoi(nextWord(&cur));
+            u->count = atoi(nextWord(&cur));
+            snprintf(u->line, sizeof(u->line), "%s", trim(cur));
+            continue;
+        }
+
+        rule = findRule(nextWord(&cur), 1);
+
+        if (rule == NULL || rule->command[0] == '\0') {
+            goto error;
+        }
+
+        if (0 == strcmp(directive, "delay")) {
+            rule->delayMsec = atoi(nextWord(&cur));
+        } else if (0 == strcmp(directive, "error")) {
+            rule->errorPercent = atoi(nextWord(&cur));
+            cur = trim(cur);
+            snprintf(rule->errorFinal, sizeof(rule->errorFinal), "%s",
+                    *cur != '\0' ? cur : "ERROR");
+        } else if (0 == strcmp(directive, "reply")) {
+            if (rule->replyCount == MAX_REPLY_LINES) {
+                goto error;
+            }
+            rule->replies[rule->replyCount++] = strdup(trim(cur));
+        } else {
+            goto error;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+
+error:
+    fprintf(stderr, "%s:%d: invalid line\n", path, lineNumber);
+    fclose(fp);
+    return -1;
+}
+
+static void sendLocked(const char *buf, size_t len)
+{
+    pthread_mutex_lock(&s_writeMutex);
+    hostmodem_write_all(s_fd, buf, len);
+    pthread_mutex_unlock(&s_writeMutex);
+}
+
+static void addLine(Response *r, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(r->buf + r->len, sizeof(r->buf) - r->len - 2, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || r->len + n + 2 >= sizeof(r->buf)) {
+        return;
+    }
+
+    r->len += n;
+    r->buf[r->len++] = '\r';
+    r->buf[r->len++] = '\n';
+}
+
+static Context *findContext(int cid, int create)
+{
+    int i;
+
+    for (i = 0 ; i < s_contextCount ; i++) {
+        if (s_contexts[i].cid == cid) {
+            return &s_contexts[i];
+        }
+    }
+
+    if (!create || s_contextCount == MAX_CONTEXTS) {
+        return NULL;
+    }
+
+    memset(&s_contexts[i], 0, sizeof(Context));
+    s_contexts[i].cid = cid;
+    s_contextCount++;
+
+    return &s_contexts[i];
+}
+
+/**
+ * Reads a "> " prompted SMS PDU from reference-ril
+ * returns 0 on success
+ */
+static int readPdu()
+{
+    char pdu[MAX_LINE];
+
+    sendLocked("> ", 2);
+
+    return hostmodem_read_until(s_fd, '\032', pdu, sizeof(pdu)) < 0 ? -1 : 0;
+}
+
+/** answers one ';' separated command, without its "AT" */
+static void handleCommand(const char *cmd, Response *r)
+{
+    int a, b, c, d, e;
+    char str[MAX_LINE];
+
+    if (0 == strncmp(cmd, "+CFUN?", 6)) {
+        addLine(r, "+CFUN: %d", s_cfun);
+    } else if (1 == sscanf(cmd, "+CFUN=%d", &a)) {
+        s_cfun = a;
+    } else if (0 == strncmp(cmd, "+CPIN?", 6)) {
+        addLine(r, "+CPIN: READY");
+    } else if (0 == strncmp(cmd, "+CREG?", 6)) {
+        addLine(r, "+CREG: 2,1,\"00C3\",\"00001234\"");
+    } else if (0 == strncmp(cmd, "+CGREG?", 7)) {
+        addLine(r, "+CGREG: 2,1,\"00C3\",\"00001234\"");
+    } else if (0 == strncmp(cmd, "+CSQ", 4)) {
+        addLine(r, "+CSQ: 20,99,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1");
+    } else if (0 == strncmp(cmd, "+COPS=?", 7)) {
+        addLine(r, "+COPS: (2,\"Android\",\"Android\",\"310260\",0),"
+                "(1,\"Other\",\"Other\",\"310410\",0),,(0-4),(0-2)");
+    } else if (2 == sscanf(cmd, "+COPS=%d,%d", &a, &b) && a == 3) {
+        s_copsFormat = b;
+    } else if (0 == strncmp(cmd, "+COPS?", 6)) {
+        static const char *names[] = { "Android", "Android", "310260" };
+        addLine(r, "+COPS: 0,%d,\"%s\"", s_copsFormat,
+                names[s_copsFormat < 0 || s_copsFormat > 2 ? 0 : s_copsFormat]);
+    } else if (0 == strncmp(cmd, "+CLCC", 5)) {
+        int i;
+
+        for (i = 0 ; i < s_callCount ; i++) {
+            Call *call = &s_calls[i];
+
+            addLine(r, "+CLCC: %d,%d,%d,0,0,\"%s\",%d", call->index,
+                    call->isMT, call->state, call->number,
+                    call->number[0] == '+' ? 145 : 129);
+
+            /* dialing -> alerting -> active, one step per poll */
+            if (call->state == 2) {
+                call->state = 3;
+            } else if (call->state == 3) {
+                call->state = 0;
+            }
+        }
+    } else if (0 == strncmp(cmd, "D*99", 4)) {
+        Context *ctx = findContext(1, 1);
+
+        if (ctx != NULL) ctx->active = 1;
+    } else if (cmd[0] == 'D') {
+        if (s_callCount < MAX_CALLS) {
+            Call *call = &s_calls[s_callCount++];
+            size_t len = strcspn(cmd + 1, ";IiGg");
+
+            call->index = s_callCount;
+            call->isMT = 0;
+            call->state = 2;
+            snprintf(call->number, sizeof(call->number), "%.*s",
+                    (int) len, cmd + 1);
+        } else {
+            r->final = "NO CARRIER";
+        }
+    } else if (cmd[0] == 'A' && cmd[1] == '\0') {
+        int i;
+
+        for (i = 0 ; i < s_callCount ; i++) {
+            if (s_calls[i].state == 4 || s_calls[i].state == 5) {
+                s_calls[i].state = 0;
+            }
+        }
+    } else if (cmd[0] == 'H' || 0 == strncmp(cmd, "+CHLD=", 6)) {
+        /* every flavour of hangup/hold just ends all calls here */
+        s_callCount = 0;
+    } else if (1 == sscanf(cmd, "+CGDCONT=%d,", &a)) {
+        Context *ctx = findContext(a, 1);
+
+        if (ctx != NULL) {
+            sscanf(cmd, "+CGDCONT=%*d,\"%7[^\"]\",\"%63[^\"]\"",
+                    ctx->type, ctx->apn);
+        }
+    } else if (0 == strncmp(cmd, "+CGDCONT?", 9)) {
+        int i;
+
+        for (i = 0 ; i < s_contextCount ; i++) {
+            addLine(r, "+CGDCONT: %d,\"%s\",\"%s\",\"10.0.2.%d\",0,0",
+                    s_contexts[i].cid, s_contexts[i].type,
+                    s_contexts[i].apn, 15 + i);
+        }
+    } else if (0 == strncmp(cmd, "+CGACT?", 7)) {
+        int i;
+
+        for (i = 0 ; i < s_contextCount ; i++) {
+            addLine(r, "+CGACT: %d,%d", s_contexts[i].cid,
+                    s_contexts[i].active);
+        }
+    } else if (5 == sscanf(cmd, "+CRSM=%d,%d,%d,%d,%d", &a, &b, &c, &d, &e)) {
+        if (a == 192) {
+            /* GET RESPONSE: a linear fixed EF of 10 0x20 byte records */
+            addLine(r, "+CRSM: 144,0,\"0000%04X%04X040011F0220102011C20\"",
+                    10 * 0x20, b);
+        } else if (a == 176 || a == 178) {
+            /* READ BINARY / READ RECORD: all 0xff */
+            int i;
+            char *p = str;
+
+            for (i = 0 ; i < e && i < (int) (sizeof(str) / 2) - 1 ; i++) {
+                *p++ = 'F';
+                *p++ = 'F';
+            }
+            *p = '\0';
+
+            addLine(r, "+CRSM: 144,0,\"%s\"", str);
+        } else {
+            addLine(r, "+CRSM: 144,0");
+        }
+    } else if (0 == strncmp(cmd, "+CMGS=", 6)) {
+        if (readPdu() < 0) return;
+        addLine(r, "+CMGS: %d", ++s_smsRef & 0xff);
+    } else if (0 == strncmp(cmd, "+CMGW=", 6)) {
+        if (readPdu() < 0) return;
+        addLine(r, "+CMGW: %d", ++s_smsRef & 0xff);
+    } else if (0 == strncmp(cmd, "+CSMS=", 6)) {
+        addLine(r, "+CSMS: 1,1,1");
+    } else if (0 == strncmp(cmd, "+CIMI", 5)) {
+        addLine(r, "310260000000000");
+    } else if (0 == strncmp(cmd, "+CGSN", 5)) {
+        addLine(r, "000000000000000");
+    } else if (0 == strncmp(cmd, "+CTEC", 5)
+            || 0 == strncmp(cmd, "+WNAM", 5)) {
+        /* a plain GSM modem: not multimode, not CDMA */
+        r->final = "ERROR";
+    }
+
+    /* everything else (E0Q0V1, +CMEE, +CREG=, +CNMI, ...) is just OK */
+}
+
+static void handleLine(char *line)
+{
+    Response r;
+    char *cur;
+    int delayMsec = s_defaultDelayMsec;
+
+    if (strncasecmp(line, "AT", 2) != 0) {
+        return;
+    }
+
+    s_commandCount++;
+
+    if (s_verbose) {
+        fprintf(stderr, "> %s\n", line);
+    }
+
+    r.len = 0;
+    r.final = "OK";
+
+    cur = line + 2;
+
+    while (*cur != '\0' && 0 == strcmp(r.final, "OK")) {
+        char *next;
+        Rule *rule;
+
+        if (*cur == '+' || *cur == '%') {
+            /* extended commands are ';' separated */
+            next = strchr(cur, ';');
+        } else {
+            /* basic commands (D, A, H...) run to the end of the line */
+            next = NULL;
+        }
+
+        if (next != NULL) {
+            *next = '\0';
+        }
+
+        rule = findRule(cur, 0);
+
+        if (rule != NULL && rule->delayMsec >= 0) {
+            delayMsec += rule->delayMsec;
+        }
+
+        if (rule != NULL && rule->errorPercent > 0
+                && rand() % 100 < rule->errorPercent) {
+            r.final = rule->errorFinal;
+            s_errorCount++;
+        } else if (rule != NULL && rule->replyCount > 0) {
+            int i;
+
+            for (i = 0 ; i < rule->replyCount ; i++) {
+                addLine(&r, "%s", rule->replies[i]);
+            }
+        } else {
+            handleCommand(cur, &r);
+        }
+
+        if (next == NULL) {
+            break;
+        }
+
+        cur = next + 1;
+
+        /* "AT+COPS=3,0;+COPS?" - the next one keeps its '+' */
+        if (strncasecmp(cur, "AT", 2) == 0) {
+            cur += 2;
+        }
+    }
+
+    if (delayMsec > 0) {
+        hostmodem_sleep_until_nsec(hostmodem_now_nsec()
+                + delayMsec * 1000000LL);
+    }
+
+    addLine(&r, "%s", r.final);
+
+    if (s_verbose) {
+        fprintf(stderr, "< %.*s", (int) r.len, r.buf);
+    }
+
+    sendLocked(r.buf, r.len);
+}
+
+static void *unsolLoop(void *param)
+{
+    Unsol *u = (Unsol *) param;
+    char buf[MAX_LINE + 4];
+    int len;
+    int i;
+
+    len = snprintf(buf, sizeof(buf), "\r\n%s\r\n", u->line);
+
+    for (i = 0 ; u->count == 0 || i < u->count ; i++) {
+        if (u->intervalMsec > 0) {
+            hostmodem_sleep_until_nsec(hostmodem_now_nsec()
+                    + u->intervalMsec * 1000000LL);
+        }
+
+        sendLocked(buf, len);
+        __sync_fetch_and_add(&s_unsolSent, 1);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int port = -1;
+    int usePty = 0;
+    int opt;
+    int i;
+    char line[MAX_LINE];
+    long long startNsec;
+
+    while (-1 != (opt = getopt(argc, argv, "f:l:p:tv"))) {
+        switch (opt) {
+            case 'f':
+                if (loadScript(optarg) < 0) return -1;
+                break;
+            case 'l': s_defaultDelayMsec = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 't': usePty = 1; break;
+            case 'v': s_verbose = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (port <= 0 && !usePty) {
+        usage(argv[0]);
+    }
+
+    s_fd = usePty ? hostmodem_open_pty() : hostmodem_open_loopback(port);
+
+    if (s_fd < 0) {
+        return -1;
+    }
+
+    startNsec = hostmodem_now_nsec();
+
+    for (i = 0 ; i < s_unsolCount ; i++) {
+        pthread_t tid;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_create(&tid, &attr, unsolLoop, &s_unsols[i]);
+    }
+
+    while (hostmodem_read_until(s_fd, '\r', line, sizeof(line)) >= 0) {
+        handleLine(trim(line));
+    }
+
+    fprintf(stderr, "channel closed after %lld ms: %ld commands, "
+            "%ld injected errors, %ld unsolicited\n",
+            (hostmodem_now_nsec() - startNsec) / 1000000,
+            s_commandCount, s_errorCount, s_unsolSent);
+
+    return 0;
+}
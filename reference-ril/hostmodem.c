@@ -0,0 +1,198 @@
+/* //device/system/reference-ril/hostmodem.c
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Helpers shared by the host side modem tools (atreplay, atsim), which
+ * sit on the modem end of reference-ril's AT channel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "hostmodem.h"
+
+#define NS_PER_S 1000000000LL
+
+/** returns CLOCK_MONOTONIC in nanoseconds */
+long long hostmodem_now_nsec()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+void hostmodem_sleep_until_nsec(long long deadline)
+{
+    struct timespec ts;
+    long long delta = deadline - hostmodem_now_nsec();
+    int err;
+
+    if (delta <= 0) {
+        return;
+    }
+
+    ts.tv_sec = delta / NS_PER_S;
+    ts.tv_nsec = delta % NS_PER_S;
+
+    do {
+        err = nanosleep(&ts, &ts);
+    } while (err < 0 && errno == EINTR);
+}
+
+/**
+ * Waits for reference-ril -p <port> to connect on the loopback
+ * returns the connected fd, or -1 on error
+ */
+int hostmodem_open_loopback(int port)
+{
+    struct sockaddr_in addr;
+    int s, fd;
+    int on = 1;
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (s < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0
+            || listen(s, 1) < 0) {
+        perror("bind");
+        close(s);
+        return -1;
+    }
+
+    fprintf(stderr, "waiting for reference-ril on port %d\n", port);
+
+    do {
+        fd = accept(s, NULL, NULL);
+    } while (fd < 0 && errno == EINTR);
+
+    close(s);
+
+    if (fd >= 0) {
+        /* don't let Nagle add latency that was not in the capture */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    return fd;
+}
+
+/**
+ * Creates a raw pty and prints the path to give reference-ril -d
+ * returns the master fd, or -1 on error
+ */
+int hostmodem_open_pty()
+{
+    struct termios ios;
+    int fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        perror("pty");
+        return -1;
+    }
+
+    /* no echo or line editing, like a modem */
+    tcgetattr(fd, &ios);
+    cfmakeraw(&ios);
+    tcsetattr(fd, TCSANOW, &ios);
+
+    fprintf(stderr, "reference-ril device: %s\n", ptsname(fd));
+
+    return fd;
+}
+
+/**
+ * Reads what reference-ril sends up to and excluding terminator.
+ * Leading \r and \n are dropped and buf is always NUL terminated
+ * returns the length read, or -1 on EOF or error
+ */
+int hostmodem_read_until(int fd, char terminator, char *buf, size_t size)
+{
+    size_t len = 0;
+
+    for (;;) {
+        char c;
+        ssize_t count;
+
+        do {
+            count = read(fd, &c, 1);
+        } while (count < 0 && errno == EINTR);
+
+        if (count <= 0) {
+            return -1;
+        }
+
+        if (c == terminator) {
+            break;
+        }
+
+        /* leading newlines are noise left over from the last command */
+        if (len == 0 && (c == '\r' || c == '\n')) {
+            continue;
+        }
+
+        if (len < size - 1) {
+            buf[len++] = c;
+        }
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+int hostmodem_write_all(int fd, const char *buf, size_t len)
+{
+    size_t cur = 0;
+
+    while (cur < len) {
+        ssize_t written;
+
+        do {
+            written = write(fd, buf + cur, len - cur);
+        } while (written < 0 && errno == EINTR);
+
+        if (written < 0) {
+            return -1;
+        }
+
+        cur += written;
+    }
+
+    return 0;
+}
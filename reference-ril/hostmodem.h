@@ -0,0 +1,32 @@
+/* //device/system/reference-ril/hostmodem.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef HOSTMODEM_H
+#define HOSTMODEM_H 1
+
+#include <stddef.h>
+
+long long hostmodem_now_nsec();
+void hostmodem_sleep_until_nsec(long long deadline);
+
+int hostmodem_open_loopback(int port);
+int hostmodem_open_pty();
+
+int hostmodem_read_until(int fd, char terminator, char *buf, size_t size);
+int hostmodem_write_all(int fd, const char *buf, size_t len);
+
+#endif /*HOSTMODEM_H*/
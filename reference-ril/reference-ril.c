@@ -27,6 +27,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <time.h>
 #include <alloca.h>
 #include "atchannel.h"
 #include "at_tok.h"
@@ -36,6 +37,9 @@
 #include <cutils/sockets.h>
 #include <termios.h>
 #include <sys/system_properties.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <limits.h>
 
 #include "ril.h"
 #include "hardware/qemu_pipe.h"
@@ -167,6 +171,18 @@ typedef enum {
     RUIM_NETWORK_PERSONALIZATION = 11
 } SIM_Status;
 
+/* which of the request executor's threads runs a request; see below */
+typedef enum {
+    REQUEST_CLASS_CALL,         /* call control and call state */
+    REQUEST_CLASS_MESSAGING,    /* SMS and USSD */
+    REQUEST_CLASS_NETWORK,      /* registration, signal and cell queries */
+    REQUEST_CLASS_SELECTION,    /* operator selection, which can take minutes */
+    REQUEST_CLASS_DATA,         /* PDP contexts */
+    REQUEST_CLASS_SIM,
+    REQUEST_CLASS_COUNT,
+    REQUEST_CLASS_BARRIER       /* run by the sequencer, not a worker */
+} RequestClass;
+
 static void onRequest (int request, void *data, size_t datalen, RIL_Token t);
 static RIL_RadioState currentState();
 static int onSupports (int requestCode);
@@ -177,6 +193,9 @@ static SIM_Status getSIMStatus();
 static int getCardStatus(RIL_CardStatus_v6 **pp_card_status);
 static void freeCardStatus(RIL_CardStatus_v6 *p_card_status);
 static void onDataCallListChanged(void *param);
+static void requestWorkerCallback(RequestClass requestClass,
+        RIL_TimedCallback callback, void *param,
+        const struct timeval *relativeTime);
 
 extern const char * requestToString(int request);
 
@@ -210,12 +229,22 @@ static int          s_device_socket = 0;
 /* trigger change to this with s_state_cond */
 static int s_closed = 0;
 
+/* set by mainLoop before queueing initializeCallback, cleared by it when it
+   runs; trigger change to this with s_state_cond */
+static int s_initPending = 0;
+
+/* reconnect backoff; the upper bound is the old fixed retry interval */
+#define RECONNECT_MIN_MS 20
+#define RECONNECT_MAX_MS 10000
+
+/* when the channel last went away, 0 if it has been recovered */
+static long long s_channelClosedMsec = 0;
+static int s_reconnectAttempts = 0;
+
 static int sFD;     /* file desc of AT channel */
 static char sATBuffer[MAX_AT_RESPONSE+1];
 static char *sATBufferCur = NULL;
 
-static const struct timeval TIMEVAL_SIMPOLL = {1,0};
-static const struct timeval TIMEVAL_CALLSTATEPOLL = {0,500000};
 static const struct timeval TIMEVAL_0 = {0,0};
 
 static int s_ims_registered  = 0;        // 0==unregistered
@@ -239,19 +268,249 @@ static int s_repollCallsCount = 0;
 static int s_expectAnswer = 0;
 #endif /* WORKAROUND_ERRONEOUS_ANSWER */
 
+/*
+ * protects these and the rest of the cell info state; the network worker
+ * and the reader thread use them, as do radio power changes
+ */
+static pthread_mutex_t s_cellInfoMutex = PTHREAD_MUTEX_INITIALIZER;
 static int s_cell_info_rate_ms = INT_MAX;
 static int s_mcc = 0;
 static int s_mnc = 0;
-static int s_lac = 0;
-static int s_cid = 0;
+
+/*
+ * Modem state cache
+ *
+ * Registration, operator and signal queries are answered from the last
+ * response lines seen for them while those are fresh, instead of sending
+ * AT+CREG? etc. on every framework poll. +CREG: and +CGREG: unsolicited
+ * lines refresh their entries directly (and drop the operator, which may
+ * have changed with them). Everything is dropped on radio state, SIM and
+ * network selection changes.
+ *
+ * Lines are stored raw and parsed on every use, so a hit goes through
+ * the same parser as a fresh response.
+ */
+
+typedef enum {
+    STATE_CACHE_CREG,
+    STATE_CACHE_CGREG,
+    STATE_CACHE_COPS,
+    STATE_CACHE_CSQ,
+    STATE_CACHE_NUM
+} StateCacheId;
+
+#define STATE_CACHE_MAX_LINES 3
+#define STATE_CACHE_LINE_LEN 128
+/* log the counters every this many lookups of an entry */
+#define STATE_CACHE_STATS_INTERVAL 100
+
+typedef struct {
+    const char *name;
+    long long maxAgeMsec;
+    long long updatedMsec;
+    int lineCount;                  /* 0 when invalid */
+    char lines[STATE_CACHE_MAX_LINES][STATE_CACHE_LINE_LEN];
+    unsigned int hits;
+    unsigned int misses;
+} StateCacheEntry;
+
+static StateCacheEntry s_stateCache[STATE_CACHE_NUM] = {
+    /* kept current by unsolicited +CREG: / +CGREG: */
+    [STATE_CACHE_CREG] = { "CREG", 60000, 0, 0, {{0}}, 0, 0 },
+    [STATE_CACHE_CGREG] = { "CGREG", 60000, 0, 0, {{0}}, 0, 0 },
+    /* dropped whenever registration changes */
+    [STATE_CACHE_COPS] = { "COPS", 60000, 0, 0, {{0}}, 0, 0 },
+    /* no unsolicited signal reports, so only absorbs bursts of polls */
+    [STATE_CACHE_CSQ] = { "CSQ", 2000, 0, 0, {{0}}, 0, 0 },
+};
+
+static pthread_mutex_t s_stateCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long long nowMsec()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Copies the cached lines for id into lines
+ * returns the number of lines, or 0 if there is no fresh entry
+ */
+static int stateCacheGet(StateCacheId id,
+        char lines[STATE_CACHE_MAX_LINES][STATE_CACHE_LINE_LEN])
+{
+    StateCacheEntry *e = &s_stateCache[id];
+    int count = 0;
+
+    pthread_mutex_lock(&s_stateCacheMutex);
+
+    if (e->lineCount > 0 && nowMsec() - e->updatedMsec <= e->maxAgeMsec) {
+        count = e->lineCount;
+        memcpy(lines, e->lines, sizeof(e->lines));
+        e->hits++;
+    } else {
+        e->misses++;
+    }
+
+    if ((e->hits + e->misses) % STATE_CACHE_STATS_INTERVAL == 0) {
+        RLOGD("state cache %s: %u hits, %u misses (AT queries saved)",
+                e->name, e->hits, e->misses);
+    }
+
+    pthread_mutex_unlock(&s_stateCacheMutex);
+
+    return count;
+}
+
+/** replaces the entry for id with count lines */
+static void stateCachePut(StateCacheId id, const char **lines, int count)
+{
+    StateCacheEntry *e = &s_stateCache[id];
+    int i;
+
+    pthread_mutex_lock(&s_stateCacheMutex);
+
+    e->lineCount = 0;
+
+    for (i = 0 ; i < count && i < STATE_CACHE_MAX_LINES ; i++) {
+        if (strlcpy(e->lines[i], lines[i], STATE_CACHE_LINE_LEN)
+                >= STATE_CACHE_LINE_LEN) {
+            /* too long to cache; leave the entry invalid */
+            pthread_mutex_unlock(&s_stateCacheMutex);
+            return;
+        }
+    }
+
+    if (i == count) {
+        e->lineCount = count;
+        e->updatedMsec = nowMsec();
+    }
+
+    pthread_mutex_unlock(&s_stateCacheMutex);
+}
+
+/** caches the intermediate lines of a successful response */
+static void stateCachePutResponse(StateCacheId id, const ATResponse *p_response)
+{
+    const char *lines[STATE_CACHE_MAX_LINES];
+    ATLine *p_cur;
+    int count = 0;
+
+    if (p_response == NULL || p_response->success == 0) {
+        return;
+    }
+
+    for (p_cur = p_response->p_intermediates
+            ; p_cur != NULL
+            ; p_cur = p_cur->p_next
+    ) {
+        if (count == STATE_CACHE_MAX_LINES) {
+            return;
+        }
+        lines[count++] = p_cur->line;
+    }
+
+    if (count > 0) {
+        stateCachePut(id, lines, count);
+    }
+}
+
+static void stateCacheInvalidate(StateCacheId id)
+{
+    pthread_mutex_lock(&s_stateCacheMutex);
+    s_stateCache[id].lineCount = 0;
+    pthread_mutex_unlock(&s_stateCacheMutex);
+}
+
+static void stateCacheInvalidateAll()
+{
+    int i;
+
+    pthread_mutex_lock(&s_stateCacheMutex);
+    for (i = 0 ; i < STATE_CACHE_NUM ; i++) {
+        s_stateCache[i].lineCount = 0;
+    }
+    pthread_mutex_unlock(&s_stateCacheMutex);
+}
+
+/**
+ * Caches an unsolicited +CREG: or +CGREG: line as an answer to AT+CREG? or
+ * AT+CGREG?. The unsolicited form has no leading <n>, so without one
+ * parseRegistrationState() would read <stat>, <lac>, <cid> a field off
+ */
+static void stateCachePutRegistration(StateCacheId id, const char *s)
+{
+    char line[STATE_CACHE_LINE_LEN];
+    const char *lines[1] = { line };
+    const char *colon = strchr(s, ':');
+    int len;
+
+    if (colon == NULL) {
+        stateCacheInvalidate(id);
+        return;
+    }
+
+    /* the <n> value is skipped when parsed */
+    len = snprintf(line, sizeof(line), "%.*s 2,%s", (int) (colon + 1 - s), s,
+            colon + 1);
+
+    if (len < 0 || len >= (int) sizeof(line)) {
+        stateCacheInvalidate(id);
+        return;
+    }
+
+    stateCachePut(id, lines, 1);
+}
+
+/**
+ * Returns the first line for id, from the cache while it is fresh and
+ * otherwise from a single line query (whose answer is then cached)
+ * returns 0 on success, -1 on error
+ */
+static int stateCacheQuery(StateCacheId id, const char *cmd,
+        const char *prefix, char line[STATE_CACHE_LINE_LEN])
+{
+    char cached[STATE_CACHE_MAX_LINES][STATE_CACHE_LINE_LEN];
+    ATResponse *p_response = NULL;
+    int err;
+
+    if (stateCacheGet(id, cached) > 0) {
+        memcpy(line, cached[0], STATE_CACHE_LINE_LEN);
+        return 0;
+    }
+
+    err = at_send_command_singleline(cmd, prefix, &p_response);
+
+    if (err < 0 || p_response->success == 0
+            || strlcpy(line, p_response->p_intermediates->line,
+                    STATE_CACHE_LINE_LEN) >= STATE_CACHE_LINE_LEN) {
+        at_response_free(p_response);
+        return -1;
+    }
+
+    stateCachePutResponse(id, p_response);
+    at_response_free(p_response);
+
+    return 0;
+}
 
 static void pollSIMState (void *param);
+static void startSIMPolling();
+static void kickSIMPolling();
+static void onCellInfoSample(void *param);
+static void startCellInfoSampling();
 static void setRadioState(RIL_RadioState newState);
 static void setRadioTechnology(ModemInfo *mdm, int newtech);
 static int query_ctec(ModemInfo *mdm, int *current, int32_t *preferred);
 static int parse_technology_response(const char *response, int *current, int32_t *preferred);
 static int techFromModemType(int mdmtype);
 
+/* also written by AT+CMGW, AT+CMGD and messages stored on the SIM */
+#define EF_SMS 0x6F3C
+static void simFileCacheInvalidateFile(int fileid);
+
 static int clccStateToRILState(int state, RIL_CallState *p_state)
 
 {
@@ -344,12 +603,16 @@ static void onRadioPowerOn()
     at_send_command("AT%CTZV=1", NULL);
 #endif
 
-    pollSIMState(NULL);
+    startSIMPolling();
+
+    startCellInfoSampling();
 }
 
 /** do post- SIM ready initialization */
 static void onSIMReady()
 {
+    stateCacheInvalidateAll();
+
     at_send_command_singleline("AT+CSMS=1", "+CSMS:", NULL);
     /*
      * Always send SMS messages directly to the TE
@@ -420,11 +683,111 @@ static void requestShutdown(RIL_Token t)
 
 static void requestOrSendDataCallList(RIL_Token *t);
 
+/*
+ * Data call list polling
+ *
+ * +CGEV: (and, with WORKAROUND_FAKE_CGEV, every ring and registration
+ * change) asks for the data call list to be polled. Triggers are
+ * coalesced: while a poll is pending further ones are dropped, and polls
+ * are at least DATA_CALL_LIST_MIN_INTERVAL_MS apart, so storms cost one
+ * AT+CGACT?/AT+CGDCONT? round every interval at most.
+ *
+ * RIL_UNSOL_DATA_CALL_LIST_CHANGED is only sent when the polled list
+ * differs from the last one the framework saw, either from an earlier
+ * unsolicited response or as the answer to a request.
+ */
+
+#define DATA_CALL_LIST_MIN_INTERVAL_MS 1000
+#define DATA_CALL_LIST_SIGNATURE_LEN 1024
+
+/* protects everything below; polls and the data worker both update the list */
+static pthread_mutex_t s_dataCallListMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_dataCallListPollPending = 0;
+static long long s_lastDataCallListPollMsec = 0;
+static char s_lastDataCallList[DATA_CALL_LIST_SIGNATURE_LEN];
+static int s_lastDataCallListValid = 0;
+
+/** Called on the reader thread or the request thread */
+static void scheduleDataCallListPoll()
+{
+    long long delayMsec;
+    struct timeval tv;
+
+    pthread_mutex_lock(&s_dataCallListMutex);
+
+    if (s_dataCallListPollPending) {
+        pthread_mutex_unlock(&s_dataCallListMutex);
+        return;
+    }
+
+    s_dataCallListPollPending = 1;
+    delayMsec = s_lastDataCallListPollMsec + DATA_CALL_LIST_MIN_INTERVAL_MS
+            - nowMsec();
+
+    pthread_mutex_unlock(&s_dataCallListMutex);
+
+    if (delayMsec > 0) {
+        tv.tv_sec = delayMsec / 1000;
+        tv.tv_usec = (delayMsec % 1000) * 1000;
+        requestWorkerCallback(REQUEST_CLASS_DATA, onDataCallListChanged, NULL, &tv);
+    } else {
+        requestWorkerCallback(REQUEST_CLASS_DATA, onDataCallListChanged, NULL, NULL);
+    }
+}
+
 static void onDataCallListChanged(void *param __unused)
 {
+    pthread_mutex_lock(&s_dataCallListMutex);
+    /* triggers from here on need a new poll */
+    s_dataCallListPollPending = 0;
+    s_lastDataCallListPollMsec = nowMsec();
+    pthread_mutex_unlock(&s_dataCallListMutex);
+
     requestOrSendDataCallList(NULL);
 }
 
+/**
+ * Records the list as the one the framework last saw
+ * returns 1 if it differs from the previous one
+ */
+static int updateDataCallList(const RIL_Data_Call_Response_v11 *responses,
+        int n)
+{
+    char signature[DATA_CALL_LIST_SIGNATURE_LEN];
+    size_t len = 0;
+    int changed;
+    int i;
+
+    signature[0] = '\0';
+
+    for (i = 0; i < n && len < sizeof(signature); i++) {
+        const RIL_Data_Call_Response_v11 *r = &responses[i];
+
+        len += snprintf(signature + len, sizeof(signature) - len,
+                "%d,%d,%d,%d,%s,%s,%s,%s,%s,%s,%d;", r->status,
+                r->suggestedRetryTime, r->cid, r->active, r->type, r->ifname,
+                r->addresses, r->dnses, r->gateways, r->pcscf, r->mtu);
+    }
+
+    pthread_mutex_lock(&s_dataCallListMutex);
+
+    if (len >= sizeof(signature)) {
+        /* too long to compare; always report it */
+        s_lastDataCallListValid = 0;
+        changed = 1;
+    } else {
+        changed = !s_lastDataCallListValid
+                || strcmp(signature, s_lastDataCallList) != 0;
+
+        strcpy(s_lastDataCallList, signature);
+        s_lastDataCallListValid = 1;
+    }
+
+    pthread_mutex_unlock(&s_dataCallListMutex);
+
+    return changed;
+}
+
 static void requestDataCallList(void *data __unused, size_t datalen __unused, RIL_Token t)
 {
     requestOrSendDataCallList(&t);
@@ -442,9 +805,10 @@ static void requestOrSendDataCallList(RIL_Token *t)
     if (err != 0 || p_response->success == 0) {
         if (t != NULL)
             RIL_onRequestComplete(*t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        else
+        else if (updateDataCallList(NULL, 0))
             RIL_onUnsolicitedResponse(RIL_UNSOL_DATA_CALL_LIST_CHANGED,
                                       NULL, 0);
+        at_response_free(p_response);
         return;
     }
 
@@ -496,9 +860,10 @@ static void requestOrSendDataCallList(RIL_Token *t)
     if (err != 0 || p_response->success == 0) {
         if (t != NULL)
             RIL_onRequestComplete(*t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        else
+        else if (updateDataCallList(NULL, 0))
             RIL_onUnsolicitedResponse(RIL_UNSOL_DATA_CALL_LIST_CHANGED,
                                       NULL, 0);
+        at_response_free(p_response);
         return;
     }
 
@@ -601,6 +966,11 @@ static void requestOrSendDataCallList(RIL_Token *t)
 
     at_response_free(p_response);
 
+    if (!updateDataCallList(responses, n) && t == NULL) {
+        RLOGD("data call list unchanged");
+        return;
+    }
+
     if (t != NULL)
         RIL_onRequestComplete(*t, RIL_E_SUCCESS, responses,
                               n * sizeof(RIL_Data_Call_Response_v11));
@@ -614,7 +984,7 @@ static void requestOrSendDataCallList(RIL_Token *t)
 error:
     if (t != NULL)
         RIL_onRequestComplete(*t, RIL_E_GENERIC_FAILURE, NULL, 0);
-    else
+    else if (updateDataCallList(NULL, 0))
         RIL_onUnsolicitedResponse(RIL_UNSOL_DATA_CALL_LIST_CHANGED,
                                   NULL, 0);
 
@@ -627,7 +997,6 @@ static void requestQueryNetworkSelectionMode(
     int err;
     ATResponse *p_response = NULL;
     int response = 0;
-    char *line;
 
     err = at_send_command_singleline("AT+COPS?", "+COPS:", &p_response);
 
@@ -635,17 +1004,8 @@ static void requestQueryNetworkSelectionMode(
         goto error;
     }
 
-    line = p_response->p_intermediates->line;
-
-    err = at_tok_start(&line);
-
-    if (err < 0) {
-        goto error;
-    }
-
-    err = at_tok_nextint(&line, &response);
-
-    if (err < 0) {
+    if (at_tok_scan(p_response->p_intermediates->line,
+                    "+COPS: %d", &response) != 1) {
         goto error;
     }
 
@@ -658,6 +1018,28 @@ error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 }
 
+/*** Call list polling ***/
+
+/*
+ * While calls are setting up, the call list is repolled here instead of
+ * by making the framework ask for it: RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED
+ * is only sent when AT+CLCC differs from the list the framework last got.
+ * The repoll interval starts short after each change and backs off, with
+ * bounds that depend on the least settled call.
+ */
+
+#define CALL_LIST_SIGNATURE_LEN 512
+#define MAX_POLLED_CALLS 8
+
+static pthread_mutex_t s_callListMutex = PTHREAD_MUTEX_INITIALIZER;
+static char s_lastCallList[CALL_LIST_SIGNATURE_LEN];
+static int s_lastCallListValid = 0;
+/* a new chain of polls supersedes the previous one */
+static intptr_t s_callPollGeneration = 0;
+static int s_callPollDelayMsec = 0;
+static unsigned int s_callPollCount = 0;
+static unsigned int s_callPollChanges = 0;
+
 static void sendCallStateChanged(void *param __unused)
 {
     RIL_onUnsolicitedResponse (
@@ -665,102 +1047,324 @@ static void sendCallStateChanged(void *param __unused)
         NULL, 0);
 }
 
-static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused, RIL_Token t)
+/**
+ * Records the list as the one the framework last saw
+ * returns 1 if it differs from the previous one
+ */
+static int updateCallList(const RIL_Call *calls, int n)
 {
-    int err;
-    ATResponse *p_response;
-    ATLine *p_cur;
-    int countCalls;
-    int countValidCalls;
-    RIL_Call *p_calls;
-    RIL_Call **pp_calls;
+    char signature[CALL_LIST_SIGNATURE_LEN];
+    size_t len = 0;
+    int changed;
     int i;
-    int needRepoll = 0;
-
-#ifdef WORKAROUND_ERRONEOUS_ANSWER
-    int prevIncomingOrWaitingLine;
 
-    prevIncomingOrWaitingLine = s_incomingOrWaitingLine;
-    s_incomingOrWaitingLine = -1;
-#endif /*WORKAROUND_ERRONEOUS_ANSWER*/
+    signature[0] = '\0';
 
-    err = at_send_command_multiline ("AT+CLCC", "+CLCC:", &p_response);
+    for (i = 0; i < n && len < sizeof(signature); i++) {
+        const RIL_Call *c = &calls[i];
 
-    if (err != 0 || p_response->success == 0) {
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        return;
+        len += snprintf(signature + len, sizeof(signature) - len,
+                "%d,%d,%d,%d,%d,%d,%s,%d;", c->index, c->state, c->isMT,
+                c->isMpty, c->isVoice, c->toa,
+                c->number != NULL ? c->number : "", c->numberPresentation);
     }
 
-    /* count the calls */
-    for (countCalls = 0, p_cur = p_response->p_intermediates
-            ; p_cur != NULL
-            ; p_cur = p_cur->p_next
-    ) {
-        countCalls++;
+    pthread_mutex_lock(&s_callListMutex);
+
+    if (len >= sizeof(signature)) {
+        /* too long to compare; always report it */
+        s_lastCallListValid = 0;
+        pthread_mutex_unlock(&s_callListMutex);
+        return 1;
     }
 
-    /* yes, there's an array of pointers and then an array of structures */
+    changed = !s_lastCallListValid
+            || strcmp(signature, s_lastCallList) != 0;
 
-    pp_calls = (RIL_Call **)alloca(countCalls * sizeof(RIL_Call *));
-    p_calls = (RIL_Call *)alloca(countCalls * sizeof(RIL_Call));
-    memset (p_calls, 0, countCalls * sizeof(RIL_Call));
+    strcpy(s_lastCallList, signature);
+    s_lastCallListValid = 1;
 
-    /* init the pointer array */
-    for(i = 0; i < countCalls ; i++) {
-        pp_calls[i] = &(p_calls[i]);
-    }
+    pthread_mutex_unlock(&s_callListMutex);
 
-    for (countValidCalls = 0, p_cur = p_response->p_intermediates
-            ; p_cur != NULL
-            ; p_cur = p_cur->p_next
-    ) {
-        err = callFromCLCCLine(p_cur->line, p_calls + countValidCalls);
+    return changed;
+}
 
-        if (err != 0) {
-            continue;
-        }
+/**
+ * Gets the repoll interval bounds for a call list
+ * returns 0 if the list doesn't need repolling
+ */
+static int callPollBounds(const RIL_Call *calls, int n, int *p_minMsec,
+        int *p_maxMsec)
+{
+    int i;
+    int ret = 0;
 
-#ifdef WORKAROUND_ERRONEOUS_ANSWER
-        if (p_calls[countValidCalls].state == RIL_CALL_INCOMING
-            || p_calls[countValidCalls].state == RIL_CALL_WAITING
-        ) {
-            s_incomingOrWaitingLine = p_calls[countValidCalls].index;
-        }
-#endif /*WORKAROUND_ERRONEOUS_ANSWER*/
+    *p_minMsec = INT_MAX;
+    *p_maxMsec = INT_MAX;
 
-        if (p_calls[countValidCalls].state != RIL_CALL_ACTIVE
-            && p_calls[countValidCalls].state != RIL_CALL_HOLDING
-        ) {
-            needRepoll = 1;
+    for (i = 0; i < n; i++) {
+        int minMsec, maxMsec;
+
+        switch (calls[i].state) {
+            case RIL_CALL_DIALING:
+                /* the network answers within a second or two */
+                minMsec = 200; maxMsec = 1000;
+                break;
+            case RIL_CALL_ALERTING:
+            case RIL_CALL_INCOMING:
+            case RIL_CALL_WAITING:
+                /* waiting on a person */
+                minMsec = 500; maxMsec = 2000;
+                break;
+            default:
+#ifdef POLL_CALL_STATE
+                /* we may not get NO CARRIER, so poll until the call ends */
+                minMsec = 1000; maxMsec = 4000;
+                break;
+#else
+                continue;
+#endif
         }
 
-        countValidCalls++;
+        if (minMsec < *p_minMsec) *p_minMsec = minMsec;
+        if (maxMsec < *p_maxMsec) *p_maxMsec = maxMsec;
+        ret = 1;
     }
 
-#ifdef WORKAROUND_ERRONEOUS_ANSWER
-    // Basically:
-    // A call was incoming or waiting
-    // Now it's marked as active
-    // But we never answered it
-    //
-    // This is probably a bug, and the call will probably
-    // disappear from the call list in the next poll
-    if (prevIncomingOrWaitingLine >= 0
-            && s_incomingOrWaitingLine < 0
-            && s_expectAnswer == 0
-    ) {
-        for (i = 0; i < countValidCalls ; i++) {
+    return ret;
+}
 
-            if (p_calls[i].index == prevIncomingOrWaitingLine
-                    && p_calls[i].state == RIL_CALL_ACTIVE
-                    && s_repollCallsCount < REPOLL_CALLS_COUNT_MAX
-            ) {
-                RLOGI(
-                    "Hit WORKAROUND_ERRONOUS_ANSWER case."
-                    " Repoll count: %d\n", s_repollCallsCount);
-                s_repollCallsCount++;
-                goto error;
-            }
+static void pollCallState(void *param);
+
+/**
+ * Schedules the next repoll of a chain, or starts a new chain if
+ * restart is set. Calls that have just changed are polled at the short
+ * end of their interval
+ */
+static void scheduleCallStatePoll(const RIL_Call *calls, int n, int restart,
+        int changed)
+{
+    struct timeval tv;
+    int minMsec, maxMsec;
+    int delayMsec;
+    intptr_t generation;
+
+    if (!callPollBounds(calls, n, &minMsec, &maxMsec)) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_callListMutex);
+
+    if (restart) {
+        s_callPollGeneration++;
+    }
+
+    if (restart || changed || s_callPollDelayMsec < minMsec) {
+        s_callPollDelayMsec = minMsec;
+    } else {
+        s_callPollDelayMsec *= 2;
+    }
+
+    if (s_callPollDelayMsec > maxMsec) {
+        s_callPollDelayMsec = maxMsec;
+    }
+
+    delayMsec = s_callPollDelayMsec;
+    generation = s_callPollGeneration;
+
+    pthread_mutex_unlock(&s_callListMutex);
+
+    tv.tv_sec = delayMsec / 1000;
+    tv.tv_usec = (delayMsec % 1000) * 1000;
+
+    requestWorkerCallback(REQUEST_CLASS_CALL, pollCallState, (void *) generation,
+            &tv);
+}
+
+/**
+ * Reads AT+CLCC into calls, which point into *pp_response
+ * returns the number of calls, or -1 on error
+ */
+static int queryCallList(ATResponse **pp_response, RIL_Call *calls, int max)
+{
+    ATLine *p_cur;
+    int err;
+    int n = 0;
+
+    err = at_send_command_multiline ("AT+CLCC", "+CLCC:", pp_response);
+
+    if (err != 0 || (*pp_response)->success == 0) {
+        return -1;
+    }
+
+    for (p_cur = (*pp_response)->p_intermediates
+            ; p_cur != NULL && n < max
+            ; p_cur = p_cur->p_next
+    ) {
+        memset(&calls[n], 0, sizeof(RIL_Call));
+
+        if (callFromCLCCLine(p_cur->line, &calls[n]) == 0) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/** repolls the call list; param is the generation of the chain */
+static void pollCallState(void *param)
+{
+    ATResponse *p_response = NULL;
+    RIL_Call calls[MAX_POLLED_CALLS];
+    int n;
+    int changed;
+
+    pthread_mutex_lock(&s_callListMutex);
+
+    if ((intptr_t) param != s_callPollGeneration) {
+        /* superseded */
+        pthread_mutex_unlock(&s_callListMutex);
+        return;
+    }
+
+    s_callPollCount++;
+
+    pthread_mutex_unlock(&s_callListMutex);
+
+    n = queryCallList(&p_response, calls, MAX_POLLED_CALLS);
+
+    if (n < 0) {
+        /* let the framework find out */
+        at_response_free(p_response);
+        sendCallStateChanged(NULL);
+        return;
+    }
+
+    changed = updateCallList(calls, n);
+
+    if (changed) {
+        pthread_mutex_lock(&s_callListMutex);
+        s_callPollChanges++;
+        RLOGD("call list changed; %u of %u polls reported",
+                s_callPollChanges, s_callPollCount);
+        pthread_mutex_unlock(&s_callListMutex);
+
+        /* the framework's GET_CURRENT_CALLS starts the next chain */
+        sendCallStateChanged(NULL);
+    } else {
+        scheduleCallStatePoll(calls, n, 0, 0);
+    }
+
+    at_response_free(p_response);
+}
+
+/**
+ * Checks the call list for a change on the call worker; for modem
+ * indications that repeat while nothing changes, like RING
+ */
+static void kickCallStatePoll()
+{
+    intptr_t generation;
+
+    pthread_mutex_lock(&s_callListMutex);
+    generation = ++s_callPollGeneration;
+    s_callPollDelayMsec = 0;
+    pthread_mutex_unlock(&s_callListMutex);
+
+    requestWorkerCallback(REQUEST_CLASS_CALL, pollCallState, (void *) generation,
+            NULL);
+}
+
+static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused, RIL_Token t)
+{
+    int err;
+    ATResponse *p_response;
+    ATLine *p_cur;
+    int countCalls;
+    int countValidCalls;
+    RIL_Call *p_calls;
+    RIL_Call **pp_calls;
+    int i;
+    int changed;
+
+#ifdef WORKAROUND_ERRONEOUS_ANSWER
+    int prevIncomingOrWaitingLine;
+
+    prevIncomingOrWaitingLine = s_incomingOrWaitingLine;
+    s_incomingOrWaitingLine = -1;
+#endif /*WORKAROUND_ERRONEOUS_ANSWER*/
+
+    err = at_send_command_multiline ("AT+CLCC", "+CLCC:", &p_response);
+
+    if (err != 0 || p_response->success == 0) {
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
+
+    /* count the calls */
+    for (countCalls = 0, p_cur = p_response->p_intermediates
+            ; p_cur != NULL
+            ; p_cur = p_cur->p_next
+    ) {
+        countCalls++;
+    }
+
+    /* yes, there's an array of pointers and then an array of structures */
+
+    pp_calls = (RIL_Call **)alloca(countCalls * sizeof(RIL_Call *));
+    p_calls = (RIL_Call *)alloca(countCalls * sizeof(RIL_Call));
+    memset (p_calls, 0, countCalls * sizeof(RIL_Call));
+
+    /* init the pointer array */
+    for(i = 0; i < countCalls ; i++) {
+        pp_calls[i] = &(p_calls[i]);
+    }
+
+    for (countValidCalls = 0, p_cur = p_response->p_intermediates
+            ; p_cur != NULL
+            ; p_cur = p_cur->p_next
+    ) {
+        err = callFromCLCCLine(p_cur->line, p_calls + countValidCalls);
+
+        if (err != 0) {
+            continue;
+        }
+
+#ifdef WORKAROUND_ERRONEOUS_ANSWER
+        if (p_calls[countValidCalls].state == RIL_CALL_INCOMING
+            || p_calls[countValidCalls].state == RIL_CALL_WAITING
+        ) {
+            s_incomingOrWaitingLine = p_calls[countValidCalls].index;
+        }
+#endif /*WORKAROUND_ERRONEOUS_ANSWER*/
+
+        countValidCalls++;
+    }
+
+#ifdef WORKAROUND_ERRONEOUS_ANSWER
+    // Basically:
+    // A call was incoming or waiting
+    // Now it's marked as active
+    // But we never answered it
+    //
+    // This is probably a bug, and the call will probably
+    // disappear from the call list in the next poll
+    if (prevIncomingOrWaitingLine >= 0
+            && s_incomingOrWaitingLine < 0
+            && s_expectAnswer == 0
+    ) {
+        for (i = 0; i < countValidCalls ; i++) {
+
+            if (p_calls[i].index == prevIncomingOrWaitingLine
+                    && p_calls[i].state == RIL_CALL_ACTIVE
+                    && s_repollCallsCount < REPOLL_CALLS_COUNT_MAX
+            ) {
+                RLOGI(
+                    "Hit WORKAROUND_ERRONOUS_ANSWER case."
+                    " Repoll count: %d\n", s_repollCallsCount);
+                s_repollCallsCount++;
+                goto error;
+            }
         }
     }
 
@@ -768,19 +1372,17 @@ static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused,
     s_repollCallsCount = 0;
 #endif /*WORKAROUND_ERRONEOUS_ANSWER*/
 
+    changed = updateCallList(p_calls, countValidCalls);
+
     RIL_onRequestComplete(t, RIL_E_SUCCESS, pp_calls,
             countValidCalls * sizeof (RIL_Call *));
 
-    at_response_free(p_response);
+    /* POLL_CALL_STATE also repolls active calls; we don't seem to get a
+       "NO CARRIER" message from smd, so we're forced to poll until the
+       call ends */
+    scheduleCallStatePoll(p_calls, countValidCalls, 1, changed);
 
-#ifdef POLL_CALL_STATE
-    if (countValidCalls) {  // We don't seem to get a "NO CARRIER" message from
-                            // smd, so we're forced to poll until the call ends.
-#else
-    if (needRepoll) {
-#endif
-        RIL_requestTimedCallback (sendCallStateChanged, NULL, &TIMEVAL_CALLSTATEPOLL);
-    }
+    at_response_free(p_response);
 
     return;
 error:
@@ -830,6 +1432,9 @@ static void requestWriteSmsToSim(void *data, size_t datalen __unused, RIL_Token
 
     err = at_send_command_sms(cmd, p_args->pdu, "+CMGW:", &p_response);
 
+    /* even a failed write may have changed the record */
+    simFileCacheInvalidateFile(EF_SMS);
+
     if (err != 0 || p_response->success == 0) goto error;
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
@@ -871,15 +1476,21 @@ static void requestSignalStrength(void *data __unused, size_t datalen __unused,
     int count =0;
     int numofElements=sizeof(RIL_SignalStrength_v6)/sizeof(int);
     int response[numofElements];
+    char cached[STATE_CACHE_MAX_LINES][STATE_CACHE_LINE_LEN];
 
-    err = at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response);
+    if (stateCacheGet(STATE_CACHE_CSQ, cached) > 0) {
+        line = cached[0];
+    } else {
+        err = at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response);
 
-    if (err < 0 || p_response->success == 0) {
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        goto error;
-    }
+        if (err < 0 || p_response->success == 0) {
+            RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+            goto error;
+        }
 
-    line = p_response->p_intermediates->line;
+        stateCachePutResponse(STATE_CACHE_CSQ, p_response);
+        line = p_response->p_intermediates->line;
+    }
 
     err = at_tok_start(&line);
     if (err < 0) goto error;
@@ -1246,7 +1857,8 @@ static int parseRegistrationState(char *str, int *type, int *items, int **respon
         if (*p == ',') commas++;
     }
 
-    resp = (int *)calloc(commas + 1, sizeof(int));
+    /* callers read <stat>, <lac>, <cid> and <networkType> */
+    resp = (int *)calloc(commas + 1 < 4 ? 4 : commas + 1, sizeof(int));
     if (!resp) goto error;
     switch (commas) {
         case 0: /* +CREG: <stat> */
@@ -1303,8 +1915,6 @@ static int parseRegistrationState(char *str, int *type, int *items, int **respon
         default:
             goto error;
     }
-    s_lac = resp[1];
-    s_cid = resp[2];
     if (response)
         *response = resp;
     if (items)
@@ -1332,26 +1942,35 @@ static void requestRegistrationState(int request, void *data __unused,
     int i = 0, j, numElements = 0;
     int count = 3;
     int type, startfrom;
+    StateCacheId cacheId;
+    char cached[STATE_CACHE_MAX_LINES][STATE_CACHE_LINE_LEN];
 
     RLOGD("requestRegistrationState");
     if (request == RIL_REQUEST_VOICE_REGISTRATION_STATE) {
         cmd = "AT+CREG?";
         prefix = "+CREG:";
         numElements = REG_STATE_LEN;
+        cacheId = STATE_CACHE_CREG;
     } else if (request == RIL_REQUEST_DATA_REGISTRATION_STATE) {
         cmd = "AT+CGREG?";
         prefix = "+CGREG:";
         numElements = REG_DATA_STATE_LEN;
+        cacheId = STATE_CACHE_CGREG;
     } else {
         assert(0);
         goto error;
     }
 
-    err = at_send_command_singleline(cmd, prefix, &p_response);
+    if (stateCacheGet(cacheId, cached) > 0) {
+        line = cached[0];
+    } else {
+        err = at_send_command_singleline(cmd, prefix, &p_response);
 
-    if (err != 0) goto error;
+        if (err != 0) goto error;
 
-    line = p_response->p_intermediates->line;
+        stateCachePutResponse(cacheId, p_response);
+        line = p_response->p_intermediates->line;
+    }
 
     if (parseRegistrationState(line, &type, &count, &registration)) goto error;
 
@@ -1438,16 +2057,40 @@ static void requestOperator(void *data __unused, size_t datalen __unused, RIL_To
     int err;
     int i;
     int skip;
+    int count;
     ATLine *p_cur;
     char *response[3];
+    char *lines[STATE_CACHE_MAX_LINES];
+    char cached[STATE_CACHE_MAX_LINES][STATE_CACHE_LINE_LEN];
 
     memset(response, 0, sizeof(response));
 
     ATResponse *p_response = NULL;
 
-    err = at_send_command_multiline(
-        "AT+COPS=3,0;+COPS?;+COPS=3,1;+COPS?;+COPS=3,2;+COPS?",
-        "+COPS:", &p_response);
+    count = stateCacheGet(STATE_CACHE_COPS, cached);
+
+    if (count > 0) {
+        for (i = 0 ; i < count ; i++) {
+            lines[i] = cached[i];
+        }
+    } else {
+        err = at_send_command_multiline(
+            "AT+COPS=3,0;+COPS?;+COPS=3,1;+COPS?;+COPS=3,2;+COPS?",
+            "+COPS:", &p_response);
+
+        if (err != 0) goto error;
+
+        for (p_cur = p_response->p_intermediates
+                ; p_cur != NULL && count < STATE_CACHE_MAX_LINES
+                ; p_cur = p_cur->p_next
+        ) {
+            lines[count++] = p_cur->line;
+        }
+
+        if (count == 3) {
+            stateCachePutResponse(STATE_CACHE_COPS, p_response);
+        }
+    }
 
     /* we expect 3 lines here:
      * +COPS: 0,0,"T - Mobile"
@@ -1455,13 +2098,8 @@ static void requestOperator(void *data __unused, size_t datalen __unused, RIL_To
      * +COPS: 0,2,"310170"
      */
 
-    if (err != 0) goto error;
-
-    for (i = 0, p_cur = p_response->p_intermediates
-            ; p_cur != NULL
-            ; p_cur = p_cur->p_next, i++
-    ) {
-        char *line = p_cur->line;
+    for (i = 0 ; i < count ; i++) {
+        char *line = lines[i];
 
         err = at_tok_start(&line);
         if (err < 0) goto error;
@@ -1489,8 +2127,15 @@ static void requestOperator(void *data __unused, size_t datalen __unused, RIL_To
         if (err < 0) goto error;
         // Simple assumption that mcc and mnc are 3 digits each
         if (strlen(response[i]) == 6) {
-            if (sscanf(response[i], "%3d%3d", &s_mcc, &s_mnc) != 2) {
+            int mcc, mnc;
+
+            if (sscanf(response[i], "%3d%3d", &mcc, &mnc) != 2) {
                 RLOGE("requestOperator expected mccmnc to be 6 decimal digits");
+            } else {
+                pthread_mutex_lock(&s_cellInfoMutex);
+                s_mcc = mcc;
+                s_mnc = mnc;
+                pthread_mutex_unlock(&s_cellInfoMutex);
             }
         }
     }
@@ -1544,15 +2189,32 @@ error:
     RIL_onRequestComplete(t, RIL_E_SMS_SEND_FAIL_RETRY, &response, sizeof(response));
 }
 
-static void requestSendSMS(void *data, size_t datalen, RIL_Token t)
+/*
+ * AT+CMMS=1 keeps the relay protocol link to the SMSC up for a few seconds
+ * after each message, so the parts of a concatenated message, or a burst,
+ * don't each set it up again. The modem drops back to 0 by itself once
+ * sends stop, so it is re-sent for a burst after SMS_LINK_HOLD_MS; that
+ * is below the shortest timer 27.005 allows.
+ *
+ * Only used from the messaging worker, or from a barrier while it is idle.
+ */
+#define SMS_LINK_HOLD_MS 1000
+
+static int s_smsLinkHeld = 0;
+static long long s_lastSmsSendMsec = 0;
+
+static void requestSendSMS(void *data, size_t datalen, RIL_Token t,
+        int expectMore)
 {
     int err;
     const char *smsc;
     const char *pdu;
     int tpLayerLength;
-    char *cmd1, *cmd2;
+    char *cmd1 = NULL, *cmd2 = NULL;
+    char *line;
     RIL_SMS_Response response;
     ATResponse *p_response = NULL;
+    long long startMsec = nowMsec();
 
     memset(&response, 0, sizeof(response));
     RLOGD("requestSendSMS datalen =%zu", datalen);
@@ -1570,6 +2232,12 @@ static void requestSendSMS(void *data, size_t datalen, RIL_Token t)
         smsc= "00";
     }
 
+    if (expectMore && !(s_smsLinkHeld
+            && startMsec - s_lastSmsSendMsec <= SMS_LINK_HOLD_MS)) {
+        /* on failure we only lose the saving */
+        s_smsLinkHeld = at_send_command("AT+CMMS=1", NULL) == 0;
+    }
+
     asprintf(&cmd1, "AT+CMGS=%d", tpLayerLength);
     asprintf(&cmd2, "%s%s", smsc, pdu);
 
@@ -1577,16 +2245,34 @@ static void requestSendSMS(void *data, size_t datalen, RIL_Token t)
 
     if (err != 0 || p_response->success == 0) goto error;
 
-    /* FIXME fill in messageRef and ackPDU */
-    response.messageRef = 1;
+    s_lastSmsSendMsec = nowMsec();
+
+    /* +CMGS: <mr>[,<ackpdu>] */
+    line = p_response->p_intermediates != NULL
+            ? p_response->p_intermediates->line : NULL;
+
+    if (line == NULL || at_tok_start(&line) < 0
+            || at_tok_nextint(&line, &response.messageRef) < 0) {
+        response.messageRef = 1;
+    } else if (at_tok_hasmore(&line)) {
+        at_tok_nextstr(&line, &response.ackPDU);
+    }
+
+    RLOGD("SMS %d sent in %lld ms%s", response.messageRef,
+            s_lastSmsSendMsec - startMsec, expectMore ? ", more to come" : "");
+
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(response));
     at_response_free(p_response);
+    free(cmd1);
+    free(cmd2);
 
     return;
 error:
     response.messageRef = -2;
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, &response, sizeof(response));
     at_response_free(p_response);
+    free(cmd1);
+    free(cmd2);
     return;
 error2:
     // send retry error.
@@ -1622,7 +2308,7 @@ static void requestImsSendSMS(void *data, size_t datalen, RIL_Token t)
     if (RADIO_TECH_3GPP == p_args->tech) {
         return requestSendSMS(p_args->message.gsmMessage,
                 datalen - sizeof(RIL_RadioTechnologyFamily),
-                t);
+                t, 0);
     } else if (RADIO_TECH_3GPP2 == p_args->tech) {
         return requestCdmaSendSMS(p_args->message.cdmaMessage,
                 datalen - sizeof(RIL_RadioTechnologyFamily),
@@ -1791,52 +2477,407 @@ error:
 
 }
 
-static void  requestSIM_IO(void *data, size_t datalen __unused, RIL_Token t)
-{
-    ATResponse *p_response = NULL;
-    RIL_SIM_IO_Response sr;
-    int err;
-    char *cmd = NULL;
-    RIL_SIM_IO_v6 *p_args;
-    char *line;
+/*** SIM file cache ***/
 
-    memset(&sr, 0, sizeof(sr));
+/*
+ * Successful reads through RIL_REQUEST_SIM_IO are cached, keyed by
+ * (command, fileid, path, p1, p2, p3), so that the framework's record by
+ * record reads of EF_ADN, EF_SMS and friends mostly don't reach the modem.
+ * A READ RECORD miss also reads the following records ahead, in one joined
+ * AT+CRSM command. Entries are dropped when the file is updated through
+ * SIM_IO and whenever the SIM's content may have changed under us.
+ */
 
-    p_args = (RIL_SIM_IO_v6 *)data;
+#define SIM_COMMAND_READ_BINARY 176
+#define SIM_COMMAND_READ_RECORD 178
+#define SIM_COMMAND_GET_RESPONSE 192
+#define SIM_COMMAND_UPDATE_BINARY 214
+#define SIM_COMMAND_UPDATE_RECORD 220
 
-    /* FIXME handle pin2 */
+#define SIM_RECORD_MODE_ABSOLUTE 4
 
-    if (p_args->data == NULL) {
-        asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d",
-                    p_args->command, p_args->fileid,
-                    p_args->p1, p_args->p2, p_args->p3);
-    } else {
-        asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d,%s",
-                    p_args->command, p_args->fileid,
-                    p_args->p1, p_args->p2, p_args->p3, p_args->data);
-    }
+#define SIM_FILE_CACHE_SIZE 512     /* a power of two */
+#define SIM_FILE_CACHE_PATH_LEN 32
+#define SIM_FILE_CACHE_STATS_INTERVAL 100
+#define SIM_READ_AHEAD_RECORDS 8
 
-    err = at_send_command_singleline(cmd, "+CRSM:", &p_response);
+typedef enum {
+    SIM_FILE_CACHE_EMPTY = 0,
+    SIM_FILE_CACHE_VALID,
+    SIM_FILE_CACHE_DELETED      /* keeps probe chains intact */
+} SimFileCacheState;
 
-    if (err < 0 || p_response->success == 0) {
-        goto error;
+typedef struct {
+    SimFileCacheState state;
+    int command;
+    int fileid;
+    int p1, p2, p3;
+    char path[SIM_FILE_CACHE_PATH_LEN];
+    int sw1, sw2;
+    char *simResponse;
+} SimFileCacheEntry;
+
+static pthread_mutex_t s_simFileCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static SimFileCacheEntry s_simFileCache[SIM_FILE_CACHE_SIZE];
+static int s_simFileCacheUsed = 0;     /* valid and deleted slots */
+static unsigned int s_simFileCacheHits = 0;
+static unsigned int s_simFileCacheMisses = 0;
+
+/* cleared if the modem rejects joined AT+CRSM commands */
+static int s_simReadAheadSupported = 1;
+
+/** returns non-zero if the result of this SIM_IO may be cached */
+static int isSimFileCacheable(const RIL_SIM_IO_v6 *p_args)
+{
+    if (p_args->data != NULL || p_args->pin2 != NULL
+            || (p_args->path != NULL
+                && strlen(p_args->path) >= SIM_FILE_CACHE_PATH_LEN)) {
+        return 0;
     }
 
-    line = p_response->p_intermediates->line;
+    switch (p_args->command) {
+        case SIM_COMMAND_READ_BINARY:
+        case SIM_COMMAND_GET_RESPONSE:
+            return 1;
+        case SIM_COMMAND_READ_RECORD:
+            /* next and previous record modes depend on the record pointer */
+            return p_args->p2 == SIM_RECORD_MODE_ABSOLUTE;
+        default:
+            return 0;
+    }
+}
 
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
+/**
+ * Returns the slot for the key, or the slot it would be put in.
+ * Assumes s_simFileCacheMutex is held
+ */
+static SimFileCacheEntry *simFileCacheFind(int command, int fileid,
+        const char *path, int p1, int p2, int p3)
+{
+    unsigned int hash;
+    unsigned int i;
+    SimFileCacheEntry *p_free = NULL;
 
-    err = at_tok_nextint(&line, &(sr.sw1));
-    if (err < 0) goto error;
+    if (path == NULL) {
+        path = "";
+    }
 
-    err = at_tok_nextint(&line, &(sr.sw2));
-    if (err < 0) goto error;
+    hash = ((((unsigned) fileid * 31 + command) * 31 + p1) * 31 + p2) * 31 + p3;
 
-    if (at_tok_hasmore(&line)) {
-        err = at_tok_nextstr(&line, &(sr.simResponse));
-        if (err < 0) goto error;
-    }
+    for (i = 0 ; i < SIM_FILE_CACHE_SIZE ; i++) {
+        SimFileCacheEntry *e = &s_simFileCache[(hash + i) & (SIM_FILE_CACHE_SIZE - 1)];
+
+        if (e->state == SIM_FILE_CACHE_EMPTY) {
+            return p_free != NULL ? p_free : e;
+        }
+
+        if (e->state == SIM_FILE_CACHE_DELETED) {
+            if (p_free == NULL) p_free = e;
+            continue;
+        }
+
+        if (e->command == command && e->fileid == fileid && e->p1 == p1
+                && e->p2 == p2 && e->p3 == p3 && 0 == strcmp(e->path, path)) {
+            return e;
+        }
+    }
+
+    return p_free;
+}
+
+/** assumes s_simFileCacheMutex is held */
+static void simFileCacheClearLocked()
+{
+    int i;
+
+    for (i = 0 ; i < SIM_FILE_CACHE_SIZE ; i++) {
+        free(s_simFileCache[i].simResponse);
+    }
+
+    memset(s_simFileCache, 0, sizeof(s_simFileCache));
+    s_simFileCacheUsed = 0;
+}
+
+/**
+ * Fills in p_sr from the cache; p_sr->simResponse is the caller's to free
+ * returns 0 on a hit, -1 on a miss
+ */
+static int simFileCacheGet(const RIL_SIM_IO_v6 *p_args, RIL_SIM_IO_Response *p_sr)
+{
+    SimFileCacheEntry *e;
+    int ret = -1;
+
+    if (!isSimFileCacheable(p_args)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_simFileCacheMutex);
+
+    e = simFileCacheFind(p_args->command, p_args->fileid, p_args->path,
+            p_args->p1, p_args->p2, p_args->p3);
+
+    if (e != NULL && e->state == SIM_FILE_CACHE_VALID) {
+        p_sr->sw1 = e->sw1;
+        p_sr->sw2 = e->sw2;
+        p_sr->simResponse = e->simResponse != NULL ? strdup(e->simResponse) : NULL;
+        s_simFileCacheHits++;
+        ret = 0;
+    } else {
+        s_simFileCacheMisses++;
+    }
+
+    if ((s_simFileCacheHits + s_simFileCacheMisses)
+            % SIM_FILE_CACHE_STATS_INTERVAL == 0) {
+        RLOGD("SIM file cache: %u hits, %u misses",
+                s_simFileCacheHits, s_simFileCacheMisses);
+    }
+
+    pthread_mutex_unlock(&s_simFileCacheMutex);
+
+    return ret;
+}
+
+/** caches a successful result for the given key */
+static void simFileCachePut(const RIL_SIM_IO_v6 *p_args, int p1,
+        const RIL_SIM_IO_Response *p_sr)
+{
+    SimFileCacheEntry *e;
+
+    /* 0x90 normal ending, 0x91 normal ending with extra information */
+    if (p_sr->sw1 != 0x90 && p_sr->sw1 != 0x91) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_simFileCacheMutex);
+
+    if (s_simFileCacheUsed >= SIM_FILE_CACHE_SIZE * 3 / 4) {
+        RLOGD("SIM file cache full; clearing");
+        simFileCacheClearLocked();
+    }
+
+    e = simFileCacheFind(p_args->command, p_args->fileid, p_args->path,
+            p1, p_args->p2, p_args->p3);
+
+    if (e != NULL) {
+        if (e->state == SIM_FILE_CACHE_EMPTY) {
+            s_simFileCacheUsed++;
+        }
+
+        free(e->simResponse);
+
+        e->state = SIM_FILE_CACHE_VALID;
+        e->command = p_args->command;
+        e->fileid = p_args->fileid;
+        e->p1 = p1;
+        e->p2 = p_args->p2;
+        e->p3 = p_args->p3;
+        strlcpy(e->path, p_args->path != NULL ? p_args->path : "", sizeof(e->path));
+        e->sw1 = p_sr->sw1;
+        e->sw2 = p_sr->sw2;
+        e->simResponse = p_sr->simResponse != NULL ? strdup(p_sr->simResponse) : NULL;
+    }
+
+    pthread_mutex_unlock(&s_simFileCacheMutex);
+}
+
+/** drops everything cached for fileid */
+static void simFileCacheInvalidateFile(int fileid)
+{
+    int i;
+
+    pthread_mutex_lock(&s_simFileCacheMutex);
+
+    for (i = 0 ; i < SIM_FILE_CACHE_SIZE ; i++) {
+        SimFileCacheEntry *e = &s_simFileCache[i];
+
+        if (e->state == SIM_FILE_CACHE_VALID && e->fileid == fileid) {
+            free(e->simResponse);
+            e->simResponse = NULL;
+            e->state = SIM_FILE_CACHE_DELETED;
+        }
+    }
+
+    pthread_mutex_unlock(&s_simFileCacheMutex);
+}
+
+/** for a SIM refresh, removal or reset */
+static void simFileCacheInvalidateAll()
+{
+    pthread_mutex_lock(&s_simFileCacheMutex);
+    simFileCacheClearLocked();
+    pthread_mutex_unlock(&s_simFileCacheMutex);
+}
+
+/**
+ * Parses "+CRSM: <sw1>,<sw2>[,<response>]" into p_sr; simResponse points
+ * into line
+ * returns 0 on success, -1 on error
+ */
+static int parseSimIOResponse(char *line, RIL_SIM_IO_Response *p_sr)
+{
+    memset(p_sr, 0, sizeof(*p_sr));
+
+    if (at_tok_start(&line) < 0
+            || at_tok_nextint(&line, &p_sr->sw1) < 0
+            || at_tok_nextint(&line, &p_sr->sw2) < 0) {
+        return -1;
+    }
+
+    if (at_tok_hasmore(&line) && at_tok_nextstr(&line, &p_sr->simResponse) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the requested record and up to SIM_READ_AHEAD_RECORDS - 1
+ * following ones in a single joined AT+CRSM command, and caches them.
+ * Fills in p_sr for the requested record; p_sr->simResponse is the
+ * caller's to free
+ * Sets *p_rejected if the joined command got a plain ERROR, which is only
+ * the modem rejecting joined commands if the record reads on its own
+ * returns 0 on success, -1 if the record has to be read on its own
+ */
+static int readSimRecordsAhead(const RIL_SIM_IO_v6 *p_args, RIL_SIM_IO_Response *p_sr,
+        int *p_rejected)
+{
+    char cmd[SIM_READ_AHEAD_RECORDS * 32];
+    ATResponse *p_response = NULL;
+    ATLine *p_cur;
+    int count;
+    int len;
+    int i;
+    int err;
+    int ret = -1;
+
+    *p_rejected = 0;
+
+    if (!s_simReadAheadSupported) {
+        return -1;
+    }
+
+    /* records are 1 to 255 and at most 255 bytes; anything else goes as is */
+    if (p_args->p1 < 1 || p_args->p1 > 254
+            || p_args->fileid < 0 || p_args->fileid > 0xFFFF
+            || p_args->p3 < 0 || p_args->p3 > 255) {
+        return -1;
+    }
+
+    count = 255 - p_args->p1 + 1;
+
+    if (count > SIM_READ_AHEAD_RECORDS) {
+        count = SIM_READ_AHEAD_RECORDS;
+    }
+
+    if (count < 2) {
+        return -1;
+    }
+
+    len = snprintf(cmd, sizeof(cmd), "AT");
+
+    for (i = 0 ; i < count && len < (int) sizeof(cmd) ; i++) {
+        len += snprintf(cmd + len, sizeof(cmd) - len, "%s+CRSM=%d,%d,%d,%d,%d",
+                i > 0 ? ";" : "", SIM_COMMAND_READ_RECORD, p_args->fileid,
+                p_args->p1 + i, p_args->p2, p_args->p3);
+    }
+
+    if (len >= (int) sizeof(cmd)) {
+        return -1;
+    }
+
+    err = at_send_command_multiline(cmd, "+CRSM:", &p_response);
+
+    if (err < 0) {
+        goto done;
+    }
+
+    /* a modem may stop at the first record it can't read, so take what came */
+    for (i = 0, p_cur = p_response->p_intermediates ; p_cur != NULL
+            ; i++, p_cur = p_cur->p_next) {
+        RIL_SIM_IO_Response sr;
+
+        if (parseSimIOResponse(p_cur->line, &sr) < 0) {
+            break;
+        }
+
+        simFileCachePut(p_args, p_args->p1 + i, &sr);
+
+        if (i == 0) {
+            *p_sr = sr;
+            p_sr->simResponse = sr.simResponse != NULL ? strdup(sr.simResponse) : NULL;
+            ret = 0;
+        }
+    }
+
+    if (i == 0 && p_response->finalResponse != NULL
+            && 0 == strcmp(p_response->finalResponse, "ERROR")) {
+        *p_rejected = 1;
+    }
+
+done:
+    at_response_free(p_response);
+
+    return ret;
+}
+
+static void  requestSIM_IO(void *data, size_t datalen __unused, RIL_Token t)
+{
+    ATResponse *p_response = NULL;
+    RIL_SIM_IO_Response sr;
+    int err;
+    char *cmd = NULL;
+    RIL_SIM_IO_v6 *p_args;
+    int readAheadRejected = 0;
+
+    memset(&sr, 0, sizeof(sr));
+
+    p_args = (RIL_SIM_IO_v6 *)data;
+
+    /* FIXME handle pin2 */
+
+    if (simFileCacheGet(p_args, &sr) == 0
+            || (p_args->command == SIM_COMMAND_READ_RECORD
+                && isSimFileCacheable(p_args)
+                && readSimRecordsAhead(p_args, &sr, &readAheadRejected) == 0)) {
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, &sr, sizeof(sr));
+        free(sr.simResponse);
+        return;
+    }
+
+    if (p_args->data == NULL) {
+        asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d",
+                    p_args->command, p_args->fileid,
+                    p_args->p1, p_args->p2, p_args->p3);
+    } else {
+        asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d,%s",
+                    p_args->command, p_args->fileid,
+                    p_args->p1, p_args->p2, p_args->p3, p_args->data);
+    }
+
+    err = at_send_command_singleline(cmd, "+CRSM:", &p_response);
+
+    if (p_args->command == SIM_COMMAND_UPDATE_BINARY
+            || p_args->command == SIM_COMMAND_UPDATE_RECORD) {
+        simFileCacheInvalidateFile(p_args->fileid);
+    }
+
+    if (err < 0 || p_response->success == 0) {
+        goto error;
+    }
+
+    err = parseSimIOResponse(p_response->p_intermediates->line, &sr);
+    if (err < 0) goto error;
+
+    if (readAheadRejected) {
+        /* the record reads on its own, so it was the joined command */
+        RLOGI("modem rejects joined AT+CRSM; SIM read-ahead disabled");
+        s_simReadAheadSupported = 0;
+    }
+
+    if (isSimFileCacheable(p_args)) {
+        simFileCachePut(p_args, p_args->p1, &sr);
+    }
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &sr, sizeof(sr));
     at_response_free(p_response);
@@ -1872,6 +2913,8 @@ error:
         RIL_onRequestComplete(t, RIL_E_PASSWORD_INCORRECT, NULL, 0);
     } else {
         RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+        /* the SIM is unlocked now; see when it becomes ready */
+        kickSIMPolling();
     }
     at_response_free(p_response);
 }
@@ -1929,43 +2972,195 @@ static int techFromModemType(int mdmtype)
     return ret;
 }
 
+/*
+ * Cell info reporting
+ *
+ * While the framework asks for RIL_UNSOL_CELL_INFO_LIST at some rate,
+ * onCellInfoSample runs that often (but at most every
+ * CELL_INFO_MIN_RATE_MS) on the network worker. It rebuilds the cell info
+ * from the modem and reports it only when it differs from the last one
+ * reported, so the framework need not poll RIL_REQUEST_GET_CELL_INFO_LIST.
+ * Registration changes trigger an extra sample so they are not held back
+ * until the next period.
+ *
+ * Samples go through the state cache, so an idle sampler costs few or
+ * no AT commands.
+ */
+
+#define CELL_INFO_MIN_RATE_MS 1000
+/* param for a single sample outside the periodic chain */
+#define CELL_INFO_ONESHOT ((void *) -1)
+
+/* protected by s_cellInfoMutex */
+static RIL_CellInfo s_lastCellInfo;
+static int s_lastCellInfoValid = 0;
+/* bumped to end the running sampling chain */
+static intptr_t s_cellInfoGeneration = 0;
+
+/** returns 0 on success, -1 if the modem could not be queried */
+static int queryCellInfo(RIL_CellInfo *ci)
+{
+    char line[STATE_CACHE_LINE_LEN];
+    int *registration = NULL;
+    int rssi, ber;
+
+    if (stateCacheQuery(STATE_CACHE_CREG, "AT+CREG?", "+CREG:", line) < 0
+            || parseRegistrationState(line, NULL, NULL, &registration) < 0) {
+        return -1;
+    }
+
+    memset(ci, 0, sizeof(*ci));
+
+    ci->cellInfoType = RIL_CELL_INFO_TYPE_GSM;
+    /* home or roaming */
+    ci->registered = registration[0] == 1 || registration[0] == 5;
+    ci->timeStampType = RIL_TIMESTAMP_TYPE_MODEM;
+    ci->timeStamp = ril_nano_time();
+    pthread_mutex_lock(&s_cellInfoMutex);
+    ci->CellInfo.gsm.cellIdentityGsm.mcc = s_mcc;
+    ci->CellInfo.gsm.cellIdentityGsm.mnc = s_mnc;
+    pthread_mutex_unlock(&s_cellInfoMutex);
+    ci->CellInfo.gsm.cellIdentityGsm.lac = registration[1];
+    ci->CellInfo.gsm.cellIdentityGsm.cid = registration[2];
+
+    free(registration);
+
+    if (stateCacheQuery(STATE_CACHE_CSQ, "AT+CSQ", "+CSQ:", line) < 0
+            || at_tok_scan(line, "+CSQ: %d,%d", &rssi, &ber) != 2) {
+        return -1;
+    }
+
+    ci->CellInfo.gsm.signalStrengthGsm.signalStrength = rssi;
+    ci->CellInfo.gsm.signalStrengthGsm.bitErrorRate = ber;
+
+    return 0;
+}
+
+/**
+ * Remembers ci as the last cell info seen
+ * returns 1 if it differs from the previous one (timestamps aside)
+ */
+static int updateCellInfo(const RIL_CellInfo *ci)
+{
+    int changed;
+
+    pthread_mutex_lock(&s_cellInfoMutex);
+
+    changed = !s_lastCellInfoValid
+            || s_lastCellInfo.cellInfoType != ci->cellInfoType
+            || s_lastCellInfo.registered != ci->registered
+            || memcmp(&s_lastCellInfo.CellInfo.gsm, &ci->CellInfo.gsm,
+                    sizeof(ci->CellInfo.gsm)) != 0;
+
+    s_lastCellInfo = *ci;
+    s_lastCellInfoValid = 1;
+
+    pthread_mutex_unlock(&s_cellInfoMutex);
+
+    return changed;
+}
+
+/** the rate the framework asked for; INT_MAX if it wants none */
+static int getCellInfoRate()
+{
+    int rateMs;
+
+    pthread_mutex_lock(&s_cellInfoMutex);
+    rateMs = s_cell_info_rate_ms;
+    pthread_mutex_unlock(&s_cellInfoMutex);
+
+    return rateMs;
+}
+
+static void scheduleCellInfoSample(void *param)
+{
+    struct timeval tv;
+    int rateMs = getCellInfoRate();
+
+    if (rateMs < CELL_INFO_MIN_RATE_MS) {
+        rateMs = CELL_INFO_MIN_RATE_MS;
+    }
+
+    tv.tv_sec = rateMs / 1000;
+    tv.tv_usec = (rateMs % 1000) * 1000;
+
+    requestWorkerCallback(REQUEST_CLASS_NETWORK, onCellInfoSample, param, &tv);
+}
+
+/** Called on the network worker */
+static void onCellInfoSample(void *param)
+{
+    RIL_CellInfo ci;
+    int stale;
+
+    pthread_mutex_lock(&s_cellInfoMutex);
+
+    /* a newer chain has taken over, or sampling was turned off */
+    stale = (param != CELL_INFO_ONESHOT
+                && (intptr_t) param != s_cellInfoGeneration)
+            || s_cell_info_rate_ms == INT_MAX;
+
+    if (!stale && sState != RADIO_STATE_ON) {
+        /* restarted by onRadioPowerOn */
+        s_lastCellInfoValid = 0;
+        stale = 1;
+    }
+
+    pthread_mutex_unlock(&s_cellInfoMutex);
+
+    if (stale) {
+        return;
+    }
+
+    if (queryCellInfo(&ci) == 0 && updateCellInfo(&ci)) {
+        RIL_onUnsolicitedResponse(RIL_UNSOL_CELL_INFO_LIST, &ci, sizeof(ci));
+    }
+
+    if (param != CELL_INFO_ONESHOT) {
+        scheduleCellInfoSample(param);
+    }
+}
+
+/** (re)starts periodic sampling at the current rate */
+static void startCellInfoSampling()
+{
+    intptr_t generation;
+    int rateMs;
+
+    pthread_mutex_lock(&s_cellInfoMutex);
+    generation = ++s_cellInfoGeneration;
+    rateMs = s_cell_info_rate_ms;
+    pthread_mutex_unlock(&s_cellInfoMutex);
+
+    if (rateMs != INT_MAX) {
+        scheduleCellInfoSample((void *) generation);
+    }
+}
+
 static void requestGetCellInfoList(void *data __unused, size_t datalen __unused, RIL_Token t)
 {
-    uint64_t curTime = ril_nano_time();
-    RIL_CellInfo ci[1] =
-    {
-        { // ci[0]
-            1, // cellInfoType
-            1, // registered
-            RIL_TIMESTAMP_TYPE_MODEM,
-            curTime - 1000, // Fake some time in the past
-            { // union CellInfo
-                {  // RIL_CellInfoGsm gsm
-                    {  // gsm.cellIdneityGsm
-                        s_mcc, // mcc
-                        s_mnc, // mnc
-                        s_lac, // lac
-                        s_cid, // cid
-                    },
-                    {  // gsm.signalStrengthGsm
-                        10, // signalStrength
-                        0  // bitErrorRate
-                    }
-                }
-            }
-        }
-    };
+    RIL_CellInfo ci;
+
+    if (queryCellInfo(&ci) < 0) {
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
+
+    /* the framework has this one now; don't report it again */
+    updateCellInfo(&ci);
 
-    RIL_onRequestComplete(t, RIL_E_SUCCESS, ci, sizeof(ci));
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, &ci, sizeof(ci));
 }
 
 
 static void requestSetCellInfoListRate(void *data, size_t datalen __unused, RIL_Token t)
 {
-    // For now we'll save the rate but no RIL_UNSOL_CELL_INFO_LIST messages
-    // will be sent.
     assert (datalen == sizeof(int));
+    pthread_mutex_lock(&s_cellInfoMutex);
     s_cell_info_rate_ms = ((int *)data)[0];
+    pthread_mutex_unlock(&s_cellInfoMutex);
+
+    startCellInfoSampling();
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
 }
@@ -1987,20 +3182,9 @@ static void requestGetHardwareConfig(void *data, size_t datalen, RIL_Token t)
 
 /*** Callback methods from the RIL library to us ***/
 
-/**
- * Call from RIL to us to make a RIL_REQUEST
- *
- * Must be completed with a call to RIL_onRequestComplete()
- *
- * RIL_onRequestComplete() may be called from any thread, before or after
- * this function returns.
- *
- * Will always be called from the same thread, so returning here implies
- * that the radio is ready to process another command (whether or not
- * the previous command has completed).
- */
+/** runs a request on the calling thread; see onRequest() */
 static void
-onRequest (int request, void *data, size_t datalen, RIL_Token t)
+processRequest (int request, void *data, size_t datalen, RIL_Token t)
 {
     ATResponse *p_response;
     int err;
@@ -2165,7 +3349,8 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
         }
         case RIL_REQUEST_SEND_SMS:
         case RIL_REQUEST_SEND_SMS_EXPECT_MORE:
-            requestSendSMS(data, datalen, t);
+            requestSendSMS(data, datalen, t,
+                    request == RIL_REQUEST_SEND_SMS_EXPECT_MORE);
             break;
         case RIL_REQUEST_CDMA_SEND_SMS:
             requestCdmaSendSMS(data, datalen, t);
@@ -2228,6 +3413,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         case RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC:
+            stateCacheInvalidateAll();
             at_send_command("AT+COPS=0", NULL);
             break;
 
@@ -2272,6 +3458,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             asprintf(&cmd, "AT+CMGD=%d", ((int *)data)[0]);
             err = at_send_command(cmd, &p_response);
             free(cmd);
+            simFileCacheInvalidateFile(EF_SMS);
             if (err < 0 || p_response->success == 0) {
                 RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
             } else {
@@ -2321,6 +3508,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             }
             break;
         case RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE:
+            stateCacheInvalidateAll();
             requestSetPreferredNetworkType(request, data, datalen, t);
             break;
 
@@ -2393,10 +3581,691 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
                 break;
             } // Fall-through if tech is not cdma
 
-        default:
-            RLOGD("Request not supported. Tech: %d",TECH(sMdmInfo));
-            RIL_onRequestComplete(t, RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
-            break;
+        default:
+            RLOGD("Request not supported. Tech: %d",TECH(sMdmInfo));
+            RIL_onRequestComplete(t, RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
+            break;
+    }
+}
+
+/*** Request executor ***/
+
+/*
+ * Requests are run by one worker thread per class, so that a slow request
+ * (an SMS waiting on the network, an operator selection) only holds up the
+ * requests that need the same AT resources. The AT channel itself hands
+ * out commands first come first served, so classes interleave on it.
+ *
+ * Within a class, requests run and complete in the order libril gave them
+ * to us. Requests of different classes may complete out of order, which
+ * RIL.java handles since it matches responses by serial. Anything that
+ * changes the radio state, and requests not in s_requestRoutes, are
+ * barriers: the sequencer thread runs them once every request queued
+ * before them has finished, and holds back the requests that arrive after
+ * them until they are done.
+ *
+ * libril calls onRequest and runs timed callbacks on its one event
+ * thread, so neither may wait on the modem: an AT command there would
+ * queue behind whatever the workers have in flight, up to the minutes an
+ * AT+COPS=? takes, and stall every other timer and request meanwhile.
+ * onRequest only queues, and pollers that talk to the modem are scheduled
+ * with requestWorkerCallback(), whose timed callback only queues them for
+ * the worker of their class; initializeCallback runs as a barrier.
+ */
+
+/* how libril passes the request's data; see ril_commands.h */
+typedef enum {
+    PAYLOAD_FLAT,       /* dispatchVoid, dispatchInts, dispatchRaw, dispatchCdmaSms */
+    PAYLOAD_STRING,     /* dispatchString */
+    PAYLOAD_STRINGS,    /* dispatchStrings */
+    PAYLOAD_DIAL,       /* dispatchDial */
+    PAYLOAD_SIM_IO,     /* dispatchSIM_IO */
+    PAYLOAD_SMS_WRITE,  /* dispatchSmsWrite */
+    PAYLOAD_IMS_SMS,    /* dispatchImsSms */
+    PAYLOAD_NONE        /* not handled here, so the data is not needed */
+} RequestPayload;
+
+typedef struct {
+    int request;
+    RequestClass requestClass;
+    RequestPayload payload;
+} RequestRoute;
+
+static const RequestRoute s_requestRoutes[] = {
+    { RIL_REQUEST_GET_CURRENT_CALLS, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_DIAL, REQUEST_CLASS_CALL, PAYLOAD_DIAL },
+    { RIL_REQUEST_HANGUP, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_ANSWER, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_CONFERENCE, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_UDUB, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_SEPARATE_CONNECTION, REQUEST_CLASS_CALL, PAYLOAD_FLAT },
+    { RIL_REQUEST_DTMF, REQUEST_CLASS_CALL, PAYLOAD_STRING },
+
+    { RIL_REQUEST_SEND_SMS, REQUEST_CLASS_MESSAGING, PAYLOAD_STRINGS },
+    { RIL_REQUEST_SEND_SMS_EXPECT_MORE, REQUEST_CLASS_MESSAGING, PAYLOAD_STRINGS },
+    { RIL_REQUEST_SMS_ACKNOWLEDGE, REQUEST_CLASS_MESSAGING, PAYLOAD_FLAT },
+    { RIL_REQUEST_DELETE_SMS_ON_SIM, REQUEST_CLASS_MESSAGING, PAYLOAD_FLAT },
+    { RIL_REQUEST_SEND_USSD, REQUEST_CLASS_MESSAGING, PAYLOAD_STRING },
+    { RIL_REQUEST_CANCEL_USSD, REQUEST_CLASS_MESSAGING, PAYLOAD_FLAT },
+
+    { RIL_REQUEST_SIGNAL_STRENGTH, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_VOICE_REGISTRATION_STATE, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_DATA_REGISTRATION_STATE, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_OPERATOR, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_IMS_REGISTRATION_STATE, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_VOICE_RADIO_TECH, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_GET_CELL_INFO_LIST, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+    { RIL_REQUEST_SET_UNSOL_CELL_INFO_LIST_RATE, REQUEST_CLASS_NETWORK, PAYLOAD_FLAT },
+
+    { RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC, REQUEST_CLASS_SELECTION, PAYLOAD_FLAT },
+    { RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL, REQUEST_CLASS_SELECTION, PAYLOAD_STRING },
+    { RIL_REQUEST_QUERY_AVAILABLE_NETWORKS, REQUEST_CLASS_SELECTION, PAYLOAD_FLAT },
+
+    { RIL_REQUEST_SETUP_DATA_CALL, REQUEST_CLASS_DATA, PAYLOAD_STRINGS },
+    { RIL_REQUEST_DEACTIVATE_DATA_CALL, REQUEST_CLASS_DATA, PAYLOAD_STRINGS },
+    { RIL_REQUEST_DATA_CALL_LIST, REQUEST_CLASS_DATA, PAYLOAD_FLAT },
+    { RIL_REQUEST_ALLOW_DATA, REQUEST_CLASS_DATA, PAYLOAD_FLAT },
+
+    { RIL_REQUEST_GET_SIM_STATUS, REQUEST_CLASS_SIM, PAYLOAD_FLAT },
+    { RIL_REQUEST_SIM_IO, REQUEST_CLASS_SIM, PAYLOAD_SIM_IO },
+    { RIL_REQUEST_GET_IMSI, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+    { RIL_REQUEST_ENTER_SIM_PIN, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+    { RIL_REQUEST_ENTER_SIM_PUK, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+    { RIL_REQUEST_ENTER_SIM_PIN2, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+    { RIL_REQUEST_ENTER_SIM_PUK2, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+    { RIL_REQUEST_CHANGE_SIM_PIN, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+    { RIL_REQUEST_CHANGE_SIM_PIN2, REQUEST_CLASS_SIM, PAYLOAD_STRINGS },
+
+    /*
+     * Every other request processRequest() handles has to be listed, for
+     * its data to be copied; the rest are queued without it
+     */
+    { RIL_REQUEST_RADIO_POWER, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_SHUTDOWN, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_CDMA_SEND_SMS, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_IMS_SEND_SMS, REQUEST_CLASS_BARRIER, PAYLOAD_IMS_SMS },
+    { RIL_REQUEST_WRITE_SMS_TO_SIM, REQUEST_CLASS_BARRIER, PAYLOAD_SMS_WRITE },
+    { RIL_REQUEST_GET_IMEI, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_OEM_HOOK_RAW, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_OEM_HOOK_STRINGS, REQUEST_CLASS_BARRIER, PAYLOAD_STRINGS },
+    { RIL_REQUEST_GET_HARDWARE_CONFIG, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_BASEBAND_VERSION, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_DEVICE_IDENTITY, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_CDMA_SUBSCRIPTION, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_CDMA_SET_SUBSCRIPTION_SOURCE, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_CDMA_GET_SUBSCRIPTION_SOURCE, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_CDMA_QUERY_ROAMING_PREFERENCE, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_CDMA_SET_ROAMING_PREFERENCE, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+    { RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE, REQUEST_CLASS_BARRIER, PAYLOAD_FLAT },
+};
+
+/* how libril sizes a RIL_IMS_SMS_Message; see dispatchImsGsmSms */
+#define IMS_SMS_HEADER_LEN (sizeof(RIL_RadioTechnologyFamily) + sizeof(uint8_t) \
+        + sizeof(int32_t))
+
+typedef struct QueuedRequest {
+    int request;
+    RequestClass requestClass;
+    void *data;
+    size_t datalen;
+    RIL_Token t;
+    RIL_TimedCallback callback; /* for a poller, run instead of a request */
+    void *param;
+    struct QueuedRequest *p_next;
+} QueuedRequest;
+
+typedef struct {
+    pthread_cond_t cond;
+    QueuedRequest *p_head;
+    QueuedRequest *p_tail;
+    int pending;        /* queued or running */
+    int maxPending;
+} RequestQueue;
+
+static const char *s_requestClassNames[REQUEST_CLASS_COUNT] = {
+    "call", "messaging", "network", "selection", "data", "sim"
+};
+
+/* protects everything below */
+static pthread_mutex_t s_executorMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_executorIdleCond = PTHREAD_COND_INITIALIZER;
+static RequestQueue s_requestQueues[REQUEST_CLASS_COUNT];
+static int s_executorPending = 0;   /* queued or running on the workers */
+static int s_executorStarted = 0;
+
+/* barriers, and the requests that arrived after them, in order */
+static pthread_cond_t s_sequencerCond = PTHREAD_COND_INITIALIZER;
+static QueuedRequest *s_sequencerHead = NULL;
+static QueuedRequest *s_sequencerTail = NULL;
+static int s_barrierRunning = 0;
+
+static const RequestRoute *findRequestRoute(int request)
+{
+    size_t i;
+
+    for (i = 0 ; i < sizeof(s_requestRoutes) / sizeof(s_requestRoutes[0]) ; i++) {
+        if (s_requestRoutes[i].request == request) {
+            return &s_requestRoutes[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** strlen() + 1, or 0 for NULL */
+static size_t stringSize(const char *s)
+{
+    return s != NULL ? strlen(s) + 1 : 0;
+}
+
+/** copies s to *p_cur and advances it; returns the copy */
+static char *packString(char **p_cur, const char *s)
+{
+    char *copy = *p_cur;
+    size_t size = stringSize(s);
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    memcpy(copy, s, size);
+    *p_cur += size;
+
+    return copy;
+}
+
+/**
+ * Copies a request's data into a single block the caller frees, since
+ * libril frees its own copy as soon as onRequest returns.
+ * Returns 0 on success
+ */
+static int copyRequestData(RequestPayload payload, const void *data,
+        size_t datalen, void **p_copy)
+{
+    size_t size = datalen;
+    size_t header = datalen;
+    size_t i;
+    char *copy;
+    char *cur;
+
+    *p_copy = NULL;
+
+    if (data == NULL || payload == PAYLOAD_NONE) {
+        return 0;
+    }
+
+    switch (payload) {
+        case PAYLOAD_FLAT:
+            break;
+
+        case PAYLOAD_STRING:
+            header = 0;
+            size = stringSize((const char *) data);
+            break;
+
+        case PAYLOAD_STRINGS:
+            for (i = 0 ; i < datalen / sizeof(char *) ; i++) {
+                size += stringSize(((char **) data)[i]);
+            }
+            break;
+
+        case PAYLOAD_DIAL: {
+            const RIL_Dial *p_dial = (const RIL_Dial *) data;
+
+            /* older RILs are passed a RIL_Dial without uusInfo */
+            header = sizeof(RIL_Dial);
+            size = header + stringSize(p_dial->address);
+
+            if (datalen >= sizeof(RIL_Dial) && p_dial->uusInfo != NULL) {
+                size += sizeof(RIL_UUS_Info) + p_dial->uusInfo->uusLength;
+            }
+            break;
+        }
+
+        case PAYLOAD_SIM_IO: {
+            const RIL_SIM_IO_v6 *p_args = (const RIL_SIM_IO_v6 *) data;
+
+            /* the v5 structure is a prefix of v6 */
+            header = sizeof(RIL_SIM_IO_v6);
+            size = header + stringSize(p_args->path) + stringSize(p_args->data)
+                    + stringSize(p_args->pin2);
+
+            if (datalen >= sizeof(RIL_SIM_IO_v6)) {
+                size += stringSize(p_args->aidPtr);
+            }
+            break;
+        }
+
+        case PAYLOAD_SMS_WRITE: {
+            const RIL_SMS_WriteArgs *p_args = (const RIL_SMS_WriteArgs *) data;
+
+            header = sizeof(RIL_SMS_WriteArgs);
+            size = header + stringSize(p_args->pdu) + stringSize(p_args->smsc);
+            break;
+        }
+
+        case PAYLOAD_IMS_SMS: {
+            const RIL_IMS_SMS_Message *p_args = (const RIL_IMS_SMS_Message *) data;
+
+            /* datalen counts the GSM pointers or the CDMA message after the header */
+            header = sizeof(RIL_IMS_SMS_Message);
+            size = header;
+
+            if (p_args->tech == RADIO_TECH_3GPP && p_args->message.gsmMessage != NULL
+                    && datalen >= IMS_SMS_HEADER_LEN) {
+                size += datalen - IMS_SMS_HEADER_LEN;
+                for (i = 0 ; i < (datalen - IMS_SMS_HEADER_LEN) / sizeof(char *) ; i++) {
+                    size += stringSize(p_args->message.gsmMessage[i]);
+                }
+            } else if (p_args->tech == RADIO_TECH_3GPP2
+                    && p_args->message.cdmaMessage != NULL) {
+                size += sizeof(RIL_CDMA_SMS_Message);
+            }
+            break;
+        }
+
+        case PAYLOAD_NONE:
+            break;
+    }
+
+    copy = calloc(1, size > 0 ? size : 1);
+
+    if (copy == NULL) {
+        return -1;
+    }
+
+    memcpy(copy, data, datalen < header ? datalen : header);
+    cur = copy + header;
+
+    switch (payload) {
+        case PAYLOAD_FLAT:
+            break;
+
+        case PAYLOAD_STRING:
+            packString(&cur, (const char *) data);
+            break;
+
+        case PAYLOAD_STRINGS:
+            for (i = 0 ; i < datalen / sizeof(char *) ; i++) {
+                ((char **) copy)[i] = packString(&cur, ((char **) data)[i]);
+            }
+            break;
+
+        case PAYLOAD_DIAL: {
+            const RIL_Dial *p_dial = (const RIL_Dial *) data;
+            RIL_Dial *p_copy_dial = (RIL_Dial *) copy;
+
+            p_copy_dial->address = packString(&cur, p_dial->address);
+
+            if (datalen >= sizeof(RIL_Dial) && p_dial->uusInfo != NULL) {
+                RIL_UUS_Info *p_uus = (RIL_UUS_Info *) cur;
+
+                *p_uus = *p_dial->uusInfo;
+                cur += sizeof(RIL_UUS_Info);
+
+                if (p_uus->uusData != NULL) {
+                    memcpy(cur, p_uus->uusData, p_uus->uusLength);
+                    p_uus->uusData = cur;
+                }
+
+                p_copy_dial->uusInfo = p_uus;
+            }
+            break;
+        }
+
+        case PAYLOAD_SIM_IO: {
+            const RIL_SIM_IO_v6 *p_args = (const RIL_SIM_IO_v6 *) data;
+            RIL_SIM_IO_v6 *p_copy_args = (RIL_SIM_IO_v6 *) copy;
+
+            p_copy_args->path = packString(&cur, p_args->path);
+            p_copy_args->data = packString(&cur, p_args->data);
+            p_copy_args->pin2 = packString(&cur, p_args->pin2);
+
+            if (datalen >= sizeof(RIL_SIM_IO_v6)) {
+                p_copy_args->aidPtr = packString(&cur, p_args->aidPtr);
+            }
+            break;
+        }
+
+        case PAYLOAD_SMS_WRITE: {
+            const RIL_SMS_WriteArgs *p_args = (const RIL_SMS_WriteArgs *) data;
+            RIL_SMS_WriteArgs *p_copy_args = (RIL_SMS_WriteArgs *) copy;
+
+            p_copy_args->pdu = packString(&cur, p_args->pdu);
+            p_copy_args->smsc = packString(&cur, p_args->smsc);
+            break;
+        }
+
+        case PAYLOAD_IMS_SMS: {
+            const RIL_IMS_SMS_Message *p_args = (const RIL_IMS_SMS_Message *) data;
+            RIL_IMS_SMS_Message *p_copy_args = (RIL_IMS_SMS_Message *) copy;
+
+            if (p_args->tech == RADIO_TECH_3GPP && p_args->message.gsmMessage != NULL
+                    && datalen >= IMS_SMS_HEADER_LEN) {
+                size_t count = (datalen - IMS_SMS_HEADER_LEN) / sizeof(char *);
+                char **p_strings = (char **) cur;
+
+                cur += datalen - IMS_SMS_HEADER_LEN;
+                for (i = 0 ; i < count ; i++) {
+                    p_strings[i] = packString(&cur, p_args->message.gsmMessage[i]);
+                }
+                p_copy_args->message.gsmMessage = p_strings;
+            } else if (p_args->tech == RADIO_TECH_3GPP2
+                    && p_args->message.cdmaMessage != NULL) {
+                memcpy(cur, p_args->message.cdmaMessage, sizeof(RIL_CDMA_SMS_Message));
+                p_copy_args->message.cdmaMessage = (RIL_CDMA_SMS_Message *) cur;
+            }
+            break;
+        }
+
+        case PAYLOAD_NONE:
+            break;
+    }
+
+    *p_copy = copy;
+
+    return 0;
+}
+
+/** hands a request to its class's worker; assumes s_executorMutex is held */
+static void enqueueForWorker(QueuedRequest *p_queued)
+{
+    RequestQueue *p_queue = &s_requestQueues[p_queued->requestClass];
+
+    if (p_queue->p_tail != NULL) {
+        p_queue->p_tail->p_next = p_queued;
+    } else {
+        p_queue->p_head = p_queued;
+    }
+
+    p_queue->p_tail = p_queued;
+    p_queue->pending++;
+    s_executorPending++;
+
+    if (p_queue->pending > p_queue->maxPending) {
+        p_queue->maxPending = p_queue->pending;
+
+        if (p_queue->maxPending > 1) {
+            RLOGD("executor: %s queue reached %d requests",
+                    s_requestClassNames[p_queued->requestClass],
+                    p_queue->maxPending);
+        }
+    }
+
+    pthread_cond_signal(&p_queue->cond);
+}
+
+/** runs a request, or a poller, and frees it */
+static void runQueuedRequest(QueuedRequest *p_queued)
+{
+    if (p_queued->callback != NULL) {
+        p_queued->callback(p_queued->param);
+    } else {
+        processRequest(p_queued->request, p_queued->data, p_queued->datalen,
+                p_queued->t);
+    }
+
+    free(p_queued->data);
+    free(p_queued);
+}
+
+static void *requestWorkerLoop(void *param)
+{
+    RequestQueue *p_queue = (RequestQueue *) param;
+    QueuedRequest *p_queued;
+
+    for (;;) {
+        pthread_mutex_lock(&s_executorMutex);
+
+        while (p_queue->p_head == NULL) {
+            pthread_cond_wait(&p_queue->cond, &s_executorMutex);
+        }
+
+        p_queued = p_queue->p_head;
+        p_queue->p_head = p_queued->p_next;
+
+        if (p_queue->p_head == NULL) {
+            p_queue->p_tail = NULL;
+        }
+
+        pthread_mutex_unlock(&s_executorMutex);
+
+        runQueuedRequest(p_queued);
+
+        pthread_mutex_lock(&s_executorMutex);
+
+        p_queue->pending--;
+        s_executorPending--;
+
+        if (s_executorPending == 0) {
+            pthread_cond_broadcast(&s_executorIdleCond);
+        }
+
+        pthread_mutex_unlock(&s_executorMutex);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs the barriers in order, each once the workers are idle, and passes
+ * the requests held back behind them on to the workers
+ */
+static void *sequencerLoop(void *param __unused)
+{
+    QueuedRequest *p_queued;
+
+    pthread_mutex_lock(&s_executorMutex);
+
+    for (;;) {
+        while (s_sequencerHead == NULL) {
+            pthread_cond_wait(&s_sequencerCond, &s_executorMutex);
+        }
+
+        p_queued = s_sequencerHead;
+
+        if (p_queued->requestClass == REQUEST_CLASS_BARRIER) {
+            while (s_executorPending > 0) {
+                pthread_cond_wait(&s_executorIdleCond, &s_executorMutex);
+            }
+        }
+
+        s_sequencerHead = p_queued->p_next;
+
+        if (s_sequencerHead == NULL) {
+            s_sequencerTail = NULL;
+        }
+
+        p_queued->p_next = NULL;
+
+        if (p_queued->requestClass != REQUEST_CLASS_BARRIER) {
+            enqueueForWorker(p_queued);
+            continue;
+        }
+
+        /* keeps later requests behind this one until it is done */
+        s_barrierRunning = 1;
+
+        pthread_mutex_unlock(&s_executorMutex);
+
+        runQueuedRequest(p_queued);
+
+        pthread_mutex_lock(&s_executorMutex);
+
+        s_barrierRunning = 0;
+    }
+
+    return NULL;
+}
+
+static void startRequestExecutor()
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    int i;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (i = 0 ; i < REQUEST_CLASS_COUNT ; i++) {
+        pthread_cond_init(&s_requestQueues[i].cond, NULL);
+
+        if (pthread_create(&tid, &attr, requestWorkerLoop, &s_requestQueues[i]) != 0) {
+            /* requests will all run on the dispatch thread */
+            RLOGE("executor: unable to start the %s worker", s_requestClassNames[i]);
+            pthread_attr_destroy(&attr);
+            return;
+        }
+    }
+
+    if (pthread_create(&tid, &attr, sequencerLoop, NULL) != 0) {
+        RLOGE("executor: unable to start the sequencer");
+        pthread_attr_destroy(&attr);
+        return;
+    }
+
+    pthread_attr_destroy(&attr);
+
+    pthread_mutex_lock(&s_executorMutex);
+    s_executorStarted = 1;
+    pthread_mutex_unlock(&s_executorMutex);
+}
+
+/**
+ * Hands a request to its class's worker, or to the sequencer if it is a
+ * barrier or has to wait behind one
+ */
+static void routeQueuedRequest(QueuedRequest *p_queued)
+{
+    pthread_mutex_lock(&s_executorMutex);
+
+    if (p_queued->requestClass != REQUEST_CLASS_BARRIER
+            && s_sequencerHead == NULL && !s_barrierRunning) {
+        enqueueForWorker(p_queued);
+    } else {
+        if (s_sequencerTail != NULL) {
+            s_sequencerTail->p_next = p_queued;
+        } else {
+            s_sequencerHead = p_queued;
+        }
+
+        s_sequencerTail = p_queued;
+
+        pthread_cond_signal(&s_sequencerCond);
+    }
+
+    pthread_mutex_unlock(&s_executorMutex);
+}
+
+/**
+ * Queues a request for its class's worker, or for the sequencer if it is
+ * a barrier or has to wait behind one. p_route is NULL for requests we
+ * don't handle.
+ * Returns 0 on success, -1 if the request data could not be copied
+ */
+static int queueRequest(const RequestRoute *p_route, int request, void *data,
+        size_t datalen, RIL_Token t)
+{
+    QueuedRequest *p_queued;
+    RequestPayload payload;
+
+    p_queued = (QueuedRequest *) malloc(sizeof(QueuedRequest));
+
+    if (p_queued == NULL) {
+        return -1;
+    }
+
+    payload = p_route != NULL ? p_route->payload : PAYLOAD_NONE;
+
+    if (copyRequestData(payload, data, datalen, &p_queued->data) < 0) {
+        free(p_queued);
+        return -1;
+    }
+
+    p_queued->request = request;
+    p_queued->requestClass = p_route != NULL ? p_route->requestClass
+            : REQUEST_CLASS_BARRIER;
+    p_queued->datalen = payload != PAYLOAD_NONE ? datalen : 0;
+    p_queued->t = t;
+    p_queued->callback = NULL;
+    p_queued->param = NULL;
+    p_queued->p_next = NULL;
+
+    routeQueuedRequest(p_queued);
+
+    return 0;
+}
+
+/** Called on the timed callback thread; only queues the poller */
+static void onWorkerCallbackDue(void *param)
+{
+    QueuedRequest *p_queued = (QueuedRequest *) param;
+
+    if (!s_executorStarted) {
+        runQueuedRequest(p_queued);
+        return;
+    }
+
+    routeQueuedRequest(p_queued);
+}
+
+/**
+ * Like RIL_requestTimedCallback(), but callback runs on the worker for
+ * requestClass, in order with that class's requests, or on the sequencer
+ * as a barrier for REQUEST_CLASS_BARRIER. For pollers that send AT
+ * commands; Called on any thread.
+ */
+static void requestWorkerCallback(RequestClass requestClass,
+        RIL_TimedCallback callback, void *param,
+        const struct timeval *relativeTime)
+{
+    QueuedRequest *p_queued;
+
+    p_queued = (QueuedRequest *) calloc(1, sizeof(QueuedRequest));
+
+    if (p_queued == NULL) {
+        RLOGE("executor: no memory to queue a poller; running it on the"
+                " timed callback thread");
+        RIL_requestTimedCallback(callback, param, relativeTime);
+        return;
+    }
+
+    p_queued->requestClass = requestClass;
+    p_queued->callback = callback;
+    p_queued->param = param;
+
+    RIL_requestTimedCallback(onWorkerCallbackDue, p_queued, relativeTime);
+}
+
+/**
+ * Call from RIL to us to make a RIL_REQUEST
+ *
+ * Must be completed with a call to RIL_onRequestComplete()
+ *
+ * RIL_onRequestComplete() may be called from any thread, before or after
+ * this function returns.
+ *
+ * Will always be called from the same thread, so returning here implies
+ * that the radio is ready to process another command (whether or not
+ * the previous command has completed).
+ */
+static void
+onRequest (int request, void *data, size_t datalen, RIL_Token t)
+{
+    if (!s_executorStarted) {
+        processRequest(request, data, datalen, t);
+        return;
+    }
+
+    if (queueRequest(findRequestRoute(request), request, data, datalen, t) < 0) {
+        RLOGE("executor: no memory to queue %s", requestToString(request));
+        RIL_onRequestComplete(t, RIL_E_NO_MEMORY, NULL, 0);
     }
 }
 
@@ -2477,6 +4346,13 @@ setRadioState(RIL_RadioState newState)
     if (sState != newState || s_closed > 0) {
         sState = newState;
 
+        stateCacheInvalidateAll();
+
+        if (newState == RADIO_STATE_UNAVAILABLE) {
+            /* the SIM may be swapped while the modem is away */
+            simFileCacheInvalidateAll();
+        }
+
         pthread_cond_broadcast (&s_state_cond);
     }
 
@@ -2758,14 +4634,72 @@ static void freeCardStatus(RIL_CardStatus_v6 *p_card_status) {
  * SIM ready means any commands that access the SIM will work, including:
  *  AT+CPIN, AT+CSMS, AT+CNMI, AT+CRSM
  *  (all SMS-related commands)
+ *
+ * Readiness is polled with AT+CPIN? from radio power on, first after
+ * SIM_POLL_MIN_MS and then backing off exponentially up to
+ * SIM_POLL_MAX_MS while the SIM stays not ready. An unsolicited +CPIN:
+ * line or a successful PIN entry polls again immediately and restarts
+ * the backoff, so modems that report SIM state changes become ready as
+ * soon as they say so instead of on the next poll.
+ *
+ * Each poll chain carries a generation number; kicking the tracker bumps
+ * it and stale chains die off on their next callback.
  */
 
-static void pollSIMState (void *param __unused)
+#define SIM_POLL_MIN_MS 250
+#define SIM_POLL_MAX_MS 8000
+
+static pthread_mutex_t s_simPollMutex = PTHREAD_MUTEX_INITIALIZER;
+static intptr_t s_simPollGeneration = 0;
+static long long s_simPollDelayMsec = SIM_POLL_MIN_MS;
+static long long s_simPollStartMsec = 0;
+static int s_simPollCount = 0;
+static int s_simReady = 0;
+
+/** restarts polling right away; Called on any thread */
+static void kickSIMPolling()
 {
-    ATResponse *p_response;
-    int ret;
+    intptr_t generation;
+
+    pthread_mutex_lock(&s_simPollMutex);
+    generation = ++s_simPollGeneration;
+    s_simPollDelayMsec = SIM_POLL_MIN_MS;
+    pthread_mutex_unlock(&s_simPollMutex);
+
+    requestWorkerCallback(REQUEST_CLASS_SIM, pollSIMState, (void *) generation,
+            NULL);
+}
+
+/** Called on radio power on */
+static void startSIMPolling()
+{
+    pthread_mutex_lock(&s_simPollMutex);
+    s_simPollStartMsec = nowMsec();
+    s_simPollCount = 0;
+    s_simReady = 0;
+    pthread_mutex_unlock(&s_simPollMutex);
+
+    kickSIMPolling();
+}
+
+static void pollSIMState (void *param)
+{
+    struct timeval tv;
+    long long delayMsec;
+
+    pthread_mutex_lock(&s_simPollMutex);
+
+    if ((intptr_t) param != s_simPollGeneration) {
+        /* superseded by a newer chain */
+        pthread_mutex_unlock(&s_simPollMutex);
+        return;
+    }
+
+    s_simPollCount++;
+
+    pthread_mutex_unlock(&s_simPollMutex);
 
-    if (sState != RADIO_STATE_SIM_NOT_READY) {
+    if (sState != RADIO_STATE_ON) {
         // no longer valid to poll
         return;
     }
@@ -2777,15 +4711,33 @@ static void pollSIMState (void *param __unused)
         case SIM_NETWORK_PERSONALIZATION:
         default:
             RLOGI("SIM ABSENT or LOCKED");
+            simFileCacheInvalidateAll();
             RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);
         return;
 
         case SIM_NOT_READY:
-            RIL_requestTimedCallback (pollSIMState, NULL, &TIMEVAL_SIMPOLL);
+            pthread_mutex_lock(&s_simPollMutex);
+            delayMsec = s_simPollDelayMsec;
+            s_simPollDelayMsec *= 2;
+            if (s_simPollDelayMsec > SIM_POLL_MAX_MS) {
+                s_simPollDelayMsec = SIM_POLL_MAX_MS;
+            }
+            pthread_mutex_unlock(&s_simPollMutex);
+
+            tv.tv_sec = delayMsec / 1000;
+            tv.tv_usec = (delayMsec % 1000) * 1000;
+            requestWorkerCallback(REQUEST_CLASS_SIM, pollSIMState, param, &tv);
         return;
 
         case SIM_READY:
-            RLOGI("SIM_READY");
+            pthread_mutex_lock(&s_simPollMutex);
+            if (!s_simReady) {
+                s_simReady = 1;
+                RLOGI("SIM_READY %lld ms after radio on, %d polls",
+                        nowMsec() - s_simPollStartMsec, s_simPollCount);
+            }
+            pthread_mutex_unlock(&s_simPollMutex);
+
             onSIMReady();
             RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);
         return;
@@ -2797,7 +4749,6 @@ static int isRadioOn()
 {
     ATResponse *p_response = NULL;
     int err;
-    char *line;
     char ret;
 
     err = at_send_command_singleline("AT+CFUN?", "+CFUN:", &p_response);
@@ -2807,13 +4758,10 @@ static int isRadioOn()
         goto error;
     }
 
-    line = p_response->p_intermediates->line;
-
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
-
-    err = at_tok_nextbool(&line, &ret);
-    if (err < 0) goto error;
+    if (at_tok_scan(p_response->p_intermediates->line,
+                    "+CFUN: %b", &ret) != 1) {
+        goto error;
+    }
 
     at_response_free(p_response);
 
@@ -2949,6 +4897,12 @@ int is_multimode_modem(ModemInfo *mdm)
     return 0;
 }
 
+/* probeForModemMode results, kept across reconnects */
+static int s_modemProbed = 0;
+static int s_probedMultimode;
+static int s_probedSupportedTechs;
+static int s_probedCurrentTech;
+
 /**
  * Find out if our modem is GSM, CDMA or both (Multimode)
  */
@@ -2957,6 +4911,39 @@ static void probeForModemMode(ModemInfo *info)
     ATResponse *response;
     int err;
     assert (info);
+
+    /*
+     * The modem does not change across reconnects, so what it supports
+     * is only probed once. A multimode modem is still asked for its
+     * current and preferred modes, which may have changed; if that fails
+     * it is probed again from scratch.
+     */
+    if (s_modemProbed && !s_probedMultimode) {
+        info->isMultimode = 0;
+        info->supportedTechs = s_probedSupportedTechs;
+        info->currentTech = s_probedCurrentTech;
+        RLOGI("Using cached probe: single mode modem, techs mask %8.8x",
+                info->supportedTechs);
+        return;
+    }
+
+    if (s_modemProbed && s_probedMultimode) {
+        int tech;
+        int32_t preferred;
+
+        if (query_ctec(info, &tech, &preferred) == 0) {
+            info->isMultimode = 1;
+            info->currentTech = tech;
+            info->preferredNetworkMode = preferred;
+            info->supportedTechs = s_probedSupportedTechs;
+            RLOGI("Using cached probe: multimode modem, techs mask %8.8x. Current tech: %d",
+                    info->supportedTechs, info->currentTech);
+            return;
+        }
+
+        s_modemProbed = 0;
+    }
+
     // Currently, our only known multimode modem is qemu's android modem,
     // which implements the AT+CTEC command to query and set mode.
     // Try that first
@@ -2964,6 +4951,9 @@ static void probeForModemMode(ModemInfo *info)
     if (is_multimode_modem(info)) {
         RLOGI("Found Multimode Modem. Supported techs mask: %8.8x. Current tech: %d",
             info->supportedTechs, info->currentTech);
+        s_modemProbed = 1;
+        s_probedMultimode = 1;
+        s_probedSupportedTechs = info->supportedTechs;
         return;
     }
 
@@ -2978,103 +4968,228 @@ static void probeForModemMode(ModemInfo *info)
         info->supportedTechs = MDM_CDMA | MDM_EVDO;
         info->currentTech = MDM_CDMA;
         RLOGI("Found CDMA Modem");
-        return;
+    } else {
+        if (!err) at_response_free(response);
+        // TODO: find out if modem really supports WCDMA/LTE
+        info->supportedTechs = MDM_GSM | MDM_WCDMA | MDM_LTE;
+        info->currentTech = MDM_GSM;
+        RLOGI("Found GSM Modem");
+    }
+
+    /* a timeout or closed channel tells us nothing about the modem */
+    if (err != AT_ERROR_TIMEOUT && err != AT_ERROR_CHANNEL_CLOSED) {
+        s_modemProbed = 1;
+        s_probedMultimode = 0;
+        s_probedSupportedTechs = info->supportedTechs;
+        s_probedCurrentTech = info->currentTech;
     }
-    if (!err) at_response_free(response);
-    // TODO: find out if modem really supports WCDMA/LTE
-    info->supportedTechs = MDM_GSM | MDM_WCDMA | MDM_LTE;
-    info->currentTech = MDM_GSM;
-    RLOGI("Found GSM Modem");
+}
+
+/*
+ * Modem initialization sequence
+ *
+ * s_initSteps lists the setup commands, without their "AT". Runs of
+ * extended ('+' or '%') commands are joined with ';' into lines of up to
+ * INIT_LINE_MAX characters, so the whole sequence costs a few round trips
+ * rather than one per command. A modem stops executing a line at its
+ * first failing command, so when a joined line fails its steps are run
+ * again one by one, with their fallbacks.
+ */
+
+#define INIT_LINE_MAX 200
+
+typedef struct {
+    const char *command;    /* without the "AT" */
+    const char *fallback;   /* sent if command fails; may be NULL */
+} InitStep;
+
+static const InitStep s_initSteps[] = {
+    /*  atchannel is tolerant of echo but it must */
+    /*  have verbose result codes */
+    { "E0Q0V1", NULL },
+    /*  No auto-answer */
+    { "S0=0", NULL },
+    /*  Extended errors */
+    { "+CMEE=1", NULL },
+    /*  Network registration events */
+    /* some handsets -- in tethered mode -- don't support CREG=2 */
+    { "+CREG=2", "+CREG=1" },
+    /*  GPRS registration events */
+    { "+CGREG=1", NULL },
+    /*  Call Waiting notifications */
+    { "+CCWA=1", NULL },
+    /*  Alternating voice/data off */
+    { "+CMOD=0", NULL },
+    /*  Not muted */
+    { "+CMUT=0", NULL },
+    /*  +CSSU unsolicited supp service notifications */
+    { "+CSSN=0,1", NULL },
+    /*  no connected line identification */
+    { "+COLP=0", NULL },
+    /*  HEX character set */
+    { "+CSCS=\"HEX\"", NULL },
+    /*  USSD unsolicited */
+    { "+CUSD=1", NULL },
+    /*  Enable +CGEV GPRS event notifications, but don't buffer */
+    { "+CGEREP=1,0", NULL },
+    /*  SMS PDU mode */
+    { "+CMGF=0", NULL },
+#ifdef USE_TI_COMMANDS
+    { "%CPI=3", NULL },
+    /*  TI specific -- notifications when SMS is ready (currently ignored) */
+    { "%CSTAT=1", NULL },
+#endif /* USE_TI_COMMANDS */
+};
+
+static int isJoinableStep(const InitStep *step)
+{
+    return step->command[0] == '+' || step->command[0] == '%';
 }
 
 /**
- * Initialize everything that can be configured while we're still in
- * AT+CFUN=0
+ * Sends "AT" + command
+ * returns 1 if it succeeded, 0 if it failed, or a negative AT_ERROR_*
+ * if the channel is unusable
  */
-static void initializeCallback(void *param __unused)
+static int sendInitCommand(const char *command, int *p_roundTrips)
 {
     ATResponse *p_response = NULL;
+    char line[INIT_LINE_MAX + 3];
+    long long startMsec = nowMsec();
     int err;
+    int ret;
 
-    setRadioState (RADIO_STATE_OFF);
-
-    at_handshake();
+    snprintf(line, sizeof(line), "AT%s", command);
 
-    probeForModemMode(sMdmInfo);
-    /* note: we don't check errors here. Everything important will
-       be handled in onATTimeout and onATReaderClosed */
+    err = at_send_command(line, &p_response);
+    (*p_roundTrips)++;
 
-    /*  atchannel is tolerant of echo but it must */
-    /*  have verbose result codes */
-    at_send_command("ATE0Q0V1", NULL);
+    if (err == AT_ERROR_TIMEOUT || err == AT_ERROR_CHANNEL_CLOSED) {
+        ret = err;
+    } else {
+        ret = (err == 0 && p_response->success) ? 1 : 0;
+    }
 
-    /*  No auto-answer */
-    at_send_command("ATS0=0", NULL);
+    RLOGD("init: %s %s in %lld ms", line, ret > 0 ? "OK" : "failed",
+            nowMsec() - startMsec);
 
-    /*  Extended errors */
-    at_send_command("AT+CMEE=1", NULL);
+    at_response_free(p_response);
+    return ret;
+}
 
-    /*  Network registration events */
-    err = at_send_command("AT+CREG=2", &p_response);
+/** returns 0, or a negative AT_ERROR_* if the channel became unusable */
+static int runInitStep(const InitStep *step, int *p_roundTrips)
+{
+    int ret = sendInitCommand(step->command, p_roundTrips);
 
-    /* some handsets -- in tethered mode -- don't support CREG=2 */
-    if (err < 0 || p_response->success == 0) {
-        at_send_command("AT+CREG=1", NULL);
+    if (ret == 0 && step->fallback != NULL) {
+        ret = sendInitCommand(step->fallback, p_roundTrips);
     }
 
-    at_response_free(p_response);
+    return ret < 0 ? ret : 0;
+}
 
-    /*  GPRS registration events */
-    at_send_command("AT+CGREG=1", NULL);
+/** returns 0, or a negative AT_ERROR_* if the channel became unusable */
+static int runInitSequence(const InitStep *steps, size_t count)
+{
+    char line[INIT_LINE_MAX + 1];
+    long long startMsec = nowMsec();
+    int roundTrips = 0;
+    size_t i = 0, j, k;
+    int ret;
 
-    /*  Call Waiting notifications */
-    at_send_command("AT+CCWA=1", NULL);
+    while (i < count) {
+        size_t len = strlcpy(line, steps[i].command, sizeof(line));
 
-    /*  Alternating voice/data off */
-    at_send_command("AT+CMOD=0", NULL);
+        j = i + 1;
 
-    /*  Not muted */
-    at_send_command("AT+CMUT=0", NULL);
+        if (isJoinableStep(&steps[i])) {
+            while (j < count && isJoinableStep(&steps[j])
+                    && len + 1 + strlen(steps[j].command) <= INIT_LINE_MAX) {
+                line[len++] = ';';
+                len += strlcpy(line + len, steps[j].command,
+                        sizeof(line) - len);
+                j++;
+            }
+        }
 
-    /*  +CSSU unsolicited supp service notifications */
-    at_send_command("AT+CSSN=0,1", NULL);
+        if (j - i == 1) {
+            ret = runInitStep(&steps[i], &roundTrips);
+        } else {
+            ret = sendInitCommand(line, &roundTrips);
 
-    /*  no connected line identification */
-    at_send_command("AT+COLP=0", NULL);
+            /* find out which ones the modem did not take */
+            for (k = i; ret == 0 && k < j; k++) {
+                ret = runInitStep(&steps[k], &roundTrips);
+            }
+        }
 
-    /*  HEX character set */
-    at_send_command("AT+CSCS=\"HEX\"", NULL);
+        if (ret < 0) {
+            return ret;
+        }
 
-    /*  USSD unsolicited */
-    at_send_command("AT+CUSD=1", NULL);
+        i = j;
+    }
 
-    /*  Enable +CGEV GPRS event notifications, but don't buffer */
-    at_send_command("AT+CGEREP=1,0", NULL);
+    RLOGI("init: %zu commands in %d round trips, %lld ms",
+            count, roundTrips, nowMsec() - startMsec);
 
-    /*  SMS PDU mode */
-    at_send_command("AT+CMGF=0", NULL);
+    return 0;
+}
 
-#ifdef USE_TI_COMMANDS
+/**
+ * Initialize everything that can be configured while we're still in
+ * AT+CFUN=0
+ */
+static void initializeCallback(void *param __unused)
+{
+    long long startMsec = nowMsec();
 
-    at_send_command("AT%CPI=3", NULL);
+    pthread_mutex_lock(&s_state_mutex);
+    s_initPending = 0;
+    pthread_cond_broadcast(&s_state_cond);
+    pthread_mutex_unlock(&s_state_mutex);
 
-    /*  TI specific -- notifications when SMS is ready (currently ignored) */
-    at_send_command("AT%CSTAT=1", NULL);
+    setRadioState (RADIO_STATE_OFF);
 
-#endif /* USE_TI_COMMANDS */
+    at_handshake();
+
+    probeForModemMode(sMdmInfo);
+    /* note: we don't check errors here. Everything important will
+       be handled in onATTimeout and onATReaderClosed */
+
+    RLOGD("init: probe done in %lld ms", nowMsec() - startMsec);
 
+    if (runInitSequence(s_initSteps,
+            sizeof(s_initSteps) / sizeof(s_initSteps[0])) < 0) {
+        return;
+    }
 
     /* assume radio is off on error */
     if (isRadioOn() > 0) {
         setRadioState (RADIO_STATE_ON);
     }
+
+    RLOGI("init: modem initialized in %lld ms", nowMsec() - startMsec);
+
+    if (s_channelClosedMsec != 0) {
+        RLOGI("modem recovered %lld ms after the AT channel closed"
+                " (%d reconnect attempts)",
+                nowMsec() - s_channelClosedMsec, s_reconnectAttempts);
+        s_channelClosedMsec = 0;
+    }
 }
 
+/**
+ * Waits for the channel to close. Also waits for the initializeCallback
+ * queued for this channel to have started, since it can't be cancelled
+ * and must not run against the next one
+ */
 static void waitForClose()
 {
     pthread_mutex_lock(&s_state_mutex);
 
-    while (s_closed == 0) {
+    while (s_closed == 0 || s_initPending) {
         pthread_cond_wait(&s_state_cond, &s_state_mutex);
     }
 
@@ -3129,23 +5244,33 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
         free(line);
     } else if (strStartsWith(s,"+CRING:")
                 || strStartsWith(s,"RING")
-                || strStartsWith(s,"NO CARRIER")
+    ) {
+        /* repeated while the call rings; only report a change */
+        kickCallStatePoll();
+    } else if (strStartsWith(s,"NO CARRIER")
                 || strStartsWith(s,"+CCWA")
     ) {
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
             NULL, 0);
 #ifdef WORKAROUND_FAKE_CGEV
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL); //TODO use new function
+        scheduleDataCallListPoll();
 #endif /* WORKAROUND_FAKE_CGEV */
     } else if (strStartsWith(s,"+CREG:")
                 || strStartsWith(s,"+CGREG:")
     ) {
+        stateCachePutRegistration(strStartsWith(s, "+CREG:")
+                ? STATE_CACHE_CREG : STATE_CACHE_CGREG, s);
+        stateCacheInvalidate(STATE_CACHE_COPS);
+        if (getCellInfoRate() != INT_MAX) {
+            requestWorkerCallback(REQUEST_CLASS_NETWORK, onCellInfoSample,
+                    CELL_INFO_ONESHOT, NULL);
+        }
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED,
             NULL, 0);
 #ifdef WORKAROUND_FAKE_CGEV
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL);
+        scheduleDataCallListPoll();
 #endif /* WORKAROUND_FAKE_CGEV */
     } else if (strStartsWith(s, "+CMT:")) {
         RIL_onUnsolicitedResponse (
@@ -3155,16 +5280,36 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT,
             sms_pdu, strlen(sms_pdu));
+    } else if (strStartsWith(s, "+CMTI:")) {
+        /* +CMTI: <mem>,<index> -- a message was stored rather than routed */
+        char *mem;
+        int index;
+
+        line = p = strdup(s);
+        at_tok_start(&p);
+
+        err = at_tok_nextstr(&p, &mem);
+        if (err == 0) err = at_tok_nextint(&p, &index);
+
+        if (err != 0) {
+            RLOGE("invalid CMTI line %s\n", s);
+        } else if (0 == strcmp(mem, "SM")) {
+            simFileCacheInvalidateFile(EF_SMS);
+            RIL_onUnsolicitedResponse (
+                RIL_UNSOL_RESPONSE_NEW_SMS_ON_SIM,
+                &index, sizeof(index));
+        }
+        free(line);
     } else if (strStartsWith(s, "+CGEV:")) {
         /* Really, we can ignore NW CLASS and ME CLASS events here,
          * but right now we don't since extranous
          * RIL_UNSOL_DATA_CALL_LIST_CHANGED calls are tolerated
          */
         /* can't issue AT commands here -- call on main thread */
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL);
+        scheduleDataCallListPoll();
 #ifdef WORKAROUND_FAKE_CGEV
     } else if (strStartsWith(s, "+CME ERROR: 150")) {
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL);
+        scheduleDataCallListPoll();
 #endif /* WORKAROUND_FAKE_CGEV */
     } else if (strStartsWith(s, "+CTEC: ")) {
         int tech, mask;
@@ -3248,6 +5393,10 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
         RIL_onUnsolicitedResponse(RIL_UNSOL_CDMA_PRL_CHANGED, &version, sizeof(version));
     } else if (strStartsWith(s, "+CFUN: 0")) {
         setRadioState(RADIO_STATE_OFF);
+    } else if (strStartsWith(s, "+CPIN:")) {
+        /* SIM state changed; check it on the SIM worker */
+        simFileCacheInvalidateAll();
+        kickSIMPolling();
     }
 }
 
@@ -3256,6 +5405,7 @@ static void onATReaderClosed()
 {
     RLOGI("AT channel closed\n");
     at_close();
+    s_channelClosedMsec = nowMsec();
     s_closed = 1;
 
     setRadioState (RADIO_STATE_UNAVAILABLE);
@@ -3267,6 +5417,7 @@ static void onATTimeout()
     RLOGI("AT channel timeout; closing\n");
     at_close();
 
+    s_channelClosedMsec = nowMsec();
     s_closed = 1;
 
     /* FIXME cause a radio reset here */
@@ -3285,73 +5436,175 @@ static void setHardwareConfiguration(int num, RIL_HardwareConfig *cfg)
 static void usage(char *s __unused)
 {
 #ifdef RIL_SHLIB
-    fprintf(stderr, "reference-ril requires: -p <tcp port> or -d /dev/tty_device\n");
+    fprintf(stderr, "reference-ril requires: -p <tcp port> or -d /dev/tty_device"
+                    " [-r <capture file>]\n");
 #else
-    fprintf(stderr, "usage: %s [-p <tcp port>] [-d /dev/tty_device]\n", s);
+    fprintf(stderr, "usage: %s [-p <tcp port>] [-d /dev/tty_device]"
+                    " [-r <capture file>]\n", s);
     exit(-1);
 #endif
 }
 
+/** returns a new AT channel fd or -1; does not retry */
+static int openATChannel()
+{
+    int fd = -1;
+
+    if (s_port > 0) {
+        fd = socket_loopback_client(s_port, SOCK_STREAM);
+    } else if (s_device_socket) {
+        if (!strcmp(s_device_path, "/dev/socket/qemud")) {
+            /* Before trying to connect to /dev/socket/qemud (which is
+             * now another "legacy" way of communicating with the
+             * emulator), we will try to connecto to gsm service via
+             * qemu pipe. */
+            fd = qemu_pipe_open("qemud:gsm");
+            if (fd < 0) {
+                /* Qemu-specific control socket */
+                fd = socket_local_client( "qemud",
+                                          ANDROID_SOCKET_NAMESPACE_RESERVED,
+                                          SOCK_STREAM );
+                if (fd >= 0 ) {
+                    char  answer[2];
+
+                    if ( write(fd, "gsm", 3) != 3 ||
+                         read(fd, answer, 2) != 2 ||
+                         memcmp(answer, "OK", 2) != 0)
+                    {
+                        close(fd);
+                        fd = -1;
+                    }
+               }
+            }
+        }
+        else
+            fd = socket_local_client( s_device_path,
+                                    ANDROID_SOCKET_NAMESPACE_FILESYSTEM,
+                                    SOCK_STREAM );
+    } else if (s_device_path != NULL) {
+        fd = open (s_device_path, O_RDWR);
+        if ( fd >= 0 && !memcmp( s_device_path, "/dev/ttyS", 9 ) ) {
+            /* disable echo on serial ports */
+            struct termios  ios;
+            tcgetattr( fd, &ios );
+            ios.c_lflag = 0;  /* disable ECHO, ICANON, etc... */
+            tcsetattr( fd, TCSANOW, &ios );
+        }
+    }
+
+    return fd;
+}
+
+/**
+ * Sleeps for up to timeoutMsec while path is missing, returning early if
+ * something is created in or changed in the directory containing path.
+ * Returns -1 if path is already there, since then open() itself failed
+ * and only time will tell, or if the directory can't be watched; either
+ * way the caller has to sleep
+ */
+static int waitForDeviceNode(const char *path, int timeoutMsec)
+{
+    char dir[PATH_MAX];
+    const char *slash;
+    struct pollfd pfd;
+    int ret;
+
+    if (access(path, R_OK | W_OK) == 0) {
+        return -1;
+    }
+
+    slash = strrchr(path, '/');
+
+    if (slash == NULL || slash == path
+            || (size_t) (slash - path) >= sizeof(dir)) {
+        return -1;
+    }
+
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = '\0';
+
+    pfd.fd = inotify_init();
+    pfd.events = POLLIN;
+
+    if (pfd.fd < 0) {
+        return -1;
+    }
+
+    if (inotify_add_watch(pfd.fd, dir,
+            IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0) {
+        close(pfd.fd);
+        return -1;
+    }
+
+    /* it may have just appeared, before the watch was added */
+    if (access(path, R_OK | W_OK) == 0) {
+        close(pfd.fd);
+        return 0;
+    }
+
+    do {
+        ret = poll(&pfd, 1, timeoutMsec);
+    } while (ret < 0 && errno == EINTR);
+
+    close(pfd.fd);
+
+    return 0;
+}
+
+/**
+ * Waits before the next attempt to open the AT channel: randomly between
+ * half and all of *p_backoffMsec, which is then doubled up to
+ * RECONNECT_MAX_MS. A missing device node cuts the wait short when it
+ * appears
+ */
+static void waitBeforeReconnect(int *p_backoffMsec)
+{
+    int delayMsec = *p_backoffMsec / 2 + rand() % (*p_backoffMsec / 2 + 1);
+
+    if (s_port > 0 || s_device_socket || s_device_path == NULL
+            || waitForDeviceNode(s_device_path, delayMsec) < 0) {
+        poll(NULL, 0, delayMsec);
+    }
+
+    *p_backoffMsec *= 2;
+
+    if (*p_backoffMsec > RECONNECT_MAX_MS) {
+        *p_backoffMsec = RECONNECT_MAX_MS;
+    }
+}
+
 static void *
 mainLoop(void *param __unused)
 {
     int fd;
     int ret;
+    int backoffMsec;
 
     AT_DUMP("== ", "entering mainLoop()", -1 );
     at_set_on_reader_closed(onATReaderClosed);
     at_set_on_timeout(onATTimeout);
+    at_set_adaptive_timeouts(1);
+
+    srand(getpid() ^ (unsigned) nowMsec());
 
     for (;;) {
-        fd = -1;
-        while  (fd < 0) {
-            if (s_port > 0) {
-                fd = socket_loopback_client(s_port, SOCK_STREAM);
-            } else if (s_device_socket) {
-                if (!strcmp(s_device_path, "/dev/socket/qemud")) {
-                    /* Before trying to connect to /dev/socket/qemud (which is
-                     * now another "legacy" way of communicating with the
-                     * emulator), we will try to connecto to gsm service via
-                     * qemu pipe. */
-                    fd = qemu_pipe_open("qemud:gsm");
-                    if (fd < 0) {
-                        /* Qemu-specific control socket */
-                        fd = socket_local_client( "qemud",
-                                                  ANDROID_SOCKET_NAMESPACE_RESERVED,
-                                                  SOCK_STREAM );
-                        if (fd >= 0 ) {
-                            char  answer[2];
-
-                            if ( write(fd, "gsm", 3) != 3 ||
-                                 read(fd, answer, 2) != 2 ||
-                                 memcmp(answer, "OK", 2) != 0)
-                            {
-                                close(fd);
-                                fd = -1;
-                            }
-                       }
-                    }
-                }
-                else
-                    fd = socket_local_client( s_device_path,
-                                            ANDROID_SOCKET_NAMESPACE_FILESYSTEM,
-                                            SOCK_STREAM );
-            } else if (s_device_path != NULL) {
-                fd = open (s_device_path, O_RDWR);
-                if ( fd >= 0 && !memcmp( s_device_path, "/dev/ttyS", 9 ) ) {
-                    /* disable echo on serial ports */
-                    struct termios  ios;
-                    tcgetattr( fd, &ios );
-                    ios.c_lflag = 0;  /* disable ECHO, ICANON, etc... */
-                    tcsetattr( fd, TCSANOW, &ios );
-                }
-            }
+        backoffMsec = RECONNECT_MIN_MS;
+        s_reconnectAttempts = 0;
 
-            if (fd < 0) {
+        while ((fd = openATChannel()) < 0) {
+            /* log the first failure and then only once the backoff is
+               at its ceiling, which is about as often as before */
+            if (s_reconnectAttempts == 0 || backoffMsec == RECONNECT_MAX_MS) {
                 perror ("opening AT interface. retrying...");
-                sleep(10);
-                /* never returns */
             }
+
+            s_reconnectAttempts++;
+            waitBeforeReconnect(&backoffMsec);
+        }
+
+        if (s_channelClosedMsec != 0) {
+            RLOGI("AT channel reopened %lld ms after close, %d retries",
+                    nowMsec() - s_channelClosedMsec, s_reconnectAttempts);
         }
 
         s_closed = 0;
@@ -3362,11 +5615,12 @@ mainLoop(void *param __unused)
             return 0;
         }
 
-        RIL_requestTimedCallback(initializeCallback, NULL, &TIMEVAL_0);
+        pthread_mutex_lock(&s_state_mutex);
+        s_initPending = 1;
+        pthread_mutex_unlock(&s_state_mutex);
 
-        // Give initializeCallback a chance to dispatched, since
-        // we don't presently have a cancellation mechanism
-        sleep(1);
+        requestWorkerCallback(REQUEST_CLASS_BARRIER, initializeCallback, NULL,
+                &TIMEVAL_0);
 
         waitForClose();
         RLOGI("Re-opening after close");
@@ -3386,7 +5640,7 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
 
     s_rilenv = env;
 
-    while ( -1 != (opt = getopt(argc, argv, "p:d:s:c:"))) {
+    while ( -1 != (opt = getopt(argc, argv, "p:d:s:c:r:"))) {
         switch (opt) {
             case 'p':
                 s_port = atoi(optarg);
@@ -3412,6 +5666,11 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
                 RLOGI("Client id received %s\n", optarg);
             break;
 
+            case 'r':
+                RLOGI("Recording AT traffic to %s\n", optarg);
+                at_capture_open(optarg);
+            break;
+
             default:
                 usage(argv[0]);
                 return NULL;
@@ -3428,6 +5687,8 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
         RLOGE("Unable to alloc memory for ModemInfo");
         return NULL;
     }
+    startRequestExecutor();
+
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
     ret = pthread_create(&s_tid_mainloop, &attr, mainLoop, NULL);
@@ -3441,7 +5702,7 @@ int main (int argc, char **argv)
     int fd = -1;
     int opt;
 
-    while ( -1 != (opt = getopt(argc, argv, "p:d:"))) {
+    while ( -1 != (opt = getopt(argc, argv, "p:d:s:r:"))) {
         switch (opt) {
             case 'p':
                 s_port = atoi(optarg);
@@ -3462,6 +5723,11 @@ int main (int argc, char **argv)
                 RLOGI("Opening socket %s\n", s_device_path);
             break;
 
+            case 'r':
+                RLOGI("Recording AT traffic to %s\n", optarg);
+                at_capture_open(optarg);
+            break;
+
             default:
                 usage(argv[0]);
         }
@@ -3471,6 +5737,8 @@ int main (int argc, char **argv)
         usage(argv[0]);
     }
 
+    startRequestExecutor();
+
     RIL_register(&s_callbacks);
 
     mainLoop(NULL);
@@ -52,4 +52,19 @@ LOCAL_MODULE_TAGS := debug
 
 include $(BUILD_EXECUTABLE)
 
+# For rilbench binary
+# ===================
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	rilbench.c
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils
+
+LOCAL_MODULE:= rilbench
+LOCAL_MODULE_TAGS := debug
+
+include $(BUILD_EXECUTABLE)
+
 endif
@@ -35,6 +35,10 @@ enum options {
     DIAL_CALL,
     ANSWER_CALL,
     END_CALL,
+    PARCEL_STATS,
+    SAP_TRACE,
+    SAP_CAPTURE,
+    SAP_STATS,
 };
 
 
@@ -50,7 +54,11 @@ static void print_usage() {
            7 - DEACTIVE_PDP, \n\
            8 number - DIAL_CALL number, \n\
            9 - ANSWER_CALL, \n\
-           10 - END_CALL \n\
+           10 - END_CALL, \n\
+           11 - PARCEL_STATS (logged by rild) \n\
+           12 level - SAP_TRACE level (0 off, 1 hex dump to log), \n\
+           13 path - SAP_CAPTURE to path on the device (off to stop), \n\
+           14 - SAP_STATS (logged by rild) \n\
           The argument before the last one must be SIM slot \n\
            0 - SIM1, \n\
            1 - SIM2, \n\
@@ -61,16 +69,21 @@ static void print_usage() {
            1 - one modem for multiple debug socket \n");
 }
 
+static int has_extra_arg(int option) {
+    return option == DIAL_CALL || option == SETUP_PDP
+            || option == SAP_TRACE || option == SAP_CAPTURE;
+}
+
 static int error_check(int argc, char * argv[]) {
     if (argc < 2) {
         return -1;
     }
     const int option = atoi(argv[1]);
-    if (option < 0 || option > 10) {
+    if (option < 0 || option > 14) {
         return 0;
-    } else if ((option == DIAL_CALL || option == SETUP_PDP) && argc == 5) {
+    } else if (has_extra_arg(option) && argc == 5) {
         return 0;
-    } else if ((option != DIAL_CALL && option != SETUP_PDP) && argc == 4) {
+    } else if (!has_extra_arg(option) && argc == 4) {
         return 0;
     }
     return -1;
@@ -78,7 +91,7 @@ static int error_check(int argc, char * argv[]) {
 
 static int get_number_args(char *argv[]) {
     const int option = atoi(argv[1]);
-    if (option != DIAL_CALL && option != SETUP_PDP) {
+    if (!has_extra_arg(option)) {
         return 3;
     } else {
         return 4;
@@ -0,0 +1,346 @@
+/* //device/system/rild/rilbench.c
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * rilbench stands in for RIL.java on the rild command socket and measures
+ * request throughput and latency end to end (libril, the vendor RIL and,
+ * with reference-ril pointed at atsim, the AT channel).
+ *
+ * Only one client may own the command socket, so the phone process must
+ * not be connected while this runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <cutils/sockets.h>
+
+#define SOCKET_NAME_RIL "rild"     /* from ril.cpp */
+
+/* from ril.cpp */
+#define RESPONSE_SOLICITED 0
+#define RESPONSE_UNSOLICITED 1
+#define RESPONSE_SOLICITED_ACK 2
+#define RESPONSE_SOLICITED_ACK_EXP 3
+#define RESPONSE_UNSOLICITED_ACK_EXP 4
+
+/* from telephony/ril.h */
+#define RIL_REQUEST_SEND_SMS 25
+#define RIL_REQUEST_SEND_SMS_EXPECT_MORE 26
+#define RIL_RESPONSE_ACKNOWLEDGEMENT 800
+
+#define MAX_REQUESTS 16
+#define MAX_PARCEL (64 * 1024)
+#define NS_PER_S 1000000000LL
+
+/* a request mix of parameterless queries, like RIL.java's polling */
+static int s_requests[MAX_REQUESTS] = {
+    9,      /* RIL_REQUEST_GET_CURRENT_CALLS */
+    19,     /* RIL_REQUEST_SIGNAL_STRENGTH */
+    20,     /* RIL_REQUEST_VOICE_REGISTRATION_STATE */
+    21,     /* RIL_REQUEST_DATA_REGISTRATION_STATE */
+    22,     /* RIL_REQUEST_OPERATOR */
+};
+static int s_requestCount = 5;
+
+/* with -m, SMS PDUs are sent instead, as a concatenated message would be */
+static const char *s_smsPdu = NULL;
+
+static long long now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+static void usage(const char *s)
+{
+    fprintf(stderr, "usage: %s [-s <socket>] [-n <count>] [-w <window>]"
+            " [-r <request>[,<request>...] | -m <pdu>]\n"
+            "  -s  socket name, or a path starting with '/'; default "
+            SOCKET_NAME_RIL "\n"
+            "  -n  number of requests to send; default 1000\n"
+            "  -w  requests kept outstanding; default 1\n"
+            "  -r  request numbers to cycle through\n"
+            "  -m  send this hex SMS PDU, all but the last time with\n"
+            "      RIL_REQUEST_SEND_SMS_EXPECT_MORE\n", s);
+    exit(-1);
+}
+
+static int writeAll(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *) buf;
+
+    while (len > 0) {
+        ssize_t written = write(fd, p, len);
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        p += written;
+        len -= written;
+    }
+
+    return 0;
+}
+
+static int readAll(int fd, void *buf, size_t len)
+{
+    char *p = (char *) buf;
+
+    while (len > 0) {
+        ssize_t count = read(fd, p, len);
+
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return -1;
+
+        p += count;
+        len -= count;
+    }
+
+    return 0;
+}
+
+/** sends a parameterless request parcel, framed as RIL.java does */
+static int sendRequest(int fd, int request, int serial)
+{
+    uint32_t buf[3];
+
+    buf[0] = htonl(2 * sizeof(int32_t));
+    buf[1] = request;
+    buf[2] = serial;
+
+    return writeAll(fd, buf, sizeof(buf));
+}
+
+/** appends a Parcel String16 of an ASCII string, or null, at *p_cur */
+static void appendString16(char **p_cur, const char *s)
+{
+    int32_t len = s != NULL ? (int32_t) strlen(s) : -1;
+    uint16_t *chars;
+    int32_t i;
+
+    memcpy(*p_cur, &len, sizeof(len));
+    *p_cur += sizeof(len);
+
+    if (s == NULL) {
+        return;
+    }
+
+    chars = (uint16_t *) *p_cur;
+
+    for (i = 0 ; i < len ; i++) {
+        chars[i] = (unsigned char) s[i];
+    }
+
+    chars[len] = 0;
+
+    /* the characters and terminator are padded to 4 bytes */
+    *p_cur += ((len + 1) * sizeof(uint16_t) + 3) & ~3;
+}
+
+/** sends a SEND_SMS(_EXPECT_MORE) request parcel for s_smsPdu */
+static int sendSmsRequest(int fd, int request, int serial)
+{
+    static char buf[MAX_PARCEL];
+    char *cur = buf + sizeof(uint32_t);
+    int32_t header[3] = { request, serial, 2 };
+
+    memcpy(cur, header, sizeof(header));
+    cur += sizeof(header);
+
+    appendString16(&cur, NULL);     /* default SMSC */
+    appendString16(&cur, s_smsPdu);
+
+    *(uint32_t *) buf = htonl(cur - buf - sizeof(uint32_t));
+
+    return writeAll(fd, buf, cur - buf);
+}
+
+static int compareLongLong(const void *a, const void *b)
+{
+    long long l = *(const long long *) a;
+    long long r = *(const long long *) b;
+
+    return l < r ? -1 : l > r;
+}
+
+int main(int argc, char **argv)
+{
+    const char *socketName = SOCKET_NAME_RIL;
+    int count = 1000;
+    int window = 1;
+    int opt;
+    int fd;
+    int sent = 0, completed = 0, errors = 0, unsols = 0;
+    long long *sendNsec;
+    long long *latencyNsec;
+    long long startNsec, elapsedNsec;
+    static char parcel[MAX_PARCEL];
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:w:r:m:"))) {
+        switch (opt) {
+            case 's': socketName = optarg; break;
+            case 'n': count = atoi(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            case 'r': {
+                char *cur = optarg;
+
+                for (s_requestCount = 0 ; s_requestCount < MAX_REQUESTS
+                        && *cur != '\0' ; s_requestCount++) {
+                    s_requests[s_requestCount] = strtol(cur, &cur, 10);
+                    if (*cur == ',') cur++;
+                }
+                break;
+            }
+            case 'm': s_smsPdu = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (count <= 0 || window <= 0 || s_requestCount == 0
+            || (s_smsPdu != NULL && strlen(s_smsPdu) > MAX_PARCEL / 4)) {
+        usage(argv[0]);
+    }
+
+    if (socketName[0] == '/') {
+        fd = socket_local_client(socketName,
+                ANDROID_SOCKET_NAMESPACE_FILESYSTEM, SOCK_STREAM);
+    } else {
+        fd = socket_local_client(socketName,
+                ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
+    }
+
+    if (fd < 0) {
+        perror("opening ril socket");
+        exit(-1);
+    }
+
+    sendNsec = calloc(count, sizeof(long long));
+    latencyNsec = calloc(count, sizeof(long long));
+
+    if (sendNsec == NULL || latencyNsec == NULL) {
+        exit(-1);
+    }
+
+    startNsec = now();
+
+    while (completed < count) {
+        uint32_t header;
+        size_t len;
+        int32_t *words = (int32_t *) parcel;
+
+        while (sent < count && sent - completed < window) {
+            int ret;
+
+            sendNsec[sent] = now();
+
+            if (s_smsPdu != NULL) {
+                ret = sendSmsRequest(fd, sent < count - 1
+                        ? RIL_REQUEST_SEND_SMS_EXPECT_MORE : RIL_REQUEST_SEND_SMS,
+                        sent);
+            } else {
+                ret = sendRequest(fd, s_requests[sent % s_requestCount], sent);
+            }
+
+            if (ret < 0) {
+                perror("writing request");
+                exit(-1);
+            }
+
+            sent++;
+        }
+
+        if (readAll(fd, &header, sizeof(header)) < 0) {
+            fprintf(stderr, "ril socket closed\n");
+            break;
+        }
+
+        len = ntohl(header);
+
+        if (len < sizeof(int32_t) || len > sizeof(parcel)
+                || readAll(fd, parcel, len) < 0) {
+            fprintf(stderr, "bad response of length %zu\n", len);
+            break;
+        }
+
+        switch (words[0]) {
+            case RESPONSE_SOLICITED_ACK_EXP:
+            case RESPONSE_UNSOLICITED_ACK_EXP:
+                /* keeps rild from holding its ack wakelock, as RIL.java does */
+                sendRequest(fd, RIL_RESPONSE_ACKNOWLEDGEMENT, 0);
+
+                if (words[0] == RESPONSE_UNSOLICITED_ACK_EXP) {
+                    unsols++;
+                    break;
+                }
+                /* fall through */
+            case RESPONSE_SOLICITED: {
+                int serial;
+
+                if (len < 3 * sizeof(int32_t)) break;
+
+                serial = words[1];
+
+                if (serial < 0 || serial >= sent || latencyNsec[serial] != 0) {
+                    fprintf(stderr, "unexpected serial %d\n", serial);
+                    break;
+                }
+
+                latencyNsec[serial] = now() - sendNsec[serial];
+                if (words[2] != 0) errors++;
+                completed++;
+                break;
+            }
+            case RESPONSE_UNSOLICITED:
+                unsols++;
+                break;
+            case RESPONSE_SOLICITED_ACK:
+            default:
+                break;
+        }
+    }
+
+    elapsedNsec = now() - startNsec;
+    close(fd);
+
+    qsort(latencyNsec, completed, sizeof(long long), compareLongLong);
+
+    printf("%d requests in %lld ms: %.1f req/s, %d errors, %d unsolicited\n",
+            completed, elapsedNsec / 1000000,
+            elapsedNsec > 0 ? completed * (double) NS_PER_S / elapsedNsec : 0.0,
+            errors, unsols);
+
+    if (completed > 0) {
+        printf("latency usec: p50 %lld p90 %lld p99 %lld max %lld\n",
+                latencyNsec[completed / 2] / 1000,
+                latencyNsec[completed * 9 / 10] / 1000,
+                latencyNsec[completed * 99 / 100] / 1000,
+                latencyNsec[completed - 1] / 1000);
+    }
+
+    return completed == count ? 0 : 1;
+}